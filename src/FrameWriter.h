@@ -0,0 +1,127 @@
+/*
+ * FrameWriter.h
+ */
+
+#ifndef FRAMEWRITER_H_
+#define FRAMEWRITER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+#include "DataOutputStream.h"
+#include "WebSocketHeader.h"
+#include "PerMessageDeflate.h"
+
+namespace websocket {
+
+/* Collects encoded websocket frames in memory. Nothing here touches the socket; the caller hands the
+ * bytes to the descriptor's output queue, which is flushed by process_output() when the socket is
+ * writable.
+ */
+class FrameWriter: public DataOutputStream {
+private:
+	// Room left in front of a frame whose length is not known yet. This fits the header of any frame
+	// up to 64K, which covers everything the game sends in one piece.
+	static const size_t FrameHeaderReserve = 4U;
+
+	// Text shorter than this costs more to compress than it saves.
+	static const size_t MinDeflateSize = 32U;
+
+	std::vector<uint8_t> _BufferedData;
+
+	// Set once permessage-deflate has been agreed.
+	MessageDeflater * _Deflater;
+	std::vector<uint8_t> _Compressed;
+public:
+	FrameWriter() :
+			_BufferedData(), _Deflater(NULL), _Compressed() {
+	}
+
+	~FrameWriter() {
+		delete _Deflater;
+	}
+
+	void setDeflater(MessageDeflater * const Deflater) {
+		delete _Deflater;
+		_Deflater = Deflater;
+	}
+
+	virtual void write(uint8_t dataIn) throw (int) {
+		_BufferedData.push_back(dataIn);
+	}
+
+	void write(const uint8_t * const DataIn, const size_t Size) {
+		_BufferedData.insert(_BufferedData.end(), DataIn, DataIn + Size);
+	}
+
+	const uint8_t * data() const {
+		return _BufferedData.empty() ? NULL : &_BufferedData[0];
+	}
+
+	size_t size() const {
+		return _BufferedData.size();
+	}
+
+	void clear() {
+		_BufferedData.clear();
+	}
+
+	/* Starts an unmasked frame. The payload is written with write() and the frame is closed with
+	 * endFrame(), which fills in the header once the length is known. A frame left empty is dropped.
+	 * With permessage-deflate, text frames long enough to gain from it are compressed and marked with
+	 * RSV1.
+	 */
+	size_t beginFrame() {
+		const size_t Mark = _BufferedData.size();
+		_BufferedData.resize(Mark + FrameHeaderReserve);
+		return Mark;
+	}
+
+	void endFrame(const size_t Mark, const Type FrameType) {
+		const size_t PayloadStart = Mark + FrameHeaderReserve;
+		uint64_t Size = _BufferedData.size() - PayloadStart;
+		if (Size == 0) {
+			_BufferedData.resize(Mark);
+			return;
+		}
+
+		uint8_t Header[10];
+		size_t HeaderSize;
+		Header[0] = 0x80U | uint8_t(FrameType);
+		if (_Deflater != NULL && FrameType == WS_TEXTFRAME && MinDeflateSize <= Size) {
+			_Deflater->compress(&_BufferedData[PayloadStart], size_t(Size), _Compressed);
+			_BufferedData.resize(PayloadStart);
+			_BufferedData.insert(_BufferedData.end(), _Compressed.begin(), _Compressed.end());
+			Size = _Compressed.size();
+			Header[0] |= 0x40U;
+		}
+		if (Size <= 125U) {
+			Header[1] = uint8_t(Size);
+			HeaderSize = 2U;
+		} else if (Size <= 0xFFFFU) {
+			Header[1] = 126U;
+			Header[2] = uint8_t(Size >> 8);
+			Header[3] = uint8_t(Size);
+			HeaderSize = 4U;
+		} else {
+			Header[1] = 127U;
+			for (unsigned int i = 0; i < 8U; i++) {
+				Header[2U + i] = uint8_t(Size >> (56U - 8U * i));
+			}
+			HeaderSize = 10U;
+		}
+
+		if (HeaderSize < FrameHeaderReserve) {
+			_BufferedData.erase(_BufferedData.begin() + Mark + HeaderSize,
+					_BufferedData.begin() + PayloadStart);
+		} else if (FrameHeaderReserve < HeaderSize) {
+			_BufferedData.insert(_BufferedData.begin() + PayloadStart,
+					HeaderSize - FrameHeaderReserve, uint8_t(0));
+		}
+		memcpy(&_BufferedData[Mark], Header, HeaderSize);
+	}
+};
+
+}
+#endif /* FRAMEWRITER_H_ */
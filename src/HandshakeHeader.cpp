@@ -17,27 +17,29 @@ HandshakeHeader::HandshakeHeader(const std::string& FirstLine) :
 }
 HandshakeHeader::HandshakeHeader(SocketReader& dataSource) throw (int) :
 		_FirstLine(dataSource.readLine()), _HeaderValuePairs() {
-	// TODO: COmplete!
-
 	bool complete = false;
 	while (!complete) {
 		const std::string currentLine = dataSource.readLine();
 		if (currentLine == "") {
 			complete = true;
 		} else {
-			size_t dividerPos = currentLine.find(':');
-			if (dividerPos == std::string::npos) {
-				throw 100;
-			}
-			else {
-				const std::string headerType(currentLine, 0, dividerPos);
-				const std::string headerValue(currentLine, dividerPos+1);
-				_HeaderValuePairs[headerType] = trim(headerValue);
-			}
+			addHeaderLine(currentLine);
 		}
 	}
 }
 
+void HandshakeHeader::addHeaderLine(const std::string& Line) throw (int) {
+	size_t dividerPos = Line.find(':');
+	if (dividerPos == std::string::npos) {
+		throw 100;
+	}
+	else {
+		const std::string headerType(Line, 0, dividerPos);
+		const std::string headerValue(Line, dividerPos+1);
+		_HeaderValuePairs[headerType] = trim(headerValue);
+	}
+}
+
 const std::string * HandshakeHeader::getValue(const std::string& Key) const {
 	std::map<std::string, std::string>::const_iterator foundValue = _HeaderValuePairs.find(Key);
 	if (foundValue != _HeaderValuePairs.end()) {
@@ -70,5 +72,44 @@ std::string HandshakeHeader::toString() const {
 	return stringOutStream.str();
 }
 
+HandshakeParser::HandshakeParser() :
+		_State(HS_READING), _HaveFirstLine(false), _TotalRead(0U), _CurrentLine(), _Header("") {
+}
+
+size_t HandshakeParser::feed(const char * const Data, const size_t Size) {
+	size_t i = 0;
+	while (i < Size && _State == HS_READING) {
+		const char CurrentChar = Data[i++];
+		_TotalRead++;
+
+		if (CurrentChar == '\n') {
+			completeLine();
+		} else if (CurrentChar != '\r') {
+			_CurrentLine.push_back(CurrentChar);
+		}
+
+		if (_State == HS_READING && _TotalRead >= MaxHeaderSize) {
+			_State = HS_FAILED;
+		}
+	}
+	return i;
+}
+
+void HandshakeParser::completeLine() {
+	if (!_HaveFirstLine) {
+		_Header = HandshakeHeader(_CurrentLine);
+		_HaveFirstLine = true;
+	} else if (_CurrentLine == "") {
+		_State = HS_COMPLETE;
+	} else {
+		try {
+			_Header.addHeaderLine(_CurrentLine);
+		} catch (int e) {
+			_State = HS_FAILED;
+		}
+	}
+	_CurrentLine.clear();
+}
+
 }
 } /* namespace websocket */
@@ -31,12 +31,45 @@ public:
 	HandshakeHeader(const std::string& FirstLine);
 	HandshakeHeader(SocketReader& dataSource) throw (int);
 
+	void addHeaderLine(const std::string& Line) throw (int);
 	const std::string * getValue(const std::string& Key) const;
 	HandshakeHeader& setValue(const std::string& Key, const std::string& Value);
 
 	std::string toString() const;
 };
 
+/* Builds a HandshakeHeader incrementally from whatever bytes the socket happens to have available,
+ * so that a slow or stalled client never blocks the caller. Feed it bytes as they arrive until the
+ * state leaves HS_READING.
+ */
+class HandshakeParser {
+public:
+	enum State {
+		HS_READING, HS_COMPLETE, HS_FAILED
+	};
+private:
+	static const size_t MaxHeaderSize = 8192U;
+
+	State _State;
+	bool _HaveFirstLine;
+	size_t _TotalRead;
+	std::string _CurrentLine;
+	HandshakeHeader _Header;
+
+	void completeLine();
+public:
+	HandshakeParser();
+
+	// Returns the number of bytes consumed; anything after the blank line belongs to the next protocol.
+	size_t feed(const char * const Data, const size_t Size);
+	State getState() const {
+		return _State;
+	}
+	const HandshakeHeader& getHeader() const {
+		return _Header;
+	}
+};
+
 }
 } /* namespace websocket */
 #endif /* HANDSHAKEHEADER_H_ */
@@ -6,16 +6,9 @@
  */
 
 #include "OutputParser.h"
-#include <list>
-#include <stdlib.h>
 #include <stdint.h>
-#include <vector>
-#include <list>
-#include <string>
-#include <sstream>
-#include "SocketWriter.h"
+#include "FrameWriter.h"
 #include "Websockets.h"
-#include <string.h>
 
 namespace websocket {
 
@@ -23,140 +16,14 @@ namespace websocket {
  */
 static const uint8_t IAC = 255U;
 static const uint8_t ESC = 27U;
+static const uint8_t ESC_START = uint8_t('[');
 static const uint8_t ESC_END = uint8_t('m');
 static const uint8_t SUB_NEG_B = 250U;
 
-static void append(std::list<char>& bufferOfInterest,
-		std::list<char>::iterator& position,
-		const std::string& StringOfInterest) {
-	bufferOfInterest.insert(position, StringOfInterest.begin(),
-			StringOfInterest.end());
-	position = bufferOfInterest.erase(position);
-}
-
-//TODO: Make sure this works right for UTF8 encoding!
-static void parseForHTML(std::list<char>& DataInOut) {
-	//std::stringbuf buffer;
-	std::list<char> buffer;
-
-	std::list<char>::iterator dataToParseItr = DataInOut.begin();
-
-	while (dataToParseItr != DataInOut.end()) {
-		switch (*dataToParseItr) {
-		case '&':
-			append(buffer, dataToParseItr, "&amp;");
-			break;
-		case '\"':
-			append(buffer, dataToParseItr, "&quot;");
-			break;
-		case '\'':
-			append(buffer, dataToParseItr, "&apos;");
-			break;
-		case '<':
-			append(buffer, dataToParseItr, "&lt;");
-			break;
-		case '>':
-			append(buffer, dataToParseItr, "&gt;");
-			break;
-		default:
-			dataToParseItr++;
-			break;
-		}
-	}
-}
-
-static void parseToUTF8(std::list<char>& DataInOut) {
-	//std::stringbuf buffer;
-	std::list<char> buffer;
-
-	std::list<char>::iterator dataToParseItr = DataInOut.begin();
-
-	while (dataToParseItr != DataInOut.end()) {
-		char& currentByte = *dataToParseItr;
-		if ((uint8_t(currentByte) & 0x80U) != 0) {
-			const char originalValue = currentByte;
-			const char highBits = (originalValue & 0xC0) >> 6;
-			const char lowBits = (originalValue & 0x3F);
-			currentByte = 0xC0 + highBits;
-			const char newByte = char(0x80) + lowBits;
-			dataToParseItr++;
-			DataInOut.insert(dataToParseItr, newByte);
-		}
-		dataToParseItr++;
-	}
-}
-
-class Token {
-public:
-	enum TokenTypes {
-		STRING, MODE_CHANGES
-	};
-private:
-	std::vector<uint8_t> * Bytes;
-	const TokenTypes _Type;
-
-	std::vector<uint8_t> * processModeChange(const std::list<char>& DataIn) {
-		const std::vector<uint8_t> VectorCopy(DataIn.begin(), DataIn.end());
-		const std::list<char>::size_type Size = DataIn.size();
-		if (Size >= 3) {
-			if (VectorCopy[0] == '[' && VectorCopy[Size - 1] == 'm') {
-				uint8_t code = VectorCopy[1] - '0';
-				if (Size >= 4) {
-					code = (code * 10) + VectorCopy[2] - '0';
-				}
-				std::vector<uint8_t>* newVector = new std::vector<uint8_t>(1);
-				(*newVector)[0] = code;
-				return newVector;
-			}
-		}
-		return NULL;
-	}
-	std::vector<uint8_t> * processString(std::list<char>& DataIn) {
-
-		parseForHTML(DataIn);
-		if (DataIn.size() == 688) {
-			std::cout << "test" << std::endl;
-		}
-		parseToUTF8(DataIn);
-		//parsedText
-		std::vector<uint8_t>* const VectorPtr = new std::vector<uint8_t>(DataIn.begin(), DataIn.end());
-		return VectorPtr;
-	}
-public:
-
-	Token(const TokenTypes Type, std::list<char>& DataIn) :
-			Bytes(NULL), _Type(Type) {
-		if (_Type == MODE_CHANGES) {
-			Bytes = processModeChange(DataIn);
-		} else if (_Type == STRING) {
-			Bytes = processString(DataIn);
-		}
-	}
-	Token(const Token& RHS) :
-			Bytes(new std::vector<uint8_t>(*RHS.Bytes)), _Type(RHS._Type) {
-	}
-	~Token() {
-		if (Bytes != NULL) {
-			delete Bytes;
-		}
-	}
-
-	void sendToWebsocket(SocketWriter& Endpoint) {
-		if (Bytes->size() > 125) {
-			std::cout << "test" << std::endl;
-		}
-		if (Bytes != NULL) {
-			if (_Type == MODE_CHANGES) {
-				sendWSData(Endpoint, Bytes->data(), Bytes->size());
-			} else if (_Type == STRING) {
-				sendWSText(Endpoint, (char*) (Bytes->data()), Bytes->size());
-			}
-		}
-	}
-};
+static const size_t MaxModeChanges = 16U;
 
 enum MuxStates {
-	NORMAL_DATA, IAC_START, IAC_CONT1, IAC_NEGOTIATE, ESC_SEQ,
+	NORMAL_DATA, IAC_START, IAC_CONT1, IAC_NEGOTIATE, ESC_SEQ, ESC_PARAMS,
 };
 enum MuxSingleActions {
 	WILL = 251, WONT = 252, DO = 253, DONT = 254
@@ -175,25 +42,90 @@ bool codeIsAnAction(const uint8_t Byte) {
 	return result;
 }
 
-struct OutputParse_Impl {
-	OutputParse_Impl(SocketWriter& writer) :
-			_CurrentState(NORMAL_DATA), _CurrentData(), _Writer(writer) {
+/* Bytes which a text run can copy as they are. Everything else is escaped, widened or ends the run.
+ */
+static inline bool isPlainText(const uint8_t Byte) {
+	if (Byte >= 0x80U) {
+		return false;
+	}
+	switch (Byte) {
+	case ESC:
+	case '&':
+	case '\"':
+	case '\'':
+	case '<':
+	case '>':
+		return false;
+	}
+	return true;
+}
 
+struct OutputParse_Impl {
+	OutputParse_Impl(FrameWriter& writer) :
+			_CurrentState(NORMAL_DATA), _Writer(writer), _InText(false), _TextMark(0), _ModeCount(0), _Mode(
+					0), _HaveMode(false) {
 	}
 	MuxStates _CurrentState;
-	std::list<char> _CurrentData;
-	SocketWriter& _Writer;
+	FrameWriter& _Writer;
+
+	// The open text frame, if any.
+	bool _InText;
+	size_t _TextMark;
+
+	// Parameters of the escape sequence being read.
+	uint8_t _Modes[MaxModeChanges];
+	size_t _ModeCount;
+	unsigned int _Mode;
+	bool _HaveMode;
+
+	void beginText() {
+		if (!_InText) {
+			_TextMark = _Writer.beginFrame();
+			_InText = true;
+		}
+	}
 
-	Token makeToken(Token::TokenTypes type);
+	void writeChar(const uint8_t Byte);
+	void pushMode();
 };
 
-Token OutputParse_Impl::makeToken(Token::TokenTypes type) {
-	const Token resultToken(type, _CurrentData);
-	_CurrentData.clear();
-	return resultToken;
+void OutputParse_Impl::writeChar(const uint8_t Byte) {
+	switch (Byte) {
+	case '&':
+		_Writer.write((const uint8_t *) "&amp;", 5);
+		break;
+	case '\"':
+		_Writer.write((const uint8_t *) "&quot;", 6);
+		break;
+	case '\'':
+		_Writer.write((const uint8_t *) "&apos;", 6);
+		break;
+	case '<':
+		_Writer.write((const uint8_t *) "&lt;", 4);
+		break;
+	case '>':
+		_Writer.write((const uint8_t *) "&gt;", 4);
+		break;
+	default:
+		if ((Byte & 0x80U) != 0) {
+			const uint8_t Widened[2] = { uint8_t(0xC0U | (Byte >> 6)), uint8_t(0x80U | (Byte & 0x3FU)) };
+			_Writer.write(Widened, 2);
+		} else {
+			_Writer.write(Byte);
+		}
+		break;
+	}
+}
+
+void OutputParse_Impl::pushMode() {
+	if (_ModeCount < MaxModeChanges) {
+		_Modes[_ModeCount++] = uint8_t(_Mode);
+	}
+	_Mode = 0;
+	_HaveMode = false;
 }
 
-OutputParser::OutputParser(SocketWriter& writer) :
+OutputParser::OutputParser(FrameWriter& writer) :
 		pImpl(new OutputParse_Impl(writer)) {
 }
 
@@ -201,10 +133,18 @@ OutputParser::~OutputParser() {
 	delete pImpl;
 }
 
+void OutputParser::endText() {
+	if (pImpl->_InText) {
+		pImpl->_Writer.endFrame(pImpl->_TextMark, WS_TEXTFRAME);
+		pImpl->_InText = false;
+	}
+}
+
 void OutputParser::processInIACStart(uint8_t byte) {
 	switch (byte) {
 	case IAC:
-		pImpl->_CurrentData.push_back(IAC);
+		pImpl->beginText();
+		pImpl->writeChar(IAC);
 		pImpl->_CurrentState = NORMAL_DATA;
 		break;
 	case SUB_NEG_B:
@@ -226,78 +166,99 @@ void OutputParser::processInNegotiate(uint8_t byte) {
 	}
 }
 
-void OutputParser::processInEscapeSequence(//std::list<Token>& tokens,
-		uint8_t byte) {
-	pImpl->_CurrentData.push_back(byte);
-	if (byte == ESC_END) {
-		pImpl->makeToken(Token::MODE_CHANGES).sendToWebsocket(pImpl->_Writer);
+/* Reads ESC [ n ; n ... m and sends each SGR parameter as its own binary frame. Other control
+ * sequences are dropped.
+ */
+void OutputParser::processInEscapeSequence(uint8_t byte) {
+	if (pImpl->_CurrentState == ESC_SEQ) {
+		if (byte == ESC_START) {
+			pImpl->_ModeCount = 0;
+			pImpl->_Mode = 0;
+			pImpl->_HaveMode = false;
+			pImpl->_CurrentState = ESC_PARAMS;
+		} else {
+			pImpl->_CurrentState = NORMAL_DATA;
+		}
+	} else if ('0' <= byte && byte <= '9') {
+		pImpl->_Mode = pImpl->_Mode * 10 + (byte - '0');
+		if (pImpl->_Mode > 255U) {
+			pImpl->_Mode = 255U;
+		}
+		pImpl->_HaveMode = true;
+	} else if (byte == ';') {
+		pImpl->pushMode();
+	} else if (0x40U <= byte && byte <= 0x7EU) {
+		if (byte == ESC_END) {
+			if (pImpl->_HaveMode || pImpl->_ModeCount == 0) {
+				pImpl->pushMode();
+			}
+			for (size_t i = 0; i < pImpl->_ModeCount; i++) {
+				sendWSData(pImpl->_Writer, &pImpl->_Modes[i], 1);
+			}
+		}
 		pImpl->_CurrentState = NORMAL_DATA;
 	}
 }
 
-bool OutputParser::isDataEmpty() {
-	return pImpl->_CurrentData.size() <= 0;
-}
-
-//TODO: Make sure this works with UTF8!
-void OutputParser::processInNormal( //std::list<Token>& tokens,
-		const uint8_t Byte) {
-	switch (Byte) {
-	case IAC:
-		if (!isDataEmpty()) {
-			//tokens.push_back(pImpl->makeToken(Token::STRING));
-			pImpl->makeToken(Token::STRING).sendToWebsocket(pImpl->_Writer);
+/* Copies text up to the next IAC or ESC into the open text frame. Runs of plain bytes are copied in
+ * one piece. Returns where it stopped.
+ */
+const uint8_t * OutputParser::processInNormal(const uint8_t * Ptr, const uint8_t * const End) {
+	pImpl->beginText();
+	while (Ptr < End) {
+		const uint8_t * Run = Ptr;
+		while (Ptr < End && isPlainText(*Ptr)) {
+			Ptr++;
 		}
-		pImpl->_CurrentState = IAC_START;
-		break;
-	case ESC:
-		if (!isDataEmpty()) {
-			//tokens.push_back(pImpl->makeToken(Token::STRING));
-			pImpl->makeToken(Token::STRING).sendToWebsocket(pImpl->_Writer);
+		if (Run < Ptr) {
+			pImpl->_Writer.write(Run, Ptr - Run);
 		}
-		pImpl->_CurrentState = ESC_SEQ;
-		break;
-	default:
-		pImpl->_CurrentData.push_back(Byte);
+		if (Ptr == End) {
+			break;
+		}
+
+		const uint8_t Byte = *Ptr++;
+		if (Byte == IAC) {
+			endText();
+			pImpl->_CurrentState = IAC_START;
+			break;
+		} else if (Byte == ESC) {
+			endText();
+			pImpl->_CurrentState = ESC_SEQ;
+			break;
+		}
+		pImpl->writeChar(Byte);
 	}
+	return Ptr;
 }
 
 void OutputParser::parseAndSend(const char * TextPtr, const size_t Size) {
-	//std::list<Token> currentTokens;
+	const uint8_t * Ptr = (const uint8_t *) TextPtr;
+	const uint8_t * const End = Ptr + Size;
 
-	for (int i = 0; i < Size; i++) {
-		uint8_t currentByte = TextPtr[i];
+	while (Ptr < End) {
 		switch (pImpl->_CurrentState) {
 		case NORMAL_DATA:
-			processInNormal(currentByte);
-			break;
+			Ptr = processInNormal(Ptr, End);
+			continue;
 		case IAC_START:
-			processInIACStart(currentByte);
+			processInIACStart(*Ptr);
 			break;
 		case IAC_CONT1:
 			pImpl->_CurrentState = NORMAL_DATA;
 			break;
 		case IAC_NEGOTIATE:
-			processInNegotiate(currentByte);
+			processInNegotiate(*Ptr);
 			break;
 		case ESC_SEQ:
-			processInEscapeSequence(currentByte);
+		case ESC_PARAMS:
+			processInEscapeSequence(*Ptr);
 			break;
 		}
+		Ptr++;
 	}
 
-	if (pImpl->_CurrentData.size() > 0 && pImpl->_CurrentState == NORMAL_DATA) {
-		pImpl->makeToken(Token::STRING).sendToWebsocket(pImpl->_Writer);
-	}
-
-	/*std::list<Token>::iterator tokenItr = currentTokens.begin();
-	while (tokenItr != currentTokens.end()) {
-		tokenItr->sendToWebsocket(pImpl->_Writer);
-		tokenItr++;
-	}*/
-	/*const std::string testString("Hello World");
-	 sendWSText(pImpl->_Writer, testString);*/
+	endText();
 }
 
 } /* namespace websocket */
-
@@ -8,27 +8,29 @@
 #ifndef OUTPUTPARSER_H_
 #define OUTPUTPARSER_H_
 
-#include "SocketWriter.h"
+#include "FrameWriter.h"
 #include "config.h"
-#include <list>
 
 namespace websocket {
 
 struct OutputParse_Impl;
-class Token;
 
+/* Translates game output into websocket frames in a single pass. Text runs are HTML-escaped, widened
+ * from Latin-1 to UTF-8 and sent as text frames; each ANSI SGR parameter is sent as a one-byte binary
+ * frame; telnet negotiation is dropped. State carries over between calls, so a sequence may be split
+ * across chunks.
+ */
 class OutputParser {
 private:
 	OutputParse_Impl * const pImpl;
 
-	bool isDataEmpty();
+	void endText();
 	void processInEscapeSequence(uint8_t byte);
 	void processInNegotiate(uint8_t byte);
 	void processInIACStart(uint8_t byte);
-	void processInNormal(
-			const uint8_t Byte);
+	const uint8_t * processInNormal(const uint8_t * Ptr, const uint8_t * End);
 public:
-	OutputParser(SocketWriter& Writer);
+	OutputParser(FrameWriter& Writer);
 	virtual ~OutputParser();
 
 	void parseAndSend(const char * TextPtr, const size_t Size);
@@ -0,0 +1,248 @@
+/*
+ * PerMessageDeflate.cpp
+ */
+
+#include "autoconf.h"
+#include "PerMessageDeflate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Utils.h"
+
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif // HAVE_ZLIB_H
+
+namespace websocket {
+
+static const char * const ExtensionName = "permessage-deflate";
+
+// zlib does not support a raw deflate window of 256 bytes, so offers which ask for one are declined.
+static const int MinWindowBits = 9;
+static const int MaxWindowBits = 15;
+
+// Every message compressed with a sync flush ends with these bytes, which RFC 7692 leaves off the wire.
+static const uint8_t FlushTrailer[4] = { 0x00U, 0x00U, 0xFFU, 0xFFU };
+
+static const size_t ChunkSize = 4096U;
+
+static void splitList(const std::string& List, const char Separator, std::vector<std::string>& Out) {
+	size_t Start = 0;
+	for (;;) {
+		const size_t End = List.find(Separator, Start);
+		Out.push_back(trim(List.substr(Start, (End == std::string::npos) ? std::string::npos : End - Start)));
+		if (End == std::string::npos) {
+			break;
+		}
+		Start = End + 1;
+	}
+}
+
+/* Checks one offer and works out the reply to it. Returns false if the offer has a parameter which is
+ * not understood, is repeated, or cannot be met.
+ */
+static bool acceptOffer(const std::vector<std::string>& Params, const DeflateParams& Allowed,
+		DeflateParams& Agreed, std::string& Response) {
+	Agreed = Allowed;
+	Agreed.enabled = true;
+	bool HaveServerBits = false;
+	bool HaveServerNoTakeover = false;
+	bool HaveClientNoTakeover = false;
+	bool HaveClientBits = false;
+
+	for (size_t i = 1; i < Params.size(); i++) {
+		const std::string& Param = Params[i];
+		const size_t Equals = Param.find('=');
+		const std::string Name = trim(Param.substr(0, Equals));
+		std::string Value;
+		if (Equals != std::string::npos) {
+			Value = trim(Param.substr(Equals + 1));
+			if (2U <= Value.size() && Value[0] == '\"' && Value[Value.size() - 1] == '\"') {
+				Value = Value.substr(1, Value.size() - 2);
+			}
+		}
+
+		if (Name == "server_no_context_takeover" && !HaveServerNoTakeover && Value.empty()) {
+			HaveServerNoTakeover = true;
+			Agreed.serverNoContextTakeover = true;
+		} else if (Name == "client_no_context_takeover" && !HaveClientNoTakeover && Value.empty()) {
+			HaveClientNoTakeover = true;
+			Agreed.clientNoContextTakeover = true;
+		} else if (Name == "server_max_window_bits" && !HaveServerBits) {
+			HaveServerBits = true;
+			const int Bits = atoi(Value.c_str());
+			if (Bits < MinWindowBits || MaxWindowBits < Bits) {
+				return false;
+			}
+			if (Bits < Agreed.serverWindowBits) {
+				Agreed.serverWindowBits = Bits;
+			}
+		} else if (Name == "client_max_window_bits" && !HaveClientBits) {
+			// Incoming messages are always inflated with the largest window, so the client may use
+			// whatever it likes.
+			HaveClientBits = true;
+			if (!Value.empty()) {
+				const int Bits = atoi(Value.c_str());
+				if (Bits < 8 || MaxWindowBits < Bits) {
+					return false;
+				}
+			}
+		} else {
+			return false;
+		}
+	}
+
+	Response = ExtensionName;
+	if (Agreed.serverNoContextTakeover) {
+		Response.append("; server_no_context_takeover");
+	}
+	if (Agreed.clientNoContextTakeover) {
+		Response.append("; client_no_context_takeover");
+	}
+	if (HaveServerBits || Agreed.serverWindowBits < MaxWindowBits) {
+		char Buffer[40];
+		sprintf(Buffer, "; server_max_window_bits=%d", Agreed.serverWindowBits);
+		Response.append(Buffer);
+	}
+	return true;
+}
+
+bool negotiateDeflate(const std::string& Offers, const DeflateParams& Allowed, DeflateParams& Agreed,
+		std::string& Response) {
+#ifdef HAVE_ZLIB_H
+	if (!Allowed.enabled) {
+		return false;
+	}
+
+	std::vector<std::string> OfferList;
+	splitList(Offers, ',', OfferList);
+	for (size_t i = 0; i < OfferList.size(); i++) {
+		std::vector<std::string> Params;
+		splitList(OfferList[i], ';', Params);
+		if (Params[0] == ExtensionName && acceptOffer(Params, Allowed, Agreed, Response)) {
+			return true;
+		}
+	}
+#endif // HAVE_ZLIB_H
+	Agreed = DeflateParams();
+	return false;
+}
+
+#ifdef HAVE_ZLIB_H
+
+struct MessageDeflater_Impl {
+	z_stream stream;
+	bool noContextTakeover;
+};
+
+MessageDeflater::MessageDeflater(const DeflateParams& Agreed) :
+		_Impl(new MessageDeflater_Impl()) {
+	memset(&_Impl->stream, 0, sizeof(_Impl->stream));
+	_Impl->noContextTakeover = Agreed.serverNoContextTakeover;
+
+	// A negative window size asks for raw deflate data, with no zlib header or checksum.
+	deflateInit2(&_Impl->stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -Agreed.serverWindowBits, 8,
+			Z_DEFAULT_STRATEGY);
+}
+
+MessageDeflater::~MessageDeflater() {
+	deflateEnd(&_Impl->stream);
+	delete _Impl;
+}
+
+void MessageDeflater::compress(const uint8_t * const In, const size_t Size, std::vector<uint8_t>& Out) {
+	z_stream * const Stream = &_Impl->stream;
+	Stream->next_in = (Bytef *) In;
+	Stream->avail_in = uInt(Size);
+
+	// A sync flush stops only once it has room to spare, so the output grows until it does.
+	Out.resize(Size / 2U + 64U);
+	size_t Used = 0;
+	for (;;) {
+		Stream->next_out = &Out[Used];
+		Stream->avail_out = uInt(Out.size() - Used);
+		deflate(Stream, Z_SYNC_FLUSH);
+		Used = Out.size() - Stream->avail_out;
+		if (Stream->avail_out != 0) {
+			break;
+		}
+		Out.resize(Out.size() * 2U);
+	}
+
+	if (sizeof(FlushTrailer) <= Used && memcmp(&Out[Used - sizeof(FlushTrailer)], FlushTrailer,
+			sizeof(FlushTrailer)) == 0) {
+		Used -= sizeof(FlushTrailer);
+	}
+	Out.resize(Used);
+
+	if (_Impl->noContextTakeover) {
+		deflateReset(Stream);
+	}
+}
+
+struct MessageInflater_Impl {
+	z_stream stream;
+	uint8_t chunk[ChunkSize];
+
+	// Bytes the current message has inflated to so far.
+	size_t messageSize;
+
+	MessageInflater::Result run(const uint8_t * const In, const size_t Size, std::vector<uint8_t>& Out,
+			const bool Keep, const size_t Limit) {
+		stream.next_in = (Bytef *) In;
+		stream.avail_in = uInt(Size);
+		do {
+			stream.next_out = chunk;
+			stream.avail_out = ChunkSize;
+			const int Result = ::inflate(&stream, Z_SYNC_FLUSH);
+			if (Result == Z_STREAM_END) {
+				// The client ended its stream with a final block. Its next message starts a new one.
+				inflateReset(&stream);
+			} else if (Result == Z_BUF_ERROR) {
+				break;
+			} else if (Result != Z_OK) {
+				return MessageInflater::BAD_DATA;
+			}
+
+			// Stop at the limit rather than inflating the rest, so a small payload cannot cost an
+			// unbounded amount of work.
+			const size_t Produced = ChunkSize - stream.avail_out;
+			if (Limit - messageSize < Produced) {
+				return MessageInflater::TOO_BIG;
+			}
+			messageSize += Produced;
+			if (Keep) {
+				Out.insert(Out.end(), chunk, chunk + Produced);
+			}
+		} while (stream.avail_in != 0 || stream.avail_out == 0);
+		return MessageInflater::OK;
+	}
+};
+
+MessageInflater::MessageInflater() :
+		_Impl(new MessageInflater_Impl()) {
+	memset(&_Impl->stream, 0, sizeof(_Impl->stream));
+	inflateInit2(&_Impl->stream, -MaxWindowBits);
+	_Impl->messageSize = 0;
+}
+
+MessageInflater::~MessageInflater() {
+	inflateEnd(&_Impl->stream);
+	delete _Impl;
+}
+
+MessageInflater::Result MessageInflater::inflate(const uint8_t * const In, const size_t Size,
+		std::vector<uint8_t>& Out, const bool Keep, const size_t Limit) {
+	return _Impl->run(In, Size, Out, Keep, Limit);
+}
+
+MessageInflater::Result MessageInflater::endMessage(std::vector<uint8_t>& Out, const bool Keep,
+		const size_t Limit) {
+	const Result Done = _Impl->run(FlushTrailer, sizeof(FlushTrailer), Out, Keep, Limit);
+	_Impl->messageSize = 0;
+	return Done;
+}
+
+#endif // HAVE_ZLIB_H
+
+} /* namespace websocket */
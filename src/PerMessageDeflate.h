@@ -0,0 +1,75 @@
+/*
+ * PerMessageDeflate.h
+ */
+
+#ifndef PERMESSAGEDEFLATE_H_
+#define PERMESSAGEDEFLATE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace websocket {
+
+/* Parameters of the permessage-deflate extension (RFC 7692). The server fills one in with what it is
+ * willing to do; negotiateDeflate() fills in another with what was agreed with a client.
+ */
+struct DeflateParams {
+	bool enabled;
+	int serverWindowBits;           // 9 to 15.
+	bool serverNoContextTakeover;   // Compress every message on its own.
+	bool clientNoContextTakeover;   // The client compresses every message on its own.
+
+	DeflateParams() :
+			enabled(false), serverWindowBits(15), serverNoContextTakeover(false), clientNoContextTakeover(false) {
+	}
+};
+
+/* Picks the first permessage-deflate offer in a Sec-WebSocket-Extensions value which Allowed can meet.
+ * On success, fills in Agreed and the value for the reply's Sec-WebSocket-Extensions header.
+ */
+bool negotiateDeflate(const std::string& Offers, const DeflateParams& Allowed, DeflateParams& Agreed,
+		std::string& Response);
+
+struct MessageDeflater_Impl;
+
+/* Compresses outgoing message payloads. Unless context takeover was turned off, each message may refer
+ * back to the ones before it, so every message compressed must also be sent.
+ */
+class MessageDeflater {
+private:
+	MessageDeflater_Impl * const _Impl;
+public:
+	MessageDeflater(const DeflateParams& Agreed);
+	~MessageDeflater();
+
+	// Replaces Out with the compressed form of the Size bytes at In, ready to send with RSV1 set.
+	void compress(const uint8_t * In, size_t Size, std::vector<uint8_t>& Out);
+};
+
+struct MessageInflater_Impl;
+
+/* Decompresses incoming message payloads. Payload may be fed in pieces as it arrives; endMessage()
+ * must follow the last piece of each message.
+ */
+class MessageInflater {
+private:
+	MessageInflater_Impl * const _Impl;
+public:
+	MessageInflater();
+	~MessageInflater();
+
+	enum Result {
+		OK, BAD_DATA, TOO_BIG
+	};
+
+	// Decompresses the Size bytes at In, appending them to Out if Keep. Returns BAD_DATA if the
+	// payload is not valid deflate data, and stops with TOO_BIG as soon as the message inflates to
+	// more than Limit bytes. After either, the inflater is of no further use.
+	Result inflate(const uint8_t * In, size_t Size, std::vector<uint8_t>& Out, bool Keep, size_t Limit);
+	Result endMessage(std::vector<uint8_t>& Out, bool Keep, size_t Limit);
+};
+
+} /* namespace websocket */
+#endif /* PERMESSAGEDEFLATE_H_ */
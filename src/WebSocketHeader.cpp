@@ -7,10 +7,11 @@
 
 #include "WebSocketHeader.h"
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include "DataInputStream.h"
+#include "PerMessageDeflate.h"
 #include <limits>
-#include <list>
 
 static void initRandom() {
 	static bool isInited = false;
@@ -23,25 +24,41 @@ static void initRandom() {
 namespace websocket {
 
 static const uint32_t MaskSize = 4U;
+static const uint32_t MaxControlSize = 125U;
 
-static void parseUTF8ToASCII(std::list<char>& DataInOut) {
-	//std::stringbuf buffer;
-	std::list<char> buffer;
-
-	std::list<char>::iterator dataToParseItr = DataInOut.begin();
-
-	while (dataToParseItr != DataInOut.end()) {
-		char& currentByte = *dataToParseItr;
-		if ((uint8_t(currentByte) & 0x80U) != 0) {
-			const char originalValue = currentByte;
-			const char highBits = (originalValue & 0xC0) >> 6;
-			const char lowBits = (originalValue & 0x3F);
-			currentByte = 0xC0 + highBits;
-			const char newByte = char(0x80) + lowBits;
-			dataToParseItr++;
-			DataInOut.insert(dataToParseItr, newByte);
-		}
-		dataToParseItr++;
+// Most a compressed message may inflate to. A message which would inflate past it closes the
+// connection, so a small compressed message cannot balloon into an unbounded buffer or amount of
+// work. Binary messages are inflated only to keep the window right, and are discarded.
+static const size_t MaxInflatedText = 65536U;
+static const size_t MaxInflatedBinary = 65536U;
+
+// Close status for a message whose compressed payload does not inflate.
+static const uint16_t CloseInvalidData = 1007U;
+
+// Close status for a message which inflates past its limit.
+static const uint16_t CloseMessageTooBig = 1009U;
+
+/* XORs Size bytes of payload with the mask, eight bytes at a time. Phase is the position of In[0]
+ * within the payload. Out may be In or anywhere before it.
+ */
+static void unmask(uint8_t * const Out, const uint8_t * const In, const size_t Size,
+		const uint8_t * const Mask, const uint64_t Phase) {
+	uint8_t Rotated[8];
+	for (unsigned int i = 0; i < 8U; i++) {
+		Rotated[i] = Mask[(Phase + i) % MaskSize];
+	}
+	uint64_t WideMask;
+	memcpy(&WideMask, Rotated, sizeof(WideMask));
+
+	size_t i = 0;
+	for (; i + 8U <= Size; i += 8U) {
+		uint64_t Word;
+		memcpy(&Word, In + i, sizeof(Word));
+		Word ^= WideMask;
+		memcpy(Out + i, &Word, sizeof(Word));
+	}
+	for (; i < Size; i++) {
+		Out[i] = In[i] ^ Rotated[i & 7U];
 	}
 }
 
@@ -53,6 +70,7 @@ struct WebSocketReader_Impl {
 		SIZE_64BIT,
 		MASK_BYTES,
 		PAYLOAD,
+		CLOSED,
 	};
 	enum Utf8State {
 		SINGLE_BYTE, TWO_BYTE,
@@ -62,16 +80,42 @@ struct WebSocketReader_Impl {
 	bool isMasked;
 	Type packetType;
 	uint64_t packetSize;
-	std::vector<char> mask;
+	uint8_t mask[MaskSize];
 	uint64_t stateCounter;
+
+	// Type of the message being reassembled from fragments. Control frames may arrive between the
+	// fragments, so this is kept apart from packetType.
+	Type messageType;
+
 	Utf8State payloadState;
-	uint8_t payloadStateCounter;
-	char currentCompositeChar;
+	uint8_t currentCompositeChar;
+
+	uint8_t controlPayload[MaxControlSize];
+
+	// Where replies to control frames go during the current processInput() call.
+	DataOutputStream * replies;
+
+	// Set once permessage-deflate has been agreed. The current message was sent compressed if
+	// messageCompressed, and text from this processInput() call is collected in text.
+	MessageInflater * inflater;
+	bool messageCompressed;
+	std::vector<uint8_t> text;
+
+	// Close status sent when a message was failed, or 0.
+	uint16_t failStatus;
 
 	WebSocketReader_Impl() :
-			currentState(FIN_AND_OPCODE), isFinal(false), isMasked(false), packetType(), packetSize(), mask(
-					MaskSize), stateCounter(0U) {
+			currentState(FIN_AND_OPCODE), isFinal(false), isMasked(false), packetType(), packetSize(), stateCounter(
+					0U), messageType(WS_CONTINUATION), payloadState(SINGLE_BYTE), currentCompositeChar(0U), replies(
+					NULL), inflater(NULL), messageCompressed(false), text(), failStatus(0U) {
+	}
 
+	~WebSocketReader_Impl() {
+		delete inflater;
+	}
+
+	static bool isControl(const Type PacketType) {
+		return (PacketType & 0x8U) != 0;
 	}
 
 	void gotoMaskOrPayload() {
@@ -84,20 +128,17 @@ struct WebSocketReader_Impl {
 
 	void gotoPayloadOrStart() {
 		if (packetSize == 0) {
-			setState(FIN_AND_OPCODE);
+			if (isControl(packetType)) {
+				processControl();
+			} else {
+				endDataFrame();
+			}
 		} else {
 			setState(PAYLOAD);
 		}
 	}
 
 	void setState(WebSocketState newState) {
-		if (newState == FIN_AND_OPCODE) {
-			// TODO: Packet complete - need to notify if close-packet?
-		} else if (newState == PAYLOAD) {
-			payloadState = SINGLE_BYTE;
-			payloadStateCounter = 0U;
-			currentCompositeChar = '\0';
-		}
 		currentState = newState;
 		stateCounter = 0U;
 	}
@@ -105,6 +146,11 @@ struct WebSocketReader_Impl {
 	void processFinOpcode(const uint8_t Byte) {
 		isFinal = (Byte & 0x80U) != 0;
 		packetType = Type(Byte & 0xFU);
+		if (!isControl(packetType) && packetType != WS_CONTINUATION) {
+			messageType = packetType;
+			messageCompressed = (inflater != NULL) && (Byte & 0x40U) != 0;
+			payloadState = SINGLE_BYTE;
+		}
 		setState(INITIAL_SIZE);
 	}
 
@@ -143,52 +189,174 @@ struct WebSocketReader_Impl {
 	void processMask(const uint8_t Byte) {
 		mask[stateCounter] = Byte;
 		stateCounter++;
-		if (stateCounter == mask.size()) {
+		if (stateCounter == MaskSize) {
 			gotoPayloadOrStart();
 		}
 	}
 
-	void processPayload(const uint8_t Byte, std::list<char>& outputChars) {
-		if (packetType == WS_TEXTFRAME) {
-			char decodedChar = char(Byte);
+	/* Takes as much of the current payload as is available. Text is unmasked into TextOut and
+	 * filtered down to Latin-1 there; other data frames are skipped. Returns the bytes consumed.
+	 */
+	size_t processPayload(const uint8_t * const DataPtr, const size_t Size, uint8_t * const TextOut,
+			size_t& TextSize) {
+		uint64_t Remaining = packetSize - stateCounter;
+		const size_t Take = (Remaining < Size) ? size_t(Remaining) : Size;
+
+		if (isControl(packetType)) {
+			// Control payloads are limited to 125 bytes. Anything past that is dropped.
+			if (stateCounter < MaxControlSize) {
+				const size_t Keep = (MaxControlSize - stateCounter < Take) ? size_t(MaxControlSize - stateCounter) : Take;
+				uint8_t * const Out = controlPayload + stateCounter;
+				if (isMasked) {
+					unmask(Out, DataPtr, Keep, mask, stateCounter);
+				} else {
+					memcpy(Out, DataPtr, Keep);
+				}
+			}
+		} else if (inflater != NULL) {
+			// Compressed binary messages are inflated too, since later messages may refer back to them.
+			if (messageType == WS_TEXTFRAME || messageCompressed) {
+				if (isMasked) {
+					unmask(TextOut, DataPtr, Take, mask, stateCounter);
+				} else {
+					memmove(TextOut, DataPtr, Take);
+				}
+				const MessageInflater::Result Result = collectText(TextOut, Take);
+				if (Result != MessageInflater::OK) {
+					failMessage(Result);
+					return Take;
+				}
+			}
+		} else if (messageType == WS_TEXTFRAME) {
+			uint8_t * const Out = TextOut + TextSize;
 			if (isMasked) {
-				decodedChar ^= mask[stateCounter % mask.size()];
+				unmask(Out, DataPtr, Take, mask, stateCounter);
+			} else {
+				memmove(Out, DataPtr, Take);
 			}
-			processUTF8(decodedChar, outputChars);
+			TextSize += processUTF8(Out, Take);
 		}
-		stateCounter++;
+
+		stateCounter += Take;
 		if (stateCounter == packetSize) {
+			if (isControl(packetType)) {
+				processControl();
+			} else {
+				endDataFrame();
+			}
+		}
+		return Take;
+	}
+
+	/* Appends payload to the collected text, inflating it first if the message was compressed. Only
+	 * text messages are kept.
+	 */
+	MessageInflater::Result collectText(const uint8_t * const Data, const size_t Size) {
+		const bool Keep = (messageType == WS_TEXTFRAME);
+		const size_t Start = text.size();
+		if (messageCompressed) {
+			const MessageInflater::Result Result = inflater->inflate(Data, Size, text, Keep, inflateLimit());
+			if (Result != MessageInflater::OK) {
+				return Result;
+			}
+		} else if (Keep) {
+			text.insert(text.end(), Data, Data + Size);
+		}
+		if (Start < text.size()) {
+			text.resize(Start + processUTF8(&text[Start], text.size() - Start));
+		}
+		return MessageInflater::OK;
+	}
+
+	size_t inflateLimit() const {
+		return (messageType == WS_TEXTFRAME) ? MaxInflatedText : MaxInflatedBinary;
+	}
+
+	void endDataFrame() {
+		if (isFinal && messageCompressed) {
+			const size_t Start = text.size();
+			const MessageInflater::Result Result = inflater->endMessage(text, messageType == WS_TEXTFRAME,
+					inflateLimit());
+			if (Result != MessageInflater::OK) {
+				failMessage(Result);
+				return;
+			}
+			if (Start < text.size()) {
+				text.resize(Start + processUTF8(&text[Start], text.size() - Start));
+			}
+		}
+		setState(FIN_AND_OPCODE);
+	}
+
+	// Closes the connection over a compressed payload which does not inflate or inflates too far.
+	void failMessage(const MessageInflater::Result Result) {
+		const uint16_t Status = (Result == MessageInflater::TOO_BIG) ? CloseMessageTooBig : CloseInvalidData;
+		controlPayload[0] = uint8_t(Status >> 8);
+		controlPayload[1] = uint8_t(Status);
+		sendControl(WS_CLOSE, 2U);
+		failStatus = Status;
+		setState(CLOSED);
+	}
+
+	/* Answers a ping with a pong carrying the same payload, and a close with a close carrying the
+	 * same status code. Unsolicited pongs are ignored.
+	 */
+	void processControl() {
+		const size_t Size = (packetSize < MaxControlSize) ? size_t(packetSize) : MaxControlSize;
+		if (packetType == WS_PING) {
+			sendControl(WS_PONG, Size);
+			setState(FIN_AND_OPCODE);
+		} else if (packetType == WS_CLOSE) {
+			sendControl(WS_CLOSE, (Size < 2U) ? Size : 2U);
+			setState(CLOSED);
+		} else {
 			setState(FIN_AND_OPCODE);
 		}
 	}
 
-	void switchUTF8State(Utf8State newState) {
-		currentCompositeChar = '\0';
-		payloadState = newState;
-		payloadStateCounter = 0;
+	void sendControl(const Type PacketType, const size_t Size) {
+		WebSocketHeader(PacketType, true, false, Size).writeOut(*replies);
+		for (size_t i = 0; i < Size; i++) {
+			replies->write(controlPayload[i]);
+		}
 	}
 
-	bool match(const uint8_t Byte, const uint8_t Mask, const uint8_t NegMask) {
+	static bool match(const uint8_t Byte, const uint8_t Mask, const uint8_t NegMask) {
 		return ((Byte & Mask) == Mask) && (((~Byte) & NegMask) == NegMask);
 	}
 
-	void processUTF8(const uint8_t Byte, std::list<char>& outputChars) {
-		switch (payloadState) {
-		case SINGLE_BYTE:
-			if ((Byte & 0x80U) == 0) {
-				outputChars.push_back(Byte);
-			} else if (match(Byte, 0xC0U, 0x20U)) {
-				switchUTF8State(TWO_BYTE);
-				currentCompositeChar = (Byte & 0x3U) << 6;
+	/* Filters Size bytes of UTF-8 in place down to Latin-1. Characters outside of Latin-1 are
+	 * dropped. Returns the new size.
+	 */
+	size_t processUTF8(uint8_t * const Data, const size_t Size) {
+		size_t i = 0;
+		if (payloadState == SINGLE_BYTE) {
+			while (i < Size && (Data[i] & 0x80U) == 0) {
+				i++;
 			}
-			break;
-		case TWO_BYTE:
-			if (match(Byte, 0x80U, 0x40U)) {
-				outputChars.push_back((Byte & 0x3F) | currentCompositeChar);
+		}
+
+		size_t Out = i;
+		for (; i < Size; i++) {
+			const uint8_t Byte = Data[i];
+			switch (payloadState) {
+			case SINGLE_BYTE:
+				if ((Byte & 0x80U) == 0) {
+					Data[Out++] = Byte;
+				} else if (match(Byte, 0xC0U, 0x20U)) {
+					payloadState = TWO_BYTE;
+					currentCompositeChar = (Byte & 0x3U) << 6;
+				}
+				break;
+			case TWO_BYTE:
+				if (match(Byte, 0x80U, 0x40U)) {
+					Data[Out++] = (Byte & 0x3FU) | currentCompositeChar;
+				}
+				payloadState = SINGLE_BYTE;
+				break;
 			}
-			switchUTF8State(SINGLE_BYTE);
-			break;
 		}
+		return Out;
 	}
 };
 
@@ -199,12 +367,16 @@ WebSocketReader::~WebSocketReader() {
 	delete _Impl;
 }
 
-ReadResult WebSocketReader::processInput(const char * const DataPtr,
-		const uint32_t Size) {
-	std::list<char> readText;
+ReadResult WebSocketReader::processInput(const char * const DataPtr, const uint32_t Size,
+		char * const TextOut, DataOutputStream& Replies) {
+	const uint8_t * const Data = (const uint8_t *) DataPtr;
+	size_t textSize = 0;
+	_Impl->replies = &Replies;
+	_Impl->text.clear();
 
-	for (uint32_t i = 0U; i < Size; i++) {
-		uint8_t readByte = DataPtr[i];
+	uint32_t i = 0U;
+	while (i < Size) {
+		const uint8_t readByte = Data[i];
 		switch (_Impl->currentState) {
 		case WebSocketReader_Impl::FIN_AND_OPCODE:
 			_Impl->processFinOpcode(readByte);
@@ -222,14 +394,26 @@ ReadResult WebSocketReader::processInput(const char * const DataPtr,
 			_Impl->processMask(readByte);
 			break;
 		case WebSocketReader_Impl::PAYLOAD:
-			_Impl->processPayload(readByte, readText);
-			break;
+			i += _Impl->processPayload(Data + i, Size - i, (uint8_t *) TextOut, textSize);
+			continue;
+		case WebSocketReader_Impl::CLOSED:
+			i = Size;
+			continue;
 		}
+		i++;
 	}
 
-	std::vector<char> v(readText.begin(), readText.end());
+	const bool Closed = (_Impl->currentState == WebSocketReader_Impl::CLOSED);
+	if (_Impl->inflater != NULL) {
+		const char * const Text = _Impl->text.empty() ? TextOut : (const char *) &_Impl->text[0];
+		return ReadResult(Text, _Impl->text.size(), Closed, _Impl->failStatus);
+	}
+	return ReadResult(TextOut, textSize, Closed, _Impl->failStatus);
+}
 
-	return ReadResult(v, false);
+void WebSocketReader::setInflater(MessageInflater * const Inflater) {
+	delete _Impl->inflater;
+	_Impl->inflater = Inflater;
 }
 
 /*WebSocketHeader::WebSocketHeader(SocketReader& inputSource) throw (int) {
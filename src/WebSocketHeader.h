@@ -10,6 +10,7 @@
 
 #include <vector>
 #include <stdint.h>
+#include <stddef.h>
 #include "DataOutputStream.h"
 
 namespace websocket {
@@ -18,13 +19,20 @@ enum Type {
 	WS_CONTINUATION = 0, WS_TEXTFRAME = 1, WS_BINARY = 2, WS_CLOSE = 8, WS_PING = 9, WS_PONG = 10
 };
 
+/* What one call to WebSocketReader::processInput() produced. The decoded text is in the caller's
+ * buffer, or in the reader's own if it might have grown.
+ */
 struct ReadResult {
 	bool hasClosed;
-	std::vector<char> readBytes;
-	ReadResult(std::vector<char> chars, bool closed) : hasClosed(closed), readBytes(chars) {
+	uint16_t failStatus;    // Close status if the reader failed the connection, or 0.
+	const char * text;
+	size_t textSize;
+	ReadResult(const char * data, size_t size, bool closed, uint16_t status) :
+			hasClosed(closed), failStatus(status), text(data), textSize(size) {
 	}
 };
 
+class MessageInflater;
 struct WebSocketReader_Impl;
 class WebSocketReader {
 private:
@@ -32,7 +40,17 @@ private:
 public:
 	WebSocketReader();
 	~WebSocketReader();
-	ReadResult processInput(const char * const DataPtr, const uint32_t Size);
+
+	/* Decodes frames from the client. Text payload is unmasked into TextOut, which may be DataPtr
+	 * itself, and is never longer than the input. Replies to ping and close frames are written to
+	 * Replies. Once permessage-deflate is on, TextOut is only scratch space and the text is collected
+	 * in the reader, since inflating it can make it longer than the input.
+	 */
+	ReadResult processInput(const char * const DataPtr, const uint32_t Size, char * const TextOut,
+			DataOutputStream& Replies);
+
+	// Takes ownership of the inflater for messages sent with RSV1.
+	void setInflater(MessageInflater * const Inflater);
 };
 
 class WebSocketHeader {
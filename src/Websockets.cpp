@@ -8,7 +8,7 @@
 #include <sys/time.h>
 #include <sys/socket.h>
 #include "SocketReader.h"
-#include "SocketWriter.h"
+#include "FrameWriter.h"
 #include "HandshakeHeader.h"
 
 #include <stdlib.h>
@@ -30,51 +30,35 @@ using namespace std;
 #define WS_VERSION_STR "13"
 #define WS_KEY "Sec-WebSocket-Key"
 #define WS_KEY_MAGIC "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WS_EXTENSIONS "Sec-WebSocket-Extensions"
 //258EAFA5-E914-47DA-95CA-C5AB0DC85B11
 
 static bool checkWebSocketVersion(const HandshakeHeader& InputHeader);
-static void issueReply(const SOCKET& SocketToUse,
-		const HandshakeHeader& InputHeader) throw (int);
-static HandshakeHeader makeReplyHeader(const std::string& Key);
-static void sendWSPacket(websocket::SocketWriter& writer, const Type& PacketType, const uint8_t *DataPointer,
+static HandshakeHeader makeReplyHeader(const std::string& Key, const std::string& Extensions);
+static void sendWSPacket(websocket::FrameWriter& writer, const Type& PacketType, const uint8_t *DataPointer,
 		const uint32_t Size)  throw (int);
 
-void setSocketTimeout(const SOCKET& socket, const int Seconds) {
-	struct timeval tv;
-
-	tv.tv_sec = Seconds; /* n Secs Timeout */
-	tv.tv_usec = 0;
-
-	setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(struct timeval));
-}
-
-void clearSocketTimeout(const SOCKET& socket) {
-	struct timeval tv;
-
-	tv.tv_sec = 0; /* 0 Secs Timeout - causes the rcv-timeout to switch off */
-	tv.tv_usec = 0;
-
-	setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(struct timeval));
-}
+bool makeHandshakeReply(const HandshakeHeader& InputHeader, const DeflateParams& Allowed,
+		DeflateParams& Agreed, std::string& ReplyOut) {
+	const std::string * const Key = InputHeader.getValue(WS_KEY);
+	if (Key == NULL || !checkWebSocketVersion(InputHeader)) {
+		return false;
+	}
 
-bool conductHandshake(const SOCKET& SocketToUse) throw (int) {
-	bool worked = true;
-	setSocketTimeout(SocketToUse, 30);
-
-	try {
-		SocketReader reader(SocketToUse);
-		const HandshakeHeader inputHeader(reader);
-		if (checkWebSocketVersion(inputHeader)) {
-			issueReply(SocketToUse, inputHeader);
-		} else {
-			worked = false;
-		}
-	} catch (int e) {
-		worked = false;
+	std::string extensions;
+	const std::string * const Offers = InputHeader.getValue(WS_EXTENSIONS);
+	if (Offers == NULL || !negotiateDeflate(*Offers, Allowed, Agreed, extensions)) {
+		Agreed = DeflateParams();
+		extensions.clear();
 	}
-	clearSocketTimeout(SocketToUse);
 
-	return worked;
+	ReplyOut = makeReplyHeader(*Key, extensions).toString();
+	Log.WriteString("Web socket handshake complete: Input Header:\n");
+	Log.WriteString(InputHeader.toString().c_str());
+	Log.WriteString("Output Header:\n");
+	Log.WriteString(ReplyOut.c_str());
+
+	return true;
 }
 
 static bool checkWebSocketVersion(const HandshakeHeader& InputHeader) {
@@ -89,22 +73,6 @@ static bool checkWebSocketVersion(const HandshakeHeader& InputHeader) {
 	}
 }
 
-static void issueReply(const SOCKET& SocketToUse,
-		const HandshakeHeader& InputHeader) throw (int) {
-	const std::string ReplyText =
-			makeReplyHeader(*InputHeader.getValue(WS_KEY)).toString();
-	const int WriteResult = ::write(SocketToUse, ReplyText.c_str(),
-			ReplyText.size());
-	Log.WriteString("Web socket handshake complete: Input Header:\n");
-	Log.WriteString(InputHeader.toString().c_str());
-	Log.WriteString("Output Header:\n");
-	Log.WriteString(ReplyText.c_str());
-
-	if (WriteResult != ReplyText.size()) {
-		throw WriteResult;
-	}
-}
-
 static std::string keyInToReplyKey(const std::string& KeyIn) {
 	std::string fullKey(KeyIn);
 	fullKey.append(WS_KEY_MAGIC);
@@ -123,39 +91,38 @@ static std::string keyInToReplyKey(const std::string& KeyIn) {
 	return finalKey;
 }
 
-static HandshakeHeader makeReplyHeader(const std::string& Key) {
+static HandshakeHeader makeReplyHeader(const std::string& Key, const std::string& Extensions) {
 	HandshakeHeader replyHeader("HTTP/1.1 101 Switching Protocols");
 	replyHeader.setValue("Upgrade", "websocket");
 	replyHeader.setValue("Connection", "Upgrade");
 	replyHeader.setValue("Sec-WebSocket-Version", WS_VERSION_STR);
 	replyHeader.setValue("Sec-WebSocket-Accept", keyInToReplyKey(Key));
+	if (!Extensions.empty()) {
+		replyHeader.setValue(WS_EXTENSIONS, Extensions);
+	}
 
 	return replyHeader;
 }
 
-void sendWSText(websocket::SocketWriter& writer,
+void sendWSText(websocket::FrameWriter& writer,
 		const std::string& StringToWrite) {
 	sendWSPacket(writer, WS_TEXTFRAME, (uint8_t *)StringToWrite.data(), StringToWrite.size());
 }
 
-void sendWSText(websocket::SocketWriter& writer,
+void sendWSText(websocket::FrameWriter& writer,
 		const char * const StringToWrite, const uint32_t Size) throw (int) {
 	sendWSPacket(writer, WS_TEXTFRAME, (uint8_t *)StringToWrite, Size);
 }
 
-void sendWSData(websocket::SocketWriter& writer, const uint8_t *DataPointer,
+void sendWSData(websocket::FrameWriter& writer, const uint8_t *DataPointer,
 		const uint32_t Size) throw (int) {
 	sendWSPacket(writer, WS_BINARY, DataPointer, Size);
 }
 
-void sendWSPacket(websocket::SocketWriter& writer, const Type& PacketType, const uint8_t *DataPointer,
+void sendWSPacket(websocket::FrameWriter& writer, const Type& PacketType, const uint8_t *DataPointer,
 		const uint32_t Size) throw (int) {
 	WebSocketHeader headerToSend(PacketType, true, false, Size);
 
 	headerToSend.writeOut(writer);
-
-	for (int i = 0; i < Size; i++) {
-		writer.write(DataPointer[i]);
-	}
-	writer.flushAll();
+	writer.write(DataPointer, Size);
 }
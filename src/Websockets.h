@@ -10,14 +10,18 @@
 
 #include "config.h"
 #include "SocketReader.h"
-#include "SocketWriter.h"
+#include "FrameWriter.h"
+#include "HandshakeHeader.h"
+#include "PerMessageDeflate.h"
 #include <string>
 
-bool conductHandshake(const SOCKET& SocketToUse) throw (int);
-void sendWSText(websocket::SocketWriter& writer, const std::string& StringToWrite) throw (int);
-void sendWSText(websocket::SocketWriter& writer,
+// Allowed is what the server will agree to for permessage-deflate; Agreed is what it did agree to.
+bool makeHandshakeReply(const websocket::handshaking::HandshakeHeader& InputHeader,
+		const websocket::DeflateParams& Allowed, websocket::DeflateParams& Agreed, std::string& ReplyOut);
+void sendWSText(websocket::FrameWriter& writer, const std::string& StringToWrite) throw (int);
+void sendWSText(websocket::FrameWriter& writer,
 		const char * const StringToWrite, const uint32_t Size) throw (int);
-void sendWSData(websocket::SocketWriter& writer, const uint8_t *DataPointer,
+void sendWSData(websocket::FrameWriter& writer, const uint8_t *DataPointer,
 		const uint32_t Size) throw (int);
 
 #endif /* WEBSOCKETS_H_ */
@@ -63,7 +63,8 @@ typedef struct pooldata
 static POOL pools[NUM_POOLS];
 static const char *poolnames[] =
 {
-    "Lbufs", "Sbufs", "Mbufs", "Bools", "Descs", "Qentries", "Pcaches", "Lbufrefs", "Regrefs"
+    "Lbufs", "Sbufs", "Mbufs", "Bools", "Descs", "Pcaches", "Lbufrefs", "Regrefs",
+    "Tblocks", "Tblocks-sm", "Tblockrefs", "Cblks"
 };
 
 void pool_init(int poolnum, int poolsize)
@@ -611,3 +612,52 @@ void pool_reset(void)
     }
 }
 
+// pool_trim: Return free buffers beyond the first nKeepFree to the system.
+// Unlike pool_reset, the remaining free buffers stay on the freelist.
+//
+void pool_trim(int poolnum, int nKeepFree)
+{
+    if (nKeepFree < 0)
+    {
+        return;
+    }
+
+    UINT64 nFree = pools[poolnum].max_alloc - pools[poolnum].num_alloc;
+    if (nFree <= static_cast<UINT64>(nKeepFree))
+    {
+        return;
+    }
+
+    POOLHDR *newchain = NULL;
+    POOLHDR *newfree = NULL;
+    POOLHDR *phnext;
+    POOLHDR *ph;
+    int nKept = 0;
+    for (ph = pools[poolnum].chain_head; ph != NULL; ph = phnext)
+    {
+        char *h = (char *)ph;
+        phnext = ph->next;
+        h += sizeof(POOLHDR);
+        unsigned int *ibuf = (unsigned int *)h;
+        if (*ibuf == pools[poolnum].poolmagic)
+        {
+            if (nKept < nKeepFree)
+            {
+                nKept++;
+                ph->nxtfree = newfree;
+                newfree = ph;
+            }
+            else
+            {
+                char *p = reinterpret_cast<char *>(ph);
+                delete [] p;
+                pools[poolnum].max_alloc--;
+                continue;
+            }
+        }
+        ph->next = newchain;
+        newchain = ph;
+    }
+    pools[poolnum].chain_head = newchain;
+    pools[poolnum].free_head = newfree;
+}
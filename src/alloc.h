@@ -11,11 +11,14 @@
 #define POOL_MBUF    2
 #define POOL_BOOL    3
 #define POOL_DESC    4
-#define POOL_QENTRY  5
-#define POOL_PCACHE  6
-#define POOL_LBUFREF 7
-#define POOL_REGREF  8
-#define NUM_POOLS    9
+#define POOL_PCACHE  5
+#define POOL_LBUFREF 6
+#define POOL_REGREF  7
+#define POOL_TBLOCK  8
+#define POOL_TBLOCKS 9
+#define POOL_TBLKREF 10
+#define POOL_CBLK    11
+#define NUM_POOLS    12
 
 #ifdef FIRANMUX
 #define LBUF_SIZE   16000   // Large
@@ -35,6 +38,7 @@ extern void pool_free_lbuf(char *, const char *, int);
 extern void list_bufstats(dbref);
 extern void list_buftrace(dbref);
 extern void pool_reset(void);
+extern void pool_trim(int, int);
 
 #define alloc_lbuf(s)    pool_alloc_lbuf(s, __FILE__, __LINE__)
 #define free_lbuf(b)     pool_free_lbuf((char *)(b), __FILE__, __LINE__)
@@ -44,14 +48,14 @@ extern void pool_reset(void);
 #define free_sbuf(b)     pool_free(POOL_SBUF,(char *)(b), __FILE__, __LINE__)
 #define alloc_bool(s)    (struct boolexp *)pool_alloc(POOL_BOOL,s, __FILE__, __LINE__)
 #define free_bool(b)     pool_free(POOL_BOOL,(char *)(b), __FILE__, __LINE__)
-#define alloc_qentry(s)  (BQUE *)pool_alloc(POOL_QENTRY,s, __FILE__, __LINE__)
-#define free_qentry(b)   pool_free(POOL_QENTRY,(char *)(b), __FILE__, __LINE__)
 #define alloc_pcache(s)  (PCACHE *)pool_alloc(POOL_PCACHE,s, __FILE__, __LINE__)
 #define free_pcache(b)   pool_free(POOL_PCACHE,(char *)(b), __FILE__, __LINE__)
 #define alloc_lbufref(s) (lbuf_ref *)pool_alloc(POOL_LBUFREF,s, __FILE__, __LINE__)
 #define free_lbufref(b)  pool_free(POOL_LBUFREF,(char *)(b), __FILE__, __LINE__)
 #define alloc_regref(s)  (reg_ref *)pool_alloc(POOL_REGREF,s, __FILE__, __LINE__)
 #define free_regref(b)   pool_free(POOL_REGREF,(char *)(b), __FILE__, __LINE__)
+#define alloc_cblk(s)    (CBLK *)pool_alloc(POOL_CBLK,s, __FILE__, __LINE__)
+#define free_cblk(b)     pool_free(POOL_CBLK,(char *)(b), __FILE__, __LINE__)
 
 #define safe_copy_chr(src, buff, bufp, nSizeOfBuffer) \
 { \
@@ -38,12 +38,18 @@ typedef struct tagAttrRecord
 
 static ATTR_RECORD TempRecord;
 
+// An entry may be pinned by cache_pin() while its text is read in place.
+// If the entry leaves the cache while pinned, it is retired rather than
+// freed, and the last cache_unpin() frees it.
+//
 typedef struct tagCacheEntryHeader
 {
     struct tagCacheEntryHeader *pPrevEntry;
     struct tagCacheEntryHeader *pNextEntry;
     Aname attrKey;
     size_t nSize;
+    int    nPins;
+    bool   bRetired;
 } CENT_HDR, *PCENT_HDR;
 
 static PCENT_HDR pCacheHead = 0;
@@ -214,6 +220,18 @@ static void ADD_ENTRY(PCENT_HDR pEntry)
     }
 }
 
+static void FREE_ENTRY(PCENT_HDR pEntry)
+{
+    if (0 < pEntry->nPins)
+    {
+        pEntry->bRetired = true;
+    }
+    else
+    {
+        MEMFREE(pEntry);
+    }
+}
+
 static void TrimCache(void)
 {
     // Check to see if the cache needs to be trimmed.
@@ -233,13 +251,17 @@ static void TrimCache(void)
         CacheSize -= pCacheEntry->nSize;
         hashdeleteLEN(&(pCacheEntry->attrKey), sizeof(Aname),
             &mudstate.acache_htab);
-        MEMFREE(pCacheEntry);
+        FREE_ENTRY(pCacheEntry);
         pCacheEntry = NULL;
     }
 }
 
-const char *cache_get(Aname *nam, size_t *pLen)
+// cache_lookup: Find an attribute, and the cache entry which holds a copy of
+// its text, if there is one.
+//
+static const char *cache_lookup(Aname *nam, size_t *pLen, PCENT_HDR *ppEntry)
 {
+    *ppEntry = NULL;
     if (  nam == (Aname *) 0
        || !cache_initted)
     {
@@ -264,6 +286,7 @@ const char *cache_get(Aname *nam, size_t *pLen)
             if (sizeof(CENT_HDR) < pCacheEntry->nSize)
             {
                 *pLen = pCacheEntry->nSize - sizeof(CENT_HDR);
+                *ppEntry = pCacheEntry;
                 return (char *)(pCacheEntry+1);
             }
             else
@@ -296,6 +319,8 @@ const char *cache_get(Aname *nam, size_t *pLen)
                 {
                     pCacheEntry->attrKey = *nam;
                     pCacheEntry->nSize = nLength + sizeof(CENT_HDR);
+                    pCacheEntry->nPins = 0;
+                    pCacheEntry->bRetired = false;
                     CacheSize += pCacheEntry->nSize;
                     memcpy((char *)(pCacheEntry+1), TempRecord.attrText, nLength);
                     ADD_ENTRY(pCacheEntry);
@@ -303,6 +328,10 @@ const char *cache_get(Aname *nam, size_t *pLen)
                         &mudstate.acache_htab);
 
                     TrimCache();
+                    if (pCacheHead == pCacheEntry)
+                    {
+                        *ppEntry = pCacheEntry;
+                    }
                 }
             }
             return TempRecord.attrText;
@@ -321,6 +350,8 @@ const char *cache_get(Aname *nam, size_t *pLen)
         {
             pCacheEntry->attrKey = *nam;
             pCacheEntry->nSize = sizeof(CENT_HDR);
+            pCacheEntry->nPins = 0;
+            pCacheEntry->bRetired = false;
             CacheSize += pCacheEntry->nSize;
             ADD_ENTRY(pCacheEntry);
             hashaddLEN(nam, sizeof(Aname), pCacheEntry,
@@ -334,6 +365,42 @@ const char *cache_get(Aname *nam, size_t *pLen)
     return NULL;
 }
 
+const char *cache_get(Aname *nam, size_t *pLen)
+{
+    PCENT_HDR pEntry;
+    return cache_lookup(nam, pLen, &pEntry);
+}
+
+// cache_pin: As cache_get, but the text stays where it is until
+// cache_unpin(*ppPin), even if the attribute is changed or leaves the cache.
+// If the text could not be kept in the cache, *ppPin is NULL and the text
+// is only good until the next call into the cache.
+//
+const char *cache_pin(Aname *nam, size_t *pLen, void **ppPin)
+{
+    PCENT_HDR pEntry;
+    const char *pText = cache_lookup(nam, pLen, &pEntry);
+    if (  pText
+       && pEntry)
+    {
+        pEntry->nPins++;
+        *ppPin = pEntry;
+        return (char *)(pEntry+1);
+    }
+    *ppPin = NULL;
+    return pText;
+}
+
+void cache_unpin(void *pPin)
+{
+    PCENT_HDR pEntry = (PCENT_HDR)pPin;
+    pEntry->nPins--;
+    if (  0 == pEntry->nPins
+       && pEntry->bRetired)
+    {
+        MEMFREE(pEntry);
+    }
+}
 
 // cache_put no longer frees the pointer.
 //
@@ -416,7 +483,7 @@ bool cache_put(Aname *nam, const char *value, size_t len)
             REMOVE_ENTRY(pCacheEntry);
             CacheSize -= pCacheEntry->nSize;
             hashdeleteLEN((char *)nam, sizeof(Aname), &mudstate.acache_htab);
-            MEMFREE(pCacheEntry);
+            FREE_ENTRY(pCacheEntry);
             pCacheEntry = NULL;
         }
 
@@ -428,6 +495,8 @@ bool cache_put(Aname *nam, const char *value, size_t len)
         {
             pCacheEntry->attrKey = *nam;
             pCacheEntry->nSize = nSizeOfEntry;
+            pCacheEntry->nPins = 0;
+            pCacheEntry->bRetired = false;
             CacheSize += pCacheEntry->nSize;
             memcpy((char *)(pCacheEntry+1), TempRecord.attrText, len);
             ADD_ENTRY(pCacheEntry);
@@ -494,7 +563,7 @@ void cache_del(Aname *nam)
             REMOVE_ENTRY(pCacheEntry);
             CacheSize -= pCacheEntry->nSize;;
             hashdeleteLEN((char *)nam, sizeof(Aname), &mudstate.acache_htab);
-            MEMFREE(pCacheEntry);
+            FREE_ENTRY(pCacheEntry);
             pCacheEntry = NULL;
         }
     }
@@ -13,6 +13,8 @@ typedef struct Aname
 } Aname;
 
 extern const char *cache_get(Aname *nam, size_t *pLen);
+extern const char *cache_pin(Aname *nam, size_t *pLen, void **ppPin);
+extern void cache_unpin(void *pPin);
 extern bool cache_put(Aname *nam, const char *obj, size_t len);
 extern int  cache_init(const char *game_dir_file, const char *game_pag_file,
     int nCachePages);
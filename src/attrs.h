@@ -206,7 +206,9 @@
 #define A_LMAIL     225 // Lock who may @mail you
 #define A_LOPEN     226 // Lock for controlling OPEN_OK locations
 
-// 227 - 235 unused
+#define A_QUEUEWEIGHT 227 // Share of queue time, against other players
+
+// 228 - 235 unused
 
 #if defined(FIRANMUX)
 #define A_COLOR      236 /* Color of name of object in look commands */
@@ -65,6 +65,16 @@
 #define HAVE_SYS_WAIT_H 1
 /* Define if sys/select.h exists */
 #define HAVE_SYS_SELECT_H 1
+/* Define if sys/epoll.h exists */
+#define HAVE_SYS_EPOLL_H 1
+/* Define if zlib.h exists and libz is linked */
+#define HAVE_ZLIB_H 1
+/* Define if accept4() exists */
+#define HAVE_ACCEPT4 1
+/* Define if sys/eventfd.h exists */
+#define HAVE_SYS_EVENTFD_H 1
+/* Define if pthread.h exists and libpthread is linked */
+#define HAVE_PTHREAD_H 1
 /* Define if sys/rusage.h exists */
 /* #undef HAVE_SYS_RUSAGE_H */
 /* Define if Big Endian */
@@ -17,6 +17,9 @@
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif // HAVE_SYS_EPOLL_H
 #endif // !WIN32
 #include <signal.h>
 #include <errno.h>
@@ -29,6 +32,8 @@
 #include "printutils.h"
 #include "errno.h"
 #include "Websockets.h"
+#include "iothread.h"
+#include "hostcache.h"
 
 #ifdef SOLARIS
 extern const int _sys_nsig;
@@ -45,6 +50,8 @@ static void SiteMonSend(SOCKET, const char *, DESC *, const char *);
 static DESC *initializesock(SOCKET, struct sockaddr_in *);
 static DESC *new_connection(PortInfo *Port, int *piError);
 static bool process_input(DESC *);
+static bool process_received(DESC *d, char *buf, int got);
+static void Task_HandshakeTimeout(void *arg_voidptr, int arg_Integer);
 static int make_nonblocking(SOCKET s);
 
 #ifdef WIN32
@@ -59,6 +66,27 @@ pid_t game_pid;
 pid_t sqlslave_pid = 0;
 int sqlslave_socket = INVALID_SOCKET;
 #endif // QUERY_SLAVE
+
+#ifdef HAVE_SYS_EPOLL_H
+// The epoll_event data carries either a DESC pointer or, for the listening
+// ports and the slave sockets, a tagged file descriptor. DESCs come from the
+// descriptor pool and are always 8-byte aligned, so the low bit is free to
+// tell the two apart.
+//
+#define EPOLL_SRC_PORT      1
+#define EPOLL_SRC_SLAVE     2
+#define EPOLL_SRC_SQLSLAVE  3
+#define EPOLL_SRC_IOTHREAD  4
+#define EPOLL_TAG(src, fd)  ((((UINT64)(fd)) << 8) | ((src) << 1) | 1)
+#define EPOLL_IS_TAG(u)     (((u) & 1) != 0)
+#define EPOLL_TAG_SRC(u)    ((int)(((u) >> 1) & 0x7F))
+#define EPOLL_TAG_FD(u)     ((SOCKET)((u) >> 8))
+#define EPOLL_MAX_EVENTS    256
+
+static int epoll_fd = INVALID_SOCKET;
+static void EpollWatch(SOCKET s, UINT64 tag, unsigned int events);
+static void EpollUnwatch(SOCKET s);
+#endif // HAVE_SYS_EPOLL_H
 #endif // WIN32
 #ifdef WIN32
 
@@ -464,6 +492,9 @@ static int get_slave_result(void)
 #else // WIN32
 void CleanUpSlaveSocket(void) {
 	if (!IS_INVALID_SOCKET(slave_socket)) {
+#ifdef HAVE_SYS_EPOLL_H
+		EpollUnwatch(slave_socket);
+#endif // HAVE_SYS_EPOLL_H
 		shutdown(slave_socket, SD_BOTH);
 		if (SOCKET_CLOSE(slave_socket) == 0) {
 			DebugTotalSockets--;
@@ -485,6 +516,9 @@ void CleanUpSQLSlaveSocket(void)
 {
 	if (!IS_INVALID_SOCKET(sqlslave_socket))
 	{
+#ifdef HAVE_SYS_EPOLL_H
+		EpollUnwatch(sqlslave_socket);
+#endif // HAVE_SYS_EPOLL_H
 		shutdown(sqlslave_socket, SD_BOTH);
 		if (SOCKET_CLOSE(sqlslave_socket) == 0)
 		{
@@ -609,6 +643,10 @@ void boot_sqlslave(dbref executor, dbref caller, dbref enactor, int)
 	{
 		maxd = sqlslave_socket + 1;
 	}
+#ifdef HAVE_SYS_EPOLL_H
+	EpollWatch(sqlslave_socket, EPOLL_TAG(EPOLL_SRC_SQLSLAVE, sqlslave_socket),
+			EPOLLIN | EPOLLET);
+#endif // HAVE_SYS_EPOLL_H
 
 	STARTLOG(LOG_ALWAYS, "NET", "QUERY");
 	log_text("SQL slave started on fd ");
@@ -705,7 +743,11 @@ void boot_slave(dbref executor, dbref caller, dbref enactor, int) {
 		for (i = 3; i < maxfds; i++) {
 			mux_close(i);
 		}
-		execlp("bin/slave", "slave", NULL);
+		if (mudconf.slave_hosts_file[0] != '\0') {
+			execlp("bin/slave", "slave", mudconf.slave_hosts_file, NULL);
+		} else {
+			execlp("bin/slave", "slave", NULL);
+		}
 		_exit(1);
 	}
 	close(sv[1]);
@@ -720,6 +762,10 @@ void boot_slave(dbref executor, dbref caller, dbref enactor, int) {
 	if (!IS_INVALID_SOCKET(slave_socket) && maxd <= slave_socket) {
 		maxd = slave_socket + 1;
 	}
+#ifdef HAVE_SYS_EPOLL_H
+	EpollWatch(slave_socket, EPOLL_TAG(EPOLL_SRC_SLAVE, slave_socket),
+			EPOLLIN | EPOLLET);
+#endif // HAVE_SYS_EPOLL_H
 
 	STARTLOG(LOG_ALWAYS, "NET", "SLAVE");
 	log_text("DNS lookup slave started on fd ");
@@ -818,51 +864,64 @@ static int get_slave_result(void) {
 	char *os = alloc_lbuf("slave_os");
 	char *userid = alloc_lbuf("slave_userid");
 	char *host = alloc_lbuf("slave_host");
-	char *p;
-	if (sscanf(buf, "%s %s", host, token) != 2) {
-		goto Done;
-	}
-	p = strchr(buf, '\n');
-	if (!p) {
-		goto Done;
-	}
-	*p = '\0';
-	if (mudconf.use_hostname) {
-		for (d = descriptor_list; d; d = d->next) {
-			if (strcmp(d->addr, host) != 0) {
-				continue;
-			}
 
-			strncpy(d->addr, token, 50);
-			d->addr[50] = '\0';
-			if (d->player != 0) {
-				if (d->username[0]) {
+	// Each line answers one lookup: a hostname line has two fields, and an
+	// ident line is the ident server's reply, which has colons.
+	//
+	char *pLine = buf;
+	while (*pLine) {
+		char *p = strchr(pLine, '\n');
+		if (!p) {
+			break;
+		}
+		*p = '\0';
+
+		struct in_addr addr;
+		if (!strchr(pLine, ':')) {
+			if (sscanf(pLine, "%s %s", host, token) == 2
+					&& mudconf.use_hostname) {
+				addr.s_addr = inet_addr(host);
+				hostcache_store_name(addr, token);
+				for (d = descriptor_list; d; d = d->next) {
+					if (strcmp(d->addr, host) != 0) {
+						continue;
+					}
+
+					strncpy(d->addr, token, 50);
+					d->addr[50] = '\0';
+					if (d->player != 0) {
+						if (d->username[0]) {
+							atr_add_raw(d->player, A_LASTSITE,
+									tprintf("%s@%s", d->username, d->addr));
+						} else {
+							atr_add_raw(d->player, A_LASTSITE, d->addr);
+						}
+						atr_add_raw(d->player, A_LASTIP,
+								inet_ntoa((d->address).sin_addr));
+					}
+				}
+			}
+		} else if (sscanf(pLine, "%s %d , %d : %s : %s : %s", host,
+				&remote_port, &local_port, token, os, userid) == 6) {
+			for (d = descriptor_list; d; d = d->next) {
+				if (ntohs((d->address).sin_port) != remote_port)
+					continue;
+				strncpy(d->username, userid, 10);
+				d->username[10] = '\0';
+				if (d->player != 0) {
 					atr_add_raw(d->player, A_LASTSITE,
 							tprintf("%s@%s", d->username, d->addr));
-				} else {
-					atr_add_raw(d->player, A_LASTSITE, d->addr);
 				}
-				atr_add_raw(d->player, A_LASTIP,
-						inet_ntoa((d->address).sin_addr));
 			}
+		} else if (sscanf(pLine, "%s %d , %d : %s : %s", host, &remote_port,
+				&local_port, token, os) == 5 && strcmp(token, "ERROR") == 0
+				&& strcmp(os, "X-UNREACHABLE") == 0) {
+			addr.s_addr = inet_addr(host);
+			hostcache_store_noident(addr);
 		}
+		pLine = p + 1;
 	}
 
-	if (sscanf(p + 1, "%s %d , %d : %s : %s : %s", host, &remote_port,
-			&local_port, token, os, userid) != 6) {
-		goto Done;
-	}
-	for (d = descriptor_list; d; d = d->next) {
-		if (ntohs((d->address).sin_port) != remote_port)
-			continue;
-		strncpy(d->username, userid, 10);
-		d->username[10] = '\0';
-		if (d->player != 0) {
-			atr_add_raw(d->player, A_LASTSITE,
-					tprintf("%s@%s", d->username, d->addr));
-		}
-	}
-	Done:
 	free_lbuf(buf);
 	free_lbuf(token);
 	free_lbuf(os);
@@ -986,6 +1045,16 @@ static void make_socket(PortInfo *Port) {
 			< 0) {
 		log_perror("NET", "FAIL", NULL, "setsockopt");
 	}
+#ifdef SO_REUSEPORT
+	// Several sockets listening on one port each get their own accept
+	// queue, and the kernel spreads new connections across them.
+	//
+	if (1 < mudconf.port_listeners
+			&& setsockopt(s, SOL_SOCKET, SO_REUSEPORT, (char *) &opt,
+					sizeof(opt)) < 0) {
+		log_perror("NET", "FAIL", NULL, "setsockopt SO_REUSEPORT");
+	}
+#endif // SO_REUSEPORT
 
 	server.sin_family = AF_INET;
 	server.sin_addr.s_addr = INADDR_ANY;
@@ -1003,6 +1072,11 @@ static void make_socket(PortInfo *Port) {
 	}
 
 	listen(s, SOMAXCONN);
+
+	// Connections are accepted until none are left, so accept() must not
+	// wait for the next one.
+	//
+	make_nonblocking(s);
 	Port->socket = s;
 	Log.tinyprintf("Listening on port %d, socket: %d" ENDLINE, Port->port, Port->socket);
 }
@@ -1043,10 +1117,23 @@ void SetupPorts(int *pnPorts, PortInfo aPorts[], IntArray *pia) {
 				}
 				aPorts[k].port = 0;
 				aPorts[k].socket = INVALID_SOCKET;
+
+				// Look at whatever was moved into this slot.
+				//
+				i--;
 			}
 		}
 	}
 
+	// With SO_REUSEPORT, each port may have several listening sockets.
+	//
+	int nListeners = 1;
+#ifdef SO_REUSEPORT
+	if (1 < mudconf.port_listeners) {
+		nListeners = mudconf.port_listeners;
+	}
+#endif // SO_REUSEPORT
+
 	// Any requested port which does not appear in the existing open set
 	// of ports should be opened.
 	//
@@ -1059,7 +1146,8 @@ void SetupPorts(int *pnPorts, PortInfo aPorts[], IntArray *pia) {
 			}
 		}
 
-		if (!bFound) {
+		for (int n = 0; !bFound && n < nListeners
+				&& *pnPorts < MAX_LISTEN_PORTS; n++) {
 			k = *pnPorts;
 			aPorts[k].port = pia->pi[j];
 			make_socket(&aPorts[k]);
@@ -1404,10 +1492,79 @@ void shovecharsNT(int nPorts, PortInfo aPorts[])
 }
 
 #else // WIN32
-void shovechars(int nPorts, PortInfo aPorts[]) {
+/*! \brief Whether a connection is waiting to be accepted on a port.
+ *
+ * \param Port      Listening port.
+ * \return          True if accept() would not block.
+ */
+
+static bool connection_waiting(PortInfo *Port) {
+	fd_set input_set;
+	FD_ZERO(&input_set);
+	FD_SET(Port->socket, &input_set);
+	struct timeval timeout;
+	timeout.tv_sec = 0;
+	timeout.tv_usec = 0;
+	return 0 < select(Port->socket + 1, &input_set, NULL, NULL, &timeout);
+}
+
+/*! \brief Admit the connections waiting on a listening port.
+ *
+ * After a network outage, players tend to reconnect all at once. Rather
+ * than take one connection per pass of the main loop, take as many as are
+ * waiting, up to what is left of the budget for this pass. Whatever is
+ * left over keeps the port readable and is taken on the next pass, so a
+ * storm of connections cannot starve the players already connected.
+ *
+ * \param Port      Listening port which is readable.
+ * \param pnBudget  Connections which may still be admitted this pass.
+ * \param nAvail    Descriptors which may be in use at once.
+ * \return          None.
+ */
+
+static void accept_connections(PortInfo *Port, int *pnBudget,
+		unsigned int nAvail) {
+	for (;;) {
+		if (*pnBudget <= 0 || nAvail <= ndescriptors) {
+			// Count the pass only if it leaves a connection waiting.
+			//
+			if (connection_waiting(Port)) {
+				mudstate.nConnDeferred++;
+			}
+			return;
+		}
+		(*pnBudget)--;
+
+		int iSocketError;
+		DESC *newd = new_connection(Port, &iSocketError);
+		if (!newd) {
+			if (0 == iSocketError) {
+				// Refused by site. Look for the next one.
+				//
+				continue;
+			}
+			if (iSocketError != SOCKET_EWOULDBLOCK
+#ifdef SOCKET_EAGAIN
+					&& iSocketError != SOCKET_EAGAIN
+#endif // SOCKET_EAGAIN
+					&& iSocketError != SOCKET_EINTR) {
+				log_perror("NET", "FAIL", NULL, "new_connection");
+			}
+			return;
+		}
+
+		if (!IS_INVALID_SOCKET(newd->getSocket())
+				&& maxd <= newd->getSocket()) {
+			maxd = newd->getSocket() + 1;
+		}
+		UpdateDescEvents(newd);
+	}
+}
+
+static void shovechars_select(int nPorts, PortInfo aPorts[]) {
 	fd_set input_set, output_set;
 	int found;
-	DESC *d, *dnext, *newd;
+	DESC *d, *dnext;
 	unsigned int avail_descriptors;
 	int maxfds;
 	int i;
@@ -1551,54 +1708,547 @@ void shovechars(int nPorts, PortInfo aPorts[]) {
 			} else if (iSocketError != SOCKET_EINTR) {
 				log_perror("NET", "FAIL", "checking for activity", "select");
 			}
-			continue;
+			continue;
+		}
+
+		// Get usernames and hostnames.
+		//
+		if (!IS_INVALID_SOCKET(slave_socket) && CheckInput(slave_socket)) {
+			while (get_slave_result() == 0) {
+				; // Nothing.
+			}
+		}
+
+#ifdef QUERY_SLAVE
+		// Get result sets from sqlslave.
+		//
+		if ( !IS_INVALID_SOCKET(sqlslave_socket)
+				&& CheckInput(sqlslave_socket))
+		{
+			while (get_sqlslave_result() == 0)
+			{
+				; // Nothing.
+			}
+		}
+#endif // QUERY_SLAVE
+		// Check for new connection requests.
+		//
+
+		int nAdmit = mudconf.accept_budget;
+		for (i = 0; i < nPorts; i++) {
+			if (CheckInput(aPorts[i].socket)) {
+				accept_connections(aPorts + i, &nAdmit, avail_descriptors);
+			}
+		}
+
+		// Check for activity on user sockets.
+		//
+		DESC_SAFEITER_ALL(d, dnext)
+		{
+			// Process input from sockets with pending input.
+			//
+			if (CheckInput(d->getSocket())) {
+				// Undo autodark
+				//
+				if (d->flags & DS_AUTODARK) {
+					// Clear the DS_AUTODARK on every related session.
+					//
+					DESC *d1;
+					DESC_ITER_PLAYER(d->player, d1)
+					{
+						d1->flags &= ~DS_AUTODARK;
+					}
+					db[d->player].fs.word[FLAG_WORD1] &= ~DARK;
+				}
+
+				// Process received data.
+				//
+				if (!process_input(d)) {
+					shutdownsock(d, R_SOCKDIED);
+					continue;
+				}
+			}
+
+			// Process output for sockets with pending output.
+			//
+			if (CheckOutput(d->getSocket())) {
+				process_output(d, true);
+			}
+		}
+	}
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+
+/*! \brief Register a non-player socket with the epoll set.
+ *
+ * \param s       Socket to watch.
+ * \param tag     EPOLL_TAG() identifying what the socket is.
+ * \param events  epoll events of interest.
+ * \return        None.
+ */
+
+static void EpollWatch(SOCKET s, UINT64 tag, unsigned int events) {
+	if (IS_INVALID_SOCKET(epoll_fd) || IS_INVALID_SOCKET(s)) {
+		return;
+	}
+
+	struct epoll_event ev;
+	ev.events = events;
+	ev.data.u64 = tag;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, s, &ev) < 0 && errno != EEXIST) {
+		log_perror("NET", "FAIL", "EpollWatch", "epoll_ctl");
+	}
+}
+
+/*! \brief Remove a socket from the epoll set.
+ *
+ * Closing a socket only drops it from the set once every copy of the
+ * descriptor is closed, and the slave children briefly hold copies of
+ * everything, so sockets are always removed explicitly before closing.
+ *
+ * \param s       Socket to forget.
+ * \return        None.
+ */
+
+static void EpollUnwatch(SOCKET s) {
+	if (IS_INVALID_SOCKET(epoll_fd) || IS_INVALID_SOCKET(s)) {
+		return;
+	}
+
+	struct epoll_event ev;
+	ev.events = 0;
+	ev.data.u64 = 0;
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, s, &ev);
+}
+
+#ifdef IO_THREADS
+// Descriptors with output queued since the last pass of the main loop.
+//
+static std::vector<DESC *> io_pending;
+
+/*! \brief Hand a descriptor's queued output to its I/O thread.
+ *
+ * The blocks still count toward output_size until the thread reports them
+ * written.
+ *
+ * \param d       Player connection.
+ * \return        None.
+ */
+
+static void IoHandOff(DESC *d) {
+#ifdef HAVE_ZLIB_H
+	if (NULL != d->mccp) {
+		mccp_compress(d, Z_SYNC_FLUSH);
+		d->mccp->done = NULL;
+	}
+#endif // HAVE_ZLIB_H
+	if (NULL == d->output_head) {
+		return;
+	}
+	mudstate.nOutputFlushes++;
+
+	IOMSG msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.op = IO_WRITE;
+	msg.d = d;
+	msg.conn = d->io_conn;
+	msg.head = d->output_head;
+	io_send(d->io_thread, msg);
+	d->output_head = NULL;
+	d->output_tail = NULL;
+}
+
+/*! \brief Hand off everything queued during this pass of the main loop.
+ *
+ * Output is collected per pass rather than sent as it is queued, so a
+ * command which produces many lines costs one message and one wakeup.
+ *
+ * \return        None.
+ */
+
+static void IoFlushPending(void) {
+	for (size_t i = 0; i < io_pending.size(); i++) {
+		DESC *d = io_pending[i];
+		d->io_flush = false;
+		IoHandOff(d);
+	}
+	io_pending.clear();
+	io_flush();
+}
+
+/*! \brief Bring a descriptor's I/O thread in line with its queues.
+ *
+ * The counterpart of the epoll registration below: attach the socket on
+ * first sight, let the thread read again once the last input has been
+ * taken, and note queued output for the end of the pass.
+ *
+ * \param d       Player connection.
+ * \return        None.
+ */
+
+static void IoUpdateDesc(DESC *d) {
+	if (d->io_closing || IS_INVALID_SOCKET(d->getSocket())) {
+		return;
+	}
+
+	if (NULL == d->io_conn) {
+		d->io_conn = io_attach(d, d->getSocket(), &d->io_thread);
+		d->io_paused = false;
+	}
+
+	if (d->io_paused && NULL == d->input_head) {
+		IOMSG msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.op = IO_RESUME;
+		msg.d = d;
+		msg.conn = d->io_conn;
+		io_send(d->io_thread, msg);
+		d->io_paused = false;
+	}
+
+	if (NULL != d->output_head && !d->io_flush) {
+		d->io_flush = true;
+		io_pending.push_back(d);
+	}
+}
+
+/*! \brief Finish closing a descriptor once its I/O thread lets go of it.
+ *
+ * \param d       Player connection, already unlinked by shutdownsock().
+ * \param head    Output the thread could not write.
+ * \return        None.
+ */
+
+static void IoDetached(DESC *d, TBLOCK *head) {
+	while (NULL != head) {
+		TBLOCK *tp = head;
+		head = head->hdr.nxt;
+		free_tblock(tp);
+	}
+
+	shutdown(d->getSocket(), SD_BOTH);
+	if (SOCKET_CLOSE(d->getSocket()) == 0) {
+		DebugTotalSockets--;
+	}
+	d->setSocket(INVALID_SOCKET, NORMAL);
+	d->cleanup();
+	d->io_conn = NULL;
+	freeqs(d);
+	free_desc(d);
+}
+
+/*! \brief Act on everything the I/O threads have sent.
+ *
+ * \return        None.
+ */
+
+static void IoDispatch(void) {
+	io_clear_event();
+
+	IOMSG msg;
+	while (io_receive(&msg)) {
+		DESC *d = msg.d;
+		switch (msg.op) {
+		case IO_INPUT:
+			if (!d->io_closing) {
+				d->io_paused = true;
+
+				// Undo autodark
+				//
+				if (d->flags & DS_AUTODARK) {
+					DESC *d1;
+					DESC_ITER_PLAYER(d->player, d1)
+					{
+						d1->flags &= ~DS_AUTODARK;
+					}
+					db[d->player].fs.word[FLAG_WORD1] &= ~DARK;
+				}
+
+				if (!process_received(d, msg.buf, int(msg.n))) {
+					shutdownsock(d, R_SOCKDIED);
+				} else {
+					UpdateDescEvents(d);
+				}
+			}
+			io_free_input(msg.buf);
+			break;
+
+		case IO_SENT:
+			mudstate.nOutputWrites += msg.nWrites;
+			mudstate.nOutputBytes += msg.n;
+			d->output_size -= msg.n;
+			while (NULL != msg.head) {
+				TBLOCK *tp = msg.head;
+				msg.head = tp->hdr.nxt;
+				retire_tblock(d, tp);
+			}
+			break;
+
+		case IO_CLOSED:
+			if (!d->io_closing) {
+				shutdownsock(d, R_SOCKDIED);
+			}
+			break;
+
+		case IO_DETACHED:
+			IoDetached(d, msg.head);
+			break;
+		}
+	}
+}
+
+/*! \brief Stop the I/O threads, letting them write what they were given.
+ *
+ * Used on the way down and before @restart, after which the game thread
+ * owns the sockets again.
+ *
+ * \return        None.
+ */
+
+void IoShutdown(void) {
+	if (io_running()) {
+		IoFlushPending();
+		io_stop();
+		IoDispatch();
+	}
+}
+#endif // IO_THREADS
+
+/*! \brief Bring a descriptor's epoll registration in line with its queues.
+ *
+ * Like the select() loop, we only read from a socket when it has no
+ * commands waiting, and only ask for writability when there is queued
+ * output. This is called when either queue changes between empty and
+ * non-empty, so epoll_ctl() is only issued on those transitions. A socket
+ * which wants neither is removed from the set altogether.
+ *
+ * \param d       Player connection.
+ * \return        None.
+ */
+
+void UpdateDescEvents(DESC *d) {
+#ifdef IO_THREADS
+	if (io_running()) {
+		IoUpdateDesc(d);
+		return;
+	}
+#endif // IO_THREADS
+	if (IS_INVALID_SOCKET(epoll_fd) || IS_INVALID_SOCKET(d->getSocket())) {
+		return;
+	}
+
+	unsigned int want = 0;
+	if (NULL == d->input_head) {
+		want |= EPOLLIN;
+	}
+	if (NULL != d->output_head) {
+		want |= EPOLLOUT;
+	}
+	if (want == d->epoll_events) {
+		return;
+	}
+
+	int op;
+	if (0 == want) {
+		op = EPOLL_CTL_DEL;
+	} else if (0 == d->epoll_events) {
+		op = EPOLL_CTL_ADD;
+	} else {
+		op = EPOLL_CTL_MOD;
+	}
+
+	struct epoll_event ev;
+	ev.events = want;
+	ev.data.u64 = 0;
+	ev.data.ptr = d;
+	if (epoll_ctl(epoll_fd, op, d->getSocket(), &ev) < 0) {
+		log_perror("NET", "FAIL", "UpdateDescEvents", "epoll_ctl");
+		return;
+	}
+	d->epoll_events = want;
+}
+
+/*! \brief Create the epoll set and register everything opened so far.
+ *
+ * Ports, the slave sockets, and descriptors restored by @restart all exist
+ * before the main loop starts. Anything created later registers itself.
+ *
+ * \param nPorts  Number of listening ports.
+ * \param aPorts  Listening ports.
+ * \return        true if epoll is available.
+ */
+
+static bool EpollInit(int nPorts, PortInfo aPorts[]) {
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (IS_INVALID_SOCKET(epoll_fd)) {
+		log_perror("NET", "FAIL", "falling back to select()", "epoll_create1");
+		return false;
+	}
+
+	for (int i = 0; i < nPorts; i++) {
+		EpollWatch(aPorts[i].socket, EPOLL_TAG(EPOLL_SRC_PORT, aPorts[i].socket),
+				EPOLLIN);
+	}
+	EpollWatch(slave_socket, EPOLL_TAG(EPOLL_SRC_SLAVE, slave_socket),
+			EPOLLIN | EPOLLET);
+#ifdef QUERY_SLAVE
+	EpollWatch(sqlslave_socket, EPOLL_TAG(EPOLL_SRC_SQLSLAVE, sqlslave_socket),
+			EPOLLIN | EPOLLET);
+#endif // QUERY_SLAVE
+
+#ifdef IO_THREADS
+	if (0 < mudconf.io_threads && io_start(mudconf.io_threads)) {
+		EpollWatch(io_event_fd(), EPOLL_TAG(EPOLL_SRC_IOTHREAD, io_event_fd()),
+				EPOLLIN);
+	}
+#endif // IO_THREADS
+
+	DESC *d;
+	DESC_ITER_ALL(d)
+	{
+		UpdateDescEvents(d);
+	}
+	return true;
+}
+
+static void shovechars_epoll(int nPorts, PortInfo aPorts[]) {
+	struct epoll_event events[EPOLL_MAX_EVENTS];
+	DESC *d;
+	unsigned int avail_descriptors;
+	int maxfds;
+	int i, j;
+
+	mudstate.debug_cmd = "< shovechars >";
+
+	CLinearTimeAbsolute ltaLastSlice;
+	ltaLastSlice.GetUTC();
+
+#ifdef HAVE_GETDTABLESIZE
+	maxfds = getdtablesize();
+#else // HAVE_GETDTABLESIZE
+	maxfds = sysconf(_SC_OPEN_MAX);
+#endif // HAVE_GETDTABLESIZE
+	avail_descriptors = maxfds - 7;
+
+	// The ports are registered by EpollInit().
+	//
+	bool bPortsWatched = true;
+
+	while (mudstate.shutdown_flag == false) {
+		CLinearTimeAbsolute ltaCurrent;
+		ltaCurrent.GetUTC();
+		update_quotas(ltaLastSlice, ltaCurrent);
+
+		// Check the scheduler.
+		//
+		scheduler.RunTasks(ltaCurrent);
+		CLinearTimeAbsolute ltaWakeUp;
+		if (scheduler.WhenNext(&ltaWakeUp)) {
+			if (ltaWakeUp < ltaCurrent) {
+				ltaWakeUp = ltaCurrent;
+			}
+		} else {
+			CLinearTimeDelta ltd = time_30m;
+			ltaWakeUp = ltaCurrent + ltd;
+		}
+
+		if (mudstate.shutdown_flag) {
+			break;
+		}
+
+		// Listen for new connections only while there are free descriptors.
+		//
+		bool bWantPorts = (ndescriptors < avail_descriptors);
+		if (bWantPorts != bPortsWatched) {
+			for (i = 0; i < nPorts; i++) {
+				if (bWantPorts) {
+					EpollWatch(aPorts[i].socket,
+							EPOLL_TAG(EPOLL_SRC_PORT, aPorts[i].socket), EPOLLIN);
+				} else {
+					EpollUnwatch(aPorts[i].socket);
+				}
+			}
+			bPortsWatched = bWantPorts;
 		}
 
-		// Get usernames and hostnames.
+#ifdef IO_THREADS
+		IoFlushPending();
+#endif // IO_THREADS
+
+		// Wait for something to happen. Round the timeout up so that we do
+		// not wake up just short of the next task and spin.
 		//
-		if (!IS_INVALID_SOCKET(slave_socket) && CheckInput(slave_socket)) {
-			while (get_slave_result() == 0) {
-				; // Nothing.
+		CLinearTimeDelta ltdTimeout = ltaWakeUp - ltaCurrent;
+		int msTimeout = static_cast<int>((ltdTimeout.ReturnMicroseconds() + 999)
+				/ 1000);
+		int found = epoll_wait(epoll_fd, events, EPOLL_MAX_EVENTS, msTimeout);
+
+		if (found < 0) {
+			if (errno != EINTR) {
+				log_perror("NET", "FAIL", "checking for activity", "epoll_wait");
 			}
+			continue;
 		}
 
+		int nAdmit = mudconf.accept_budget;
+		for (i = 0; i < found; i++) {
+			UINT64 u = events[i].data.u64;
+			if (EPOLL_IS_TAG(u)) {
+				switch (EPOLL_TAG_SRC(u)) {
+				case EPOLL_SRC_SLAVE:
+
+					// Get usernames and hostnames.
+					//
+					while (get_slave_result() == 0) {
+						; // Nothing.
+					}
+					break;
+
 #ifdef QUERY_SLAVE
-		// Get result sets from sqlslave.
-		//
-		if ( !IS_INVALID_SOCKET(sqlslave_socket)
-				&& CheckInput(sqlslave_socket))
-		{
-			while (get_sqlslave_result() == 0)
-			{
-				; // Nothing.
-			}
-		}
+				case EPOLL_SRC_SQLSLAVE:
+
+					// Get result sets from sqlslave.
+					//
+					while (get_sqlslave_result() == 0)
+					{
+						; // Nothing.
+					}
+					break;
 #endif // QUERY_SLAVE
-		// Check for new connection requests.
-		//
 
-		for (i = 0; i < nPorts; i++) {
-			if (CheckInput(aPorts[i].socket)) {
-				int iSocketError;
-				newd = new_connection(aPorts + i, &iSocketError);
-				if (!newd) {
-					if (iSocketError && iSocketError != SOCKET_EINTR) {
-						log_perror("NET", "FAIL", NULL, "new_connection");
+#ifdef IO_THREADS
+				case EPOLL_SRC_IOTHREAD:
+
+					// Input, written output, and closed sockets.
+					//
+					IoDispatch();
+					break;
+#endif // IO_THREADS
+
+				case EPOLL_SRC_PORT:
+
+					// Check for new connection requests.
+					//
+					for (j = 0; j < nPorts; j++) {
+						if (aPorts[j].socket == EPOLL_TAG_FD(u)) {
+							accept_connections(aPorts + j, &nAdmit,
+									avail_descriptors);
+							break;
+						}
 					}
-				} else if (!IS_INVALID_SOCKET(newd->getSocket())
-						&& maxd <= newd->getSocket()) {
-					maxd = newd->getSocket() + 1;
+					break;
 				}
+				continue;
 			}
-		}
 
-		// Check for activity on user sockets.
-		//
-		DESC_SAFEITER_ALL(d, dnext)
-		{
+			d = (DESC *) events[i].data.ptr;
+			unsigned int ev = events[i].events;
+
 			// Process input from sockets with pending input.
 			//
-			if (CheckInput(d->getSocket())) {
+			if ((d->epoll_events & EPOLLIN)
+					&& (ev & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
 				// Undo autodark
 				//
 				if (d->flags & DS_AUTODARK) {
@@ -1622,48 +2272,60 @@ void shovechars(int nPorts, PortInfo aPorts[]) {
 
 			// Process output for sockets with pending output.
 			//
-			if (CheckOutput(d->getSocket())) {
+			if (d->output_head && (ev & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
 				process_output(d, true);
 			}
 		}
 	}
 }
 
+#endif // HAVE_SYS_EPOLL_H
+
+void shovechars(int nPorts, PortInfo aPorts[]) {
+#ifdef HAVE_SYS_EPOLL_H
+	if (EpollInit(nPorts, aPorts)) {
+		shovechars_epoll(nPorts, aPorts);
+		return;
+	}
+#endif // HAVE_SYS_EPOLL_H
+	shovechars_select(nPorts, aPorts);
+}
+
 #endif // WIN32
 
 
 SOCKET makeConnection(const int SOCKET_IN, const ConnectionType& TYPE,
 		struct sockaddr * pSocketOut) {
 	socklen_t addr_len = sizeof(struct sockaddr);
+#ifdef HAVE_ACCEPT4
+	// The socket comes back non-blocking, saving two fcntl() calls. It must
+	// stay open across @restart, so it is not close-on-exec.
+	//
+	SOCKET baseSocket = accept4(SOCKET_IN, pSocketOut, &addr_len,
+			SOCK_NONBLOCK);
+#else // HAVE_ACCEPT4
 	SOCKET baseSocket = accept(SOCKET_IN, pSocketOut, &addr_len);
+#endif // HAVE_ACCEPT4
 
 	if (IS_INVALID_SOCKET(baseSocket)) {
-		Log.tinyprintf("Accept failed: errno: %d"ENDLINE, errno);
+		// Running out of waiting connections is how every batch ends.
+		//
+		int iSocketError = SOCKET_LAST_ERROR;
+		if (iSocketError != SOCKET_EWOULDBLOCK
+#ifdef SOCKET_EAGAIN
+				&& iSocketError != SOCKET_EAGAIN
+#endif // SOCKET_EAGAIN
+				) {
+			Log.tinyprintf("Accept failed: errno: %d"ENDLINE, iSocketError);
+		}
 		return INVALID_SOCKET;
 	}
 
-	switch (TYPE) {
-	case NORMAL:
-		return baseSocket;
-	case WEB_SOCKET:
-		if (conductHandshake(baseSocket)) {
-			return baseSocket;
-		}
-		else {
-			::close(baseSocket);
-		}
-		/*websocket::SocketReader reader(baseSocket);
-		websocket::handshaking::HandshakeHeader headerIn(reader);
-
-		Log.WriteString("Websocket info: "ENDLINE);
-		Log.WriteString(headerIn.toString().c_str());
-		Log.WriteString(ENDLINE);
-		Log.Flush();
-		std::cout << headerIn.toString() << std::endl;*/
-
-		//TODO: Add websocket handshake stuff here
-	}
-	return INVALID_SOCKET;
+	// Websocket connections complete their upgrade handshake from the main
+	// loop (see process_handshake), so both types are simply accepted here.
+	//
+	UNUSED_PARAMETER(TYPE);
+	return baseSocket;
 }
 
 DESC *new_connection(PortInfo *Port, int *piSocketError) {
@@ -1676,15 +2338,13 @@ DESC *new_connection(PortInfo *Port, int *piSocketError) {
 #endif // SOCKLEN_T_DCL
 #ifndef WIN32
 	int len;
+	char szCachedName[51];
+	bool bCachedName = false;
 #endif // !WIN32
 	const char *cmdsave = mudstate.debug_cmd;
 	mudstate.debug_cmd = "< new_connection >";
 	addr_len = sizeof(struct sockaddr);
 
-	Log.WriteString(toString(*Port).c_str());
-	Log.WriteString(ENDLINE);
-
-
 	//SOCKET newsock = accept(Port->socket, (struct sockaddr *)&addr, &addr_len);
 	SOCKET newsock = makeConnection(Port->socket, Port->type,
 			(struct sockaddr *) &addr);
@@ -1695,12 +2355,15 @@ DESC *new_connection(PortInfo *Port, int *piSocketError) {
 		return 0;
 	}
 
+	Log.WriteString(toString(*Port).c_str());
+	Log.WriteString(ENDLINE);
+
 	char *pBuffM2 = alloc_mbuf("new_connection.address");
 	mux_strncpy(pBuffM2, inet_ntoa(addr.sin_addr), MBUF_SIZE - 1);
 	unsigned short usPort = ntohs(addr.sin_port);
 
 	DebugTotalSockets++;
-	if (site_check(addr.sin_addr, mudstate.access_list) == H_FORBIDDEN) {
+	if (site_check(addr.sin_addr, &mudstate.access_list) == H_FORBIDDEN) {
 		STARTLOG(LOG_NET | LOG_SECURITY, "NET", "SITE");
 		char *pBuffM1 = alloc_mbuf("new_connection.LOG.badsite");
 		mux_sprintf(pBuffM1, MBUF_SIZE,
@@ -1711,6 +2374,8 @@ DESC *new_connection(PortInfo *Port, int *piSocketError) {
 		ENDLOG
 		;
 
+		mudstate.nConnRejected++;
+
 		// Report site monitor information.
 		//
 		SiteMonSend(newsock, pBuffM2, NULL, "Connection refused");
@@ -1756,23 +2421,38 @@ DESC *new_connection(PortInfo *Port, int *piSocketError) {
 			}
 		}
 #else // WIN32
-		// Make slave request
+		// Answer what we can from the cache, and ask the slave for the rest.
 		//
-		if (!IS_INVALID_SOCKET(slave_socket) && mudconf.use_hostname) {
-			char *pBuffL1 = alloc_lbuf("new_connection.write");
-			mux_sprintf(pBuffL1, LBUF_SIZE, "%s\n%s,%d,%d\n", pBuffM2, pBuffM2,
-					usPort, Port->port);
-			len = strlen(pBuffL1);
-			if (mux_write(slave_socket, pBuffL1, len) < 0) {
-				CleanUpSlaveSocket();
-				CleanUpSlaveProcess();
-
-				STARTLOG(LOG_ALWAYS, "NET", "SLAVE");
-				log_text("write() of slave request failed. Slave stopped.");
-				ENDLOG
-				;
+		if (mudconf.use_hostname) {
+			char szOps[3];
+			int nOps = 0;
+			if (hostcache_name(addr.sin_addr, szCachedName,
+					sizeof(szCachedName))) {
+				bCachedName = true;
+			} else {
+				szOps[nOps++] = SLAVE_IPTONAME;
+			}
+			if (!hostcache_skip_ident(addr.sin_addr)) {
+				szOps[nOps++] = SLAVE_IDENTQ;
+			}
+			szOps[nOps] = '\0';
+
+			if (0 < nOps && !IS_INVALID_SOCKET(slave_socket)) {
+				char *pBuffL1 = alloc_lbuf("new_connection.write");
+				mux_sprintf(pBuffL1, LBUF_SIZE, "%s\n%s,%d,%d,%s\n", pBuffM2,
+						pBuffM2, usPort, Port->port, szOps);
+				len = strlen(pBuffL1);
+				if (mux_write(slave_socket, pBuffL1, len) < 0) {
+					CleanUpSlaveSocket();
+					CleanUpSlaveProcess();
+
+					STARTLOG(LOG_ALWAYS, "NET", "SLAVE");
+					log_text("write() of slave request failed. Slave stopped.");
+					ENDLOG
+					;
+				}
+				free_lbuf(pBuffL1);
 			}
-			free_lbuf(pBuffL1);
 		}
 #endif // WIN32
 		STARTLOG(LOG_NET, "NET", "CONN");
@@ -1785,16 +2465,36 @@ DESC *new_connection(PortInfo *Port, int *piSocketError) {
 		ENDLOG
 		;
 
+		mudstate.nConnAccepted++;
 		d = initializesock(newsock, &addr);
 		d->setSocket(newsock, Port->type);
-		TelnetSetup(d);
+#ifndef WIN32
+		if (bCachedName) {
+			mux_strncpy(d->addr, szCachedName, 50);
+		}
+#endif // !WIN32
+		if (d->isHandshaking()) {
+			// The telnet setup and welcome wait for the upgrade request.
+			//
+			CLinearTimeDelta ltdTimeout;
+			ltdTimeout.SetSeconds(mudconf.handshake_timeout);
+			CLinearTimeAbsolute ltaTimeout;
+			ltaTimeout.GetUTC();
+			ltaTimeout += ltdTimeout;
+			scheduler.DeferTask(ltaTimeout, PRIORITY_SYSTEM,
+					Task_HandshakeTimeout, d, 0);
+		} else {
+			TelnetSetup(d);
+		}
 
 		// Initalize everything before sending the sitemon info, so that we
 		// can pass the descriptor, d.
 		//
 		SiteMonSend(newsock, pBuffM2, d, "Connection");
 
-		welcome_user(d);
+		if (!d->isHandshaking()) {
+			welcome_user(d);
+		}
 	}
 	free_mbuf(pBuffM2);
 	*piSocketError = SOCKET_LAST_ERROR;
@@ -1820,7 +2520,7 @@ void shutdownsock(DESC *d, int reason) {
 	DESC *dtemp;
 
 	if ((reason == R_LOGOUT)
-			&& (site_check((d->address).sin_addr, mudstate.access_list)
+			&& (site_check((d->address).sin_addr, &mudstate.access_list)
 					== H_FORBIDDEN)) {
 		reason = R_QUIT;
 	}
@@ -1986,9 +2686,9 @@ void shutdownsock(DESC *d, int reason) {
 		d->quota = mudconf.cmd_quota_max;
 		d->last_time = d->connected_at;
 		int AccessFlag = site_check((d->address).sin_addr,
-				mudstate.access_list);
+				&mudstate.access_list);
 		int SuspectFlag = site_check((d->address).sin_addr,
-				mudstate.suspect_list);
+				&mudstate.suspect_list);
 		d->host_info = AccessFlag | SuspectFlag;
 		d->input_tot = d->input_size;
 		d->output_tot = 0;
@@ -1997,6 +2697,7 @@ void shutdownsock(DESC *d, int reason) {
 		// Cancel any scheduled processing on this descriptor.
 		//
 		scheduler.CancelTask(Task_ProcessCommand, d, 0);
+		scheduler.CancelTask(Task_HandshakeTimeout, d, 0);
 
 #ifdef WIN32
 		if (bUseCompletionPorts)
@@ -2035,11 +2736,53 @@ void shutdownsock(DESC *d, int reason) {
 		}
 #endif
 
+#ifdef IO_THREADS
+		if (NULL != d->io_conn && !d->io_closing) {
+			// The I/O thread makes a last attempt to write what is queued,
+			// and the descriptor is freed when it lets go of the socket.
+			//
+			if (d->io_flush) {
+				for (size_t j = 0; j < io_pending.size(); j++) {
+					if (io_pending[j] == d) {
+						io_pending.erase(io_pending.begin() + j);
+						break;
+					}
+				}
+				d->io_flush = false;
+			}
+			IoHandOff(d);
+
+			IOMSG msg;
+			memset(&msg, 0, sizeof(msg));
+			msg.op = IO_DETACH;
+			msg.d = d;
+			msg.conn = d->io_conn;
+			io_send(d->io_thread, msg);
+			d->io_closing = true;
+
+			*d->prev = d->next;
+			if (d->next) {
+				d->next->prev = d->prev;
+			}
+			d->next = 0;
+			d->prev = 0;
+			ndescriptors--;
+			return;
+		}
+#endif // IO_THREADS
+
+#ifdef HAVE_SYS_EPOLL_H
+		if (0 != d->epoll_events) {
+			EpollUnwatch(d->getSocket());
+			d->epoll_events = 0;
+		}
+#endif // HAVE_SYS_EPOLL_H
 		shutdown(d->getSocket(), SD_BOTH);
 		if (SOCKET_CLOSE(d->getSocket()) == 0) {
 			DebugTotalSockets--;
 		}
 		d->setSocket(INVALID_SOCKET, NORMAL);
+		d->cleanup();
 
 		*d->prev = d->next;
 		if (d->next) {
@@ -2167,7 +2910,9 @@ static void make_nolinger(SOCKET s) {
 }
 
 static void config_socket(SOCKET s) {
+#ifndef HAVE_ACCEPT4
 	make_nonblocking(s);
+#endif // HAVE_ACCEPT4
 	make_nolinger(s);
 }
 
@@ -2202,8 +2947,8 @@ DESC *initializesock(SOCKET s, struct sockaddr_in *a) {
 	d->command_count = 0;
 	d->timeout = mudconf.idle_timeout;
 
-	int AccessFlag = site_check((*a).sin_addr, mudstate.access_list);
-	int SuspectFlag = site_check((*a).sin_addr, mudstate.suspect_list);
+	int AccessFlag = site_check((*a).sin_addr, &mudstate.access_list);
+	int SuspectFlag = site_check((*a).sin_addr, &mudstate.suspect_list);
 	d->host_info = AccessFlag | SuspectFlag;
 
 	// Be sure #0 isn't wizard. Shouldn't be.
@@ -2221,6 +2966,7 @@ DESC *initializesock(SOCKET s, struct sockaddr_in *a) {
 	d->output_lost = 0;
 	d->output_head = NULL;
 	d->output_tail = NULL;
+	d->output_warm = NULL;
 	d->input_head = NULL;
 	d->input_tail = NULL;
 	d->input_size = 0;
@@ -2236,6 +2982,10 @@ DESC *initializesock(SOCKET s, struct sockaddr_in *a) {
 	d->nvt_eor_us_state = OPTION_NO;
 	d->nvt_naws_him_state = OPTION_NO;
 	d->nvt_naws_us_state = OPTION_NO;
+	d->nvt_compress2_us_state = OPTION_NO;
+#ifdef HAVE_ZLIB_H
+	d->mccp = NULL;
+#endif // HAVE_ZLIB_H
 	d->height = 24;
 	d->width = 78;
 	d->quota = mudconf.cmd_quota_max;
@@ -2320,7 +3070,7 @@ void process_output9x(void *dvoid, int bHandleShutdown)
 		}
 		TBLOCK *save = tb;
 		tb = tb->hdr.nxt;
-		MEMFREE(save);
+		retire_tblock(d, save);
 		save = NULL;
 		d->output_head = tb;
 		if (tb == NULL)
@@ -2410,7 +3160,7 @@ void process_outputNT(void *dvoid, int bHandleShutdown)
 		{
 			save = tb;
 			tb = tb->hdr.nxt;
-			MEMFREE(save);
+			free_tblock(save);
 			save = NULL;
 			d->output_head = tb;
 			if (tb == NULL)
@@ -2438,7 +3188,7 @@ void process_outputNT(void *dvoid, int bHandleShutdown)
 			{
 				save = tb;
 				tb = tb->hdr.nxt;
-				MEMFREE(save);
+				free_tblock(save);
 				save = NULL;
 				d->output_head = tb;
 				if (tb == NULL)
@@ -2452,17 +3202,58 @@ void process_outputNT(void *dvoid, int bHandleShutdown)
 }
 
 #else // WIN32
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif // IOV_MAX
+
 void process_output(void *dvoid, int bHandleShutdown) {
 	DESC *d = (DESC *) dvoid;
 
+#ifdef IO_THREADS
+	// The I/O thread does the writing, once per pass of the main loop.
+	//
+	if (NULL != d->io_conn) {
+		IoUpdateDesc(d);
+		return;
+	}
+#endif // IO_THREADS
+
 	const char *cmdsave = mudstate.debug_cmd;
 	mudstate.debug_cmd = "< process_output >";
 
+#ifdef HAVE_ZLIB_H
+	// Compress what was queued since the last flush, and end it on a byte
+	// boundary the client can inflate up to.
+	//
+	if (NULL != d->mccp) {
+		mccp_compress(d, Z_SYNC_FLUSH);
+	}
+#endif // HAVE_ZLIB_H
+
 	TBLOCK *tb = d->output_head;
+	if (tb != NULL) {
+		mudstate.nOutputFlushes++;
+	}
+
+	struct iovec aiov[IOV_MAX];
 	while (tb != NULL) {
-		while (tb->hdr.nchars > 0) {
-			//int cnt = SOCKET_WRITE(d->descriptor, tb->hdr.start, tb->hdr.nchars, 0);
-			int cnt = d->writeToSocket(tb->hdr.start, tb->hdr.nchars);
+		// Gather as many queued blocks as a single writev() will take.
+		//
+		int niov = 0;
+		size_t nWant = 0;
+		for (TBLOCK *tp = tb; tp != NULL && niov < IOV_MAX; tp = tp->hdr.nxt) {
+			if (tp->hdr.nchars > 0) {
+				aiov[niov].iov_base = tp->hdr.start;
+				aiov[niov].iov_len = tp->hdr.nchars;
+				nWant += tp->hdr.nchars;
+				niov++;
+			}
+		}
+
+		size_t nDone = 0;
+		if (niov > 0) {
+			int cnt = d->writevToSocket(aiov, niov);
+			mudstate.nOutputWrites++;
 			if (IS_SOCKET_ERROR(cnt)) {
 				int iSocketError = SOCKET_LAST_ERROR;
 				mudstate.debug_cmd = cmdsave;
@@ -2475,17 +3266,37 @@ void process_output(void *dvoid, int bHandleShutdown) {
 				}
 				return;
 			}
+			nDone = cnt;
+			mudstate.nOutputBytes += cnt;
 			d->output_size -= cnt;
-			tb->hdr.nchars -= cnt;
-			tb->hdr.start += cnt;
 		}
-		TBLOCK *save = tb;
-		tb = tb->hdr.nxt;
-		MEMFREE(save);
-		save = NULL;
-		d->output_head = tb;
-		if (tb == NULL) {
-			d->output_tail = NULL;
+
+		// Free the blocks which went out completely, and advance into the
+		// block which went out partially.
+		//
+		bool bShort = (nDone < nWant);
+		while (tb != NULL && tb->hdr.nchars <= nDone) {
+			nDone -= tb->hdr.nchars;
+			TBLOCK *save = tb;
+			tb = tb->hdr.nxt;
+			retire_tblock(d, save);
+			save = NULL;
+			d->output_head = tb;
+			if (tb == NULL) {
+				d->output_tail = NULL;
+				UpdateDescEvents(d);
+			}
+		}
+		if (tb != NULL && nDone > 0) {
+			tb->hdr.nchars -= nDone;
+			tb->hdr.start += nDone;
+		}
+
+		// A short write means the socket is full. Wait to hear that it is
+		// writable again rather than spend another call on EWOULDBLOCK.
+		//
+		if (bShort) {
+			break;
 		}
 	}
 
@@ -2612,6 +3423,8 @@ int UsState(DESC *d, unsigned char chOption) {
 		return d->nvt_eor_us_state;
 	} else if (TELNET_SGA == chOption) {
 		return d->nvt_sga_us_state;
+	} else if (TELNET_COMPRESS2 == chOption) {
+		return d->nvt_compress2_us_state;
 	}
 	return OPTION_NO;
 }
@@ -2654,6 +3467,18 @@ static void SetUsState(DESC *d, unsigned char chOption, int iUsState) {
 		}
 	} else if (TELNET_SGA == chOption) {
 		d->nvt_sga_us_state = iUsState;
+	} else if (TELNET_COMPRESS2 == chOption) {
+		int iOldState = d->nvt_compress2_us_state;
+		d->nvt_compress2_us_state = iUsState;
+#ifdef HAVE_ZLIB_H
+		if (OPTION_YES == iUsState && OPTION_YES != iOldState) {
+			mccp_start(d);
+		} else if (OPTION_YES != iUsState && OPTION_YES == iOldState) {
+			mccp_stop(d);
+		}
+#else
+		UNUSED_PARAMETER(iOldState);
+#endif // HAVE_ZLIB_H
 	}
 }
 
@@ -2744,6 +3569,11 @@ static bool DesiredUsOption(DESC *d, unsigned char chOption) {
 			|| (TELNET_SGA == chOption && OPTION_YES == UsState(d, TELNET_EOR))) {
 		return true;
 	}
+#ifdef HAVE_ZLIB_H
+	if (TELNET_COMPRESS2 == chOption && !d->isFramed()) {
+		return true;
+	}
+#endif // HAVE_ZLIB_H
 	return false;
 }
 
@@ -2815,7 +3645,7 @@ void DisableHim(DESC *d, unsigned char chOption) {
  */
 
 void EnableUs(DESC *d, unsigned char chOption) {
-	switch (HimState(d, chOption)) {
+	switch (UsState(d, chOption)) {
 	case OPTION_NO:
 		SetUsState(d, chOption, OPTION_WANTYES_EMPTY);
 		SendWill(d, chOption);
@@ -2843,7 +3673,7 @@ void EnableUs(DESC *d, unsigned char chOption) {
  */
 
 void DisableUs(DESC *d, unsigned char chOption) {
-	switch (HimState(d, chOption)) {
+	switch (UsState(d, chOption)) {
 	case OPTION_YES:
 		SetUsState(d, chOption, OPTION_WANTNO_EMPTY);
 		SendWont(d, chOption);
@@ -2879,6 +3709,107 @@ void TelnetSetup(DESC *d) {
 	EnableHim(d, TELNET_EOR);
 	EnableHim(d, TELNET_SGA);
 	EnableHim(d, TELNET_NAWS);
+#ifdef HAVE_ZLIB_H
+	if (!d->isFramed()) {
+		EnableUs(d, TELNET_COMPRESS2);
+	}
+#endif // HAVE_ZLIB_H
+}
+
+/*! \brief Measure the run of plain text at the front of received bytes.
+ *
+ * In the Normal state, a printable character with no Telnet meaning is
+ * simply accepted, so a run of them can be copied as a block. While the
+ * input is printable ASCII, eight bytes are checked at a time.
+ *
+ * \param pBytes   Point to received bytes.
+ * \param nBytes   Number of received bytes in above buffer.
+ * \return         Number of leading bytes which are plain text.
+ */
+
+static size_t nvt_plain_run(const unsigned char *pBytes, size_t nBytes) {
+	static const UINT64 Ones = ~static_cast<UINT64>(0) / 255;
+	static const UINT64 Highs = Ones * 0x80;
+
+	size_t i = 0;
+	for (; i + sizeof(UINT64) <= nBytes; i += sizeof(UINT64)) {
+		UINT64 w;
+		memcpy(&w, pBytes + i, sizeof(w));
+
+		// Stop at any byte below 0x20 or at or above 0x7F.
+		//
+		if ((((w - Ones * 0x20) & ~w) | ((w + Ones) | w)) & Highs) {
+			break;
+		}
+	}
+
+	while (  i < nBytes
+	      && 0 == nvt_input_xlat_table[pBytes[i]]
+	      && mux_isprint(pBytes[i])) {
+		i++;
+	}
+	return i;
+}
+
+/*! \brief Decode ordinary text in the Normal state.
+ *
+ * Printable characters are accepted into the line being built, as far as
+ * there is room for them, and the rest are counted as lost. Decoding stops
+ * before the first byte which needs any other action, such as a line end or
+ * IAC, and leaves that byte to the state tables.
+ *
+ * \param pBytes   Point to received bytes.
+ * \param nBytes   Number of received bytes in above buffer.
+ * \param pOut     Where accepted characters go.
+ * \param nRoom    Room for accepted characters at pOut.
+ * \param pnOut    Number of characters accepted.
+ * \param pnLost   Number of characters for which there was no room.
+ * \param bRuns    Copy runs of plain text in bulk, as the server does. If
+ *                 false, every byte goes through the state tables, which is
+ *                 kept so that @selftest/telnet can compare the two.
+ * \return         Number of received bytes consumed.
+ */
+
+size_t nvt_decode_normal(const unsigned char *pBytes, size_t nBytes,
+		unsigned char *pOut, size_t nRoom, size_t *pnOut, size_t *pnLost,
+		bool bRuns) {
+	size_t i = 0;
+	size_t nOut = 0;
+	size_t nLost = 0;
+	while (i < nBytes) {
+		if (bRuns) {
+			size_t nRun = nvt_plain_run(pBytes + i, nBytes - i);
+			if (0 < nRun) {
+				size_t nCopy = nRoom - nOut;
+				if (nRun < nCopy) {
+					nCopy = nRun;
+				}
+				memcpy(pOut + nOut, pBytes + i, nCopy);
+				nOut += nCopy;
+				nLost += nRun - nCopy;
+				i += nRun;
+				continue;
+			}
+		}
+
+		// Action 1 - Accept CHR(X).
+		//
+		unsigned char ch = pBytes[i];
+		if (1 != nvt_input_action_table[NVT_IS_NORMAL][nvt_input_xlat_table[ch]]) {
+			break;
+		}
+		if (mux_isprint(ch)) {
+			if (nOut < nRoom) {
+				pOut[nOut++] = ch;
+			} else {
+				nLost++;
+			}
+		}
+		i++;
+	}
+	*pnOut = nOut;
+	*pnLost = nLost;
+	return i;
 }
 
 /*! \brief Parse raw data from network connection into command lines and
@@ -2900,7 +3831,7 @@ void TelnetSetup(DESC *d) {
 
 static void process_input_helper(DESC *d, char *pBytes, int nBytes) {
 	if (!d->raw_input) {
-		d->raw_input = (CBLK *) alloc_lbuf("process_input.raw");
+		d->raw_input = alloc_cblk("process_input.raw");
 		d->raw_input_at = d->raw_input->cmd;
 	}
 
@@ -2913,8 +3844,25 @@ static void process_input_helper(DESC *d, char *pBytes, int nBytes) {
 	unsigned char *q = d->aOption + d->nOption;
 	unsigned char *qend = d->aOption + SBUF_SIZE - 1;
 
-	int n = nBytes;
-	while (n--) {
+	const char *pBytesEnd = pBytes + nBytes;
+	while (pBytes < pBytesEnd) {
+		if (NVT_IS_NORMAL == d->raw_input_state) {
+			// Take ordinary text up to the next byte that needs an action.
+			//
+			size_t nOut;
+			size_t nLost;
+			size_t nUsed = nvt_decode_normal((unsigned char *) pBytes,
+					pBytesEnd - pBytes, (unsigned char *) p, pend - p,
+					&nOut, &nLost, true);
+			if (0 < nUsed) {
+				p += nOut;
+				nInputBytes += nOut;
+				nLostBytes += nLost;
+				pBytes += nUsed;
+				continue;
+			}
+		}
+
 		unsigned char ch = (unsigned char) *pBytes;
 		int iAction =
 				nvt_input_action_table[d->raw_input_state][nvt_input_xlat_table[ch]];
@@ -2971,7 +3919,7 @@ static void process_input_helper(DESC *d, char *pBytes, int nBytes) {
 			if (d->raw_input->cmd < p)
 			{
 				save_command(d, d->raw_input);
-				d->raw_input = (CBLK *) alloc_lbuf("process_input.raw");
+				d->raw_input = alloc_cblk("process_input.raw");
 
 				p = d->raw_input_at = d->raw_input->cmd;
 				pend = d->raw_input->cmd + (LBUF_SIZE - sizeof(CBLKHDR) - 1);
@@ -3097,8 +4045,12 @@ static void process_input_helper(DESC *d, char *pBytes, int nBytes) {
 				case OPTION_NO:
 				if (DesiredUsOption(d, ch))
 				{
-					SetUsState(d, ch, OPTION_YES);
+					// WILL must go out before the state change, since
+					// enabling some options (COMPRESS2) changes what
+					// follows on the wire.
+					//
 					SendWill(d, ch);
+					SetUsState(d, ch, OPTION_YES);
 				}
 				else
 				{
@@ -3188,7 +4140,7 @@ static void process_input_helper(DESC *d, char *pBytes, int nBytes) {
 	if (d->raw_input->cmd < p && p <= pend) {
 		d->raw_input_at = p;
 	} else {
-		free_lbuf(d->raw_input);
+		free_cblk(d->raw_input);
 		d->raw_input = NULL;
 		d->raw_input_at = NULL;
 	}
@@ -3203,6 +4155,128 @@ static void process_input_helper(DESC *d, char *pBytes, int nBytes) {
 	d->input_lost += nLostBytes;
 }
 
+/*! \brief Drop a websocket connection which has not finished its upgrade
+ * request in time.
+ *
+ * \param arg_voidptr   Descriptor still in the handshaking state.
+ * \param arg_Integer   Unused.
+ * \return             None.
+ */
+
+static void Task_HandshakeTimeout(void *arg_voidptr, int arg_Integer) {
+	UNUSED_PARAMETER(arg_Integer);
+
+	DESC *d = (DESC *) arg_voidptr;
+	if (d->isHandshaking()) {
+		STARTLOG(LOG_NET | LOG_SECURITY, "NET", "WEBS");
+		char *buff = alloc_mbuf("Task_HandshakeTimeout.LOG");
+		mux_sprintf(buff, MBUF_SIZE,
+				"[%u/%s] Websocket handshake timed out.", d->getSocket(),
+				d->addr);
+		log_text(buff);
+		free_mbuf(buff);
+		ENDLOG
+		;
+		shutdownsock(d, R_TIMEOUT);
+	}
+}
+
+/*! \brief Decode websocket frames received on an upgraded connection.
+ *
+ * Replies to ping and close frames are queued first, then the text carried
+ * by the frames is handed to process_input_helper().
+ *
+ * \param d        Connection which has completed its handshake.
+ * \param pBytes   Point to received bytes. These are decoded in place.
+ * \param nBytes   Number of received bytes in above buffer.
+ * \return         false if the client closed the connection.
+ */
+
+static bool process_frames(DESC *d, char *pBytes, int nBytes) {
+	websocket::ReadResult result = d->decodeFrames(pBytes, nBytes);
+
+	const char *pReplies;
+	size_t nReplies;
+	d->getFrameReplies(pReplies, nReplies);
+	if (0 < nReplies) {
+		queue_raw_LEN(d, pReplies, nReplies);
+	}
+
+	if (0 < result.textSize) {
+		process_input_helper(d, (char *) result.text, result.textSize);
+	}
+	if (0 != result.failStatus) {
+		STARTLOG(LOG_NET | LOG_SECURITY, "NET", "WEBS");
+		char *buff = alloc_mbuf("process_frames.LOG");
+		mux_sprintf(buff, MBUF_SIZE,
+				"[%u/%s] Websocket message failed with close status %u.",
+				d->getSocket(), d->addr, result.failStatus);
+		log_text(buff);
+		free_mbuf(buff);
+		ENDLOG
+		;
+	}
+	return !result.hasClosed;
+}
+
+/*! \brief Feed bytes from a handshaking websocket connection into its
+ * upgrade request parser.
+ *
+ * Once the request is complete, the reply is queued ahead of all other
+ * output, the connection is welcomed like any other, and any bytes after the
+ * request are decoded as websocket frames.
+ *
+ * \param d        Connection in the handshaking state.
+ * \param pBytes   Point to received bytes.
+ * \param nBytes   Number of received bytes in above buffer.
+ * \return         false if the connection should be dropped.
+ */
+
+static bool process_handshake(DESC *d, char *pBytes, int nBytes) {
+	websocket::handshaking::HandshakeParser *hp = d->getHandshake();
+	size_t nUsed = hp->feed(pBytes, nBytes);
+	if (websocket::handshaking::HandshakeParser::HS_READING == hp->getState()) {
+		return true;
+	}
+
+	websocket::DeflateParams allowed;
+	allowed.enabled = mudconf.websocket_deflate;
+	allowed.serverWindowBits = mudconf.websocket_deflate_bits;
+	if (allowed.serverWindowBits < 9) {
+		allowed.serverWindowBits = 9;
+	} else if (15 < allowed.serverWindowBits) {
+		allowed.serverWindowBits = 15;
+	}
+	allowed.serverNoContextTakeover = !mudconf.websocket_deflate_takeover;
+
+	websocket::DeflateParams agreed;
+	std::string reply;
+	if ( websocket::handshaking::HandshakeParser::HS_FAILED == hp->getState()
+			|| !makeHandshakeReply(hp->getHeader(), allowed, agreed, reply)) {
+		STARTLOG(LOG_NET | LOG_SECURITY, "NET", "WEBS");
+		char *buff = alloc_mbuf("process_handshake.LOG");
+		mux_sprintf(buff, MBUF_SIZE,
+				"[%u/%s] Websocket handshake refused.", d->getSocket(),
+				d->addr);
+		log_text(buff);
+		free_mbuf(buff);
+		ENDLOG
+		;
+		return false;
+	}
+
+	scheduler.CancelTask(Task_HandshakeTimeout, d, 0);
+	queue_write_LEN(d, reply.data(), reply.size());
+	d->completeHandshake(agreed);
+	TelnetSetup(d);
+	welcome_user(d);
+
+	if (nUsed < (size_t) nBytes) {
+		return process_frames(d, pBytes + nUsed, nBytes - nUsed);
+	}
+	return true;
+}
+
 bool process_input(DESC *d) {
 	const char *cmdsave = mudstate.debug_cmd;
 	mudstate.debug_cmd = "< process_input >";
@@ -3224,8 +4298,27 @@ bool process_input(DESC *d) {
 		}
 		return false;
 	}
-	process_input_helper(d, buf, got);
+	bool bOkay = process_received(d, buf, got);
 	mudstate.debug_cmd = cmdsave;
+	return bOkay;
+}
+
+/*! \brief Decode bytes read from a descriptor's socket.
+ *
+ * \param d       Player connection.
+ * \param buf     Bytes read.
+ * \param got     Number of bytes read.
+ * \return        false if the connection should be closed.
+ */
+
+static bool process_received(DESC *d, char *buf, int got) {
+	if (d->isHandshaking()) {
+		return process_handshake(d, buf, got);
+	}
+	if (d->isFramed()) {
+		return process_frames(d, buf, got);
+	}
+	process_input_helper(d, buf, got);
 	return true;
 }
 
@@ -3236,7 +4329,12 @@ void close_sockets(bool emergency, const char *message) {
 	{
 		if (emergency) {
 			//SOCKET_WRITE(d->getSocket(), message, strlen(message), 0);
-			d->writeToSocket(message, strlen(message));
+			const char *p = message;
+			size_t n = strlen(message);
+			if (d->isFramed()) {
+				d->encodeOutput(p, n);
+			}
+			d->writeToSocket(p, n);
 			if (IS_SOCKET_ERROR(shutdown(d->getSocket(), SD_BOTH))) {
 				log_perror("NET", "FAIL", NULL, "shutdown");
 			}
@@ -3249,6 +4347,11 @@ void close_sockets(bool emergency, const char *message) {
 			shutdownsock(d, R_GOING_DOWN);
 		}
 	}
+#ifdef IO_THREADS
+	if (!emergency) {
+		IoShutdown();
+	}
+#endif // IO_THREADS
 	for (int i = 0; i < nMainGamePorts; i++) {
 		if (SOCKET_CLOSE(aMainGamePorts[i].socket) == 0) {
 			DebugTotalSockets--;
@@ -3971,7 +5074,7 @@ static DWORD WINAPI MUDListenThread(LPVOID pVoid)
 		}
 
 		DebugTotalSockets++;
-		if (site_check(SockAddr.sin_addr, mudstate.access_list) == H_FORBIDDEN)
+		if (site_check(SockAddr.sin_addr, &mudstate.access_list) == H_FORBIDDEN)
 		{
 			STARTLOG(LOG_NET | LOG_SECURITY, "NET", "SITE");
 			unsigned short us = ntohs(SockAddr.sin_port);
@@ -4211,7 +5314,7 @@ void ProcessWindowsTCP(DWORD dwTimeout)
 					memcpy(d->output_buffer, tp->hdr.start, nBytes);
 					TBLOCK *save = tp;
 					tp = tp->hdr.nxt;
-					MEMFREE(save);
+					free_tblock(save);
 					save = NULL;
 					d->output_head = tp;
 					if (tp == NULL)
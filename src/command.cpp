@@ -24,6 +24,7 @@
 #include "vattr.h"
 #include "help.h"
 #include "pcre.h"
+#include "hostcache.h"
 
 // Switch tables for the various commands.
 //
@@ -439,6 +440,15 @@ static NAMETAB pose_sw[] =
     { NULL,             0,          0,  0}
 };
 
+static NAMETAB profile_sw[] =
+{
+    {"export",          1,  CA_WIZARD,  PROFILE_EXPORT},
+    {"reset",           1,  CA_WIZARD,  PROFILE_RESET},
+    {"start",           3,  CA_WIZARD,  PROFILE_START},
+    {"stop",            3,  CA_WIZARD,  PROFILE_STOP},
+    { NULL,             0,          0,  0}
+};
+
 static NAMETAB ps_sw[] =
 {
     {"all",             1,  CA_PUBLIC,  PS_ALL|SW_MULTIPLE},
@@ -464,6 +474,17 @@ static NAMETAB say_sw[] =
     { NULL,             0,          0,  0}
 };
 
+static NAMETAB selftest_sw[] =
+{
+    {"deflate",         1,  CA_GOD,     SELFTEST_DEFLATE},
+    {"functions",       1,  CA_GOD,     SELFTEST_FUNCTIONS},
+    {"parse",           1,  CA_GOD,     SELFTEST_PARSE},
+    {"scheduler",       1,  CA_GOD,     SELFTEST_SCHEDULER},
+    {"telnet",          1,  CA_GOD,     SELFTEST_TELNET},
+    {"websocket",       1,  CA_GOD,     SELFTEST_WEBSOCKET},
+    { NULL,             0,          0,  0}
+};
+
 static NAMETAB set_sw[] =
 {
     {"quiet",           1,  CA_PUBLIC,  SET_QUIET},
@@ -622,9 +643,11 @@ static CMDENT_ONE_ARG command_table_one_arg[] =
     {"@motd",         motd_sw,    CA_WIZARD,                  0,  CS_ONE_ARG,           0, do_motd},
     {"@nemit",        emit_sw,    CA_LOCATION|CA_NO_GUEST|CA_NO_SLAVE, SAY_EMIT, CS_ONE_ARG|CS_UNPARSE|CS_NOSQUISH, 0, do_say},
     {"@poor",         NULL,       CA_GOD,                     0,  CS_ONE_ARG|CS_INTERP, 0, do_poor},
+    {"@profile",      profile_sw, CA_WIZARD,     PROFILE_REPORT,  CS_ONE_ARG|CS_INTERP, 0, do_profile},
     {"@ps",           ps_sw,      CA_PUBLIC,                  0,  CS_ONE_ARG|CS_INTERP, 0, do_ps},
     {"@quitprogram",  NULL,       CA_PUBLIC,                  0,  CS_ONE_ARG|CS_INTERP, 0, do_quitprog},
     {"@search",       NULL,       CA_PUBLIC,        SRCH_SEARCH,  CS_ONE_ARG|CS_NOINTERP,   0, do_search},
+    {"@selftest",     selftest_sw,CA_GOD,                     0,  CS_ONE_ARG,           0, do_selftest},
     {"@shutdown",     NULL,       CA_NO_GUEST|CA_NO_SLAVE,    0,  CS_ONE_ARG,           0, do_shutdown},
     {"@stats",        stats_sw,   CA_PUBLIC,                  0,  CS_ONE_ARG|CS_INTERP, 0, do_stats},
     {"@sweep",        sweep_sw,   CA_PUBLIC,                  0,  CS_ONE_ARG,           0, do_sweep},
@@ -3788,6 +3811,68 @@ static void list_process(dbref player)
     raw_notify(player,
            tprintf("Descs avail: %10d", maxfds));
 #endif // HAVE_GETRUSAGE
+
+    // Network output flushing. Each flush gathers a descriptor's queued
+    // output blocks into as few writes as possible.
+    //
+    char szFlushes[30], szWrites[30], szBytes[30];
+    mux_i64toa(mudstate.nOutputFlushes, szFlushes);
+    mux_i64toa(mudstate.nOutputWrites, szWrites);
+    mux_i64toa(mudstate.nOutputBytes, szBytes);
+    raw_notify(player,
+           tprintf("Output:      %10s flushes%10s writes %10s bytes",
+               szFlushes, szWrites, szBytes));
+    if (0 < mudstate.nOutputFlushes)
+    {
+        raw_notify(player,
+               tprintf("Per flush:   %10.2f writes %10.1f bytes",
+                   (double)mudstate.nOutputWrites / mudstate.nOutputFlushes,
+                   (double)mudstate.nOutputBytes / mudstate.nOutputFlushes));
+    }
+
+    // MCCP v2 compression of telnet output.
+    //
+    if (0 < mudstate.nMccpIn)
+    {
+        char szIn[30], szOut[30];
+        mux_i64toa(mudstate.nMccpIn, szIn);
+        mux_i64toa(mudstate.nMccpOut, szOut);
+        raw_notify(player,
+               tprintf("Compress:    %10s chars %10s bytes %7.1f%% %8ld ms",
+                   szIn, szOut,
+                   100.0 * mudstate.nMccpOut / mudstate.nMccpIn,
+                   mudstate.ltdMccpCost.ReturnMilliseconds()));
+    }
+
+    // Connection admission.
+    //
+    char szAccepted[30], szDeferred[30], szRejected[30];
+    mux_i64toa(mudstate.nConnAccepted, szAccepted);
+    mux_i64toa(mudstate.nConnDeferred, szDeferred);
+    mux_i64toa(mudstate.nConnRejected, szRejected);
+    raw_notify(player,
+           tprintf("Connections: %10s accepted %9s deferred %9s rejected",
+               szAccepted, szDeferred, szRejected));
+
+#ifndef WIN32
+    // Hostname and ident lookups answered without the slave.
+    //
+    HOSTCACHE_STATS hs;
+    hostcache_stats(&hs);
+    char szHits[30], szNegative[30], szMisses[30], szSkipped[30];
+    char szEntries[30];
+    mux_i64toa(hs.nEntries, szEntries);
+    mux_i64toa(hs.nHits, szHits);
+    mux_i64toa(hs.nNegativeHits, szNegative);
+    mux_i64toa(hs.nMisses, szMisses);
+    mux_i64toa(hs.nIdentSkipped, szSkipped);
+    raw_notify(player,
+           tprintf("Host cache:  %10s hits %13s negative %7s misses",
+               szHits, szNegative, szMisses));
+    raw_notify(player,
+           tprintf("             %10s entries %10s idents skipped",
+               szEntries, szSkipped));
+#endif // !WIN32
 }
 
 //----------------------------------------------------------------------------
@@ -105,6 +105,7 @@ CMD_TWO_ARG(do_pcreate);        /* Create new characters */
 CMD_TWO_ARG(do_pemit);          /* Messages to specific player */
 CMD_ONE_ARG(do_poor);           /* Reduce wealth of all players */
 CMD_TWO_ARG(do_power);          /* Sets powers */
+CMD_ONE_ARG(do_profile);        /* Profile softcode */
 CMD_ONE_ARG(do_ps);             /* List contents of queue */
 CMD_ONE_ARG(do_queue);          /* Force queue processing */
 CMD_TWO_ARG(do_quota);          /* Set or display quotas */
@@ -114,6 +115,7 @@ CMD_NO_ARG(do_backup);          /* Backup the database and restart */
 CMD_ONE_ARG(do_say);            /* Messages to all */
 CMD_NO_ARG(do_score);           /* Display my wealth */
 CMD_ONE_ARG(do_search);         /* Search for objs matching criteria */
+CMD_ONE_ARG(do_selftest);       /* Run a benchmark or self-check */
 CMD_TWO_ARG(do_set);            /* Set flags or attributes */
 CMD_TWO_ARG(do_setattr);        /* Set object attribute */
 CMD_TWO_ARG(do_setvattr);       /* Set variable attribute */
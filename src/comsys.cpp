@@ -1435,6 +1435,7 @@ void SendChannelMessage
     bool bSpoof = ((ch->type & CHANNEL_SPOOF) != 0);
     ch->num_messages++;
 
+    BeginSharedOutput();
     struct comuser *user;
     for (user = ch->on_users; user; user = user->on_next)
     {
@@ -1453,6 +1454,7 @@ void SendChannelMessage
             }
         }
     }
+    EndSharedOutput();
 
     dbref obj = ch->chan_obj;
     if (Good_obj(obj))
@@ -56,6 +56,8 @@ void cf_init(void)
     mudconf.compress = StringClone("gzip");
     mudconf.uncompress = StringClone("gzip -d");
     mudconf.status_file = StringClone("shutdown.status");
+    mudconf.profile_file = StringClone("netmux.folded");
+    mudconf.slave_hosts_file = StringClone("");
     mudconf.max_cache_size = 1*1024*1024;
 
     mudconf.ports.n = 1;
@@ -70,6 +72,7 @@ void cf_init(void)
     }
 
     mudconf.init_size = 1000;
+    mudconf.io_threads = 0;
     mudconf.guest_char = -1;
     mudconf.guest_nuker = GOD;
     mudconf.number_guests = 30;
@@ -126,6 +129,7 @@ void cf_init(void)
     mudconf.have_mailer = true;
     mudconf.have_zones = true;
     mudconf.paranoid_alloc = false;
+    mudconf.parse_cache = true;
     mudconf.sig_action = SA_DFLT;
     mudconf.max_players = -1;
     mudconf.dump_interval = 3600;
@@ -134,10 +138,17 @@ void cf_init(void)
     mudconf.dump_offset = 0;
     mudconf.check_offset = 300;
     mudconf.idle_timeout = 3600;
+    mudconf.hostname_cache_ttl = 3600;
+    mudconf.hostname_negative_ttl = 600;
     mudconf.conn_timeout = 120;
+    mudconf.handshake_timeout = 30;
+    mudconf.websocket_deflate = true;
+    mudconf.websocket_deflate_bits = 13;
+    mudconf.websocket_deflate_takeover = true;
     mudconf.idle_interval = 60;
     mudconf.retry_limit = 3;
     mudconf.output_limit = 16384;
+    mudconf.netbuf_high_water = 64;
     mudconf.paycheck = 0;
     mudconf.paystart = 0;
     mudconf.paylimit = 10000;
@@ -175,6 +186,9 @@ void cf_init(void)
     mudconf.mail_expiration = 14;
     mudconf.queuemax = 100;
     mudconf.queue_chunk = 10;
+    mudconf.queue_slice_funcs = 0;
+    mudconf.queue_weight = 1;
+    mudconf.accept_budget = 32;
     mudconf.active_q_chunk  = 10;
     mudconf.sacfactor       = 5;
     mudconf.sacadjust       = -1;
@@ -195,6 +209,7 @@ void cf_init(void)
     mudconf.pemit_any       = false;
     mudconf.player_listen   = false;
     mudconf.pub_flags       = true;
+    mudconf.queue_fair_share = true;
     mudconf.quiet_look      = true;
     mudconf.quiet_whisper   = true;
     mudconf.quotas          = false;
@@ -245,6 +260,7 @@ void cf_init(void)
     mudconf.cmd_quota_incr = 1;
     mudconf.rpt_cmdsecs.SetSeconds(120);
     mudconf.max_cmdsecs.SetSeconds(60);
+    mudconf.queue_slice.Set100ns(0);
     mudconf.cache_tick_period.SetSeconds(30);
     mudconf.control_flags = 0xffffffff; // Everything for now...
     mudconf.log_options = LOG_ALWAYS | LOG_BUGS | LOG_SECURITY |
@@ -281,6 +297,7 @@ void cf_init(void)
     mudconf.mail_per_hour = 50;
     mudconf.vattr_per_hour = 5000;
     mudconf.pcreate_per_hour = 100;
+    mudconf.port_listeners = 1;
     mudconf.lbuf_size = LBUF_SIZE;
 
     mudstate.events_flag = 0;
@@ -297,8 +314,8 @@ void cf_init(void)
     mudstate.debug_cmd = "< init >";
     mudstate.curr_cmd  = "< none >";
     mux_strncpy(mudstate.doing_hdr, "Doing", SIZEOF_DOING_STRING-1);
-    mudstate.access_list = NULL;
-    mudstate.suspect_list = NULL;
+    memset(&mudstate.access_list, 0, sizeof(mudstate.access_list));
+    memset(&mudstate.suspect_list, 0, sizeof(mudstate.suspect_list));
     mudstate.badname_head = NULL;
     mudstate.mstat_ixrss[0] = 0;
     mudstate.mstat_ixrss[1] = 0;
@@ -309,6 +326,15 @@ void cf_init(void)
     mudstate.mstat_secs[0] = 0;
     mudstate.mstat_secs[1] = 0;
     mudstate.mstat_curr = 0;
+    mudstate.nOutputFlushes = 0;
+    mudstate.nOutputWrites = 0;
+    mudstate.nOutputBytes = 0;
+    mudstate.nMccpIn = 0;
+    mudstate.nMccpOut = 0;
+    mudstate.ltdMccpCost.Set100ns(0);
+    mudstate.nConnAccepted = 0;
+    mudstate.nConnDeferred = 0;
+    mudstate.nConnRejected = 0;
     mudstate.iter_alist.data = NULL;
     mudstate.iter_alist.len = 0;
     mudstate.iter_alist.next = NULL;
@@ -538,18 +564,24 @@ static CF_HAND(cf_int_array)
 }
 
 // ---------------------------------------------------------------------------
-// cf_int: Set integer parameter.
+// cf_int: Set integer parameter. A positive nExtra is the least value
+// allowed, and smaller values are raised to it.
 //
 static CF_HAND(cf_int)
 {
     UNUSED_PARAMETER(pExtra);
-    UNUSED_PARAMETER(nExtra);
     UNUSED_PARAMETER(player);
     UNUSED_PARAMETER(cmd);
 
     // Copy the numeric value to the parameter.
     //
     *vp = mux_atol(str);
+    int iLeast = (int)nExtra;
+    if (  0 < iLeast
+       && *vp < iLeast)
+    {
+        *vp = iLeast;
+    }
     return 0;
 }
 
@@ -1371,7 +1403,7 @@ static CF_HAND(cf_site)
 {
     UNUSED_PARAMETER(pExtra);
 
-    SITE **ppv = (SITE **)vp;
+    SITELIST *pList = (SITELIST *)vp;
     struct in_addr addr_num, mask_num;
     in_addr_t ulMask, ulNetBits;
 
@@ -1453,8 +1485,6 @@ static CF_HAND(cf_site)
         addr_num.s_addr = htonl(ulAddr);
     }
 
-    SITE *head = *ppv;
-
     // Parse the access entry and allocate space for it.
     //
     SITE *site = NULL;
@@ -1485,26 +1515,11 @@ static CF_HAND(cf_site)
     // processed as you would think they would be, while entries made while
     // running are processed first.
     //
-    if (mudstate.bReadingConfiguration)
+    if (!site_add(pList, site, mudstate.bReadingConfiguration))
     {
-        if (head == NULL)
-        {
-            *ppv = site;
-        }
-        else
-        {
-            SITE *last;
-            for (last = head; last->next; last = last->next)
-            {
-                // Nothing
-            }
-            last->next = site;
-        }
-    }
-    else
-    {
-        site->next = head;
-        *ppv = site;
+        delete site;
+        cf_log_syntax(player, cmd, "Out of memory.");
+        return -1;
     }
     return 0;
 }
@@ -1850,6 +1865,7 @@ static CF_HAND(cf_include)
 
 static CONF conftable[] =
 {
+    {"accept_budget",             cf_int,         CA_GOD,    CA_WIZARD,   &mudconf.accept_budget,          NULL,               1},
     {"access",                    cf_access,      CA_GOD,    CA_DISABLED, NULL,                            access_nametab,     0},
     {"alias",                     cf_cmd_alias,   CA_GOD,    CA_DISABLED, (int *)&mudstate.command_htab,   0,                  0},
     {"allow_guest_from_registered_site", cf_bool, CA_GOD,    CA_WIZARD,   (int *)&mudconf.allow_guest_from_registered_site, NULL,     1},
@@ -1924,12 +1940,15 @@ static CONF conftable[] =
     {"guest_site",                cf_site,        CA_GOD,    CA_DISABLED, (int *)&mudstate.access_list,    NULL,         H_GUEST},
     {"guests_channel",            cf_string,      CA_STATIC, CA_PUBLIC,   (int *)mudconf.guests_channel,   NULL,              32},
     {"guests_channel_alias",      cf_string,      CA_STATIC, CA_PUBLIC,   (int *)mudconf.guests_channel_alias, NULL,          32},
+    {"handshake_timeout",         cf_int,         CA_GOD,    CA_WIZARD,   &mudconf.handshake_timeout,      NULL,               0},
     {"have_comsys",               cf_bool,        CA_STATIC, CA_PUBLIC,   (int *)&mudconf.have_comsys,     NULL,               0},
     {"have_mailer",               cf_bool,        CA_STATIC, CA_PUBLIC,   (int *)&mudconf.have_mailer,     NULL,               0},
     {"have_zones",                cf_bool,        CA_STATIC, CA_PUBLIC,   (int *)&mudconf.have_zones,      NULL,               0},
     {"helpfile",                  cf_helpfile,    CA_STATIC, CA_DISABLED, NULL,                            NULL,               0},
     {"hook_cmd",                  cf_hook,        CA_GOD,    CA_GOD,      &mudconf.hook_cmd,               NULL,               0},
     {"hook_obj",                  cf_dbref,       CA_GOD,    CA_GOD,      &mudconf.hook_obj,               NULL,               0},
+    {"hostname_cache_ttl",        cf_int,         CA_GOD,    CA_WIZARD,   &mudconf.hostname_cache_ttl,     NULL,               0},
+    {"hostname_negative_ttl",     cf_int,         CA_GOD,    CA_WIZARD,   &mudconf.hostname_negative_ttl,  NULL,               0},
     {"hostnames",                 cf_bool,        CA_GOD,    CA_WIZARD,   (int *)&mudconf.use_hostname,    NULL,               0},
     {"idle_interval",             cf_int,         CA_GOD,    CA_WIZARD,   &mudconf.idle_interval,          NULL,               0},
     {"idle_timeout",              cf_int,         CA_GOD,    CA_PUBLIC,   &mudconf.idle_timeout,           NULL,               0},
@@ -1938,6 +1957,7 @@ static CONF conftable[] =
     {"indent_desc",               cf_bool,        CA_GOD,    CA_PUBLIC,   (int *)&mudconf.indent_desc,     NULL,               0},
     {"initial_size",              cf_int,         CA_STATIC, CA_WIZARD,   &mudconf.init_size,              NULL,               0},
     {"input_database",            cf_string_dyn,  CA_STATIC, CA_GOD,      (int *)&mudconf.indb,            NULL, SIZEOF_PATHNAME},
+    {"io_threads",                cf_int,         CA_STATIC, CA_WIZARD,   &mudconf.io_threads,             NULL,               0},
     {"kill_guarantee_cost",       cf_int,         CA_GOD,    CA_PUBLIC,   &mudconf.killguarantee,          NULL,               0},
     {"kill_max_cost",             cf_int,         CA_GOD,    CA_PUBLIC,   &mudconf.killmax,                NULL,               0},
     {"kill_min_cost",             cf_int,         CA_GOD,    CA_PUBLIC,   &mudconf.killmin,                NULL,               0},
@@ -1965,6 +1985,7 @@ static CONF conftable[] =
     {"motd_file",                 cf_string_dyn,  CA_STATIC, CA_GOD,      (int *)&mudconf.motd_file,       NULL, SIZEOF_PATHNAME},
     {"motd_message",              cf_string,      CA_GOD,    CA_WIZARD,   (int *)mudconf.motd_msg,         NULL,       GBUF_SIZE},
     {"mud_name",                  cf_string,      CA_GOD,    CA_PUBLIC,   (int *)mudconf.mud_name,         NULL,              32},
+    {"netbuf_high_water",         cf_int,         CA_GOD,    CA_WIZARD,   &mudconf.netbuf_high_water,      NULL,               0},
     {"newuser_file",              cf_string_dyn,  CA_STATIC, CA_GOD,      (int *)&mudconf.crea_file,       NULL, SIZEOF_PATHNAME},
     {"nositemon_site",            cf_site,        CA_GOD,    CA_DISABLED, (int *)&mudstate.access_list,    NULL,     H_NOSITEMON},
     {"notify_recursion_limit",    cf_int,         CA_GOD,    CA_PUBLIC,   &mudconf.ntfy_nest_lim,          NULL,               0},
@@ -1975,6 +1996,7 @@ static CONF conftable[] =
     {"page_cost",                 cf_int,         CA_GOD,    CA_PUBLIC,   &mudconf.pagecost,               NULL,               0},
     {"paranoid_allocate",         cf_bool,        CA_GOD,    CA_WIZARD,   (int *)&mudconf.paranoid_alloc,  NULL,               0},
     {"parent_recursion_limit",    cf_int,         CA_GOD,    CA_PUBLIC,   &mudconf.parent_nest_lim,        NULL,               0},
+    {"parse_cache",               cf_bool,        CA_GOD,    CA_WIZARD,   (int *)&mudconf.parse_cache,     NULL,               0},
     {"paycheck",                  cf_int,         CA_GOD,    CA_PUBLIC,   &mudconf.paycheck,               NULL,               0},
     {"pemit_any_object",          cf_bool,        CA_GOD,    CA_PUBLIC,   (int *)&mudconf.pemit_any,       NULL,               0},
     {"pemit_far_players",         cf_bool,        CA_GOD,    CA_PUBLIC,   (int *)&mudconf.pemit_players,   NULL,               0},
@@ -1988,15 +2010,21 @@ static CONF conftable[] =
     {"player_starting_home",      cf_dbref,       CA_GOD,    CA_PUBLIC,   &mudconf.start_home,             NULL,               0},
     {"player_starting_room",      cf_dbref,       CA_GOD,    CA_PUBLIC,   &mudconf.start_room,             NULL,               0},
     {"port",                      cf_int_array,   CA_STATIC, CA_PUBLIC,   (int *)&mudconf.ports,           NULL, MAX_LISTEN_PORTS},
+    {"port_listeners",            cf_int,         CA_STATIC, CA_WIZARD,   &mudconf.port_listeners,         NULL,               0},
     {"postdump_message",          cf_string,      CA_GOD,    CA_WIZARD,   (int *)mudconf.postdump_msg,     NULL,             256},
     {"power_alias",               cf_poweralias,  CA_GOD,    CA_DISABLED, NULL,                            NULL,               0},
     {"pcreate_per_hour",          cf_int,         CA_STATIC, CA_PUBLIC,   (int *)&mudconf.pcreate_per_hour,NULL,               0},
+    {"profile_file",              cf_string_dyn,  CA_STATIC, CA_GOD,      (int *)&mudconf.profile_file,    NULL, SIZEOF_PATHNAME},
     {"public_channel",            cf_string,      CA_STATIC, CA_PUBLIC,   (int *)mudconf.public_channel,   NULL,              32},
     {"public_channel_alias",      cf_string,      CA_STATIC, CA_PUBLIC,   (int *)mudconf.public_channel_alias, NULL,          32},
     {"public_flags",              cf_bool,        CA_GOD,    CA_PUBLIC,   (int *)&mudconf.pub_flags,       NULL,               0},
     {"pueblo_message",            cf_string,      CA_GOD,    CA_WIZARD,   (int *)mudconf.pueblo_msg,       NULL,       GBUF_SIZE},
     {"queue_active_chunk",        cf_int,         CA_GOD,    CA_PUBLIC,   &mudconf.active_q_chunk,         NULL,               0},
+    {"queue_fair_share",          cf_bool,        CA_GOD,    CA_WIZARD,   (int *)&mudconf.queue_fair_share, NULL,               0},
     {"queue_idle_chunk",          cf_int,         CA_GOD,    CA_PUBLIC,   &mudconf.queue_chunk,            NULL,               0},
+    {"queue_slice",               cf_seconds,     CA_GOD,    CA_WIZARD,   (int *)&mudconf.queue_slice,     NULL,               0},
+    {"queue_slice_functions",     cf_int,         CA_GOD,    CA_WIZARD,   &mudconf.queue_slice_funcs,      NULL,               0},
+    {"queue_weight",              cf_int,         CA_GOD,    CA_WIZARD,   &mudconf.queue_weight,           NULL,               0},
     {"quiet_look",                cf_bool,        CA_GOD,    CA_PUBLIC,   (int *)&mudconf.quiet_look,      NULL,               0},
     {"quiet_whisper",             cf_bool,        CA_GOD,    CA_PUBLIC,   (int *)&mudconf.quiet_whisper,   NULL,               0},
     {"quit_file",                 cf_string_dyn,  CA_STATIC, CA_GOD,      (int *)&mudconf.quit_file,       NULL, SIZEOF_PATHNAME},
@@ -2023,6 +2051,7 @@ static CONF conftable[] =
     {"see_owned_dark",            cf_bool,        CA_GOD,    CA_PUBLIC,   (int *)&mudconf.see_own_dark,    NULL,               0},
     {"signal_action",             cf_option,      CA_STATIC, CA_GOD,      &mudconf.sig_action,             sigactions_nametab, 0},
     {"site_chars",                cf_int,         CA_GOD,    CA_WIZARD,   (int *)&mudconf.site_chars,      NULL,               0},
+    {"slave_hosts_file",          cf_string_dyn,  CA_STATIC, CA_GOD,      (int *)&mudconf.slave_hosts_file, NULL, SIZEOF_PATHNAME},
     {"space_compress",            cf_bool,        CA_GOD,    CA_PUBLIC,   (int *)&mudconf.space_compress,  NULL,               0},
     {"stack_limit",               cf_int,         CA_GOD,    CA_PUBLIC,   &mudconf.stack_limit,            NULL,               0},
     {"starting_money",            cf_int,         CA_GOD,    CA_PUBLIC,   &mudconf.paystart,               NULL,               0},
@@ -2047,6 +2076,9 @@ static CONF conftable[] =
     {"user_attr_access",          cf_modify_bits, CA_GOD,    CA_DISABLED, &mudconf.vattr_flags,            attraccess_nametab, 0},
     {"user_attr_per_hour",        cf_int,         CA_GOD,    CA_PUBLIC,   &mudconf.vattr_per_hour,         NULL,               0},
     {"wait_cost",                 cf_int,         CA_GOD,    CA_PUBLIC,   &mudconf.waitcost,               NULL,               0},
+    {"websocket_deflate",         cf_bool,        CA_GOD,    CA_WIZARD,   (int *)&mudconf.websocket_deflate, NULL,             0},
+    {"websocket_deflate_bits",    cf_int,         CA_GOD,    CA_WIZARD,   &mudconf.websocket_deflate_bits, NULL,               0},
+    {"websocket_deflate_takeover", cf_bool,       CA_GOD,    CA_WIZARD,   (int *)&mudconf.websocket_deflate_takeover, NULL,    0},
     {"wizard_motd_file",          cf_string_dyn,  CA_STATIC, CA_GOD,      (int *)&mudconf.wizmotd_file,    NULL, SIZEOF_PATHNAME},
     {"wizard_motd_message",       cf_string,      CA_GOD,    CA_WIZARD,   (int *)mudconf.wizmotd_msg,      NULL,       GBUF_SIZE},
     {"zone_recursion_limit",      cf_int,         CA_GOD,    CA_PUBLIC,   &mudconf.zone_nest_lim,          NULL,               0},
@@ -18,6 +18,8 @@
 #define MAX_GLOBAL_REGS     36  /* r() registers */
 
 #define OUTPUT_BLOCK_SIZE   16384
+#define OUTPUT_SMALL_BLOCK_SIZE 512  /* Block queued after shared output */
+#define OUTPUT_SHARE_MIN    64  /* Shorter lines are copied, not shared */
 
 /* ---------------------------------------------------------------------------
  * Database R/W flags.
@@ -13,11 +13,16 @@
 #include "externs.h"
 
 #include <signal.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
 
 #include "attrs.h"
 #include "command.h"
 #include "interface.h"
 #include "powers.h"
+#include "profile.h"
 
 bool break_called = false;
 
@@ -81,14 +86,613 @@ static int add_to(dbref executor, int am, int attrnum)
     return num;
 }
 
-// This Task assumes that pEntry is already unlinked from any lists it may
-// have been related to.
+// ---------------------------------------------------------------------------
+// Register sets.
 //
-static void Task_RunQueueEntry(void *pEntry, int iUnused)
+// A trigger which fans out to many objects queues many entries with the same
+// registers.  A reg_ref is never changed once it is assigned, so the set
+// made for one entry can be shared by the next as long as the registers are
+// still the same pointers.
+//
+static REG_SET *last_regset = NULL;
+
+static REG_SET *RegSetSave(reg_ref *sargs[])
+{
+    if (NULL == sargs)
+    {
+        return NULL;
+    }
+
+    if (  NULL != last_regset
+       && 0 == memcmp(last_regset->regs, sargs, sizeof(last_regset->regs)))
+    {
+        last_regset->refcount++;
+        return last_regset;
+    }
+
+    int i;
+    for (i = 0; i < MAX_GLOBAL_REGS; i++)
+    {
+        if (sargs[i])
+        {
+            break;
+        }
+    }
+    if (MAX_GLOBAL_REGS == i)
+    {
+        return NULL;
+    }
+
+    REG_SET *prs = (REG_SET *)MEMALLOC(sizeof(REG_SET));
+    ISOUTOFMEMORY(prs);
+    prs->refcount = 1;
+    for (i = 0; i < MAX_GLOBAL_REGS; i++)
+    {
+        prs->regs[i] = sargs[i];
+        RegAddRef(sargs[i]);
+    }
+    last_regset = prs;
+    return prs;
+}
+
+static void RegSetRelease(REG_SET *prs)
+{
+    if (NULL == prs)
+    {
+        return;
+    }
+
+    prs->refcount--;
+    if (0 == prs->refcount)
+    {
+        for (int i = 0; i < MAX_GLOBAL_REGS; i++)
+        {
+            RegRelease(prs->regs[i]);
+        }
+        if (last_regset == prs)
+        {
+            last_regset = NULL;
+        }
+        MEMFREE(prs);
+    }
+}
+
+// RegSetLoad: Replace the global registers with those from a set, and let go
+// of the set.
+//
+static void RegSetLoad(REG_SET *prs)
+{
+    for (int i = 0; i < MAX_GLOBAL_REGS; i++)
+    {
+        if (mudstate.global_regs[i])
+        {
+            RegRelease(mudstate.global_regs[i]);
+            mudstate.global_regs[i] = NULL;
+        }
+    }
+
+    if (NULL == prs)
+    {
+        return;
+    }
+
+    if (1 == prs->refcount)
+    {
+        // No one else has this set, so its references can be handed over.
+        //
+        memcpy(mudstate.global_regs, prs->regs, sizeof(prs->regs));
+        if (last_regset == prs)
+        {
+            last_regset = NULL;
+        }
+        MEMFREE(prs);
+    }
+    else
+    {
+        for (int i = 0; i < MAX_GLOBAL_REGS; i++)
+        {
+            mudstate.global_regs[i] = prs->regs[i];
+            RegAddRef(prs->regs[i]);
+        }
+        RegSetRelease(prs);
+    }
+}
+
+static void Task_SemaphoreTimeout(void *pExpired, int iUnused);
+
+// ---------------------------------------------------------------------------
+// Queue lists.
+//
+// Each queue entry is listed under its executor, under its owner, and while
+// it waits on a semaphore, under the semaphore object.  halt_que, nfy_que,
+// and do_ps walk only the lists they need instead of every task in the
+// scheduler.  An object's lists are dropped when they become empty.
+//
+typedef struct
+{
+    BQUE *head[QL_COUNT];
+    BQUE *tail[QL_COUNT];
+} QUEUE_LISTS;
+
+typedef std::map<dbref, QUEUE_LISTS> QUEUE_LISTS_MAP;
+static QUEUE_LISTS_MAP que_lists;
+
+static int que_serial;
+static int que_nRunQueueEntry;
+static int que_nSemaphoreTimeout;
+#ifdef QUERY_SLAVE
+static int que_nSQLTimeout;
+#endif // QUERY_SLAVE
+static int que_nSliceYields;
+static int que_nSliceOverruns;
+
+static int *que_count(BQUE *point)
+{
+    if (point->task == Task_SemaphoreTimeout)
+    {
+        return &que_nSemaphoreTimeout;
+    }
+#ifdef QUERY_SLAVE
+    else if (point->task == Task_SQLTimeout)
+    {
+        return &que_nSQLTimeout;
+    }
+#endif // QUERY_SLAVE
+    return &que_nRunQueueEntry;
+}
+
+static dbref que_key(BQUE *point, int iList)
+{
+    switch (iList)
+    {
+    case QL_EXECUTOR:
+        return point->executor;
+
+    case QL_OWNER:
+        return point->owner;
+    }
+    return point->sem;
+}
+
+static void que_link(BQUE *point, int iList)
+{
+    QUEUE_LISTS_MAP::iterator it = que_lists.find(que_key(point, iList));
+    if (it == que_lists.end())
+    {
+        QUEUE_LISTS ql;
+        memset(&ql, 0, sizeof(ql));
+        it = que_lists.insert(QUEUE_LISTS_MAP::value_type(que_key(point, iList), ql)).first;
+    }
+    QUEUE_LISTS &ql = it->second;
+
+    point->links[iList].next = NULL;
+    point->links[iList].prev = ql.tail[iList];
+    if (ql.tail[iList])
+    {
+        ql.tail[iList]->links[iList].next = point;
+    }
+    else
+    {
+        ql.head[iList] = point;
+    }
+    ql.tail[iList] = point;
+}
+
+static void que_unlink(BQUE *point, int iList)
+{
+    QUEUE_LISTS_MAP::iterator it = que_lists.find(que_key(point, iList));
+    if (it == que_lists.end())
+    {
+        return;
+    }
+    QUEUE_LISTS &ql = it->second;
+
+    BQUE *pNext = point->links[iList].next;
+    BQUE *pPrev = point->links[iList].prev;
+    if (pPrev)
+    {
+        pPrev->links[iList].next = pNext;
+    }
+    else
+    {
+        ql.head[iList] = pNext;
+    }
+    if (pNext)
+    {
+        pNext->links[iList].prev = pPrev;
+    }
+    else
+    {
+        ql.tail[iList] = pPrev;
+    }
+    point->links[iList].next = NULL;
+    point->links[iList].prev = NULL;
+
+    if (  NULL == ql.head[QL_EXECUTOR]
+       && NULL == ql.head[QL_OWNER]
+       && NULL == ql.head[QL_SEMAPHORE])
+    {
+        que_lists.erase(it);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Run queues.
+//
+// An entry which is ready to run waits on the run queue of its owner.  The
+// owners with ready entries take turns by deficit round-robin: each turn
+// grants queue_weight (or the owner's QueueWeight) milliseconds of credit,
+// the time an entry takes is charged against it afterwards, and the owner
+// keeps the turn while the credit lasts.  One object storm can then only
+// delay other players' objects by about one turn.
+//
+// Every entry made ready puts a dispatch task on the scheduler at the
+// entry's priority, so commands typed by players still come first.  The
+// dispatch task runs whichever entry is next by turn, not necessarily the
+// entry which made it.  Entries removed from a run queue leave their
+// dispatch tasks behind, and those are reused by the next ready entries.
+//
+#define QUE_QUANTUM      10000  // Credit for each unit of weight, in 100ns.
+#define QUE_WAIT_SAMPLES 64     // Recent waits kept for @ps/summary.
+
+typedef struct
 {
+    BQUE *head;
+    BQUE *tail;
+    int   nReady;
+    INT64 tCredit;              // Negative when an entry overran its turn.
+    int   nSamples;
+    int   iSample;              // Where the next wait goes in tWait.
+    INT64 tWait[QUE_WAIT_SAMPLES];
+} QUEUE_FLOW;
+
+typedef std::map<dbref, QUEUE_FLOW> QUEUE_FLOW_MAP;
+static QUEUE_FLOW_MAP que_flows;
+static std::deque<dbref> que_turns;
+static int que_nReady;
+static int que_nDispatches;
+
+static void Task_DispatchQueue(void *pUnused, int iUnused);
+
+static int que_priority(BQUE *point)
+{
+    if (isPlayer(point->enactor))
+    {
+        return PRIORITY_PLAYER;
+    }
+    return PRIORITY_OBJECT;
+}
+
+// que_ready: Put an entry at the end of its owner's run queue.
+//
+static void que_ready(BQUE *point)
+{
+    point->IsReady = true;
+    point->flow = mudconf.queue_fair_share ? point->owner : NOTHING;
+    point->readytime.GetUTC();
+
+    QUEUE_FLOW_MAP::iterator it = que_flows.find(point->flow);
+    if (it == que_flows.end())
+    {
+        QUEUE_FLOW qf;
+        memset(&qf, 0, sizeof(qf));
+        it = que_flows.insert(QUEUE_FLOW_MAP::value_type(point->flow, qf)).first;
+        que_turns.push_back(point->flow);
+    }
+    QUEUE_FLOW &qf = it->second;
+
+    point->ready.next = NULL;
+    point->ready.prev = qf.tail;
+    if (qf.tail)
+    {
+        qf.tail->ready.next = point;
+    }
+    else
+    {
+        qf.head = point;
+    }
+    qf.tail = point;
+    qf.nReady++;
+    que_nReady++;
+}
+
+// que_unready: Take an entry off its run queue.
+//
+static void que_unready(BQUE *point)
+{
+    QUEUE_FLOW &qf = que_flows[point->flow];
+    BQUE *pNext = point->ready.next;
+    BQUE *pPrev = point->ready.prev;
+    if (pPrev)
+    {
+        pPrev->ready.next = pNext;
+    }
+    else
+    {
+        qf.head = pNext;
+    }
+    if (pNext)
+    {
+        pNext->ready.prev = pPrev;
+    }
+    else
+    {
+        qf.tail = pPrev;
+    }
+    point->ready.next = NULL;
+    point->ready.prev = NULL;
+    point->IsReady = false;
+    qf.nReady--;
+    que_nReady--;
+}
+
+// que_schedule: Make an entry ready and see that it will be dispatched.
+//
+static void que_schedule(BQUE *point)
+{
+    que_ready(point);
+    if (que_nDispatches < que_nReady)
+    {
+        // Dispatch tasks are numbered only to keep them from sharing a chain
+        // in the scheduler's task index.
+        //
+        static int iDispatch = 0;
+        que_nDispatches++;
+        scheduler.DeferImmediateTask(que_priority(point), Task_DispatchQueue, 0, iDispatch++);
+    }
+}
+
+// que_next: Find the entry whose turn it is.
+//
+static BQUE *que_next(void)
+{
+    while (!que_turns.empty())
+    {
+        dbref key = que_turns.front();
+        QUEUE_FLOW &qf = que_flows[key];
+        if (NULL == qf.head)
+        {
+            // Owners leave the rotation once they have nothing ready, and
+            // are forgotten along with any credit or debt they had, so that
+            // que_flows holds only owners with something to run.
+            //
+            que_turns.pop_front();
+            que_flows.erase(key);
+        }
+        else if (0 < qf.tCredit)
+        {
+            return qf.head;
+        }
+        else
+        {
+            INT64 tQuantum = QUE_QUANTUM;
+            if (NOTHING != key)
+            {
+                tQuantum *= QueueWeight(key);
+            }
+            que_turns.pop_front();
+            if (que_turns.empty())
+            {
+                // No one else is waiting for a turn, so there is no need
+                // to pay back what was overrun.
+                //
+                qf.tCredit = tQuantum;
+            }
+            else
+            {
+                qf.tCredit += tQuantum;
+            }
+            que_turns.push_back(key);
+        }
+    }
+    return NULL;
+}
+
+static void que_run(BQUE *point);
+static BQUE *que_alloc(dbref executor, dbref caller, dbref enactor, int eval,
+    char *command, int nargs, char *args[], reg_ref *sargs[]);
+static void Task_RunQueueEntry(void *pEntry, int iUnused);
+
+// que_dispatch: Run the next entry by turn, and charge its owner.
+//
+static int que_dispatch(void)
+{
+    BQUE *point = que_next();
+    if (NULL == point)
+    {
+        return 0;
+    }
+
+    CLinearTimeAbsolute ltaBegin;
+    ltaBegin.GetUTC();
+    dbref key = point->flow;
+    INT64 tWait = (ltaBegin - point->readytime).Return100ns();
+
+    que_run(point);
+
+    CLinearTimeAbsolute ltaEnd;
+    ltaEnd.GetUTC();
+    INT64 tCost = (ltaEnd - ltaBegin).Return100ns();
+    if (tCost < 1)
+    {
+        tCost = 1;
+    }
+
+    QUEUE_FLOW &qf = que_flows[key];
+    qf.tCredit -= tCost;
+    if (tWait < 0)
+    {
+        tWait = 0;
+    }
+    qf.tWait[qf.iSample] = tWait;
+    qf.iSample = (qf.iSample + 1) % QUE_WAIT_SAMPLES;
+    if (qf.nSamples < QUE_WAIT_SAMPLES)
+    {
+        qf.nSamples++;
+    }
+    return 1;
+}
+
+static void Task_DispatchQueue(void *pUnused, int iUnused)
+{
+    UNUSED_PARAMETER(pUnused);
     UNUSED_PARAMETER(iUnused);
 
-    BQUE *point = (BQUE *)pEntry;
+    que_nDispatches--;
+    que_dispatch();
+}
+
+// que_file: List an entry which fpTask will run or expire.
+//
+static void que_file(BQUE *point, FTASK *fpTask)
+{
+    point->task = fpTask;
+    point->serial = que_serial++;
+    point->owner = Owner(point->executor);
+    que_link(point, QL_EXECUTOR);
+    que_link(point, QL_OWNER);
+    if (fpTask == Task_SemaphoreTimeout)
+    {
+        que_link(point, QL_SEMAPHORE);
+    }
+    (*que_count(point))++;
+}
+
+// que_unfile: Take an entry off its lists. Entries which are not listed are
+// left alone.
+//
+static void que_unfile(BQUE *point)
+{
+    if (NOTHING == point->owner)
+    {
+        return;
+    }
+    (*que_count(point))--;
+    if (point->IsReady)
+    {
+        que_unready(point);
+    }
+    if (point->task == Task_SemaphoreTimeout)
+    {
+        que_unlink(point, QL_SEMAPHORE);
+    }
+    que_unlink(point, QL_OWNER);
+    que_unlink(point, QL_EXECUTOR);
+    point->owner = NOTHING;
+}
+
+// que_rehome: Move thing's entries to the lists of its current owner.
+//
+void que_rehome(dbref thing)
+{
+    QUEUE_LISTS_MAP::iterator it = que_lists.find(thing);
+    if (it == que_lists.end())
+    {
+        return;
+    }
+
+    dbref owner = Owner(thing);
+    BQUE *point = it->second.head[QL_EXECUTOR];
+    while (point)
+    {
+        BQUE *pNext = point->links[QL_EXECUTOR].next;
+        if (  NOTHING != point->owner
+           && owner != point->owner)
+        {
+            que_unlink(point, QL_OWNER);
+            point->owner = owner;
+            que_link(point, QL_OWNER);
+        }
+        point = pNext;
+    }
+}
+
+// que_before: Order entries the way @notify releases them and @ps lists them:
+// entries without a time in the order they were queued, then timed entries
+// in the order they are due.
+//
+static bool que_before(BQUE *a, BQUE *b)
+{
+    if (a->IsTimed != b->IsTimed)
+    {
+        return !a->IsTimed;
+    }
+    if (a->IsTimed)
+    {
+        if (a->waittime < b->waittime)
+        {
+            return true;
+        }
+        else if (b->waittime < a->waittime)
+        {
+            return false;
+        }
+    }
+    return (a->serial - b->serial) < 0;
+}
+
+// que_free: Release an entry which will not be run.
+//
+static void que_free(BQUE *point)
+{
+    que_unfile(point);
+    RegSetRelease(point->scr);
+    point->scr = NULL;
+    MEMFREE(point);
+}
+
+// ---------------------------------------------------------------------------
+// Time slicing.
+//
+// With queue_slice or queue_slice_functions set, an entry that has used up
+// its slice between two commands hands the rest of its action list to a
+// new entry at the back of the queue, so that player input is serviced in
+// the meantime.  A single command is never cut short.  One that by itself
+// runs past the slice is counted as an overrun.
+//
+static bool que_slice_enabled(void)
+{
+    return (  0 < mudconf.queue_slice_funcs
+           || 0 < mudconf.queue_slice.Return100ns());
+}
+
+static bool que_slice_exceeded(CLinearTimeDelta ltd, int nFuncs)
+{
+    return (  (  0 < mudconf.queue_slice_funcs
+              && mudconf.queue_slice_funcs < nFuncs)
+           || (  0 < mudconf.queue_slice.Return100ns()
+              && mudconf.queue_slice < ltd));
+}
+
+// que_continue: Queue the rest of an action list with the current registers.
+//
+// The action list was paid for and counted against QueueMax when it was
+// queued, so the rest is not charged or checked again.  Like any entry, the
+// new one holds the deposit and queue slot which que_run() returned when
+// this one started.
+//
+static void que_continue(BQUE *point, dbref executor, char *command)
+{
+    BQUE *tmp = que_alloc(executor, point->caller, point->enactor,
+        point->eval, command, point->nargs, point->env, mudstate.global_regs);
+    tmp->prof_kind = point->prof_kind;
+    tmp->prof_thing = point->prof_thing;
+    tmp->prof_attr = point->prof_attr;
+
+    giveto(executor, -mudconf.waitcost);
+    a_Queue(Owner(executor), 1);
+
+    que_file(tmp, Task_RunQueueEntry);
+    que_schedule(tmp);
+    que_nSliceYields++;
+}
+
+// que_run: Run an entry and free it.  The entry is taken off its lists
+// before it runs, so nothing the command does can find and free it.
+//
+static void que_run(BQUE *point)
+{
+    que_unfile(point);
     dbref executor = point->executor;
 
     if (  Good_obj(executor)
@@ -101,20 +705,21 @@ static void Task_RunQueueEntry(void *pEntry, int iUnused)
         point->executor = NOTHING;
         if (!Halted(executor))
         {
+            PROF_FRAME pf;
+            prof_begin(&pf, point->prof_kind,
+                NOTHING == point->prof_thing ? executor : point->prof_thing,
+                point->prof_attr);
+
             // Load scratch args.
             //
-            for (int i = 0; i < MAX_GLOBAL_REGS; i++)
-            {
-                if (mudstate.global_regs[i])
-                {
-                    RegRelease(mudstate.global_regs[i]);
-                    mudstate.global_regs[i] = NULL;
-                }
-                mudstate.global_regs[i] = point->scr[i];
-                point->scr[i] = NULL;
-            }
+            RegSetLoad(point->scr);
+            point->scr = NULL;
 
             char *command = point->comm;
+            bool bSliced = que_slice_enabled();
+            CLinearTimeAbsolute ltaSlice;
+            ltaSlice.GetUTC();
+            int nSliceFuncs = 0;
 
             mux_assert(!mudstate.inpipe);
             mux_assert(mudstate.pipe_nest_lev == 0);
@@ -191,6 +796,15 @@ static void Task_RunQueueEntry(void *pEntry, int iUnused)
                         log_text(log_cmdbuf);
                         ENDLOG;
                     }
+
+                    if (bSliced)
+                    {
+                        nSliceFuncs += mudstate.func_invk_ctr;
+                        if (que_slice_exceeded(ltd, mudstate.func_invk_ctr))
+                        {
+                            que_nSliceOverruns++;
+                        }
+                    }
                 }
 
                 // Transition %| value.
@@ -207,6 +821,23 @@ static void Task_RunQueueEntry(void *pEntry, int iUnused)
                     mudstate.poutnew  = NULL;
                     mudstate.poutbufc = NULL;
                 }
+
+                // A pending %| value cannot be carried over, so the entry
+                // only yields between unpiped commands.
+                //
+                if (  bSliced
+                   && command
+                   && !break_called
+                   && !mudstate.pout)
+                {
+                    CLinearTimeAbsolute ltaNow;
+                    ltaNow.GetUTC();
+                    if (que_slice_exceeded(ltaNow - ltaSlice, nSliceFuncs))
+                    {
+                        que_continue(point, executor, command);
+                        command = NULL;
+                    }
+                }
             }
 
             // Clean up %| value.
@@ -219,27 +850,32 @@ static void Task_RunQueueEntry(void *pEntry, int iUnused)
             mudstate.pipe_nest_lev = 0;
             mudstate.inpipe = false;
             mudstate.poutobj = NOTHING;
+            prof_end(&pf);
         }
     }
 
+    RegSetRelease(point->scr);
+    point->scr = NULL;
     for (int i = 0; i < MAX_GLOBAL_REGS; i++)
     {
-        if (point->scr[i])
-        {
-            RegRelease(point->scr[i]);
-            point->scr[i] = NULL;
-        }
-
         if (mudstate.global_regs[i])
         {
             RegRelease(mudstate.global_regs[i]);
             mudstate.global_regs[i] = NULL;
         }
     }
+    MEMFREE(point);
+}
+
+// A timed entry is due.  It goes to the end of its run queue, and the entry
+// whose turn it is runs in its place.
+//
+static void Task_RunQueueEntry(void *pEntry, int iUnused)
+{
+    UNUSED_PARAMETER(iUnused);
 
-    MEMFREE(point->text);
-    point->text = NULL;
-    free_qentry(point);
+    que_ready((BQUE *)pEntry);
+    que_dispatch();
 }
 
 // ---------------------------------------------------------------------------
@@ -256,6 +892,59 @@ static bool que_want(BQUE *entry, dbref ptarg, dbref otarg)
            || otarg == entry->executor);
 }
 
+// ---------------------------------------------------------------------------
+// que_gather: Collect the listed entries that que_want() picks out.
+//
+static void que_gather_list(dbref key, int iList, dbref ptarg, dbref otarg, std::vector<BQUE *> &entries)
+{
+    QUEUE_LISTS_MAP::iterator it = que_lists.find(key);
+    if (it == que_lists.end())
+    {
+        return;
+    }
+    for (BQUE *point = it->second.head[iList]; point; point = point->links[iList].next)
+    {
+        if (que_want(point, ptarg, otarg))
+        {
+            entries.push_back(point);
+        }
+    }
+}
+
+static void que_gather(dbref ptarg, dbref otarg, std::vector<BQUE *> &entries)
+{
+    if (NOTHING != otarg)
+    {
+        que_gather_list(otarg, QL_EXECUTOR, ptarg, otarg, entries);
+    }
+    else if (NOTHING != ptarg)
+    {
+        que_gather_list(ptarg, QL_OWNER, ptarg, otarg, entries);
+    }
+    else
+    {
+        QUEUE_LISTS_MAP::iterator it;
+        for (it = que_lists.begin(); it != que_lists.end(); ++it)
+        {
+            BQUE *point;
+            for (point = it->second.head[QL_EXECUTOR]; point; point = point->links[QL_EXECUTOR].next)
+            {
+                entries.push_back(point);
+            }
+        }
+    }
+}
+
+// que_unblock: Move an entry from the semaphore queue to the wait queue.
+//
+static void que_unblock(BQUE *point)
+{
+    que_unlink(point, QL_SEMAPHORE);
+    que_nSemaphoreTimeout--;
+    que_nRunQueueEntry++;
+    point->task = Task_RunQueueEntry;
+}
+
 static void Task_SemaphoreTimeout(void *pExpired, int iUnused)
 {
     UNUSED_PARAMETER(iUnused);
@@ -263,9 +952,11 @@ static void Task_SemaphoreTimeout(void *pExpired, int iUnused)
     // A semaphore has timed out.
     //
     BQUE *point = (BQUE *)pExpired;
+    que_unblock(point);
     add_to(point->sem, -1, point->attr);
     point->sem = NOTHING;
-    Task_RunQueueEntry(point, 0);
+    que_ready(point);
+    que_dispatch();
 }
 
 #ifdef QUERY_SLAVE
@@ -274,71 +965,11 @@ void Task_SQLTimeout(void *pExpired, int iUnused)
     // A SQL Query has timed out.
     //
     BQUE *point = (BQUE *)pExpired;
-    Task_RunQueueEntry(point, 0);
+    que_unfile(point);
+    que_run(point);
 }
 #endif // QUERY_SLAVE
 
-static dbref Halt_Player_Target;
-static dbref Halt_Object_Target;
-static int   Halt_Entries;
-static dbref Halt_Player_Run;
-static dbref Halt_Entries_Run;
-
-static int CallBack_HaltQueue(PTASK_RECORD p)
-{
-    if (  p->fpTask == Task_RunQueueEntry
-#ifdef QUERY_SLAVE
-       || p->fpTask == Task_SQLTimeout
-#endif // QUERY_SLAVE
-       || p->fpTask == Task_SemaphoreTimeout)
-    {
-        // This is a @wait, timed Semaphore Task, or timed SQL Query.
-        //
-        BQUE *point = (BQUE *)(p->arg_voidptr);
-        if (que_want(point, Halt_Player_Target, Halt_Object_Target))
-        {
-            // Accounting for pennies and queue quota.
-            //
-            dbref dbOwner = point->executor;
-            if (!isPlayer(dbOwner))
-            {
-                dbOwner = Owner(dbOwner);
-            }
-            if (dbOwner != Halt_Player_Run)
-            {
-                if (Halt_Player_Run != NOTHING)
-                {
-                    giveto(Halt_Player_Run, mudconf.waitcost * Halt_Entries_Run);
-                    a_Queue(Halt_Player_Run, -Halt_Entries_Run);
-                }
-                Halt_Player_Run = dbOwner;
-                Halt_Entries_Run = 0;
-            }
-            Halt_Entries++;
-            Halt_Entries_Run++;
-            if (p->fpTask == Task_SemaphoreTimeout)
-            {
-                add_to(point->sem, -1, point->attr);
-            }
-
-            for (int i = 0; i < MAX_GLOBAL_REGS; i++)
-            {
-                if (point->scr[i])
-                {
-                    RegRelease(point->scr[i]);
-                    point->scr[i] = NULL;
-                }
-            }
-
-            MEMFREE(point->text);
-            point->text = NULL;
-            free_qentry(point);
-            return IU_REMOVE_TASK;
-        }
-    }
-    return IU_NEXT_TASK;
-}
-
 // ------------------------------------------------------------------
 //
 // halt_que: Remove all queued commands that match (executor, object).
@@ -351,23 +982,49 @@ static int CallBack_HaltQueue(PTASK_RECORD p)
 //
 int halt_que(dbref executor, dbref object)
 {
-    Halt_Player_Target = executor;
-    Halt_Object_Target = object;
-    Halt_Entries       = 0;
-    Halt_Player_Run    = NOTHING;
-    Halt_Entries_Run   = 0;
-
     // Process @wait, timed semaphores, and untimed semaphores.
     //
-    scheduler.TraverseUnordered(CallBack_HaltQueue);
+    std::vector<BQUE *> entries;
+    que_gather(executor, object, entries);
+
+    dbref Halt_Player_Run  = NOTHING;
+    int   Halt_Entries_Run = 0;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        BQUE *point = entries[i];
+        scheduler.CancelTask(point->task, point, 0);
+
+        // Accounting for pennies and queue quota.
+        //
+        dbref dbOwner = point->executor;
+        if (!isPlayer(dbOwner))
+        {
+            dbOwner = Owner(dbOwner);
+        }
+        if (dbOwner != Halt_Player_Run)
+        {
+            if (Halt_Player_Run != NOTHING)
+            {
+                giveto(Halt_Player_Run, mudconf.waitcost * Halt_Entries_Run);
+                a_Queue(Halt_Player_Run, -Halt_Entries_Run);
+            }
+            Halt_Player_Run = dbOwner;
+            Halt_Entries_Run = 0;
+        }
+        Halt_Entries_Run++;
+        if (point->task == Task_SemaphoreTimeout)
+        {
+            add_to(point->sem, -1, point->attr);
+        }
+        que_free(point);
+    }
 
     if (Halt_Player_Run != NOTHING)
     {
         giveto(Halt_Player_Run, mudconf.waitcost * Halt_Entries_Run);
         a_Queue(Halt_Player_Run, -Halt_Entries_Run);
-        Halt_Player_Run = NOTHING;
     }
-    return Halt_Entries;
+    return static_cast<int>(entries.size());
 }
 
 // ---------------------------------------------------------------------------
@@ -443,111 +1100,14 @@ void do_halt(dbref executor, dbref caller, dbref enactor, int eval, int key, cha
     notify(Owner(executor), tprintf("%d queue entr%s removed.", numhalted, numhalted == 1 ? "y" : "ies"));
 }
 
-static int Notify_Key;
-static int Notify_Num_Done;
-static int Notify_Num_Max;
-static int Notify_Sem;
-static int Notify_Attr;
-
-// NFY_DRAIN or NFY_NFYALL
-//
-static int CallBack_NotifySemaphoreDrainOrAll(PTASK_RECORD p)
-{
-    if (p->fpTask == Task_SemaphoreTimeout)
-    {
-        // This represents a semaphore.
-        //
-        BQUE *point = (BQUE *)(p->arg_voidptr);
-        if (  point->sem == Notify_Sem
-           && (  point->attr == Notify_Attr
-              || !Notify_Attr))
-        {
-            Notify_Num_Done++;
-            if (Notify_Key == NFY_DRAIN)
-            {
-                // Discard the command
-                //
-                giveto(point->executor, mudconf.waitcost);
-                a_Queue(Owner(point->executor), -1);
-
-                for (int i = 0; i < MAX_GLOBAL_REGS; i++)
-                {
-                    if (point->scr[i])
-                    {
-                        RegRelease(point->scr[i]);
-                        point->scr[i] = NULL;
-                    }
-                }
-
-                MEMFREE(point->text);
-                point->text = NULL;
-                free_qentry(point);
-
-                return IU_REMOVE_TASK;
-            }
-            else
-            {
-                // Allow the command to run. The priority may have been
-                // PRIORITY_SUSPEND, so we need to change it.
-                //
-                if (isPlayer(point->enactor))
-                {
-                    p->iPriority = PRIORITY_PLAYER;
-                }
-                else
-                {
-                    p->iPriority = PRIORITY_OBJECT;
-                }
-                p->ltaWhen.GetUTC();
-                p->fpTask = Task_RunQueueEntry;
-                return IU_UPDATE_TASK;
-            }
-        }
-    }
-    return IU_NEXT_TASK;
-}
-
-// NFY_NFY or NFY_QUIET
+// ---------------------------------------------------------------------------
+// que_release: Allow a command waiting on a semaphore to run.
 //
-static int CallBack_NotifySemaphoreFirstOrQuiet(PTASK_RECORD p)
+static void que_release(BQUE *point)
 {
-    // If we've notified enough, exit.
-    //
-    if (  (  NFY_NFY == Notify_Key
-          || NFY_QUIET == Notify_Key)
-       && Notify_Num_Done >= Notify_Num_Max)
-    {
-        return IU_DONE;
-    }
-
-    if (p->fpTask == Task_SemaphoreTimeout)
-    {
-        // This represents a semaphore.
-        //
-        BQUE *point = (BQUE *)(p->arg_voidptr);
-        if (  point->sem == Notify_Sem
-           && (  point->attr == Notify_Attr
-              || !Notify_Attr))
-        {
-            Notify_Num_Done++;
-
-            // Allow the command to run. The priority may have been
-            // PRIORITY_SUSPEND, so we need to change it.
-            //
-            if (isPlayer(point->enactor))
-            {
-                p->iPriority = PRIORITY_PLAYER;
-            }
-            else
-            {
-                p->iPriority = PRIORITY_OBJECT;
-            }
-            p->ltaWhen.GetUTC();
-            p->fpTask = Task_RunQueueEntry;
-            return IU_UPDATE_TASK;
-        }
-    }
-    return IU_NEXT_TASK;
+    scheduler.CancelTask(Task_SemaphoreTimeout, point, 0);
+    que_unblock(point);
+    que_schedule(point);
 }
 
 // ---------------------------------------------------------------------------
@@ -565,21 +1125,50 @@ int nfy_que(dbref sem, int attr, int key, int count)
         free_lbuf(str);
     }
 
-    Notify_Num_Done = 0;
+    std::vector<BQUE *> entries;
     if (cSemaphore > 0)
     {
-        Notify_Key     = key;
-        Notify_Sem     = sem;
-        Notify_Attr    = attr;
-        Notify_Num_Max = count;
+        QUEUE_LISTS_MAP::iterator it = que_lists.find(sem);
+        if (it != que_lists.end())
+        {
+            BQUE *point;
+            for (point = it->second.head[QL_SEMAPHORE]; point; point = point->links[QL_SEMAPHORE].next)
+            {
+                if (  point->attr == attr
+                   || !attr)
+                {
+                    entries.push_back(point);
+                }
+            }
+        }
+
         if (  key == NFY_NFY
            || key == NFY_QUIET)
         {
-            scheduler.TraverseOrdered(CallBack_NotifySemaphoreFirstOrQuiet);
+            std::sort(entries.begin(), entries.end(), que_before);
+            if (  0 <= count
+               && static_cast<size_t>(count) < entries.size())
+            {
+                entries.resize(count);
+            }
         }
-        else
+
+        for (size_t i = 0; i < entries.size(); i++)
         {
-            scheduler.TraverseUnordered(CallBack_NotifySemaphoreDrainOrAll);
+            BQUE *point = entries[i];
+            if (key == NFY_DRAIN)
+            {
+                // Discard the command
+                //
+                scheduler.CancelTask(Task_SemaphoreTimeout, point, 0);
+                giveto(point->executor, mudconf.waitcost);
+                a_Queue(Owner(point->executor), -1);
+                que_free(point);
+            }
+            else
+            {
+                que_release(point);
+            }
         }
     }
 
@@ -595,7 +1184,7 @@ int nfy_que(dbref sem, int attr, int key, int count)
         atr_clr(sem, attr);
     }
 
-    return Notify_Num_Done;
+    return static_cast<int>(entries.size());
 }
 
 // ---------------------------------------------------------------------------
@@ -737,7 +1326,26 @@ static BQUE *setup_que
 
     // We passed all the tests.
     //
+    return que_alloc(executor, caller, enactor, eval, command, nargs, args,
+        sargs);
+}
 
+// ---------------------------------------------------------------------------
+// que_alloc: Make a queue entry, with its command, arguments, and registers
+// copied in behind it.
+//
+static BQUE *que_alloc
+(
+    dbref    executor,
+    dbref    caller,
+    dbref    enactor,
+    int      eval,
+    char    *command,
+    int      nargs,
+    char    *args[],
+    reg_ref *sargs[]
+)
+{
     // Calculate the length of the save string.
     //
     size_t tlen = 0;
@@ -755,6 +1363,7 @@ static BQUE *setup_que
         nargs = NUM_ENV_VARS;
     }
 
+    int a;
     for (a = 0; a < nargs; a++)
     {
         if (args[a])
@@ -764,13 +1373,13 @@ static BQUE *setup_que
         }
     }
 
-    // Create the qeue entry and load the save string.
+    // Create the queue entry with the save string behind it.
     //
-    BQUE *tmp = alloc_qentry("setup_que.qblock");
+    BQUE *tmp = (BQUE *)MEMALLOC(sizeof(BQUE) + tlen);
+    ISOUTOFMEMORY(tmp);
     tmp->comm = NULL;
 
-    char *tptr = tmp->text = (char *)MEMALLOC(tlen);
-    ISOUTOFMEMORY(tptr);
+    char *tptr = (char *)(tmp + 1);
 
     if (command)
     {
@@ -798,29 +1407,16 @@ static BQUE *setup_que
         tmp->env[a] = NULL;
     }
 
-    if (sargs)
-    {
-        for (a = 0; a < MAX_GLOBAL_REGS; a++)
-        {
-            tmp->scr[a] = sargs[a];
-            if (sargs[a])
-            {
-                RegAddRef(sargs[a]);
-            }
-        }
-    }
-    else
-    {
-        for (a = 0; a < MAX_GLOBAL_REGS; a++)
-        {
-            tmp->scr[a] = NULL;
-        }
-    }
+    tmp->scr = RegSetSave(sargs);
 
     // Load the rest of the queue block.
     //
     tmp->executor = executor;
     tmp->IsTimed = false;
+    tmp->IsReady = false;
+    tmp->prof_kind = PROF_QUEUE;
+    tmp->prof_thing = NOTHING;
+    tmp->prof_attr = 0;
     tmp->sem = NOTHING;
     tmp->attr = 0;
     tmp->enactor = enactor;
@@ -849,6 +1445,11 @@ void wait_que
     reg_ref *sargs[]
 )
 {
+    int   iProfKind;
+    dbref ProfThing;
+    int   iProfAttr;
+    prof_take_origin(&iProfKind, &ProfThing, &iProfAttr);
+
     if (!(mudconf.control_flags & CF_INTERP))
     {
         return;
@@ -863,6 +1464,9 @@ void wait_que
     {
         return;
     }
+    tmp->prof_kind = iProfKind;
+    tmp->prof_thing = ProfThing;
+    tmp->prof_attr = iProfAttr;
 
     int iPriority;
     if (isPlayer(tmp->enactor))
@@ -884,13 +1488,14 @@ void wait_que
         // Not a semaphore, so let it run it immediately or put it on
         // the wait queue.
         //
+        que_file(tmp, Task_RunQueueEntry);
         if (tmp->IsTimed)
         {
             scheduler.DeferTask(tmp->waittime, iPriority, Task_RunQueueEntry, tmp, 0);
         }
         else
         {
-            scheduler.DeferImmediateTask(iPriority, Task_RunQueueEntry, tmp, 0);
+            que_schedule(tmp);
         }
     }
     else
@@ -903,6 +1508,7 @@ void wait_que
             //
             iPriority = PRIORITY_SUSPEND;
         }
+        que_file(tmp, Task_SemaphoreTimeout);
         scheduler.DeferTask(tmp->waittime, iPriority, Task_SemaphoreTimeout, tmp, 0);
     }
 }
@@ -960,6 +1566,7 @@ void sql_que
     {
         iPriority = PRIORITY_OBJECT;
     }
+    que_file(tmp, Task_SQLTimeout);
     scheduler.DeferTask(tmp->waittime, iPriority, Task_SQLTimeout, tmp, 0);
 }
 #endif // QUERY_SLAVE
@@ -1144,11 +1751,8 @@ static int Total_RunQueueEntry;
 static int Shown_RunQueueEntry;
 static int Total_SemaphoreTimeout;
 static int Shown_SemaphoreTimeout;
-static dbref Show_Player_Target;
-static dbref Show_Object_Target;
 static int Show_Key;
 static dbref Show_Player;
-static int Show_bFirstLine;
 
 #ifdef QUERY_SLAVE
 int Total_SQLTimeout;
@@ -1245,85 +1849,101 @@ static void ShowPsLine(BQUE *tmp)
     free_lbuf(bufp);
 }
 
-static int CallBack_ShowWait(PTASK_RECORD p)
+// ShowQueue: List the entries run or expired by fpTask.
+//
+static int ShowQueue(std::vector<BQUE *> &entries, FTASK *fpTask, const char *pHeader)
 {
-    if (p->fpTask != Task_RunQueueEntry)
+    int nShown = 0;
+    for (size_t i = 0; i < entries.size(); i++)
     {
-        return IU_NEXT_TASK;
-    }
+        BQUE *tmp = entries[i];
+        if (tmp->task != fpTask)
+        {
+            continue;
+        }
 
-    Total_RunQueueEntry++;
-    BQUE *tmp = (BQUE *)(p->arg_voidptr);
-    if (que_want(tmp, Show_Player_Target, Show_Object_Target))
-    {
-        Shown_RunQueueEntry++;
+        nShown++;
         if (Show_Key == PS_SUMM)
         {
-            return IU_NEXT_TASK;
+            continue;
         }
-        if (Show_bFirstLine)
+        if (1 == nShown)
         {
-            notify(Show_Player, "----- Wait Queue -----");
-            Show_bFirstLine = false;
+            notify(Show_Player, pHeader);
         }
         ShowPsLine(tmp);
     }
-    return IU_NEXT_TASK;
+    return nShown;
 }
 
-static int CallBack_ShowSemaphore(PTASK_RECORD p)
+// que_percentile: Wait, in microseconds, which p percent of samples are
+// within.  The samples are sorted.
+//
+static int que_percentile(const INT64 *tWait, int nSamples, int p)
 {
-    if (p->fpTask != Task_SemaphoreTimeout)
+    if (0 == nSamples)
     {
-        return IU_NEXT_TASK;
+        return 0;
     }
-
-    Total_SemaphoreTimeout++;
-    BQUE *tmp = (BQUE *)(p->arg_voidptr);
-    if (que_want(tmp, Show_Player_Target, Show_Object_Target))
+    INT64 t = tWait[((nSamples - 1) * p) / 100] / FACTOR_100NS_PER_MICROSECOND;
+    if (INT32_MAX_VALUE < t)
     {
-        Shown_SemaphoreTimeout++;
-        if (Show_Key == PS_SUMM)
+        t = INT32_MAX_VALUE;
+    }
+    return static_cast<int>(t);
+}
+
+// ShowRunQueues: List how much each owner has ready to run, and how long
+// their recent entries waited to run once they were ready.
+//
+static void ShowRunQueues(dbref executor_targ)
+{
+    bool bHeader = false;
+    QUEUE_FLOW_MAP::iterator it;
+    for (it = que_flows.begin(); it != que_flows.end(); ++it)
+    {
+        dbref key = it->first;
+        QUEUE_FLOW &qf = it->second;
+        if (  (  NOTHING != executor_targ
+              && key != executor_targ)
+           || (  0 == qf.nReady
+              && 0 == qf.nSamples))
         {
-            return IU_NEXT_TASK;
+            continue;
         }
-        if (Show_bFirstLine)
+
+        if (!bHeader)
         {
-            notify(Show_Player, "----- Semaphore Queue -----");
-            Show_bFirstLine = false;
+            notify(Show_Player, "----- Run Queues -----");
+            bHeader = true;
         }
-        ShowPsLine(tmp);
-    }
-    return IU_NEXT_TASK;
-}
 
-#ifdef QUERY_SLAVE
-int CallBack_ShowSQLQueries(PTASK_RECORD p)
-{
-    if (p->fpTask != Task_SQLTimeout)
-    {
-        return IU_NEXT_TASK;
-    }
+        INT64 tWait[QUE_WAIT_SAMPLES];
+        memcpy(tWait, qf.tWait, qf.nSamples * sizeof(tWait[0]));
+        std::sort(tWait, tWait + qf.nSamples);
 
-    Total_SQLTimeout++;
-    BQUE *tmp = (BQUE *)(p->arg_voidptr);
-    if (que_want(tmp, Show_Player_Target, Show_Object_Target))
-    {
-        Shown_SQLTimeout++;
-        if (Show_Key == PS_SUMM)
+        char *bufp = alloc_lbuf("ShowRunQueues");
+        if (Good_obj(key))
         {
-            return IU_NEXT_TASK;
+            char *name = unparse_object(Show_Player, key, false);
+            mux_sprintf(bufp, LBUF_SIZE, "%s  Ready...%d/%d  Weight...%d",
+                name, qf.nReady, a_Queue(key, 0), QueueWeight(key));
+            free_lbuf(name);
         }
-        if (Show_bFirstLine)
+        else
         {
-            notify(Show_Player, "----- SQL Queries -----");
-            Show_bFirstLine = false;
+            mux_sprintf(bufp, LBUF_SIZE, "All owners  Ready...%d", qf.nReady);
         }
-        ShowPsLine(tmp);
+        notify(Show_Player, bufp);
+        mux_sprintf(bufp, LBUF_SIZE, "    Wait (us) 50%%...%d  90%%...%d  99%%...%d  of last %d",
+            que_percentile(tWait, qf.nSamples, 50),
+            que_percentile(tWait, qf.nSamples, 90),
+            que_percentile(tWait, qf.nSamples, 99),
+            qf.nSamples);
+        notify(Show_Player, bufp);
+        free_lbuf(bufp);
     }
-    return IU_NEXT_TASK;
 }
-#endif
 
 // ---------------------------------------------------------------------------
 // do_ps: tell executor what commands they have pending in the queue
@@ -1393,23 +2013,21 @@ void do_ps(dbref executor, dbref caller, dbref enactor, int eval, int key, char
         return;
     }
 
+    std::vector<BQUE *> entries;
+    que_gather(executor_targ, obj_targ, entries);
+    std::sort(entries.begin(), entries.end(), que_before);
+
     Show_lsaNow.GetUTC();
     Total_SystemTasks = 0;
-    Total_RunQueueEntry = 0;
-    Shown_RunQueueEntry = 0;
-    Total_SemaphoreTimeout = 0;
-    Shown_SemaphoreTimeout = 0;
-    Show_Player_Target = executor_targ;
-    Show_Object_Target = obj_targ;
     Show_Key = key;
     Show_Player = executor;
-    Show_bFirstLine = true;
-    scheduler.TraverseOrdered(CallBack_ShowWait);
-    Show_bFirstLine = true;
-    scheduler.TraverseOrdered(CallBack_ShowSemaphore);
+    Total_RunQueueEntry = que_nRunQueueEntry;
+    Shown_RunQueueEntry = ShowQueue(entries, Task_RunQueueEntry, "----- Wait Queue -----");
+    Total_SemaphoreTimeout = que_nSemaphoreTimeout;
+    Shown_SemaphoreTimeout = ShowQueue(entries, Task_SemaphoreTimeout, "----- Semaphore Queue -----");
 #ifdef QUERY_SLAVE
-    Show_bFirstLine = true;
-    scheduler.TraverseOrdered(CallBack_ShowSQLQueries);
+    Total_SQLTimeout = que_nSQLTimeout;
+    Shown_SQLTimeout = ShowQueue(entries, Task_SQLTimeout, "----- SQL Queries -----");
 #endif // QUERY_SLAVE
     if (Wizard(executor))
     {
@@ -1431,10 +2049,20 @@ void do_ps(dbref executor, dbref caller, dbref enactor, int eval, int key, char
         Shown_SemaphoreTimeout, Total_SemaphoreTimeout);
 #endif // QUERY_SLAVE
     notify(executor, bufp);
+    if (PS_SUMM == key)
+    {
+        ShowRunQueues(executor_targ);
+    }
     if (Wizard(executor))
     {
         mux_sprintf(bufp, MBUF_SIZE, "        System Tasks.....%d", Total_SystemTasks);
         notify(executor, bufp);
+        if (que_slice_enabled())
+        {
+            mux_sprintf(bufp, MBUF_SIZE, "        Time Slices......%d yielded  %d overran",
+                que_nSliceYields, que_nSliceOverruns);
+            notify(executor, bufp);
+        }
     }
     free_mbuf(bufp);
 }
@@ -147,6 +147,7 @@ ATTR AttrTable[] =
     {"Prefix",      A_PREFIX,   AF_ODARK | AF_NOPROG},
     {"ProgCmd",     A_PROGCMD,  AF_DARK | AF_NOPROG | AF_NOCMD | AF_INTERNAL},
     {"QueueMax",    A_QUEUEMAX, AF_MDARK | AF_WIZARD | AF_NOPROG},
+    {"QueueWeight", A_QUEUEWEIGHT, AF_MDARK | AF_WIZARD | AF_NOPROG},
     {"Quota",       A_QUOTA,    AF_MDARK | AF_NOPROG | AF_GOD | AF_NOCMD | AF_NOCLONE},
     {"ReceiveLock", A_LRECEIVE, AF_ODARK | AF_NOPROG | AF_NOCMD | AF_IS_LOCK},
     {"Reject",      A_REJECT,   AF_ODARK | AF_NOPROG},
@@ -950,6 +951,7 @@ void do_fixdb
     case FIXDB_OWNER:
 
         s_Owner(thing, res);
+        que_rehome(thing);
         if (!Quiet(executor))
             notify(executor, tprintf("Owner set to #%d", res));
         break;
@@ -1866,6 +1868,92 @@ static void atr_decode_LEN(const char *iattr, size_t nLen, char *oattr,
     }
 }
 
+#ifdef MEMORY_BASED
+// Attribute text which is being read in place through an ATTR_VIEW.  Text
+// which atr_clr() or atr_add_raw_LEN() would free while it is pinned here is
+// retired instead, and the last atr_release() frees it.
+//
+#define ATR_PIN_MAX 128
+
+typedef struct
+{
+    char *pText;
+    int   nPins;
+    bool  bRetired;
+} ATR_PIN;
+
+static ATR_PIN atr_pins[ATR_PIN_MAX];
+static int     atr_nPinSlots = 0;   // Slots at or above this are unused.
+
+// Returns NULL if too much text is pinned already.
+//
+static void *atr_pin_text(char *pText)
+{
+    ATR_PIN *pFree = NULL;
+    for (int i = 0; i < atr_nPinSlots; i++)
+    {
+        if (0 == atr_pins[i].nPins)
+        {
+            pFree = &atr_pins[i];
+        }
+        else if (  atr_pins[i].pText == pText
+                && !atr_pins[i].bRetired)
+        {
+            atr_pins[i].nPins++;
+            return &atr_pins[i];
+        }
+    }
+    if (NULL == pFree)
+    {
+        if (ATR_PIN_MAX <= atr_nPinSlots)
+        {
+            return NULL;
+        }
+        pFree = &atr_pins[atr_nPinSlots++];
+    }
+    pFree->pText = pText;
+    pFree->nPins = 1;
+    pFree->bRetired = false;
+    return pFree;
+}
+
+static void atr_unpin_text(void *pPin)
+{
+    ATR_PIN *pp = (ATR_PIN *)pPin;
+    pp->nPins--;
+    if (0 == pp->nPins)
+    {
+        if (pp->bRetired)
+        {
+            MEMFREE(pp->pText);
+        }
+        pp->pText = NULL;
+
+        // Views are usually released in the reverse order they were opened.
+        //
+        while (  0 < atr_nPinSlots
+              && 0 == atr_pins[atr_nPinSlots-1].nPins)
+        {
+            atr_nPinSlots--;
+        }
+    }
+}
+
+static void atr_free_text(char *pText)
+{
+    for (int i = 0; i < atr_nPinSlots; i++)
+    {
+        if (  0 < atr_pins[i].nPins
+           && atr_pins[i].pText == pText)
+        {
+            atr_pins[i].bRetired = true;
+            return;
+        }
+    }
+    MEMFREE(pText);
+}
+#endif // MEMORY_BASED
+
 /* ---------------------------------------------------------------------------
  * atr_clr: clear an attribute in the list.
  */
@@ -1901,7 +1989,7 @@ void atr_clr(dbref thing, int atr)
         }
         else // (list[mid].number == atr)
         {
-            MEMFREE(list[mid].data);
+            atr_free_text(list[mid].data);
             list[mid].data = NULL;
             db[thing].nALUsed--;
             if (mid != db[thing].nALUsed)
@@ -1955,6 +2043,7 @@ void atr_clr(dbref thing, int atr)
         break;
 
     case A_QUEUEMAX:
+    case A_QUEUEWEIGHT:
 
         pcache_reload(thing);
         break;
@@ -2030,7 +2119,7 @@ void atr_add_raw_LEN(dbref thing, int atr, const char *szValue, size_t nValue)
                 }
                 else // if (list[mid].number == atr)
                 {
-                    MEMFREE(list[mid].data);
+                    atr_free_text(list[mid].data);
                     list[mid].data = text;
                     list[mid].size = nValue + 1;
                     goto FoundAttribute;
@@ -2140,6 +2229,7 @@ FoundAttribute:
         break;
 
     case A_QUEUEMAX:
+    case A_QUEUEWEIGHT:
 
         pcache_reload(thing);
         break;
@@ -2414,6 +2504,152 @@ bool atr_pget_info(dbref thing, int atr, dbref *owner, int *flags)
     return false;
 }
 
+// ---------------------------------------------------------------------------
+// atr_get_view, atr_pget_view: Read an attribute in place rather than copying
+// it into an lbuf.  The view stays valid until atr_release(), even if the
+// attribute is changed or cleared in the meantime.  They return false if
+// there is no text, and such a view holds nothing and needs no release,
+// though it does no harm.
+//
+static const char *atr_pin_raw_LEN(dbref thing, int atr, size_t *pLen,
+    void **ppPin)
+{
+#ifdef MEMORY_BASED
+    const char *pRaw = atr_get_raw_LEN(thing, atr, pLen);
+    *ppPin = pRaw ? atr_pin_text((char *)pRaw) : NULL;
+    return pRaw;
+#else // MEMORY_BASED
+    Aname okey;
+
+    makekey(thing, atr, &okey);
+    size_t nLen;
+    const char *pRaw = cache_pin(&okey, &nLen, ppPin);
+    *pLen = pRaw ? (nLen-1) : 0;
+    return pRaw;
+#endif // MEMORY_BASED
+}
+
+static void atr_unpin_raw(void *pPin)
+{
+#ifdef MEMORY_BASED
+    atr_unpin_text(pPin);
+#else // MEMORY_BASED
+    cache_unpin(pPin);
+#endif // MEMORY_BASED
+}
+
+static void atr_view_empty(ATTR_VIEW *pav, dbref thing)
+{
+    pav->pText = "";
+    pav->nText = 0;
+    pav->owner = Owner(thing);
+    pav->flags = 0;
+    pav->pPin  = NULL;
+    pav->pCopy = NULL;
+}
+
+// Fill in a view from raw text found on an object.  Text which could not
+// be pinned may be overwritten by the next attribute fetch, so it is copied.
+//
+static void atr_view_decode(ATTR_VIEW *pav, dbref thing, const char *pRaw,
+    size_t nRaw, void *pPin)
+{
+    pav->owner = Owner(thing);
+    const char *cp = atr_decode_flags_owner(pRaw, &pav->owner, &pav->flags);
+    pav->nText = nRaw - (cp - pRaw);
+    pav->pPin  = pPin;
+    pav->pCopy = NULL;
+    if (pPin)
+    {
+        pav->pText = cp;
+    }
+    else
+    {
+        pav->pCopy = alloc_lbuf("atr_view");
+        memcpy(pav->pCopy, cp, pav->nText + 1);
+        pav->pText = pav->pCopy;
+    }
+}
+
+bool atr_get_view(ATTR_VIEW *pav, dbref thing, int atr)
+{
+    size_t nRaw;
+    void  *pPin;
+    const char *pRaw = atr_pin_raw_LEN(thing, atr, &nRaw, &pPin);
+    if (!pRaw)
+    {
+        atr_view_empty(pav, thing);
+        return false;
+    }
+    atr_view_decode(pav, thing, pRaw, nRaw, pPin);
+    if (0 == pav->nText)
+    {
+        atr_release(pav);
+        return false;
+    }
+    return true;
+}
+
+bool atr_pget_view(ATTR_VIEW *pav, dbref thing, int atr)
+{
+    dbref parent;
+    int lev;
+    ATTR *ap;
+
+    ITER_PARENTS(thing, parent, lev)
+    {
+        size_t nRaw;
+        void  *pPin;
+        const char *pRaw = atr_pin_raw_LEN(parent, atr, &nRaw, &pPin);
+        if (pRaw && *pRaw)
+        {
+            atr_view_decode(pav, thing, pRaw, nRaw, pPin);
+            if (  lev == 0
+               || !(pav->flags & AF_PRIVATE))
+            {
+                if (0 == pav->nText)
+                {
+                    atr_release(pav);
+                    return false;
+                }
+                return true;
+            }
+            atr_release(pav);
+        }
+        else if (pPin)
+        {
+            atr_unpin_raw(pPin);
+        }
+        if (  lev == 0
+           && Good_obj(Parent(parent)))
+        {
+            ap = atr_num(atr);
+            if (!ap || ap->flags & AF_PRIVATE)
+            {
+                break;
+            }
+        }
+    }
+    atr_view_empty(pav, thing);
+    return false;
+}
+
+void atr_release(ATTR_VIEW *pav)
+{
+    if (pav->pPin)
+    {
+        atr_unpin_raw(pav->pPin);
+        pav->pPin = NULL;
+    }
+    if (pav->pCopy)
+    {
+        free_lbuf(pav->pCopy);
+        pav->pCopy = NULL;
+    }
+    pav->pText = "";
+    pav->nText = 0;
+}
+
 /* ---------------------------------------------------------------------------
  * atr_free: Reset all attributes of an object.
  */
@@ -3371,6 +3607,13 @@ void dump_restart_db(void)
     putref(f, mudstate.record_players);
     DESC_ITER_ALL(d)
     {
+#ifdef HAVE_ZLIB_H
+        // The new process cannot pick up a deflate stream, so finish it and
+        // let the client fall back to plain text.
+        //
+        mccp_stop(d);
+        process_output(d, false);
+#endif // HAVE_ZLIB_H
         putref(f, d->getSocket());
         putref(f, d->flags);
         putref(f, d->connected_at.ReturnSeconds());
@@ -3461,6 +3704,7 @@ void load_restart_db(void)
         ndescriptors++;
         DebugTotalSockets++;
         d = alloc_desc("restart");
+        d->init();
         d->setSocket(val, NORMAL);
         d->flags = getref(f);
         d->connected_at.SetSeconds(getref(f));
@@ -3493,6 +3737,10 @@ void load_restart_db(void)
             d->height = 24;
             d->width = 78;
         }
+        d->nvt_compress2_us_state = OPTION_NO;
+#ifdef HAVE_ZLIB_H
+        d->mccp = NULL;
+#endif // HAVE_ZLIB_H
 
         size_t nBuffer;
         char *temp = getstring_noalloc(f, true, &nBuffer);
@@ -3529,6 +3777,7 @@ void load_restart_db(void)
         d->output_lost = 0;
         d->output_head = NULL;
         d->output_tail = NULL;
+        d->output_warm = NULL;
         d->input_head = NULL;
         d->input_tail = NULL;
         d->input_size = 0;
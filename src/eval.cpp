@@ -7,6 +7,8 @@
 #include "config.h"
 #include "externs.h"
 
+#include <vector>
+
 #include "ansi.h"
 #include "attrs.h"
 #include "functions.h"
@@ -832,11 +834,10 @@ static char *parse_arglist_lite( dbref executor, dbref caller, dbref enactor,
 //
 int get_gender(dbref player)
 {
-    dbref aowner;
-    int aflags;
-    char *atr_gotten = atr_pget(player, A_SEX, &aowner, &aflags);
-    char first = atr_gotten[0];
-    free_lbuf(atr_gotten);
+    ATTR_VIEW av;
+    atr_pget_view(&av, player, A_SEX);
+    char first = av.pText[0];
+    atr_release(&av);
     switch (mux_tolower(first))
     {
     case 'p':
@@ -1080,8 +1081,452 @@ void PopRegisters(reg_ref **p, int nNeeded)
     pRefsFrame->nrefs += nNeeded;
 }
 
+//-----------------------------------------------------------------------------
+// Parse cache.
+//
+// Attribute bodies reached through u(), @function, and friends are evaluated
+// over and over. The first time one is seen, parse_compile() walks a private
+// copy of it the way mux_exec() would and records, in order, what mux_exec()
+// will find at each '(', '[', and '{': the function a call resolves to, the
+// spans of its arguments, and the spans of bracketed and braced text. The
+// walk uses parse_to_lite(), so the copy is left terminated exactly as
+// mux_exec() would leave it, and it is never written to again.
+//
+// mux_exec() then follows these hints instead of scanning ahead, lowercasing,
+// and hashing. Since it is the same loop producing output either way, the
+// result is byte-identical. A level whose shape depends on run-time values
+// (a function name assembled from substitutions, a call with no closing
+// parenthesis) is marked unparsed and is evaluated by mux_exec() as usual
+// from a fresh copy of its original text.
+//
+// Entries are keyed by (object, attribute). The stored text itself serves as
+// the modification stamp: an entry is used only if the caller's text matches
+// it exactly, the eval flags and space_compress agree, and no @function has
+// been defined since it was built.
+//
+#define PARSE_CACHE_SIZE 1024
+
+typedef struct parse_level PARSE_LEVEL;
+
+typedef struct parse_hint
+{
+    char        *pNext;     // Text after the closing delimiter or NULL.
+    PARSE_LEVEL *pInner;    // Contents of [] or {}.
+    FUN         *fp;
+    UFUN        *ufp;
+    std::vector<PARSE_LEVEL *> args;
+    char        szName[SBUF_SIZE];
+} PARSE_HINT;
+
+struct parse_level
+{
+    char       *pText;      // Terminated text within the parsed copy.
+    const char *pOrig;      // The same text before parsing.
+    size_t      nOrig;
+    bool        bParsed;
+    std::vector<PARSE_HINT> hints;
+};
+
+typedef struct parse_entry
+{
+    dbref  thing;
+    int    attr;
+    int    eval;
+    int    iGeneration;
+    bool   bSpaceCompress;
+    int    nRefs;
+    size_t nText;
+    char  *pOrig;
+    char  *pCopy;
+    PARSE_LEVEL *pTop;
+    std::vector<PARSE_LEVEL *> levels;
+} PARSE_ENTRY;
+
+static PARSE_ENTRY parse_cache[PARSE_CACHE_SIZE];
+static int parse_generation = 0;
+
+// Invalidate every entry, because the set of functions a name resolves to
+// has changed.
+//
+void parse_cache_invalidate(void)
+{
+    parse_generation++;
+}
+
+static void parse_cache_clear(PARSE_ENTRY *pe)
+{
+    for (size_t i = 0; i < pe->levels.size(); i++)
+    {
+        delete pe->levels[i];
+    }
+    pe->levels.clear();
+    if (pe->pOrig)
+    {
+        MEMFREE(pe->pOrig);
+        pe->pOrig = NULL;
+    }
+    if (pe->pCopy)
+    {
+        MEMFREE(pe->pCopy);
+        pe->pCopy = NULL;
+    }
+    pe->pTop = NULL;
+    pe->thing = NOTHING;
+}
+
+// Returns the last character consumed by an evaluated %-substitution
+// starting at p. This follows the substitution code in mux_exec().
+//
+static char *parse_percent_end(char *p)
+{
+    char *q = p + 1;
+    switch (isSpecial(L2, *q) & 0x7F)
+    {
+    case 18:
+        // %<NUL>
+        //
+        return p;
+
+    case 2:
+    case 10:
+        // %q<reg> and %v<letter>
+        //
+        q++;
+        return *q ? q : q - 1;
+
+    case 6:
+        // %x<color> and %c<color>
+        //
+        return ColorTable[(unsigned char)q[1]] ? q + 1 : q;
+
+    case 21:
+        // %=<attr>
+        //
+        q++;
+        if ('<' == *q)
+        {
+            q++;
+            while (  *q
+                  && '>' != *q)
+            {
+                q++;
+            }
+            return ('>' == *q) ? q : q - 1;
+        }
+        return *q ? q : q - 1;
+    }
+    return q;
+}
+
+static PARSE_LEVEL *parse_compile(PARSE_ENTRY *pe, char *pText, int eval);
+
+// Walks one level of text the way mux_exec() would, recording a hint for
+// each '(', '[', and '{' that mux_exec() will act on. Returns false if the
+// level cannot be described ahead of time.
+//
+static bool parse_walk(PARSE_ENTRY *pe, PARSE_LEVEL *pl, int eval)
+{
+    bool bSpaceIsSpecial = mudconf.space_compress && !(eval & EV_NO_COMPRESS);
+    bool bBracketIsSpecial = (eval & EV_NOFCHECK) == 0;
+    bool bPlain = true;
+    char *pStart = pl->pText;
+    char *p = pStart;
+    char *q, *tbuf;
+    size_t nLen;
+    int iWhichDelim;
+
+    for (;;)
+    {
+        if ('\0' == *p)
+        {
+            return true;
+        }
+        else if (  '(' == *p
+                && (eval & EV_FCHECK))
+        {
+            // Only the first '(' can be a function call, and its name is
+            // whatever was copied out ahead of it.
+            //
+            eval &= ~EV_FCHECK;
+            if (  !bPlain
+               || SBUF_SIZE - 1 < p - pStart)
+            {
+                return false;
+            }
+
+            size_t n = p - pStart;
+            if (mudconf.space_compress && (eval & EV_FMAND))
+            {
+                while (  0 < n
+                      && mux_isspace(pStart[n-1]))
+                {
+                    n--;
+                }
+            }
+
+            PARSE_HINT ph;
+            for (size_t i = 0; i < n; i++)
+            {
+                ph.szName[i] = mux_tolower(pStart[i]);
+            }
+            ph.szName[n] = '\0';
+            ph.fp = function_find(pStart, n);
+            ph.ufp = NULL;
+            if (NULL == ph.fp)
+            {
+                ph.ufp = (UFUN *)hashfindLEN(ph.szName, n, &mudstate.ufunc_htab);
+            }
+            ph.pInner = NULL;
+            ph.pNext = NULL;
+
+            if (  NULL == ph.fp
+               && NULL == ph.ufp)
+            {
+                pl->hints.push_back(ph);
+                if (eval & EV_FMAND)
+                {
+                    return true;
+                }
+                p++;
+                continue;
+            }
+
+            // Split the arguments as parse_arglist_lite() would.
+            //
+            int nfargs = ph.ufp ? MAX_ARG : ph.fp->maxArgsParsed;
+            int feval;
+            if (  ph.fp
+               && (ph.fp->flags & FN_NOEVAL))
+            {
+                feval = eval & ~(EV_EVAL|EV_TOP|EV_STRIP_CURLY);
+            }
+            else
+            {
+                feval = eval & ~EV_TOP;
+            }
+
+            int peval;
+            if (feval & EV_EVAL)
+            {
+                peval = feval | EV_FCHECK;
+            }
+            else
+            {
+                peval = ((feval & ~EV_FCHECK)|EV_NOFCHECK);
+            }
+
+            q = p + 1;
+            iWhichDelim = 0;
+            while (  (int)ph.args.size() < nfargs
+                  && q
+                  && iWhichDelim != 2)
+            {
+                bool bLast = (int)ph.args.size() == nfargs - 1;
+                tbuf = parse_to_lite(&q, bLast ? '\0' : ',', ')', &nLen,
+                    &iWhichDelim);
+
+                if (  iWhichDelim == 2
+                   && ph.args.empty()
+                   && tbuf[0] == '\0')
+                {
+                    break;
+                }
+                ph.args.push_back(parse_compile(pe, tbuf, peval));
+            }
+
+            if (NULL == q)
+            {
+                return false;
+            }
+            ph.pNext = q;
+            pl->hints.push_back(ph);
+            p = q;
+        }
+        else if (  '[' == *p
+                && bBracketIsSpecial)
+        {
+            bPlain = false;
+            PARSE_HINT ph;
+            ph.fp = NULL;
+            ph.ufp = NULL;
+            ph.pInner = NULL;
+            ph.szName[0] = '\0';
+
+            q = p + 1;
+            tbuf = parse_to_lite(&q, ']', '\0', &nLen, &iWhichDelim);
+            ph.pNext = q;
+            if (q)
+            {
+                ph.pInner = parse_compile(pe, tbuf,
+                    (eval | EV_FCHECK | EV_FMAND) & ~EV_TOP);
+                p = q;
+            }
+            else
+            {
+                p++;
+            }
+            pl->hints.push_back(ph);
+        }
+        else if ('{' == *p)
+        {
+            bPlain = false;
+            PARSE_HINT ph;
+            ph.fp = NULL;
+            ph.ufp = NULL;
+            ph.pInner = NULL;
+            ph.szName[0] = '\0';
+
+            q = p + 1;
+            tbuf = parse_to_lite(&q, '}', '\0', &nLen, &iWhichDelim);
+            ph.pNext = q;
+            if (q)
+            {
+                if (eval & EV_EVAL)
+                {
+                    if (' ' == *tbuf)
+                    {
+                        tbuf++;
+                    }
+                    ph.pInner = parse_compile(pe, tbuf,
+                        eval & ~(EV_STRIP_CURLY | EV_FCHECK | EV_TOP));
+                }
+                else
+                {
+                    ph.pInner = parse_compile(pe, tbuf, eval & ~EV_TOP);
+                }
+                p = q;
+            }
+            else
+            {
+                p++;
+            }
+            pl->hints.push_back(ph);
+        }
+        else if ('%' == *p)
+        {
+            bPlain = false;
+            if (eval & EV_EVAL)
+            {
+                p = parse_percent_end(p) + 1;
+            }
+            else if ('\0' == p[1])
+            {
+                // mux_exec() would copy the terminator and run on.
+                //
+                return false;
+            }
+            else
+            {
+                p += 2;
+            }
+        }
+        else if (  '\\' == *p
+                || ESC_CHAR == *p)
+        {
+            bPlain = false;
+            p++;
+            if (*p)
+            {
+                p++;
+            }
+        }
+        else
+        {
+            if (  ' ' == *p
+               && bSpaceIsSpecial)
+            {
+                bPlain = false;
+            }
+            p++;
+        }
+    }
+}
+
+static PARSE_LEVEL *parse_compile(PARSE_ENTRY *pe, char *pText, int eval)
+{
+    PARSE_LEVEL *pl = new PARSE_LEVEL;
+    pe->levels.push_back(pl);
+
+    pl->pText = pText;
+    pl->nOrig = strlen(pText);
+    pl->pOrig = pe->pOrig + (pText - pe->pCopy);
+    pl->bParsed = parse_walk(pe, pl, eval);
+    if (!pl->bParsed)
+    {
+        pl->hints.clear();
+    }
+    return pl;
+}
+
+static void mux_exec_level(char *buff, char **bufc, dbref executor,
+    dbref caller, dbref enactor, int eval, char **dstr, char *cargs[],
+    int ncargs, const PARSE_LEVEL *pLevel);
+
+// Evaluates one level of a cached body. A level the parse cache could not
+// describe is handed to mux_exec() as a fresh copy of its original text.
+//
+static void parse_exec(char *buff, char **bufc, dbref executor, dbref caller,
+    dbref enactor, int eval, const PARSE_LEVEL *pl, char *cargs[], int ncargs)
+{
+    if (pl->bParsed)
+    {
+        char *p = pl->pText;
+        mux_exec_level(buff, bufc, executor, caller, enactor, eval, &p, cargs,
+            ncargs, pl);
+    }
+    else
+    {
+        char *tbuf = alloc_lbuf("parse_exec");
+        memcpy(tbuf, pl->pOrig, pl->nOrig);
+        tbuf[pl->nOrig] = '\0';
+        char *p = tbuf;
+        mux_exec_level(buff, bufc, executor, caller, enactor, eval, &p, cargs,
+            ncargs, NULL);
+        free_lbuf(tbuf);
+    }
+}
+
+// The parse cache counterpart of parse_arglist_lite().
+//
+static char *parse_arglist_parsed(dbref executor, dbref caller, dbref enactor,
+    const PARSE_HINT *ph, int eval, char *fargs[], char *cargs[], int ncargs,
+    int *nArgsParsed)
+{
+    int peval;
+    if (eval & EV_EVAL)
+    {
+        peval = eval | EV_FCHECK;
+    }
+    else
+    {
+        peval = ((eval & ~EV_FCHECK)|EV_NOFCHECK);
+    }
+
+    int arg;
+    for (arg = 0; arg < (int)ph->args.size(); arg++)
+    {
+        char *bp = fargs[arg] = alloc_lbuf("parse_arglist");
+        parse_exec(fargs[arg], &bp, executor, caller, enactor, peval,
+            ph->args[arg], cargs, ncargs);
+        *bp = '\0';
+    }
+    *nArgsParsed = arg;
+    return ph->pNext;
+}
+
 void mux_exec( char *buff, char **bufc, dbref executor, dbref caller,
                dbref enactor, int eval, char **dstr, char *cargs[], int ncargs)
+{
+    mux_exec_level(buff, bufc, executor, caller, enactor, eval, dstr, cargs,
+        ncargs, NULL);
+}
+
+// pLevel, when not NULL, is the parse cache's description of the text at
+// *dstr, and the text is not modified.
+//
+static void mux_exec_level(char *buff, char **bufc, dbref executor,
+    dbref caller, dbref enactor, int eval, char **dstr, char *cargs[],
+    int ncargs, const PARSE_LEVEL *pLevel)
 {
     if (  *dstr == NULL
        || **dstr == '\0'
@@ -1103,8 +1548,7 @@ void mux_exec( char *buff, char **bufc, dbref executor, dbref caller,
     const char *constbuf;
     char ch;
     char *realbuff = NULL, *realbp = NULL;
-    dbref aowner;
-    int nfargs, aflags, feval, i;
+    int nfargs, feval, i;
     size_t n;
     bool ansi = false;
     FUN *fp;
@@ -1125,6 +1569,8 @@ void mux_exec( char *buff, char **bufc, dbref executor, dbref caller,
 
     int at_space = 1;
     int gender = -1;
+    int iHint = 0;
+    const PARSE_HINT *ph = NULL;
 
     bool is_trace = (Trace(executor) || (eval & EV_TRACE)) && !(eval & EV_NOTRACE);
     bool is_top = false;
@@ -1149,7 +1595,20 @@ void mux_exec( char *buff, char **bufc, dbref executor, dbref caller,
     {
         is_top = tcache_empty();
         savestr = alloc_lbuf("exec.save");
-        mux_strncpy(savestr, pdstr, LBUF_SIZE-1);
+        if (pLevel)
+        {
+            n = pLevel->nOrig;
+            if (LBUF_SIZE-1 < n)
+            {
+                n = LBUF_SIZE-1;
+            }
+            memcpy(savestr, pLevel->pOrig, n);
+            savestr[n] = '\0';
+        }
+        else
+        {
+            mux_strncpy(savestr, pdstr, LBUF_SIZE-1);
+        }
     }
 
     // Save Parser Mode.
@@ -1217,38 +1676,45 @@ void mux_exec( char *buff, char **bufc, dbref executor, dbref caller,
             //
             at_space = 0;
 
-            // Load an sbuf with an lowercase version of the func name, and
-            // see if the func exists. Trim trailing spaces from the name if
-            // configured.
-            //
-            char *pEnd = *bufc - 1;
-            if (mudconf.space_compress && (eval & EV_FMAND))
+            const char *pName = mux_scratch;
+            if (pLevel)
             {
-                while (  oldp <= pEnd
-                      && mux_isspace(*pEnd))
-                {
-                    pEnd--;
-                }
+                ph = &pLevel->hints[iHint++];
+                pName = ph->szName;
+                fp = ph->fp;
+                ufp = ph->ufp;
             }
-
-            // _strlwr(tbuf);
-            //
-            char *p2 = mux_scratch;
-            for (char *p = oldp; p <= pEnd; p++)
+            else
             {
-                *p2++ = mux_tolower(*p);
-            }
-            *p2 = '\0';
-
-            size_t ntbuf = p2 - mux_scratch;
-            fp = (FUN *)hashfindLEN(mux_scratch, ntbuf, &mudstate.func_htab);
+                // See if the func exists. Trim trailing spaces from the
+                // name if configured.
+                //
+                char *pEnd = *bufc - 1;
+                if (mudconf.space_compress && (eval & EV_FMAND))
+                {
+                    while (  oldp <= pEnd
+                          && mux_isspace(*pEnd))
+                    {
+                        pEnd--;
+                    }
+                }
+                size_t ntbuf = pEnd - oldp + 1;
+                fp = function_find(oldp, ntbuf);
 
-            // If not a builtin func, check for global func.
-            //
-            ufp = NULL;
-            if (fp == NULL)
-            {
-                ufp = (UFUN *)hashfindLEN(mux_scratch, ntbuf, &mudstate.ufunc_htab);
+                // If not a builtin func, load an lbuf with a lowercase
+                // version of the func name and check for global func.
+                //
+                ufp = NULL;
+                if (fp == NULL)
+                {
+                    char *p2 = mux_scratch;
+                    for (char *p = oldp; p <= pEnd; p++)
+                    {
+                        *p2++ = mux_tolower(*p);
+                    }
+                    *p2 = '\0';
+                    ufp = (UFUN *)hashfindLEN(mux_scratch, ntbuf, &mudstate.ufunc_htab);
+                }
             }
 
             // Do the right thing if it doesn't exist.
@@ -1259,7 +1725,7 @@ void mux_exec( char *buff, char **bufc, dbref executor, dbref caller,
                 {
                     *bufc = oldp;
                     safe_str("#-1 FUNCTION (", buff, bufc);
-                    safe_str(mux_scratch, buff, bufc);
+                    safe_str(pName, buff, bufc);
                     safe_str(") NOT FOUND", buff, bufc);
                     nBufferAvailable = LBUF_SIZE - (*bufc - buff) - 1;
                     break;
@@ -1296,9 +1762,17 @@ void mux_exec( char *buff, char **bufc, dbref executor, dbref caller,
                 }
 
                 char **fargs = PushPointers(MAX_ARG);
-                pdstr = parse_arglist_lite(executor, caller, enactor,
-                      pdstr + 1, ')', feval, fargs, nfargs, cargs, ncargs,
-                      &nfargs);
+                if (pLevel)
+                {
+                    pdstr = parse_arglist_parsed(executor, caller, enactor, ph,
+                          feval, fargs, cargs, ncargs, &nfargs);
+                }
+                else
+                {
+                    pdstr = parse_arglist_lite(executor, caller, enactor,
+                          pdstr + 1, ')', feval, fargs, nfargs, cargs, ncargs,
+                          &nfargs);
+                }
 
 
                 // If no closing delim, just insert the '(' and continue normally.
@@ -1342,7 +1816,8 @@ void mux_exec( char *buff, char **bufc, dbref executor, dbref caller,
                     }
                     else if (ufp)
                     {
-                        tstr = atr_get(ufp->obj, ufp->atr, &aowner, &aflags);
+                        ATTR_VIEW av;
+                        atr_get_view(&av, ufp->obj, ufp->atr);
                         if (ufp->flags & FN_PRIV)
                         {
                             i = ufp->obj;
@@ -1351,8 +1826,6 @@ void mux_exec( char *buff, char **bufc, dbref executor, dbref caller,
                         {
                             i = executor;
                         }
-                        TempPtr = tstr;
-
                         reg_ref **preserve = NULL;
 
                         if (ufp->flags & FN_PRES)
@@ -1361,8 +1834,9 @@ void mux_exec( char *buff, char **bufc, dbref executor, dbref caller,
                             save_global_regs(preserve);
                         }
 
-                        mux_exec(buff, &oldp, i, executor, enactor,
-                            AttrTrace(aflags, feval), &TempPtr, fargs, nfargs);
+                        mux_exec_attr(buff, &oldp, i, executor, enactor,
+                            AttrTrace(av.flags, feval), av.pText, av.nText,
+                            ufp->obj, ufp->atr, fargs, nfargs);
 
                         if (ufp->flags & FN_PRES)
                         {
@@ -1370,7 +1844,7 @@ void mux_exec( char *buff, char **bufc, dbref executor, dbref caller,
                             PopRegisters(preserve, MAX_GLOBAL_REGS);
                             preserve = NULL;
                         }
-                        free_lbuf(tstr);
+                        atr_release(&av);
                     }
                     else
                     {
@@ -1624,18 +2098,18 @@ void mux_exec( char *buff, char **bufc, dbref executor, dbref caller,
                         if (mux_isazAZ(*pdstr))
                         {
                             i = A_VA + mux_toupper(*pdstr) - 'A';
-                            size_t nAttrGotten;
-                            atr_pget_str_LEN(mux_scratch, executor, i,
-                                &aowner, &aflags, &nAttrGotten);
-                            if (0 < nAttrGotten)
+                            ATTR_VIEW av;
+                            if (atr_pget_view(&av, executor, i))
                             {
+                                size_t nAttrGotten = av.nText;
                                 if (nAttrGotten > nBufferAvailable)
                                 {
                                     nAttrGotten = nBufferAvailable;
                                 }
-                                memcpy(*bufc, mux_scratch, nAttrGotten);
+                                memcpy(*bufc, av.pText, nAttrGotten);
                                 *bufc += nAttrGotten;
                                 nBufferAvailable -= nAttrGotten;
+                                atr_release(&av);
                             }
                         }
                         else if ('\0' == *pdstr)
@@ -1856,14 +2330,14 @@ void mux_exec( char *buff, char **bufc, dbref executor, dbref caller,
                                     ATTR *ap = atr_str(mux_scratch);
                                     if (ap)
                                     {
-                                        size_t nLen;
-                                        tbuf = atr_pget_LEN(executor, ap->number, &aowner, &aflags, &nLen);
+                                        ATTR_VIEW av;
+                                        atr_pget_view(&av, executor, ap->number);
                                         if (See_attr(executor, executor, ap))
                                         {
-                                            safe_copy_buf(tbuf, nLen, buff, bufc);
+                                            safe_copy_buf(av.pText, av.nText, buff, bufc);
                                             nBufferAvailable = LBUF_SIZE - (*bufc - buff) - 1;
                                         }
-                                        free_lbuf(tbuf);
+                                        atr_release(&av);
                                     }
                                 }
                             }
@@ -1897,7 +2371,15 @@ void mux_exec( char *buff, char **bufc, dbref executor, dbref caller,
             //
             tstr = pdstr++;
             mudstate.nStackNest++;
-            tbuf = parse_to_lite(&pdstr, ']', '\0', &n, &at_space);
+            if (pLevel)
+            {
+                ph = &pLevel->hints[iHint++];
+                pdstr = ph->pNext;
+            }
+            else
+            {
+                tbuf = parse_to_lite(&pdstr, ']', '\0', &n, &at_space);
+            }
             at_space = 0;
             if (pdstr == NULL)
             {
@@ -1911,10 +2393,19 @@ void mux_exec( char *buff, char **bufc, dbref executor, dbref caller,
             else
             {
                 mudstate.nStackNest--;
-                TempPtr = tbuf;
-                mux_exec(buff, bufc, executor, caller, enactor,
-                    (eval | EV_FCHECK | EV_FMAND) & ~EV_TOP, &TempPtr, cargs,
-                    ncargs);
+                if (pLevel)
+                {
+                    parse_exec(buff, bufc, executor, caller, enactor,
+                        (eval | EV_FCHECK | EV_FMAND) & ~EV_TOP, ph->pInner,
+                        cargs, ncargs);
+                }
+                else
+                {
+                    TempPtr = tbuf;
+                    mux_exec(buff, bufc, executor, caller, enactor,
+                        (eval | EV_FCHECK | EV_FMAND) & ~EV_TOP, &TempPtr, cargs,
+                        ncargs);
+                }
                 nBufferAvailable = LBUF_SIZE - (*bufc - buff) - 1;
                 pdstr--;
             }
@@ -1950,7 +2441,16 @@ void mux_exec( char *buff, char **bufc, dbref executor, dbref caller,
             //
             tstr = pdstr++;
             mudstate.nStackNest++;
-            tbuf = parse_to_lite(&pdstr, '}', '\0', &n, &at_space);
+            if (pLevel)
+            {
+                ph = &pLevel->hints[iHint++];
+                pdstr = ph->pNext;
+                tbuf = tstr + 1;
+            }
+            else
+            {
+                tbuf = parse_to_lite(&pdstr, '}', '\0', &n, &at_space);
+            }
             at_space = 0;
             if (pdstr == NULL)
             {
@@ -1987,10 +2487,24 @@ void mux_exec( char *buff, char **bufc, dbref executor, dbref caller,
                         tbuf++;
                     }
 
-                    TempPtr = tbuf;
-                    mux_exec(buff, bufc, executor, caller, enactor,
-                        (eval & ~(EV_STRIP_CURLY | EV_FCHECK | EV_TOP)),
-                        &TempPtr, cargs, ncargs);
+                    if (pLevel)
+                    {
+                        parse_exec(buff, bufc, executor, caller, enactor,
+                            (eval & ~(EV_STRIP_CURLY | EV_FCHECK | EV_TOP)),
+                            ph->pInner, cargs, ncargs);
+                    }
+                    else
+                    {
+                        TempPtr = tbuf;
+                        mux_exec(buff, bufc, executor, caller, enactor,
+                            (eval & ~(EV_STRIP_CURLY | EV_FCHECK | EV_TOP)),
+                            &TempPtr, cargs, ncargs);
+                    }
+                }
+                else if (pLevel)
+                {
+                    parse_exec(buff, bufc, executor, caller, enactor,
+                        eval & ~EV_TOP, ph->pInner, cargs, ncargs);
                 }
                 else
                 {
@@ -2134,6 +2648,80 @@ void mux_exec( char *buff, char **bufc, dbref executor, dbref caller,
     isSpecial(L1, '[') = bBracketIsSpecialSave;
 }
 
+// mux_exec_copy: mux_exec() works in place, so give it a copy of text
+// which must not change.
+//
+static void mux_exec_copy(char *buff, char **bufc, dbref executor,
+    dbref caller, dbref enactor, int eval, const char *atext, size_t nText,
+    char *cargs[], int ncargs)
+{
+    char *pCopy = alloc_lbuf("mux_exec_copy");
+    memcpy(pCopy, atext, nText+1);
+    char *str = pCopy;
+    mux_exec(buff, bufc, executor, caller, enactor, eval, &str, cargs, ncargs);
+    free_lbuf(pCopy);
+}
+
+//-----------------------------------------------------------------------------
+// mux_exec_attr: Evaluate atext, the nText-long text of attribute attr on
+// thing, as mux_exec() would, using the parse cache. atext is not modified,
+// so it may be read in place through an ATTR_VIEW.
+//
+void mux_exec_attr(char *buff, char **bufc, dbref executor, dbref caller,
+    dbref enactor, int eval, const char *atext, size_t nText, dbref thing,
+    int attr, char *cargs[], int ncargs)
+{
+    if (  !mudconf.parse_cache
+       || '\0' == atext[0])
+    {
+        mux_exec_copy(buff, bufc, executor, caller, enactor, eval, atext,
+            nText, cargs, ncargs);
+        return;
+    }
+
+    unsigned int iSlot = ((unsigned int)thing * 31 + (unsigned int)attr) * 31
+                       + (unsigned int)eval;
+    PARSE_ENTRY *pe = &parse_cache[iSlot % PARSE_CACHE_SIZE];
+    if (  pe->thing != thing
+       || pe->attr != attr
+       || pe->eval != eval
+       || pe->iGeneration != parse_generation
+       || pe->bSpaceCompress != mudconf.space_compress
+       || pe->nText != nText
+       || memcmp(pe->pOrig, atext, nText) != 0)
+    {
+        if (0 < pe->nRefs)
+        {
+            // The slot is still in use further up the stack.
+            //
+            mux_exec_copy(buff, bufc, executor, caller, enactor, eval, atext,
+                nText, cargs, ncargs);
+            return;
+        }
+
+        parse_cache_clear(pe);
+        pe->pOrig = (char *)MEMALLOC(nText+1);
+        ISOUTOFMEMORY(pe->pOrig);
+        memcpy(pe->pOrig, atext, nText+1);
+        pe->pCopy = (char *)MEMALLOC(nText+1);
+        ISOUTOFMEMORY(pe->pCopy);
+        memcpy(pe->pCopy, atext, nText+1);
+
+        pe->thing = thing;
+        pe->attr = attr;
+        pe->eval = eval;
+        pe->iGeneration = parse_generation;
+        pe->bSpaceCompress = mudconf.space_compress;
+        pe->nText = nText;
+        pe->pTop = parse_compile(pe, pe->pCopy, eval);
+    }
+
+    pe->nRefs++;
+    parse_exec(buff, bufc, executor, caller, enactor, eval, pe->pTop, cargs,
+        ncargs);
+    pe->nRefs--;
+}
+
 /* ---------------------------------------------------------------------------
  * save_global_regs, restore_global_regs:  Save and restore the global
  * registers to protect them from various sorts of munging.
@@ -34,6 +34,9 @@ void boot_slave(dbref executor, dbref caller, dbref enactor, int key);
 void close_sockets(bool emergency, const char *message);
 void CleanUpSlaveSocket(void);
 void CleanUpSlaveProcess(void);
+size_t nvt_decode_normal(const unsigned char *pBytes, size_t nBytes,
+    unsigned char *pOut, size_t nRoom, size_t *pnOut, size_t *pnLost,
+    bool bRuns);
 #ifdef QUERY_SLAVE
 void CleanUpSQLSlaveSocket(void);
 void CleanUpSQLSlaveProcess(void);
@@ -115,6 +118,8 @@ size_t MessageFetchSize(int number);
 // From netcommon.cpp.
 //
 void DCL_CDECL raw_broadcast(int, const char *, ...);
+void BeginSharedOutput(void);
+void EndSharedOutput(void);
 void list_siteinfo(dbref);
 void logged_out0(dbref executor, dbref caller, dbref enactor, int key);
 void logged_out1(dbref executor, dbref caller, dbref enactor, int eval, int key, char *arg);
@@ -126,6 +131,7 @@ char *MakeCanonicalDoing(char *pDoing, size_t *pnValidDoing, bool *pbValidDoing)
 /* From cque.cpp */
 int  nfy_que(dbref, int, int, int);
 int  halt_que(dbref, dbref);
+void que_rehome(dbref);
 void wait_que(dbref executor, dbref caller, dbref enactor, int, bool,
     CLinearTimeAbsolute&, dbref, int, char *, int, char *[], reg_ref *[]);
 
@@ -143,6 +149,10 @@ int get_gender(dbref);
 void mux_exec(char *buff, char **bufc, dbref executor, dbref caller,
               dbref enactor, int eval, char **dstr, char *cargs[],
               int ncargs);
+void mux_exec_attr(char *buff, char **bufc, dbref executor, dbref caller,
+                   dbref enactor, int eval, const char *atext, size_t nText,
+                   dbref thing, int attr, char *cargs[], int ncargs);
+void parse_cache_invalidate(void);
 
 DCL_INLINE void BufAddRef(lbuf_ref *lbufref)
 {
@@ -342,6 +352,7 @@ void badname_list(dbref, const char *);
 void ChangePassword(dbref player, const char *szPassword);
 const char *mux_crypt(const char *szPassword, const char *szSalt, int *piType);
 int  QueueMax(dbref);
+int  QueueWeight(dbref);
 int  a_Queue(dbref, int);
 void pcache_reload(dbref);
 void pcache_init(void);
@@ -493,6 +504,23 @@ char *atr_pget_str_LEN(char *, dbref, int, dbref *, int *, size_t *);
 char *atr_pget_str(char *, dbref, int, dbref *, int *);
 bool atr_get_info(dbref, int, dbref *, int *);
 bool atr_pget_info(dbref, int, dbref *, int *);
+
+// A read-only view of an attribute's text, owner, and flags.  The text is
+// good until atr_release().
+//
+typedef struct
+{
+    const char *pText;
+    size_t      nText;
+    dbref       owner;
+    int         flags;
+    void       *pPin;   // Pinned attribute text, or NULL.
+    char       *pCopy;  // Copy of text which could not be pinned, or NULL.
+} ATTR_VIEW;
+
+bool atr_get_view(ATTR_VIEW *, dbref, int);
+bool atr_pget_view(ATTR_VIEW *, dbref, int);
+void atr_release(ATTR_VIEW *);
 void atr_free(dbref);
 bool check_zone_handler(dbref player, dbref thing, bool bPlayerCheck);
 #define check_zone(player, thing) check_zone_handler(player, thing, false)
@@ -679,6 +707,11 @@ extern int anum_alc_top;
 #define PEMIT_ROOM      32  /* Send to containing rm (@femit, additive) */
 #define PEMIT_LIST      64  /* Send to a list */
 #define PEMIT_HTML      128 /* HTML escape, and no newline */
+#define PROFILE_REPORT  0   /* Show where time went */
+#define PROFILE_START   1   /* Start profiling */
+#define PROFILE_STOP    2   /* Stop profiling */
+#define PROFILE_RESET   3   /* Forget what has been profiled */
+#define PROFILE_EXPORT  4   /* Write call stacks to profile_file */
 #define PS_BRIEF        0   /* Short PS report */
 #define PS_LONG         1   /* Long PS report */
 #define PS_SUMM         2   /* Queue counts only */
@@ -715,6 +748,12 @@ extern int anum_alc_top;
 #define SAY_HERE        64  /* Output to current location */
 #define SAY_ROOM        128 /* Output to containing room */
 #define SAY_HTML        256 /* Don't output a newline */
+#define SELFTEST_WEBSOCKET 1 /* Time websocket output translation */
+#define SELFTEST_TELNET    2 /* Time telnet input decoding */
+#define SELFTEST_SCHEDULER 3 /* Time deferring and cancelling tasks */
+#define SELFTEST_PARSE     4 /* Compare cached and uncached evaluation */
+#define SELFTEST_FUNCTIONS 5 /* Time function name lookup */
+#define SELFTEST_DEFLATE   6 /* Check and time websocket inflation */
 #define SET_QUIET       1   /* Don't display 'Set.' message. */
 #define SHOUT_DEFAULT   0   /* Default @wall message */
 #define SHOUT_WIZARD    1   /* @wizwall */
@@ -983,7 +1022,7 @@ void dispatch_CacheTick(void *pUnused, int iUnused);
 //
 typedef void FTASK(void *, int);
 
-typedef struct
+typedef struct task_record
 {
     CLinearTimeAbsolute ltaWhen;
 
@@ -993,6 +1032,13 @@ typedef struct
     void       *arg_voidptr;
     int        arg_Integer;
     int        m_iVisitedMark;
+
+    // Maintained by the heap or wheel which holds the task.
+    //
+    int        m_iSlot;         // Slot in the heap or on the wheel.
+    struct task_record *m_pNextIndexed; // Next task in the same index bucket.
+    struct task_record *m_pNextInSlot;  // Neighbors on the same wheel slot.
+    struct task_record *m_pPrevInSlot;
 } TASK_RECORD, *PTASK_RECORD;
 
 #define PRIORITY_SYSTEM  100
@@ -1008,15 +1054,51 @@ typedef struct
 typedef int SCHCMP(PTASK_RECORD, PTASK_RECORD);
 typedef int SCHLOOK(PTASK_RECORD);
 
+// Tasks indexed by (fpTask, arg_voidptr, arg_Integer), so CancelTask can
+// find them without a scan.
+//
+class CTaskIndex
+{
+private:
+    int m_nBuckets;
+    int m_nTasks;
+    PTASK_RECORD *m_pBuckets;
+
+    PTASK_RECORD *Bucket(FTASK *fpTask, void *arg_voidptr, int arg_Integer);
+    bool Grow(void);
+
+public:
+    CTaskIndex();
+    ~CTaskIndex();
+
+    // Tasks with the key are on the chain from here, linked through
+    // m_pNextIndexed, among others which are not.
+    //
+    PTASK_RECORD First(FTASK *fpTask, void *arg_voidptr, int arg_Integer);
+    bool Insert(PTASK_RECORD pTask);
+
+    // The key is passed separately, because a traversal may have changed
+    // the fields the task was indexed under.
+    //
+    void Remove(PTASK_RECORD pTask, FTASK *fpTask, void *arg_voidptr, int arg_Integer);
+};
+
 class CTaskHeap
 {
 private:
     int m_nAllocated;
     int m_nCurrent;
     PTASK_RECORD *m_pHeap;
+    CTaskIndex m_Index;
 
     int m_iVisitedMark;
 
+    void Place(int iNode, PTASK_RECORD pTask)
+    {
+        m_pHeap[iNode] = pTask;
+        pTask->m_iSlot = iNode;
+    }
+    int  Look(PTASK_RECORD p, SCHLOOK *pfLook);
     bool Grow(void);
     void SiftDown(int, SCHCMP *);
     void SiftUp(int, SCHCMP *);
@@ -1033,7 +1115,7 @@ public:
     bool Insert(PTASK_RECORD, SCHCMP *);
     PTASK_RECORD PeekAtTopmost(void);
     PTASK_RECORD RemoveTopmost(SCHCMP *);
-    void CancelTask(FTASK *fpTask, void *arg_voidptr, int arg_Integer);
+    void CancelTask(FTASK *fpTask, void *arg_voidptr, int arg_Integer, SCHCMP *pfCompare);
 
 #define IU_DONE        0
 #define IU_NEXT_TASK   1
@@ -1043,13 +1125,57 @@ public:
     int TraverseOrdered(SCHLOOK *pfLook, SCHCMP *pfCompare);
 };
 
+// Tasks deferred further out than WHEEL_HORIZON seconds wait on a
+// hierarchical timing wheel instead of in the WhenHeap. Each level has
+// WHEEL_SLOTS slots, and each slot on a level spans the whole of the level
+// below. As time passes, slots cascade down a level, and the tasks on the
+// bottom level are handed to the WhenHeap WHEEL_HORIZON seconds before they
+// are due, so the WhenHeap still decides exactly when everything runs.
+//
+#define WHEEL_BITS    6
+#define WHEEL_SLOTS   (1 << WHEEL_BITS)
+#define WHEEL_LEVELS  4
+#define WHEEL_HORIZON WHEEL_SLOTS
+
+class CTaskWheel
+{
+private:
+    INT64 m_nCursor;    // Tasks due before this second have been handed on.
+    int   m_nTasks;
+    int   m_anTasks[WHEEL_LEVELS];
+    PTASK_RECORD m_apSlots[WHEEL_LEVELS][WHEEL_SLOTS];
+    CTaskIndex m_Index;
+    PTASK_RECORD m_pRefile;
+
+    void LinkTask(PTASK_RECORD pTask);
+    void UnlinkTask(PTASK_RECORD pTask);
+
+public:
+    CTaskWheel();
+    ~CTaskWheel();
+
+    bool Insert(PTASK_RECORD pTask);
+    PTASK_RECORD Advance(const CLinearTimeAbsolute &ltaNow);
+    bool WhenNext(CLinearTimeAbsolute *pltaWhen);
+    void CancelTask(FTASK *fpTask, void *arg_voidptr, int arg_Integer);
+
+    int  GetTasks(PTASK_RECORD *apTasks);
+    int  Count(void) { return m_nTasks; }
+    int  Visit(PTASK_RECORD pTask, SCHLOOK *pfLook);
+    PTASK_RECORD TakeRefile(void);
+};
+
 class CScheduler
 {
 private:
-    CTaskHeap m_WhenHeap;
-    CTaskHeap m_PriorityHeap;
-    int       m_Ticket;
-    int       m_minPriority;
+    CTaskHeap  m_WhenHeap;
+    CTaskHeap  m_PriorityHeap;
+    CTaskWheel m_Wheel;
+    int        m_Ticket;
+    int        m_minPriority;
+
+    void FileTask(PTASK_RECORD pTask);
+    void RefileWheel(void);
 
 public:
     void TraverseUnordered(SCHLOOK *pfLook);
@@ -1143,6 +1269,7 @@ char *modSpeech(dbref player, char *message, bool bWhich, char *command);
 void stack_clr(dbref obj);
 #endif // DEPRECATED
 bool parse_and_get_attrib(dbref, char *[], char **, dbref *, dbref *, int *, char *, char **);
+bool parse_and_get_attrib_view(dbref, char *[], ATTR_VIEW *, dbref *, int *, char *, char **);
 void SimplifyColorLetters(char Out[8], char *pIn);
 
 #endif // EXTERNS_H
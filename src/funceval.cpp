@@ -30,14 +30,15 @@
  * credit is due.
  */
 
-bool parse_and_get_attrib
+// parse_attrib_arg: Find the attribute named by fargs[0], either as
+// <obj>/<attr> or as <attr> on executor, if executor may see it.
+//
+static bool parse_attrib_arg
 (
     dbref   executor,
     char   *fargs[],
-    char  **atext,
     dbref  *thing,
-    dbref  *paowner,
-    dbref  *paflags,
+    ATTR  **pap,
     char   *buff,
     char  **bufc
 )
@@ -66,6 +67,27 @@ bool parse_and_get_attrib
         safe_noperm(buff, bufc);
         return false;
     }
+    *pap = ap;
+    return true;
+}
+
+bool parse_and_get_attrib
+(
+    dbref   executor,
+    char   *fargs[],
+    char  **atext,
+    dbref  *thing,
+    dbref  *paowner,
+    dbref  *paflags,
+    char   *buff,
+    char  **bufc
+)
+{
+    ATTR *ap;
+    if (!parse_attrib_arg(executor, fargs, thing, &ap, buff, bufc))
+    {
+        return false;
+    }
 
     *atext = atr_pget(*thing, ap->number, paowner, paflags);
     if (!*atext)
@@ -80,6 +102,31 @@ bool parse_and_get_attrib
     return true;
 }
 
+// parse_and_get_attrib_view: As parse_and_get_attrib, but the attribute is
+// read in place through pav, which the caller must atr_release(), and it
+// also says which attribute was read.
+//
+bool parse_and_get_attrib_view
+(
+    dbref      executor,
+    char      *fargs[],
+    ATTR_VIEW *pav,
+    dbref     *thing,
+    int       *pattr,
+    char      *buff,
+    char     **bufc
+)
+{
+    ATTR *ap;
+    if (!parse_attrib_arg(executor, fargs, thing, &ap, buff, bufc))
+    {
+        return false;
+    }
+
+    *pattr = ap->number;
+    return atr_pget_view(pav, *thing, ap->number);
+}
+
 #define CWHO_ON  0
 #define CWHO_OFF 1
 #define CWHO_ALL 2
@@ -2967,10 +3014,9 @@ FUNCTION(fun_mix)
     // Get the attribute. Check the permissions.
     //
     dbref thing;
-    char *atext;
-    dbref aowner;
-    int   aflags;
-    if (!parse_and_get_attrib(executor, fargs, &atext, &thing, &aowner, &aflags, buff, bufc))
+    int   attr;
+    ATTR_VIEW av;
+    if (!parse_and_get_attrib_view(executor, fargs, &av, &thing, &attr, buff, bufc))
     {
         return;
     }
@@ -2991,7 +3037,6 @@ FUNCTION(fun_mix)
     }
 
     char empty[1] = "";
-    char *atextbuf = alloc_lbuf("fun_mix");
     char *os[NUM_ENV_VARS];
     bool bFirst = true;
     for (  int wc = 0;
@@ -3017,14 +3062,11 @@ FUNCTION(fun_mix)
                 os[i] = empty;
             }
         }
-        mux_strncpy(atextbuf, atext, LBUF_SIZE-1);
-        char *str = atextbuf;
-        mux_exec(buff, bufc, thing, executor, enactor,
-            AttrTrace(aflags, EV_STRIP_CURLY|EV_FCHECK|EV_EVAL), &str,
-            os, lastn);
+        mux_exec_attr(buff, bufc, thing, executor, enactor,
+            AttrTrace(av.flags, EV_STRIP_CURLY|EV_FCHECK|EV_EVAL), av.pText,
+            av.nText, thing, attr, os, lastn);
     }
-    free_lbuf(atext);
-    free_lbuf(atextbuf);
+    atr_release(&av);
 }
 
 /* ---------------------------------------------------------------------------
@@ -3059,18 +3101,16 @@ FUNCTION(fun_step)
 
     // Get attribute. Check permissions.
     //
-    char *atext;
+    ATTR_VIEW av;
     dbref thing;
-    dbref aowner;
-    int   aflags;
-    if (!parse_and_get_attrib(executor, fargs, &atext, &thing, &aowner, &aflags, buff, bufc))
+    int   attr;
+    if (!parse_and_get_attrib_view(executor, fargs, &av, &thing, &attr, buff, bufc))
     {
         return;
     }
 
     char *cp = trim_space_sep(fargs[1], &isep);
 
-    char *atextbuf = alloc_lbuf("fun_step");
     char *os[NUM_ENV_VARS];
     bool bFirst = true;
     while (  cp
@@ -3090,13 +3130,11 @@ FUNCTION(fun_step)
         {
             os[i] = split_token(&cp, &isep);
         }
-        mux_strncpy(atextbuf, atext, LBUF_SIZE-1);
-        char *str = atextbuf;
-        mux_exec(buff, bufc, executor, caller, enactor,
-             AttrTrace(aflags, EV_STRIP_CURLY|EV_FCHECK|EV_EVAL), &str, os, i);
+        mux_exec_attr(buff, bufc, executor, caller, enactor,
+             AttrTrace(av.flags, EV_STRIP_CURLY|EV_FCHECK|EV_EVAL), av.pText,
+             av.nText, thing, attr, os, i);
     }
-    free_lbuf(atext);
-    free_lbuf(atextbuf);
+    atr_release(&av);
 }
 
 /* ---------------------------------------------------------------------------
@@ -3120,18 +3158,15 @@ FUNCTION(fun_foreach)
         return;
     }
 
-    char *atext;
+    ATTR_VIEW av;
     dbref thing;
-    dbref aowner;
-    int   aflags;
-    if (!parse_and_get_attrib(executor, fargs, &atext, &thing, &aowner, &aflags, buff, bufc))
+    int   attr;
+    if (!parse_and_get_attrib_view(executor, fargs, &av, &thing, &attr, buff, bufc))
     {
         return;
     }
 
-    char *str;
     char cbuf[2], prev = '\0';
-    char *atextbuf = alloc_lbuf("fun_foreach");
     SEP sep;
     sep.n = 1;
     sep.str[0] = ' ';
@@ -3178,10 +3213,9 @@ FUNCTION(fun_foreach)
                 }
             }
 
-            mux_strncpy(atextbuf, atext, LBUF_SIZE-1);
-            str = atextbuf;
-            mux_exec(buff, bufc, thing, executor, enactor,
-                AttrTrace(aflags, EV_STRIP_CURLY|EV_FCHECK|EV_EVAL), &str, &bp, 1);
+            mux_exec_attr(buff, bufc, thing, executor, enactor,
+                AttrTrace(av.flags, EV_STRIP_CURLY|EV_FCHECK|EV_EVAL),
+                av.pText, av.nText, thing, attr, &bp, 1);
             prev = cbuf[0];
         }
     }
@@ -3194,14 +3228,12 @@ FUNCTION(fun_foreach)
         {
             cbuf[0] = *cp++;
 
-            mux_strncpy(atextbuf, atext, LBUF_SIZE-1);
-            str = atextbuf;
-            mux_exec(buff, bufc, thing, executor, enactor,
-                AttrTrace(aflags, EV_STRIP_CURLY|EV_FCHECK|EV_EVAL), &str, &bp, 1);
+            mux_exec_attr(buff, bufc, thing, executor, enactor,
+                AttrTrace(av.flags, EV_STRIP_CURLY|EV_FCHECK|EV_EVAL),
+                av.pText, av.nText, thing, attr, &bp, 1);
         }
     }
-    free_lbuf(atextbuf);
-    free_lbuf(atext);
+    atr_release(&av);
 }
 
 /* ---------------------------------------------------------------------------
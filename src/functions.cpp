@@ -18,6 +18,7 @@
 #include "interface.h"
 #include "misc.h"
 #include "pcre.h"
+#include "profile.h"
 #ifdef REALITY_LVLS
 #include "levels.h"
 #endif // REALITY_LVLS
@@ -2164,15 +2165,17 @@ static void do_ufun(char *buff, char **bufc, dbref executor, dbref caller,
     UNUSED_PARAMETER(cargs);
     UNUSED_PARAMETER(ncargs);
 
-    char *atext;
+    ATTR_VIEW av;
     dbref thing;
-    dbref aowner;
-    int   aflags;
-    if (!parse_and_get_attrib(executor, fargs, &atext, &thing, &aowner, &aflags, buff, bufc))
+    int   attr;
+    if (!parse_and_get_attrib_view(executor, fargs, &av, &thing, &attr, buff, bufc))
     {
         return;
     }
 
+    PROF_FRAME pf;
+    prof_begin(&pf, PROF_UFUN, thing, attr);
+
     // If we're evaluating locally, preserve the global registers.
     //
     reg_ref **preserve = NULL;
@@ -2184,11 +2187,10 @@ static void do_ufun(char *buff, char **bufc, dbref executor, dbref caller,
 
     // Evaluate it using the rest of the passed function args.
     //
-    char *str = atext;
-    mux_exec(buff, bufc, thing, executor, enactor,
-        AttrTrace(aflags, EV_FCHECK|EV_EVAL),
-        &str, &(fargs[1]), nfargs - 1);
-    free_lbuf(atext);
+    mux_exec_attr(buff, bufc, thing, executor, enactor,
+        AttrTrace(av.flags, EV_FCHECK|EV_EVAL), av.pText, av.nText, thing,
+        attr, &(fargs[1]), nfargs - 1);
+    atr_release(&av);
 
     // If we're evaluating locally, restore the preserved registers.
     //
@@ -2197,6 +2199,7 @@ static void do_ufun(char *buff, char **bufc, dbref executor, dbref caller,
         restore_global_regs(preserve);
         PopRegisters(preserve, MAX_GLOBAL_REGS);
     }
+    prof_end(&pf);
 }
 
 static FUNCTION(fun_u)
@@ -6386,11 +6389,10 @@ static FUNCTION(fun_fold)
         return;
     }
 
-    char *atext;
+    ATTR_VIEW av;
     dbref thing;
-    dbref aowner;
-    int   aflags;
-    if (!parse_and_get_attrib(executor, fargs, &atext, &thing, &aowner, &aflags, buff, bufc))
+    int   attr;
+    if (!parse_and_get_attrib_view(executor, fargs, &av, &thing, &attr, buff, bufc))
     {
         return;
     }
@@ -6399,10 +6401,8 @@ static FUNCTION(fun_fold)
     //
     char *curr = fargs[1];
     char *cp = curr;
-    char *atextbuf = alloc_lbuf("fun_fold");
-    mux_strncpy(atextbuf, atext, LBUF_SIZE-1);
 
-    char *result, *bp, *str, *clist[2];
+    char *result, *bp, *clist[2];
 
     // May as well handle first case now.
     //
@@ -6412,10 +6412,9 @@ static FUNCTION(fun_fold)
         clist[0] = fargs[2];
         clist[1] = split_token(&cp, &sep);
         result = bp = alloc_lbuf("fun_fold");
-        str = atextbuf;
-        mux_exec(result, &bp, thing, executor, enactor,
-            AttrTrace(aflags, EV_STRIP_CURLY|EV_FCHECK|EV_EVAL), &str,
-            clist, 2);
+        mux_exec_attr(result, &bp, thing, executor, enactor,
+            AttrTrace(av.flags, EV_STRIP_CURLY|EV_FCHECK|EV_EVAL), av.pText,
+            av.nText, thing, attr, clist, 2);
         *bp = '\0';
     }
     else
@@ -6423,10 +6422,9 @@ static FUNCTION(fun_fold)
         clist[0] = split_token(&cp, &sep);
         clist[1] = split_token(&cp, &sep);
         result = bp = alloc_lbuf("fun_fold");
-        str = atextbuf;
-        mux_exec(result, &bp, thing, executor, enactor,
-            AttrTrace(aflags, EV_STRIP_CURLY|EV_FCHECK|EV_EVAL), &str,
-            clist, 2);
+        mux_exec_attr(result, &bp, thing, executor, enactor,
+            AttrTrace(av.flags, EV_STRIP_CURLY|EV_FCHECK|EV_EVAL), av.pText,
+            av.nText, thing, attr, clist, 2);
         *bp = '\0';
     }
 
@@ -6439,20 +6437,17 @@ static FUNCTION(fun_fold)
     {
         clist[0] = rstore;
         clist[1] = split_token(&cp, &sep);
-        mux_strncpy(atextbuf, atext, LBUF_SIZE-1);
         bp = result;
-        str = atextbuf;
-        mux_exec(result, &bp, thing, executor, enactor,
-            AttrTrace(aflags, EV_STRIP_CURLY|EV_FCHECK|EV_EVAL), &str,
-            clist, 2);
+        mux_exec_attr(result, &bp, thing, executor, enactor,
+            AttrTrace(av.flags, EV_STRIP_CURLY|EV_FCHECK|EV_EVAL), av.pText,
+            av.nText, thing, attr, clist, 2);
         *bp = '\0';
         mux_strncpy(rstore, result, LBUF_SIZE-1);
     }
     free_lbuf(result);
     safe_str(rstore, buff, bufc);
     free_lbuf(rstore);
-    free_lbuf(atext);
-    free_lbuf(atextbuf);
+    atr_release(&av);
 }
 
 // Taken from PennMUSH with permission.
@@ -6816,11 +6811,10 @@ FUNCTION(fun_sql)
 static void filter_handler(char *buff, char **bufc, dbref executor, dbref enactor,
                     char *fargs[], int nfargs, SEP *psep, SEP *posep, bool bBool)
 {
-    char *atext;
+    ATTR_VIEW av;
     dbref thing;
-    dbref aowner;
-    int   aflags;
-    if (!parse_and_get_attrib(executor, fargs, &atext, &thing, &aowner, &aflags, buff, bufc))
+    int   attr;
+    if (!parse_and_get_attrib_view(executor, fargs, &av, &thing, &attr, buff, bufc))
     {
         return;
     }
@@ -6839,7 +6833,6 @@ static void filter_handler(char *buff, char **bufc, dbref executor, dbref enacto
     char *cp = trim_space_sep(fargs[1], psep);
     if ('\0' != cp[0])
     {
-        char *atextbuf = alloc_lbuf("fun_filter");
         char *result = alloc_lbuf("fun_filter");
         bool bFirst = true;
         while (  cp
@@ -6847,13 +6840,11 @@ static void filter_handler(char *buff, char **bufc, dbref executor, dbref enacto
               && !MuxAlarm.bAlarmed)
         {
             char *objstring = split_token(&cp, psep);
-            mux_strncpy(atextbuf, atext, LBUF_SIZE-1);
             char *bp = result;
-            char *str = atextbuf;
             filter_args[0] = objstring;
-            mux_exec(result, &bp, thing, executor, enactor,
-                AttrTrace(aflags, EV_STRIP_CURLY|EV_FCHECK|EV_EVAL), &str,
-                filter_args, filter_nargs);
+            mux_exec_attr(result, &bp, thing, executor, enactor,
+                AttrTrace(av.flags, EV_STRIP_CURLY|EV_FCHECK|EV_EVAL),
+                av.pText, av.nText, thing, attr, filter_args, filter_nargs);
             *bp = '\0';
 
             if (  (  bBool
@@ -6871,9 +6862,8 @@ static void filter_handler(char *buff, char **bufc, dbref executor, dbref enacto
             }
         }
         free_lbuf(result);
-        free_lbuf(atextbuf);
     }
-    free_lbuf(atext);
+    atr_release(&av);
 }
 
 static FUNCTION(fun_filter)
@@ -6930,11 +6920,10 @@ static FUNCTION(fun_map)
         return;
     }
 
-    char *atext;
+    ATTR_VIEW av;
     dbref thing;
-    dbref aowner;
-    int   aflags;
-    if (!parse_and_get_attrib(executor, fargs, &atext, &thing, &aowner, &aflags, buff, bufc))
+    int   attr;
+    if (!parse_and_get_attrib_view(executor, fargs, &av, &thing, &attr, buff, bufc))
     {
         return;
     }
@@ -6953,7 +6942,6 @@ static FUNCTION(fun_map)
     char *cp = trim_space_sep(fargs[1], &sep);
     if ('\0' != cp[0])
     {
-        char *atextbuf = alloc_lbuf("fun_map");
         bool first = true;
         while (  cp
               && mudstate.func_invk_ctr < mudconf.func_invk_lim
@@ -6965,16 +6953,13 @@ static FUNCTION(fun_map)
             }
             first = false;
             char *objstring = split_token(&cp, &sep);
-            mux_strncpy(atextbuf, atext, LBUF_SIZE-1);
-            char *str = atextbuf;
             map_args[0] = objstring;
-            mux_exec(buff, bufc, thing, executor, enactor,
-                AttrTrace(aflags, EV_STRIP_CURLY|EV_FCHECK|EV_EVAL), &str,
-                map_args, map_nargs);
+            mux_exec_attr(buff, bufc, thing, executor, enactor,
+                AttrTrace(av.flags, EV_STRIP_CURLY|EV_FCHECK|EV_EVAL),
+                av.pText, av.nText, thing, attr, map_args, map_nargs);
         }
-        free_lbuf(atextbuf);
     }
-    free_lbuf(atext);
+    atr_release(&av);
 }
 
 /*
@@ -10329,6 +10314,303 @@ void init_functab(void)
     ufun_head = NULL;
 }
 
+// Builtin function index.
+//
+// mux_exec looks up a name at every '('.  Instead of lowercasing the name
+// and probing func_htab, the names in func_htab are also indexed by a
+// minimal perfect hash (hash and displace) whose hash folds case as it goes,
+// so a lookup hashes the text where it lies and makes one comparison.
+//
+// Builtins, local functions, and function_alias entries are only ever added
+// to func_htab, so the index is rebuilt whenever its entry count changes.
+// @function names live in ufunc_htab and are not indexed.  If no seed within
+// FUN_SEED_MAX gives a usable hash, there is no index, and lookups go to
+// func_htab as they used to.
+//
+typedef struct
+{
+    char  *pKey;    // Lowercase name, as keyed in func_htab.
+    size_t nKey;
+    FUN   *fp;
+    UINT32 nHash;   // Folded hash of pKey, valid while building.
+} FUN_SLOT;
+
+#define FUN_BUCKET_MAX 16
+#define FUN_DISP_MAX   (1 << 20)
+#define FUN_SEED_MAX   64
+
+static FUN_SLOT *fun_slots = NULL;
+static UINT32   *fun_disp = NULL;   // Displacement for each bucket.
+static UINT32    fun_nSlots = 0;
+static UINT32    fun_nBuckets = 0;
+static UINT32    fun_seed = 0;
+static unsigned int fun_nIndexed = 0;
+
+static inline UINT32 fun_fmix(UINT32 h)
+{
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+    return h;
+}
+
+static inline UINT32 fun_hash(UINT32 seed, const char *p, size_t n)
+{
+    UINT32 h = 2166136261U ^ seed;
+    for (size_t i = 0; i < n; i++)
+    {
+        h ^= mux_tolower(p[i]);
+        h *= 16777619U;
+    }
+    return h;
+}
+
+// Map a hash onto [0, n) without dividing.
+//
+static inline UINT32 fun_range(UINT32 h, UINT32 n)
+{
+    return (UINT32)(((UINT64)h * n) >> 32);
+}
+
+static inline UINT32 fun_bucket(UINT32 h)
+{
+    return fun_range(fun_fmix(h), fun_nBuckets);
+}
+
+static inline UINT32 fun_slot(UINT32 h, UINT32 d)
+{
+    return fun_range(fun_fmix((h + 0x9E3779B9) ^ d), fun_nSlots);
+}
+
+// Choose a displacement for one bucket so that its keys land in distinct,
+// unused slots.
+//
+static bool fun_place(FUN_SLOT *aKeys[], UINT32 nKeys, UINT32 iBucket,
+    bool abUsed[])
+{
+    UINT32 aSlot[FUN_BUCKET_MAX];
+    for (UINT32 d = 0; d < FUN_DISP_MAX; d++)
+    {
+        UINT32 i;
+        for (i = 0; i < nKeys; i++)
+        {
+            aSlot[i] = fun_slot(aKeys[i]->nHash, d);
+            if (abUsed[aSlot[i]])
+            {
+                break;
+            }
+            UINT32 j;
+            for (j = 0; j < i; j++)
+            {
+                if (aSlot[j] == aSlot[i])
+                {
+                    break;
+                }
+            }
+            if (j < i)
+            {
+                break;
+            }
+        }
+        if (i == nKeys)
+        {
+            fun_disp[iBucket] = d;
+            for (i = 0; i < nKeys; i++)
+            {
+                abUsed[aSlot[i]] = true;
+                fun_slots[aSlot[i]] = *aKeys[i];
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+static void functions_index(void)
+{
+    if (fun_slots)
+    {
+        for (UINT32 i = 0; i < fun_nSlots; i++)
+        {
+            MEMFREE(fun_slots[i].pKey);
+        }
+        MEMFREE(fun_slots);
+        MEMFREE(fun_disp);
+        fun_slots = NULL;
+        fun_disp = NULL;
+    }
+    fun_nSlots = 0;
+    fun_nIndexed = mudstate.func_htab.GetEntryCount();
+    if (0 == fun_nIndexed)
+    {
+        return;
+    }
+
+    // Collect the names.  A key which is not already lowercase can never
+    // match a folded name, so it is left out.
+    //
+    FUN_SLOT *aKeys = (FUN_SLOT *)MEMALLOC(fun_nIndexed * sizeof(FUN_SLOT));
+    ISOUTOFMEMORY(aKeys);
+    UINT32 nKeys = 0;
+    char *pKey;
+    int   nKey;
+    for (FUN *fp = (FUN *)hash_firstkey(&mudstate.func_htab, &nKey, &pKey);
+         fp && nKeys < fun_nIndexed;
+         fp = (FUN *)hash_nextkey(&mudstate.func_htab, &nKey, &pKey))
+    {
+        int i;
+        for (i = 0; i < nKey; i++)
+        {
+            if (mux_tolower(pKey[i]) != pKey[i])
+            {
+                break;
+            }
+        }
+        if (i == nKey)
+        {
+            aKeys[nKeys].pKey = StringCloneLen(pKey, nKey);
+            aKeys[nKeys].nKey = nKey;
+            aKeys[nKeys].fp = fp;
+            nKeys++;
+        }
+    }
+
+    if (0 == nKeys)
+    {
+        MEMFREE(aKeys);
+        return;
+    }
+
+    fun_nSlots = nKeys;
+    fun_nBuckets = (nKeys + 3)/4;
+    fun_slots = (FUN_SLOT *)MEMALLOC(nKeys * sizeof(FUN_SLOT));
+    ISOUTOFMEMORY(fun_slots);
+    fun_disp = (UINT32 *)MEMALLOC(fun_nBuckets * sizeof(UINT32));
+    ISOUTOFMEMORY(fun_disp);
+    FUN_SLOT **aOrder = (FUN_SLOT **)MEMALLOC(nKeys * sizeof(FUN_SLOT *));
+    ISOUTOFMEMORY(aOrder);
+    UINT32 *aStart = (UINT32 *)MEMALLOC((fun_nBuckets + 1) * sizeof(UINT32));
+    ISOUTOFMEMORY(aStart);
+    UINT32 *aFill = (UINT32 *)MEMALLOC(fun_nBuckets * sizeof(UINT32));
+    ISOUTOFMEMORY(aFill);
+    bool *abUsed = (bool *)MEMALLOC(nKeys * sizeof(bool));
+    ISOUTOFMEMORY(abUsed);
+
+    bool bPlaced = false;
+    for (fun_seed = 0; !bPlaced && fun_seed < FUN_SEED_MAX; fun_seed++)
+    {
+        // Group the keys by bucket.
+        //
+        UINT32 i;
+        memset(aStart, 0, (fun_nBuckets + 1) * sizeof(UINT32));
+        for (i = 0; i < nKeys; i++)
+        {
+            aKeys[i].nHash = fun_hash(fun_seed, aKeys[i].pKey, aKeys[i].nKey);
+            aStart[fun_bucket(aKeys[i].nHash) + 1]++;
+        }
+        UINT32 nLargest = 0;
+        for (i = 0; i < fun_nBuckets; i++)
+        {
+            if (nLargest < aStart[i+1])
+            {
+                nLargest = aStart[i+1];
+            }
+            aStart[i+1] += aStart[i];
+            aFill[i] = aStart[i];
+        }
+        if (FUN_BUCKET_MAX < nLargest)
+        {
+            continue;
+        }
+        for (i = 0; i < nKeys; i++)
+        {
+            aOrder[aFill[fun_bucket(aKeys[i].nHash)]++] = &aKeys[i];
+        }
+
+        // Place the largest buckets first, while the table is emptiest.
+        //
+        memset(abUsed, 0, nKeys * sizeof(bool));
+        bPlaced = true;
+        for (UINT32 nSize = nLargest; 0 < nSize && bPlaced; nSize--)
+        {
+            for (i = 0; i < fun_nBuckets && bPlaced; i++)
+            {
+                if (aStart[i+1] - aStart[i] == nSize)
+                {
+                    bPlaced = fun_place(aOrder + aStart[i], nSize, i, abUsed);
+                }
+            }
+        }
+    }
+    fun_seed--;
+
+    if (!bPlaced)
+    {
+        for (UINT32 i = 0; i < nKeys; i++)
+        {
+            MEMFREE(aKeys[i].pKey);
+        }
+        MEMFREE(fun_slots);
+        MEMFREE(fun_disp);
+        fun_slots = NULL;
+        fun_disp = NULL;
+        fun_nSlots = 0;
+        STARTLOG(LOG_PROBLEMS, "FUN", "INDEX")
+        log_text(tprintf("No perfect hash for %u function names.", nKeys));
+        ENDLOG
+    }
+
+    MEMFREE(aFill);
+    MEMFREE(abUsed);
+    MEMFREE(aStart);
+    MEMFREE(aOrder);
+    MEMFREE(aKeys);
+}
+
+// Find a builtin or local function by name, in any case.
+//
+FUN *function_find(const char *pName, size_t nName)
+{
+    if (fun_nIndexed != mudstate.func_htab.GetEntryCount())
+    {
+        functions_index();
+    }
+    if (0 == fun_nSlots)
+    {
+        // There is no index, so lowercase the name and probe func_htab.
+        //
+        static char aLower[LBUF_SIZE];
+        if (sizeof(aLower) <= nName)
+        {
+            return NULL;
+        }
+        for (size_t i = 0; i < nName; i++)
+        {
+            aLower[i] = mux_tolower(pName[i]);
+        }
+        aLower[nName] = '\0';
+        return (FUN *)hashfindLEN(aLower, nName, &mudstate.func_htab);
+    }
+
+    UINT32 nHash = fun_hash(fun_seed, pName, nName);
+    UINT32 iBucket = fun_bucket(nHash);
+    FUN_SLOT *ps = &fun_slots[fun_slot(nHash, fun_disp[iBucket])];
+    if (ps->nKey != nName)
+    {
+        return NULL;
+    }
+    for (size_t i = 0; i < nName; i++)
+    {
+        if (mux_tolower(pName[i]) != ps->pKey[i])
+        {
+            return NULL;
+        }
+    }
+    return ps->fp;
+}
+
 void do_function
 (
     dbref executor,
@@ -10477,6 +10759,7 @@ void do_function
             ufp2->next = ufp;
         }
         hashaddLEN(np, strlen(np), ufp, &mudstate.ufunc_htab);
+        parse_cache_invalidate();
     }
     ufp->obj = obj;
     ufp->atr = pattr->number;
@@ -10488,6 +10771,35 @@ void do_function
     }
 }
 
+// ---------------------------------------------------------------------------
+// remove_user_func: Forget an @function.  pName must be lowercase, as the
+// keys of ufunc_htab are.
+//
+void remove_user_func(const char *pName)
+{
+    size_t nName = strlen(pName);
+    UFUN *ufp = (UFUN *)hashfindLEN(pName, nName, &mudstate.ufunc_htab);
+    if (!ufp)
+    {
+        return;
+    }
+    hashdeleteLEN(pName, nName, &mudstate.ufunc_htab);
+
+    UFUN **pp = &ufun_head;
+    while (*pp && *pp != ufp)
+    {
+        pp = &(*pp)->next;
+    }
+    if (*pp)
+    {
+        *pp = ufp->next;
+    }
+    MEMFREE(ufp->name);
+    ufp->name = NULL;
+    delete ufp;
+    parse_cache_invalidate();
+}
+
 // ---------------------------------------------------------------------------
 // list_functable: List available functions.
 //
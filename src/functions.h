@@ -39,6 +39,7 @@ typedef struct ufun {
 
 void init_functab(void);
 void list_functable(dbref);
+void remove_user_func(const char *pName);
 extern UFUN *ufun_head;
 
 /* Special handling of separators. */
@@ -102,6 +103,7 @@ int countwords(char *str, SEP *psep);
 //
 void function_add(FUN *fp);
 void functions_add(FUN funlist[]);
+FUN *function_find(const char *pName, size_t nName);
 
 // Function definitions from funceval.cpp
 //
@@ -23,6 +23,7 @@ using namespace std;
 #include "muxcli.h"
 #include "pcre.h"
 #include "powers.h"
+#include "profile.h"
 #include "help.h"
 #ifdef REALITY_LVLS
 #include "levels.h"
@@ -205,19 +206,19 @@ static int atr_match1(dbref thing, dbref parent, dbref player, char type,
 
 		// We need to grab the attribute even before we know whether we'll use
 		// it or not in order to maintain cached knowledge about ^-Commands
-		// and $-Commands.
+		// and $-Commands.  It is read in place and only copied out when it
+		// is a candidate.
 		//
-		dbref aowner;
-		int aflags;
-		char buff[LBUF_SIZE];
-		atr_get_str(buff, parent, atr, &aowner, &aflags);
+		ATTR_VIEW av;
+		atr_get_view(&av, parent, atr);
+		int aflags = av.flags;
 
-		char *s = NULL;
+		const char *s = NULL;
 		if (0 == (aflags & AF_NOPROG)
-				&& (AMATCH_CMD == buff[0] || AMATCH_LISTEN == buff[0])) {
-			s = strchr(buff + 1, ':');
+				&& (AMATCH_CMD == av.pText[0] || AMATCH_LISTEN == av.pText[0])) {
+			s = strchr(av.pText + 1, ':');
 			if (s) {
-				if (AMATCH_CMD == buff[0]) {
+				if (AMATCH_CMD == av.pText[0]) {
 					bFoundCommands = true;
 				} else {
 					bFoundListens = true;
@@ -232,6 +233,7 @@ static int atr_match1(dbref thing, dbref parent, dbref player, char type,
 				&& ((ap->flags & AF_PRIVATE) || (aflags & AF_PRIVATE)
 						|| hashfindLEN(&(ap->number), sizeof(ap->number),
 								&mudstate.parent_htab))) {
+			atr_release(&av);
 			continue;
 		}
 
@@ -243,24 +245,20 @@ static int atr_match1(dbref thing, dbref parent, dbref player, char type,
 					&mudstate.parent_htab);
 		}
 
-		if (aflags & AF_NOPROG) {
-			continue;
-		}
-
 		// Check for the leadin character after excluding the attrib.
 		// This lets non-command attribs on the child block commands
-		// on the parent.
+		// on the parent.  Also require the ':'.
 		//
-		if (buff[0] != type) {
+		if ((aflags & AF_NOPROG) || av.pText[0] != type || !s) {
+			atr_release(&av);
 			continue;
 		}
 
-		// Was there a ':'?
-		//
-		if (!s) {
-			continue;
-		}
-		*s++ = '\0';
+		char buff[LBUF_SIZE];
+		memcpy(buff, av.pText, av.nText + 1);
+		char *act = buff + (s - av.pText);
+		*act++ = '\0';
+		atr_release(&av);
 
 		char *args[NUM_ENV_VARS];
 		if ((0 != (aflags & AF_REGEXP)
@@ -272,8 +270,10 @@ static int atr_match1(dbref thing, dbref parent, dbref player, char type,
 								args, NUM_ENV_VARS))) {
 			match = 1;
 			CLinearTimeAbsolute lta;
+			prof_origin(AMATCH_CMD == type ? PROF_COMMAND : PROF_LISTEN,
+					parent, atr);
 			wait_que(thing, player, player, AttrTrace(aflags, 0), false, lta,
-					NOTHING, 0, s, NUM_ENV_VARS, args, mudstate.global_regs);
+					NOTHING, 0, act, NUM_ENV_VARS, args, mudstate.global_regs);
 
 			for (int i = 0; i < NUM_ENV_VARS; i++) {
 				if (args[i]) {
@@ -942,6 +942,7 @@ void notify_except(dbref loc, dbref player, dbref exception, const char *msg,
 		int key) {
 	dbref first;
 
+	BeginSharedOutput();
 	if (loc != exception) {
 		notify_check(loc, player, msg,
 				(MSG_ME_ALL | MSG_F_UP | MSG_S_INSIDE | MSG_NBR_EXITS_A | key));
@@ -953,12 +954,14 @@ void notify_except(dbref loc, dbref player, dbref exception, const char *msg,
 					(MSG_ME | MSG_F_DOWN | MSG_S_OUTSIDE | key));
 		}
 	}
+	EndSharedOutput();
 }
 
 void notify_except2(dbref loc, dbref player, dbref exc1, dbref exc2,
 		const char *msg) {
 	dbref first;
 
+	BeginSharedOutput();
 	if (loc != exc1 && loc != exc2) {
 		notify_check(loc, player, msg,
 				(MSG_ME_ALL | MSG_F_UP | MSG_S_INSIDE | MSG_NBR_EXITS_A));
@@ -970,6 +973,7 @@ void notify_except2(dbref loc, dbref player, dbref exc1, dbref exc2,
 					(MSG_ME | MSG_F_DOWN | MSG_S_OUTSIDE));
 		}
 	}
+	EndSharedOutput();
 }
 
 /* ----------------------------------------------------------------------
@@ -2773,9 +2777,12 @@ int DCL_CDECL main(int argc, char *argv[]) {
 	pool_init(POOL_BOOL, sizeof(struct boolexp));
 
 	pool_init(POOL_DESC, sizeof(DESC));
-	pool_init(POOL_QENTRY, sizeof(BQUE));
 	pool_init(POOL_LBUFREF, sizeof(lbuf_ref));
 	pool_init(POOL_REGREF, sizeof(reg_ref));
+	pool_init(POOL_TBLOCK, OUTPUT_BLOCK_SIZE);
+	pool_init(POOL_TBLOCKS, OUTPUT_SMALL_BLOCK_SIZE);
+	pool_init(POOL_TBLKREF, sizeof(TBLOCKHDR));
+	pool_init(POOL_CBLK, LBUF_SIZE);
 	tcache_init();
 	pcache_init();
 	cf_init();
@@ -2905,7 +2912,11 @@ int DCL_CDECL main(int argc, char *argv[]) {
 	Log.WriteString(ENDLINE);
 
 	//TODO: Remove and cleanup
-	aMainGamePorts[0].type = WEB_SOCKET;
+	for (int i = 0; i < nMainGamePorts; i++) {
+		if (aMainGamePorts[i].port == aMainGamePorts[0].port) {
+			aMainGamePorts[i].type = WEB_SOCKET;
+		}
+	}
 	boot_slave(GOD, GOD, GOD, 0);
 #ifdef QUERY_SLAVE
 	boot_sqlslave(GOD, GOD, GOD, 0);
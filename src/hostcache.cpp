@@ -0,0 +1,208 @@
+// hostcache.cpp -- Cache of slave hostname and ident lookups.
+//
+// See hostcache.h. Entries expire after hostname_cache_ttl seconds, or
+// hostname_negative_ttl seconds for failures. A TTL of zero turns that kind
+// of caching off.
+//
+
+#include "copyright.h"
+#include "autoconf.h"
+#include "config.h"
+#include "externs.h"
+
+#include <map>
+#include <string>
+
+#include "hostcache.h"
+
+// More addresses than this, and expired entries are swept out. If that does
+// not make room, the cache starts over.
+//
+#define HOSTCACHE_MAX 8192
+
+typedef struct hostcache_entry
+{
+    std::string name;               // Empty if the address has no name.
+    bool bName;                     // name (or its absence) is known.
+    bool bNoIdent;                  // The host has no ident server.
+    CLinearTimeAbsolute ltaName;    // When name expires.
+    CLinearTimeAbsolute ltaNoIdent; // When bNoIdent expires.
+} HOSTCACHE_ENTRY;
+
+typedef std::map<UINT32, HOSTCACHE_ENTRY> HOSTCACHE_MAP;
+
+static HOSTCACHE_MAP hostcache;
+static HOSTCACHE_STATS hoststats;
+
+static void hostcache_sweep(const CLinearTimeAbsolute &ltaNow)
+{
+    HOSTCACHE_MAP::iterator it = hostcache.begin();
+    while (it != hostcache.end())
+    {
+        HOSTCACHE_ENTRY &e = it->second;
+        if (  e.bName
+           && e.ltaName < ltaNow)
+        {
+            e.bName = false;
+        }
+        if (  e.bNoIdent
+           && e.ltaNoIdent < ltaNow)
+        {
+            e.bNoIdent = false;
+        }
+
+        if (  !e.bName
+           && !e.bNoIdent)
+        {
+            hostcache.erase(it++);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    if (HOSTCACHE_MAX <= hostcache.size())
+    {
+        hostcache.clear();
+    }
+}
+
+static HOSTCACHE_ENTRY *hostcache_entry(struct in_addr addr,
+    const CLinearTimeAbsolute &ltaNow)
+{
+    HOSTCACHE_MAP::iterator it = hostcache.find(addr.s_addr);
+    if (it != hostcache.end())
+    {
+        return &it->second;
+    }
+
+    if (HOSTCACHE_MAX <= hostcache.size())
+    {
+        hostcache_sweep(ltaNow);
+    }
+    HOSTCACHE_ENTRY &e = hostcache[addr.s_addr];
+    e.bName = false;
+    e.bNoIdent = false;
+    return &e;
+}
+
+static CLinearTimeAbsolute hostcache_expires(const CLinearTimeAbsolute &ltaNow,
+    int nSeconds)
+{
+    CLinearTimeDelta ltd;
+    ltd.SetSeconds(nSeconds);
+    return ltaNow + ltd;
+}
+
+/* ---------------------------------------------------------------------------
+ * hostcache_name: Look up the name of an address. Returns false if the slave
+ * needs to be asked. An address known to have no name comes back as itself.
+ */
+
+bool hostcache_name(struct in_addr addr, char *pName, size_t nName)
+{
+    HOSTCACHE_MAP::iterator it = hostcache.find(addr.s_addr);
+    if (it != hostcache.end())
+    {
+        CLinearTimeAbsolute ltaNow;
+        ltaNow.GetUTC();
+
+        HOSTCACHE_ENTRY &e = it->second;
+        if (  e.bName
+           && ltaNow < e.ltaName)
+        {
+            if (e.name.empty())
+            {
+                hoststats.nNegativeHits++;
+                mux_strncpy(pName, inet_ntoa(addr), nName - 1);
+            }
+            else
+            {
+                hoststats.nHits++;
+                mux_strncpy(pName, e.name.c_str(), nName - 1);
+            }
+            return true;
+        }
+    }
+    hoststats.nMisses++;
+    return false;
+}
+
+/* ---------------------------------------------------------------------------
+ * hostcache_skip_ident: Is the host known to have no ident server?
+ */
+
+bool hostcache_skip_ident(struct in_addr addr)
+{
+    HOSTCACHE_MAP::iterator it = hostcache.find(addr.s_addr);
+    if (it != hostcache.end())
+    {
+        CLinearTimeAbsolute ltaNow;
+        ltaNow.GetUTC();
+
+        HOSTCACHE_ENTRY &e = it->second;
+        if (  e.bNoIdent
+           && ltaNow < e.ltaNoIdent)
+        {
+            hoststats.nIdentSkipped++;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* ---------------------------------------------------------------------------
+ * hostcache_store_name: Remember what the slave found. The slave answers
+ * with the address itself when it has no name.
+ */
+
+void hostcache_store_name(struct in_addr addr, const char *pName)
+{
+    bool bNegative = (strcmp(pName, inet_ntoa(addr)) == 0);
+    int nSeconds = bNegative ? mudconf.hostname_negative_ttl
+                             : mudconf.hostname_cache_ttl;
+    if (nSeconds <= 0)
+    {
+        return;
+    }
+
+    CLinearTimeAbsolute ltaNow;
+    ltaNow.GetUTC();
+
+    HOSTCACHE_ENTRY *pe = hostcache_entry(addr, ltaNow);
+    pe->bName = true;
+    pe->ltaName = hostcache_expires(ltaNow, nSeconds);
+    if (bNegative)
+    {
+        pe->name.erase();
+    }
+    else
+    {
+        pe->name = pName;
+    }
+}
+
+/* ---------------------------------------------------------------------------
+ * hostcache_store_noident: Remember that the host has no ident server.
+ */
+
+void hostcache_store_noident(struct in_addr addr)
+{
+    if (mudconf.hostname_negative_ttl <= 0)
+    {
+        return;
+    }
+
+    CLinearTimeAbsolute ltaNow;
+    ltaNow.GetUTC();
+
+    HOSTCACHE_ENTRY *pe = hostcache_entry(addr, ltaNow);
+    pe->bNoIdent = true;
+    pe->ltaNoIdent = hostcache_expires(ltaNow, mudconf.hostname_negative_ttl);
+}
+
+void hostcache_stats(HOSTCACHE_STATS *pStats)
+{
+    *pStats = hoststats;
+    pStats->nEntries = hostcache.size();
+}
@@ -0,0 +1,31 @@
+// hostcache.h -- Cache of slave hostname and ident lookups.
+//
+// Players reconnect from the same few addresses over and over, so the
+// answers the slave gives are kept for a while, keyed by address. Failures
+// are kept too, for a shorter while: an address with no reverse entry, or a
+// host with no ident server, would otherwise be asked about again on every
+// connection.
+//
+// Only the lack of an ident server is cached. A user name answers for one
+// connection, and two players behind the same address may differ.
+//
+
+#ifndef HOSTCACHE_H
+#define HOSTCACHE_H
+
+typedef struct hostcache_stats
+{
+    INT64  nHits;           // Names found.
+    INT64  nNegativeHits;   // Addresses known to have no name.
+    INT64  nMisses;         // Names the slave was asked for.
+    INT64  nIdentSkipped;   // Ident queries skipped for hosts without one.
+    size_t nEntries;
+} HOSTCACHE_STATS;
+
+extern bool hostcache_name(struct in_addr addr, char *pName, size_t nName);
+extern bool hostcache_skip_ident(struct in_addr addr);
+extern void hostcache_store_name(struct in_addr addr, const char *pName);
+extern void hostcache_store_noident(struct in_addr addr);
+extern void hostcache_stats(HOSTCACHE_STATS *pStats);
+
+#endif // !HOSTCACHE_H
@@ -22,7 +22,34 @@ struct name_table
 
 /* BQUE - Command queue */
 
+// Besides being in the scheduler, each queue entry is on a list of entries
+// with the same executor, a list of entries with the same owner, and while
+// it waits on a semaphore, a list of entries waiting on the same object.
+//
+#define QL_EXECUTOR  0
+#define QL_OWNER     1
+#define QL_SEMAPHORE 2
+#define QL_COUNT     3
+
+// Registers saved with queue entries.  Entries queued with the same
+// registers share one set.
+//
+typedef struct reg_set
+{
+    int      refcount;
+    reg_ref *regs[MAX_GLOBAL_REGS];
+} REG_SET;
+
+// A queue entry is allocated as one block, with the command and environment
+// text following the BQUE itself.
+//
 typedef struct bque BQUE;
+typedef struct bque_links
+{
+    BQUE    *next;
+    BQUE    *prev;
+} BQUE_LINKS;
+
 struct bque
 {
     CLinearTimeAbsolute waittime;   // time to run command
@@ -33,11 +60,21 @@ struct bque
     dbref   sem;                    // blocking semaphore
     int     attr;                   // blocking attribute
     int     nargs;                  // How many args I have
-    char    *text;                  // buffer for comm, env, and scr text
     char    *comm;                  // command
     char    *env[NUM_ENV_VARS];     // environment vars
-    reg_ref *scr[MAX_GLOBAL_REGS];  // temp vars
+    REG_SET *scr;                   // temp vars, or NULL
     bool    IsTimed;                // Is there a waittime time on this entry?
+    int     prof_kind;              // Where the command came from, by PROF_*
+    dbref   prof_thing;             // Object holding the command, or NOTHING
+    int     prof_attr;              // Attribute holding the command, or 0
+    void  (*task)(void *, int);     // Scheduler task which runs or expires it
+    int     serial;                 // Order in which entries were queued
+    dbref   owner;                  // Owner it is listed under, or NOTHING
+    BQUE_LINKS links[QL_COUNT];     // Lists of entries, by QL_*
+    bool    IsReady;                // Is it on a run queue?
+    dbref   flow;                   // Run queue it is on
+    BQUE_LINKS ready;               // Neighbors on that run queue
+    CLinearTimeAbsolute readytime;  // When it was put there
 };
 
 class CBitField
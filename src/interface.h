@@ -14,10 +14,22 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <sys/uio.h>
+#include <limits.h>
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
 #endif // HAVE_SYS_SELECT_H
 #endif // !WIN32
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif // HAVE_ZLIB_H
+
+// Sockets can be served by dedicated I/O threads (see iothread.cpp) where
+// epoll, eventfd, and pthreads are all available.
+//
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_EVENTFD_H) && defined(HAVE_PTHREAD_H)
+#define IO_THREADS
+#endif
 /* these symbols must be defined by the interface */
 #include "externs.h"
 #include "Websockets.h"
@@ -68,12 +80,23 @@ typedef struct cmd_block {
 	char cmd[LBUF_SIZE - sizeof(CBLKHDR)];
 } CBLK;
 
+// An immutable, reference-counted run of output which several descriptors
+// can queue at once (see BeginSharedOutput).
+//
+typedef struct output_segment {
+	int refcount;
+	size_t nchars;
+	char data[1];
+} OUTSEG;
+
 typedef struct text_block TBLOCK;
 typedef struct text_block_hdr {
 	struct text_block *nxt;
 	char *start;
 	char *end;
 	size_t nchars;
+	size_t nsize;   // Allocated size of this block.
+	OUTSEG *seg;    // If not NULL, the text lives here instead of in data.
 } TBLOCKHDR;
 
 typedef struct text_block {
@@ -81,6 +104,21 @@ typedef struct text_block {
 	char data[OUTPUT_BLOCK_SIZE - sizeof(TBLOCKHDR)];
 } TBLOCK;
 
+#ifdef HAVE_ZLIB_H
+// Output compression (MCCP v2) for one connection. Queued output is
+// compressed as process_output() gathers it, so the queue holds wire-ready
+// blocks up to and including done, and plain text after it.
+//
+typedef struct mccp_state {
+	z_stream stream;
+	bool bActive;               // The stream is open.
+	TBLOCK *done;               // Last queued block already in wire form.
+	INT64 nIn;                  // Characters compressed.
+	INT64 nOut;                 // Bytes they compressed to.
+	CLinearTimeDelta ltdCost;   // Time spent in deflate().
+} MCCP;
+#endif // HAVE_ZLIB_H
+
 typedef struct prog_data PROG;
 struct prog_data {
 	dbref wait_enactor;
@@ -103,8 +141,10 @@ struct prog_data {
 #define NVT_BS   '\x08'
 #define NVT_DEL  '\x7F'
 #define NVT_EOR  '\xEF'
+#define NVT_SE   '\xF0'
 #define NVT_NOP  '\xF1'
 #define NVT_GA   '\xF9'
+#define NVT_SB   '\xFA'
 #define NVT_WILL '\xFB'
 #define NVT_WONT '\xFC'
 #define NVT_DO   '\xFD'
@@ -116,6 +156,7 @@ struct prog_data {
 #define TELNET_SGA  '\x03'
 #define TELNET_EOR  '\x19'
 #define TELNET_NAWS '\x1F'
+#define TELNET_COMPRESS2 '\x56'  // MCCP v2
 
 // Telnet Option Negotiation States
 //
@@ -132,27 +173,41 @@ private:
 	SOCKET descriptor;
 	ConnectionType _TypeOfSocket;
 
-	websocket::SocketReader * _Reader;
-	websocket::SocketWriter * _Writer;
+	websocket::FrameWriter * _Writer;
 	websocket::OutputParser * _Parser;
 	websocket::WebSocketReader * _WSReader;
+	websocket::handshaking::HandshakeParser * _Handshake;
 public:
 
 	void init() {
 		descriptor = -1;
-		_Reader = NULL;
 		_Writer = NULL;
 		_Parser = NULL;
 		_WSReader = NULL;
+		_Handshake = NULL;
+#ifdef HAVE_SYS_EPOLL_H
+		epoll_events = 0;
+#endif // HAVE_SYS_EPOLL_H
+#ifdef IO_THREADS
+		io_conn = NULL;
+		io_thread = -1;
+		io_paused = false;
+		io_flush = false;
+		io_closing = false;
+#endif // IO_THREADS
 	}
 
 	void cleanup() {
-		if (_Reader != NULL) {
-			delete _Reader;
+		if (_Writer != NULL) {
 			delete _Parser;
 			delete _Writer;
 			delete _WSReader;
+			_Writer = NULL;
+			_Parser = NULL;
+			_WSReader = NULL;
 		}
+		delete _Handshake;
+		_Handshake = NULL;
 	}
 
 	void setSocket(SOCKET socket, ConnectionType typeOfSocket) {
@@ -161,11 +216,55 @@ public:
 
 		if (_TypeOfSocket == WEB_SOCKET) {
 			cleanup();
-			_Reader = new websocket::SocketReader(descriptor);
-			_Writer = new websocket::SocketWriter(descriptor);
+			_Writer = new websocket::FrameWriter();
 			_Parser = new websocket::OutputParser(*_Writer);
 			_WSReader = new websocket::WebSocketReader();
+			_Handshake = new websocket::handshaking::HandshakeParser();
+		}
+	}
+
+	// A websocket connection is handshaking from accept until the upgrade
+	// request has been parsed. Until then, reads return raw bytes for the
+	// HandshakeParser rather than decoded frames.
+	//
+	bool isHandshaking() const {
+		return _Handshake != NULL;
+	}
+
+	websocket::handshaking::HandshakeParser * getHandshake() {
+		return _Handshake;
+	}
+
+	// The caller queues the reply before completing the handshake, so that
+	// it goes out unframed ahead of everything else. Compression applies
+	// from the first frame after it.
+	//
+	void completeHandshake(const websocket::DeflateParams& Agreed) {
+		delete _Handshake;
+		_Handshake = NULL;
+#ifdef HAVE_ZLIB_H
+		if (Agreed.enabled) {
+			_Writer->setDeflater(new websocket::MessageDeflater(Agreed));
+			_WSReader->setInflater(new websocket::MessageInflater());
 		}
+#else
+		UNUSED_PARAMETER(Agreed);
+#endif // HAVE_ZLIB_H
+	}
+
+	// Websocket output is framed as it is queued, so the output queue only
+	// ever holds ready-to-send bytes and process_output() can resume partial
+	// writes the same way for every type of socket.
+	//
+	bool isFramed() const {
+		return _TypeOfSocket == WEB_SOCKET && _Handshake == NULL;
+	}
+
+	void encodeOutput(const char *&pText, size_t &nText) {
+		_Writer->clear();
+		_Parser->parseAndSend(pText, nText);
+		pText = (const char *) _Writer->data();
+		nText = _Writer->size();
 	}
 
 	const SOCKET getSocket() {
@@ -175,50 +274,39 @@ public:
 	int writeToSocket(const char * pTEXT, const size_t NO_OF_CHARS) {
 		switch (_TypeOfSocket) {
 		case NORMAL:
-			return write(descriptor, pTEXT, strlen(pTEXT));
+			return write(descriptor, pTEXT, NO_OF_CHARS);
 		case WEB_SOCKET:
-			try {
-				_Parser->parseAndSend(pTEXT, NO_OF_CHARS);
-				//sendWSText(*_Writer, std::string(pTEXT, NO_OF_CHARS));
-			} catch (int e) {
-				Log.tinyprintf("Websocket write failed: %d\n", e);
-				std::cout << "Write failed: " << e << std::endl;
-				return -1;
-			}
-			return NO_OF_CHARS;
-			// TODO: Add Websocket handler;
+			return write(descriptor, pTEXT, NO_OF_CHARS);
 		}
 		return -1;
 	}
 
+#ifndef WIN32
+	// Queued output is ready-to-send bytes for every type of socket, so a
+	// whole run of output blocks can go out in one call.
+	//
+	int writevToSocket(const struct iovec *iov, const int iovcnt) {
+		return writev(descriptor, iov, iovcnt);
+	}
+#endif // !WIN32
+
 	int readFromSocket(char arrTextOut[], const size_t MAX_OUT_SIZE) {
-		switch (_TypeOfSocket) {
-		case NORMAL:
-			return read(descriptor, arrTextOut, MAX_OUT_SIZE);
-			break;
-			// TODO: Add Websocket handler;
-		case WEB_SOCKET:
-			try {
-				std::vector<char> inputBuffer(MAX_OUT_SIZE);
-				const int readResult = _Reader->readAvailable((unsigned char *)inputBuffer.data(), inputBuffer.size());
-				if (readResult > 0) {
-					websocket::ReadResult readData = _WSReader->processInput(inputBuffer.data(), readResult);
-					memcpy(arrTextOut, readData.readBytes.data(), readData.readBytes.size());
-					if (MAX_OUT_SIZE > readData.readBytes.size()) {
-						arrTextOut[readData.readBytes.size()] = '\0';
-					}
-					return readData.readBytes.size();
-				}
-				else {
-					return readResult;
-				}
-			} catch (int e) {
-				Log.tinyprintf("Websocket read failed: %d\n", e);
-				std::cout << "Read failed: " << e << std::endl;
-				return -1;
-			}
-		}
-		return -1;
+		return read(descriptor, arrTextOut, MAX_OUT_SIZE);
+	}
+
+	// Websocket frames are decoded in place: the text they carry is left at
+	// the front of pBytes, or in the reader when it was inflated. Replies to
+	// control frames are left in the frame writer for the caller to queue
+	// before any further output.
+	//
+	websocket::ReadResult decodeFrames(char * pBytes, const size_t nBytes) {
+		_Writer->clear();
+		return _WSReader->processInput(pBytes, nBytes, pBytes, *_Writer);
+	}
+
+	void getFrameReplies(const char *&pReplies, size_t &nReplies) {
+		pReplies = (const char *) _Writer->data();
+		nReplies = _Writer->size();
 	}
 
 	CLinearTimeAbsolute connected_at;
@@ -236,6 +324,16 @@ public:
 	bool bConnectionShutdown;// true if connection has been shutdown
 	bool bCallProcessOutputLater;// Does the socket need priming for output.
 #endif // WIN32
+#ifdef HAVE_SYS_EPOLL_H
+	unsigned int epoll_events;  // Events this socket is registered for.
+#endif // HAVE_SYS_EPOLL_H
+#ifdef IO_THREADS
+	struct io_conn *io_conn;    // I/O thread state for the socket, if served.
+	int io_thread;              // Which I/O thread serves it.
+	bool io_paused;             // The thread awaits IO_RESUME before reading.
+	bool io_flush;              // On the list of output to hand off.
+	bool io_closing;            // IO_DETACH sent; freed on IO_DETACHED.
+#endif // IO_THREADS
 	int flags;
 	int retries_left;
 	int command_count;
@@ -249,6 +347,7 @@ public:
 	size_t output_lost;
 	TBLOCK *output_head;
 	TBLOCK *output_tail;
+	TBLOCK *output_warm;    // Spare block kept while the queue is empty.
 	size_t input_size;
 	size_t input_tot;
 	size_t input_lost;
@@ -265,6 +364,10 @@ public:
 	int nvt_eor_us_state;
 	int nvt_naws_him_state;
 	int nvt_naws_us_state;
+	int nvt_compress2_us_state;
+#ifdef HAVE_ZLIB_H
+	struct mccp_state *mccp;
+#endif // HAVE_ZLIB_H
 	int width;
 	int height;
 	int quota;
@@ -309,6 +412,14 @@ extern void shovechars(int nPorts, PortInfo aPorts[]);
 extern void process_output(void *, int);
 extern void dump_restart_db(void);
 #endif // WIN32
+#ifdef IO_THREADS
+extern void IoShutdown(void);
+#endif // IO_THREADS
+#ifdef HAVE_SYS_EPOLL_H
+extern void UpdateDescEvents(DESC *d);
+#else // HAVE_SYS_EPOLL_H
+#define UpdateDescEvents(d)
+#endif // HAVE_SYS_EPOLL_H
 extern void BuildSignalNamesTable(void);
 extern void set_signals(void);
 
@@ -329,8 +440,20 @@ extern void raw_notify(dbref, const char *);
 extern void raw_notify_newline(dbref);
 extern void clearstrings(DESC *);
 extern void queue_write_LEN(DESC *, const char *, size_t n);
+extern void queue_raw_LEN(DESC *, const char *, size_t n);
 extern void queue_write(DESC *, const char *);
 extern void queue_string(DESC *, const char *);
+extern void queue_write_seg(DESC *, OUTSEG *);
+extern OUTSEG *alloc_outseg(size_t n);
+extern void release_outseg(OUTSEG *);
+extern void free_tblock(TBLOCK *);
+extern void retire_tblock(DESC *, TBLOCK *);
+#ifdef HAVE_ZLIB_H
+extern void mccp_start(DESC *);
+extern void mccp_stop(DESC *);
+extern void mccp_compress(DESC *, int);
+extern void mccp_free(DESC *);
+#endif // HAVE_ZLIB_H
 extern void freeqs(DESC *);
 extern void welcome_user(DESC *);
 extern void save_command(DESC *, CBLK *);
@@ -339,7 +462,8 @@ extern int boot_by_port(SOCKET port, bool bGod, const char *message);
 extern void find_oldest(dbref target, DESC *dOldest[2]);
 extern void check_idle(void);
 void Task_ProcessCommand(void *arg_voidptr, int arg_iInteger);
-extern int site_check(struct in_addr, SITE *);
+extern int site_check(struct in_addr, SITELIST *);
+extern bool site_add(SITELIST *pList, SITE *site, bool bAppend);
 extern dbref find_connected_name(dbref, char *);
 extern void do_command(DESC *, char *);
 extern void desc_addhash(DESC *);
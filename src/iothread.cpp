@@ -0,0 +1,714 @@
+// iothread.cpp -- Network I/O threads.
+//
+// See iothread.h for the division of labor. Everything here above
+// io_thread_main() runs on the game thread; io_thread_main() and the
+// functions it calls run on the I/O threads and touch nothing but their own
+// IOTHREAD and the IOCONNs attached to it.
+//
+
+#include "copyright.h"
+#include "autoconf.h"
+#include "config.h"
+#include "externs.h"
+
+#include "iothread.h"
+
+#ifdef IO_THREADS
+
+#include <deque>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define IO_QUEUE_SIZE   4096
+#define IO_MAX_EVENTS   256
+
+// A ring buffer with one producer and one consumer, each on its own thread.
+// Each index is written only by its owner, and published with release
+// semantics after the slot it covers.
+//
+template <class T, size_t nSize> class CSpscQueue
+{
+private:
+    T m_aSlots[nSize];
+    size_t m_iHead;                 // Next slot to pop. Consumer-owned.
+    char m_aPad[64];                // Keep the indexes on separate lines.
+    size_t m_iTail;                 // Next slot to push. Producer-owned.
+
+public:
+    CSpscQueue(void) : m_iHead(0), m_iTail(0)
+    {
+    }
+
+    bool push(const T &item)
+    {
+        size_t iTail = m_iTail;
+        if (iTail - __atomic_load_n(&m_iHead, __ATOMIC_ACQUIRE) == nSize)
+        {
+            return false;
+        }
+        m_aSlots[iTail % nSize] = item;
+        __atomic_store_n(&m_iTail, iTail + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    bool pop(T *pitem)
+    {
+        size_t iHead = m_iHead;
+        if (iHead == __atomic_load_n(&m_iTail, __ATOMIC_ACQUIRE))
+        {
+            return false;
+        }
+        *pitem = m_aSlots[iHead % nSize];
+        __atomic_store_n(&m_iHead, iHead + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+};
+
+// One direction of traffic. A producer which finds the ring full keeps the
+// overflow in its own backlog rather than wait, so neither side ever blocks
+// on the other.
+//
+struct io_channel
+{
+    CSpscQueue<IOMSG, IO_QUEUE_SIZE> ring;
+    std::deque<IOMSG> backlog;      // Producer-owned.
+
+    void send(const IOMSG &msg)
+    {
+        if (  !backlog.empty()
+           || !ring.push(msg))
+        {
+            backlog.push_back(msg);
+        }
+    }
+
+    void deliver(void)
+    {
+        while (  !backlog.empty()
+              && ring.push(backlog.front()))
+        {
+            backlog.pop_front();
+        }
+    }
+};
+
+// A socket served by an I/O thread. Created by the game thread, and from
+// then on touched only by the I/O thread, which deletes it on IO_DETACH.
+//
+struct io_conn
+{
+    DESC   *d;
+    SOCKET  s;
+    TBLOCK *head;               // Output not yet written.
+    TBLOCK *tail;
+    unsigned int events;        // Events the socket is registered for.
+    bool    bPaused;            // Input is with the game thread.
+    bool    bDead;              // IO_CLOSED sent; waiting for IO_DETACH.
+    IOCONN *next;               // Every connection served by the thread.
+    IOCONN *prev;
+};
+
+typedef struct io_thread
+{
+    pthread_t thread;
+    int       epfd;
+    SOCKET    wake;             // Signalled when toIO has something.
+    io_channel toIO;
+    io_channel toGame;
+    bool      bSent;            // Game-owned: toIO was sent to since io_flush().
+    bool      bPosted;          // Thread-owned: toGame was sent to this pass.
+    IOCONN   *conns;            // Thread-owned.
+} IOTHREAD;
+
+static IOTHREAD *io_threads = NULL;
+static int io_nThreads = 0;
+static bool io_bStopped = false;
+static int io_iNext = 0;
+static int io_iReceive = 0;
+static SOCKET io_game_event = INVALID_SOCKET;
+
+static void *io_thread_main(void *pvThread);
+
+static void io_signal(SOCKET fd)
+{
+    UINT64 one = 1;
+    if (write(fd, &one, sizeof(one)) < 0)
+    {
+        ; // The counter is already non-zero.
+    }
+}
+
+/* ---------------------------------------------------------------------------
+ * io_start: Start nThreads I/O threads. Returns false if they could not be.
+ */
+
+bool io_start(int nThreads)
+{
+    if (nThreads <= 0)
+    {
+        return false;
+    }
+    if (IO_MAX_THREADS < nThreads)
+    {
+        nThreads = IO_MAX_THREADS;
+    }
+
+    io_game_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (IS_INVALID_SOCKET(io_game_event))
+    {
+        log_perror("NET", "FAIL", "io_start", "eventfd");
+        return false;
+    }
+
+    io_threads = new IOTHREAD[nThreads];
+
+    // Signals are for the game thread. The I/O threads start with all of
+    // them blocked.
+    //
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+
+    int i;
+    for (i = 0; i < nThreads; i++)
+    {
+        IOTHREAD *t = io_threads + i;
+        t->bSent = false;
+        t->bPosted = false;
+        t->conns = NULL;
+        t->epfd = epoll_create1(EPOLL_CLOEXEC);
+        t->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (  IS_INVALID_SOCKET(t->epfd)
+           || IS_INVALID_SOCKET(t->wake))
+        {
+            log_perror("NET", "FAIL", "io_start", "epoll_create1");
+            break;
+        }
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = 0;
+        ev.data.ptr = NULL;
+        epoll_ctl(t->epfd, EPOLL_CTL_ADD, t->wake, &ev);
+
+        if (0 != pthread_create(&t->thread, NULL, io_thread_main, t))
+        {
+            log_perror("NET", "FAIL", "io_start", "pthread_create");
+            break;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    io_nThreads = i;
+    if (0 == io_nThreads)
+    {
+        delete [] io_threads;
+        io_threads = NULL;
+        close(io_game_event);
+        io_game_event = INVALID_SOCKET;
+        return false;
+    }
+
+    STARTLOG(LOG_STARTUP, "NET", "IOTHR");
+    Log.tinyprintf("Started %d I/O thread%s.", io_nThreads,
+        (1 == io_nThreads) ? "" : "s");
+    ENDLOG;
+    return true;
+}
+
+/* ---------------------------------------------------------------------------
+ * io_stop: Let the I/O threads finish what they have been sent, and wait for
+ * them to exit. Their last messages are left for io_receive().
+ */
+
+void io_stop(void)
+{
+    if (  0 == io_nThreads
+       || io_bStopped)
+    {
+        return;
+    }
+
+    IOMSG msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.op = IO_STOP;
+    for (int i = 0; i < io_nThreads; i++)
+    {
+        io_send(i, msg);
+    }
+    io_flush();
+
+    for (int i = 0; i < io_nThreads; i++)
+    {
+        IOTHREAD *t = io_threads + i;
+
+        // The game thread owns the backlog of toIO, so deliver it here until
+        // the thread has taken everything.
+        //
+        while (!t->toIO.backlog.empty())
+        {
+            t->toIO.deliver();
+            io_signal(t->wake);
+            sched_yield();
+        }
+        pthread_join(t->thread, NULL);
+        close(t->epfd);
+        close(t->wake);
+    }
+    io_bStopped = true;
+}
+
+bool io_running(void)
+{
+    return  0 < io_nThreads
+         && !io_bStopped;
+}
+
+SOCKET io_event_fd(void)
+{
+    return io_game_event;
+}
+
+// Call before draining with io_receive(), so that a message sent after the
+// drain still leaves the event set.
+//
+void io_clear_event(void)
+{
+    UINT64 count;
+    if (read(io_game_event, &count, sizeof(count)) < 0)
+    {
+        ; // Nothing was pending.
+    }
+}
+
+/* ---------------------------------------------------------------------------
+ * io_attach: Hand a socket to the next I/O thread in turn.
+ */
+
+IOCONN *io_attach(DESC *d, SOCKET s, int *piThread)
+{
+    IOCONN *conn = new IOCONN;
+    conn->d = d;
+    conn->s = s;
+    conn->head = NULL;
+    conn->tail = NULL;
+    conn->events = 0;
+    conn->bPaused = false;
+    conn->bDead = false;
+    conn->next = NULL;
+    conn->prev = NULL;
+
+    int iThread = io_iNext;
+    io_iNext = (io_iNext + 1) % io_nThreads;
+
+    IOMSG msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.op = IO_ATTACH;
+    msg.d = d;
+    msg.conn = conn;
+    io_send(iThread, msg);
+
+    *piThread = iThread;
+    return conn;
+}
+
+void io_send(int iThread, const IOMSG &msg)
+{
+    IOTHREAD *t = io_threads + iThread;
+    t->toIO.send(msg);
+    t->bSent = true;
+}
+
+/* ---------------------------------------------------------------------------
+ * io_flush: Deliver what has been sent since the last call, and wake the
+ * threads it went to. Called once per pass of the main loop, so that a
+ * thread is woken at most once for everything a pass produced.
+ */
+
+void io_flush(void)
+{
+    for (int i = 0; i < io_nThreads; i++)
+    {
+        IOTHREAD *t = io_threads + i;
+        if (t->bSent)
+        {
+            t->toIO.deliver();
+            io_signal(t->wake);
+            t->bSent = t->toIO.backlog.empty() ? false : true;
+        }
+    }
+}
+
+bool io_receive(IOMSG *pmsg)
+{
+    for (int n = 0; n < io_nThreads; n++)
+    {
+        IOTHREAD *t = io_threads + io_iReceive;
+        io_iReceive = (io_iReceive + 1) % io_nThreads;
+        if (t->toGame.ring.pop(pmsg))
+        {
+            return true;
+        }
+
+        // Once the thread has exited, what it could not fit in the ring is
+        // the game thread's to take.
+        //
+        if (  io_bStopped
+           && !t->toGame.backlog.empty())
+        {
+            *pmsg = t->toGame.backlog.front();
+            t->toGame.backlog.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void io_free_input(char *buf)
+{
+    free(buf);
+}
+
+/* ---------------------------------------------------------------------------
+ * Everything below runs on an I/O thread.
+ */
+
+static void io_update_events(IOTHREAD *t, IOCONN *conn)
+{
+    unsigned int want = 0;
+    if (!conn->bDead)
+    {
+        if (!conn->bPaused)
+        {
+            want |= EPOLLIN;
+        }
+        if (NULL != conn->head)
+        {
+            want |= EPOLLOUT;
+        }
+    }
+    if (want == conn->events)
+    {
+        return;
+    }
+
+    int op;
+    if (0 == want)
+    {
+        op = EPOLL_CTL_DEL;
+    }
+    else if (0 == conn->events)
+    {
+        op = EPOLL_CTL_ADD;
+    }
+    else
+    {
+        op = EPOLL_CTL_MOD;
+    }
+
+    struct epoll_event ev;
+    ev.events = want;
+    ev.data.u64 = 0;
+    ev.data.ptr = conn;
+    if (0 == epoll_ctl(t->epfd, op, conn->s, &ev))
+    {
+        conn->events = want;
+    }
+}
+
+static void io_post(IOTHREAD *t, const IOMSG &msg)
+{
+    t->toGame.send(msg);
+    t->bPosted = true;
+}
+
+static void io_closed(IOTHREAD *t, IOCONN *conn)
+{
+    conn->bDead = true;
+
+    IOMSG msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.op = IO_CLOSED;
+    msg.d = conn->d;
+    msg.conn = conn;
+    io_post(t, msg);
+}
+
+static void io_read(IOTHREAD *t, IOCONN *conn)
+{
+    char *buf = (char *)malloc(LBUF_SIZE);
+    if (NULL == buf)
+    {
+        return;
+    }
+
+    int got = read(conn->s, buf, LBUF_SIZE);
+    if (0 < got)
+    {
+        IOMSG msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.op = IO_INPUT;
+        msg.d = conn->d;
+        msg.conn = conn;
+        msg.buf = buf;
+        msg.n = got;
+        io_post(t, msg);
+        conn->bPaused = true;
+        return;
+    }
+
+    free(buf);
+    if (  0 == got
+       || (  errno != EWOULDBLOCK
+          && errno != EAGAIN
+          && errno != EINTR))
+    {
+        io_closed(t, conn);
+    }
+}
+
+// Write as much queued output as the socket will take, and send the blocks
+// which went out completely back to be freed.
+//
+static void io_write(IOTHREAD *t, IOCONN *conn)
+{
+    TBLOCK *sent = NULL;
+    TBLOCK *sentTail = NULL;
+    size_t nSent = 0;
+    int nWrites = 0;
+
+    struct iovec aiov[IOV_MAX];
+    while (NULL != conn->head)
+    {
+        int niov = 0;
+        size_t nWant = 0;
+        for (TBLOCK *tp = conn->head; tp != NULL && niov < IOV_MAX; tp = tp->hdr.nxt)
+        {
+            if (tp->hdr.nchars > 0)
+            {
+                aiov[niov].iov_base = tp->hdr.start;
+                aiov[niov].iov_len = tp->hdr.nchars;
+                nWant += tp->hdr.nchars;
+                niov++;
+            }
+        }
+
+        size_t nDone = 0;
+        if (niov > 0)
+        {
+            int cnt = writev(conn->s, aiov, niov);
+            nWrites++;
+            if (cnt < 0)
+            {
+                if (  errno != EWOULDBLOCK
+                   && errno != EAGAIN
+                   && errno != EINTR)
+                {
+                    io_closed(t, conn);
+                }
+                break;
+            }
+            nDone = cnt;
+            nSent += cnt;
+        }
+
+        bool bShort = (nDone < nWant);
+        while (  NULL != conn->head
+              && conn->head->hdr.nchars <= nDone)
+        {
+            TBLOCK *tp = conn->head;
+            nDone -= tp->hdr.nchars;
+            conn->head = tp->hdr.nxt;
+            tp->hdr.nxt = NULL;
+            if (NULL == sent)
+            {
+                sent = tp;
+            }
+            else
+            {
+                sentTail->hdr.nxt = tp;
+            }
+            sentTail = tp;
+        }
+        if (NULL == conn->head)
+        {
+            conn->tail = NULL;
+        }
+        else if (nDone > 0)
+        {
+            conn->head->hdr.nchars -= nDone;
+            conn->head->hdr.start += nDone;
+        }
+
+        if (bShort)
+        {
+            break;
+        }
+    }
+
+    if (  NULL != sent
+       || 0 < nSent)
+    {
+        IOMSG msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.op = IO_SENT;
+        msg.d = conn->d;
+        msg.conn = conn;
+        msg.head = sent;
+        msg.n = nSent;
+        msg.nWrites = nWrites;
+        io_post(t, msg);
+    }
+}
+
+// Returns true for IO_STOP.
+//
+static bool io_handle(IOTHREAD *t, IOMSG &msg)
+{
+    IOCONN *conn = msg.conn;
+    switch (msg.op)
+    {
+    case IO_ATTACH:
+        conn->next = t->conns;
+        if (NULL != t->conns)
+        {
+            t->conns->prev = conn;
+        }
+        t->conns = conn;
+        io_update_events(t, conn);
+        break;
+
+    case IO_WRITE:
+        if (NULL == conn->head)
+        {
+            conn->head = msg.head;
+        }
+        else
+        {
+            conn->tail->hdr.nxt = msg.head;
+        }
+        for (conn->tail = msg.head; NULL != conn->tail->hdr.nxt; conn->tail = conn->tail->hdr.nxt)
+        {
+            ; // Nothing.
+        }
+        if (!conn->bDead)
+        {
+            io_write(t, conn);
+        }
+        io_update_events(t, conn);
+        break;
+
+    case IO_RESUME:
+        conn->bPaused = false;
+        io_update_events(t, conn);
+        break;
+
+    case IO_DETACH:
+        if (  !conn->bDead
+           && NULL != conn->head)
+        {
+            io_write(t, conn);
+        }
+        if (0 != conn->events)
+        {
+            struct epoll_event ev;
+            ev.events = 0;
+            ev.data.u64 = 0;
+            epoll_ctl(t->epfd, EPOLL_CTL_DEL, conn->s, &ev);
+        }
+        if (NULL != conn->prev)
+        {
+            conn->prev->next = conn->next;
+        }
+        else
+        {
+            t->conns = conn->next;
+        }
+        if (NULL != conn->next)
+        {
+            conn->next->prev = conn->prev;
+        }
+
+        msg.op = IO_DETACHED;
+        msg.head = conn->head;
+        msg.conn = NULL;
+        io_post(t, msg);
+        delete conn;
+        break;
+
+    case IO_STOP:
+        return true;
+    }
+    return false;
+}
+
+static void *io_thread_main(void *pvThread)
+{
+    IOTHREAD *t = (IOTHREAD *)pvThread;
+    struct epoll_event events[IO_MAX_EVENTS];
+    bool bStop = false;
+
+    while (!bStop)
+    {
+        // With a backlog still to hand over, check back for room soon.
+        //
+        int found = epoll_wait(t->epfd, events, IO_MAX_EVENTS,
+            t->toGame.backlog.empty() ? -1 : 1);
+        for (int i = 0; i < found; i++)
+        {
+            IOCONN *conn = (IOCONN *)events[i].data.ptr;
+            if (NULL == conn)
+            {
+                UINT64 count;
+                if (read(t->wake, &count, sizeof(count)) < 0)
+                {
+                    ; // Nothing was pending.
+                }
+                continue;
+            }
+
+            unsigned int ev = events[i].events;
+            if (  (conn->events & EPOLLIN)
+               && (ev & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+            {
+                io_read(t, conn);
+            }
+            if (  NULL != conn->head
+               && !conn->bDead
+               && (ev & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+            {
+                io_write(t, conn);
+            }
+            io_update_events(t, conn);
+        }
+
+        IOMSG msg;
+        while (t->toIO.ring.pop(&msg))
+        {
+            if (io_handle(t, msg))
+            {
+                bStop = true;
+            }
+        }
+
+        // Hand over what fits, and wake the game thread once for the lot.
+        // Whatever is left waits for the next pass, or for io_receive()
+        // after the thread exits.
+        //
+        if (!t->toGame.backlog.empty())
+        {
+            t->toGame.deliver();
+            t->bPosted = true;
+        }
+        if (t->bPosted)
+        {
+            t->bPosted = false;
+            io_signal(io_game_event);
+        }
+    }
+    return NULL;
+}
+
+#endif // IO_THREADS
@@ -0,0 +1,61 @@
+// iothread.h -- Network I/O threads.
+//
+// With io_threads set, player sockets are read and written by a pool of
+// threads, each with its own epoll set. Each thread exchanges messages with
+// the game thread over a pair of single-producer, single-consumer queues.
+//
+// The game thread still owns every DESC. An I/O thread only ever sees the
+// socket, the output blocks handed to it, and the DESC pointer as a token to
+// hand back. Nothing is allocated from or freed to the pools off the game
+// thread: written blocks travel back to be freed there.
+//
+
+#ifndef IOTHREAD_H
+#define IOTHREAD_H
+
+#ifdef IO_THREADS
+
+#define IO_MAX_THREADS 32
+
+// Messages to an I/O thread.
+//
+#define IO_ATTACH   1   // Start serving a socket.
+#define IO_WRITE    2   // Send a chain of output blocks.
+#define IO_RESUME   3   // Read again; the last input has been taken.
+#define IO_DETACH   4   // Make a last attempt to write, and let go.
+#define IO_STOP     5   // Exit once the queue is empty.
+
+// Messages to the game thread.
+//
+#define IO_INPUT    6   // Bytes were read. Reading pauses until IO_RESUME.
+#define IO_SENT     7   // Blocks were written, and can be freed.
+#define IO_CLOSED   8   // The socket failed, or the other end closed it.
+#define IO_DETACHED 9   // The socket is let go, with any unwritten blocks.
+
+typedef struct io_conn IOCONN;
+
+typedef struct io_message
+{
+    int     op;
+    DESC   *d;
+    IOCONN *conn;
+    TBLOCK *head;       // IO_WRITE, IO_SENT, IO_DETACHED: chain of blocks.
+    char   *buf;        // IO_INPUT: bytes read. Free with io_free_input().
+    size_t  n;          // IO_INPUT: bytes in buf. IO_SENT: bytes written.
+    int     nWrites;    // IO_SENT: writev() calls it took.
+} IOMSG;
+
+extern bool   io_start(int nThreads);
+extern void   io_stop(void);
+extern bool   io_running(void);
+extern SOCKET io_event_fd(void);
+extern void   io_clear_event(void);
+extern IOCONN *io_attach(DESC *d, SOCKET s, int *piThread);
+extern void   io_send(int iThread, const IOMSG &msg);
+extern void   io_flush(void);
+extern bool   io_receive(IOMSG *pmsg);
+extern void   io_free_input(char *buf);
+
+#endif // IO_THREADS
+
+#endif // !IOTHREAD_H
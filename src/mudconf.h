@@ -53,9 +53,11 @@ struct confdata {
 	bool match_mine_pl; /* Should players check selves for $-cmds? */
 	bool name_spaces;        // allow player names to have spaces.
 	bool paranoid_alloc; /* Rigorous buffer integrity checks */
+	bool parse_cache;        // Keep parsed forms of u() and @function bodies?
 	bool pemit_any; /* Can you @pemit to ANY remote object? */
 	bool pemit_players; /* Can you @pemit to faraway players? */
 	bool player_listen; /* Are AxHEAR triggered on players? */
+	bool queue_fair_share;  // Do players take turns running queue entries?
 	bool pub_flags; /* true = flags() works on anything */
 	bool quiet_look; /* true = don't see attribs when looking */
 	bool quiet_whisper; /* Can others tell when you whisper? */
@@ -78,6 +80,8 @@ struct confdata {
 	bool terse_movemsg; /* Show move msgs (SUCC/LEAVE/etc) if TERSE? */
 	bool trace_topdown; /* Is TRACE output top-down or bottom-up? */
 	bool use_hostname; /* true = use machine NAME rather than quad */
+	bool websocket_deflate; // Offer permessage-deflate to websocket clients.
+	bool websocket_deflate_takeover; // Compressed websocket output may refer to earlier messages.
 	dbref default_home;       // HOME when home is inaccessable.
 	dbref global_error_obj;   // Object that is used to generate error messages.
 	dbref guest_char;         // player num of prototype GUEST character.
@@ -87,6 +91,7 @@ struct confdata {
 	dbref start_home;         // initial HOME for players.
 	dbref start_room;         // initial location and home for players.
 	dbref toad_recipient; /* Default @toad recipient. */
+	int accept_budget;      // Connections admitted per pass of the main loop.
 	int active_q_chunk; /* # cmds to run from queue when active */
 	int cache_pages;        // Size of hash page cache (in pages).
 	int check_interval; /* interval between db check/cleans in secs */
@@ -104,10 +109,14 @@ struct confdata {
 	int exit_quota; /* quota needed to make an exit */
 	int func_invk_lim; /* Max funcs invoked by a command */
 	int func_nest_lim; /* Max nesting of functions */
+	int handshake_timeout; /* Allow this long to finish a websocket upgrade */
 	int hook_cmd;           // @hooks to be initialized.
+	int hostname_cache_ttl; // Seconds to remember the name of an address.
+	int hostname_negative_ttl; // Seconds to remember a failed name or ident lookup.
 	int idle_interval; /* when to check for idle users */
 	int idle_timeout; /* Boot off players idle this long in secs */
 	int init_size;          // initial db size.
+	int io_threads;         // Network I/O threads; 0 does it all on the game thread.
 	int killguarantee; /* cost of kill cmd that guarantees success */
 	int killmax; /* max cost of kill command */
 	int killmin; /* default (and minimum) cost of kill cmd */
@@ -137,6 +146,7 @@ struct confdata {
 	RLEVEL def_thing_rx; /* Default thing RX level */
 	RLEVEL def_thing_tx; /* Default thing TX level */
 #endif // REALITY_LVLS
+	int netbuf_high_water;  // Free network buffers kept per pool.
 	int ntfy_nest_lim; /* Max nesting of notifys */
 	int number_guests;      // number of guest characters allowed.
 	int opencost; /* cost of @open command */
@@ -149,7 +159,10 @@ struct confdata {
 	int paystart; /* new players start with this much money */
 	int player_quota; /* quota needed to make a robot player */
 	int pcreate_per_hour;   // Maximum allowed players created per hour */
+	int port_listeners;     // Listening sockets per port, with SO_REUSEPORT.
 	int queue_chunk; /* # cmds to run from queue when idle */
+	int queue_slice_funcs;  // Functions a queue entry may call before it yields.
+	int queue_weight;       // Default share of queue time for each player.
 	int queuemax; /* max commands a player may have in queue */
 	int retry_limit; /* close conn after this many bad logins */
 	int robotcost; /* cost of @robot command */
@@ -165,6 +178,7 @@ struct confdata {
 	int vattr_flags; /* Attr flags for all user-defined attrs */
 	int vattr_per_hour;     // Maximum allowed vattrs per hour per object.
 	int waitcost; /* cost of @wait (refunded when finishes) */
+	int websocket_deflate_bits; // LZ77 window size (log2) for websocket output.
 	int wild_invk_lim;      // Max Regular Expression function calls.
 	int zone_nest_lim; /* Max nesting of zones */
 	int restrict_home;      // Special condition to restrict 'home' command
@@ -225,9 +239,11 @@ struct confdata {
 	char *mail_db; /* name of the @mail database */
 	char *motd_file; /* display this file on login */
 	char *outdb; /* checkpoint the database to here */
+	char *profile_file; // Where @profile/export writes call stacks.
 	char *quit_file; /* display on quit */
 	char *regf_file; /* display on (failed) create if reg is on */
 	char *site_file; /* display if conn from bad site */
+	char *slave_hosts_file; // hosts-style file the slave consults before DNS.
 	char *status_file; /* Where to write arg to @shutdown */
 	char *uncompress; /* program to run to uncompress */
 	char *wizmotd_file; /* display this file on login to wizards */
@@ -235,6 +251,7 @@ struct confdata {
 	unsigned char markdata[8]; /* Masks for marking/unmarking */
 	CLinearTimeDelta rpt_cmdsecs; /* Reporting Threshhold for time taken by command */
 	CLinearTimeDelta max_cmdsecs; /* Upper Limit for real time taken by command */
+	CLinearTimeDelta queue_slice;   // Time a queue entry may run before it yields.
 	CLinearTimeDelta cache_tick_period; // Minor cycle for cache maintenance.
 	CLinearTimeDelta timeslice;     // How often do we bump people's cmd quotas?
 
@@ -256,6 +273,22 @@ struct site_data {
 	struct in_addr address; /* Host or network address */
 	struct in_addr mask; /* Mask to apply before comparing */
 	int flag; /* Value to return on match */
+	int rank; /* Position in the chain; lower ranks are checked first */
+};
+
+typedef struct site_node SITENODE;
+
+// A site list keeps its entries chained in the order they are checked, and
+// indexes them in a binary trie on their prefix bits, so a check visits at
+// most one node per address bit however long the list grows.
+//
+typedef struct site_list SITELIST;
+struct site_list {
+	SITE *head; /* Chain, in the order entries are checked */
+	SITE *tail;
+	SITENODE *root; /* Trie of prefixes */
+	int nFirst; /* Rank of head */
+	int nLast; /* Rank of tail */
 };
 
 typedef struct objlist_block OBLOCK;
@@ -359,6 +392,15 @@ struct statedata {
 	int *guest_free; /* Table to keep track of free guests */
 	size_t mod_alist_len; /* Length of mod_alist */
 	size_t mod_size; /* Length of modified buffer */
+	INT64 nOutputFlushes;   // Calls to process_output() which had output.
+	INT64 nOutputWrites;    // write()/writev() calls made by those flushes.
+	INT64 nOutputBytes;     // Bytes accepted by those calls.
+	INT64 nMccpIn;          // Characters given to MCCP compression.
+	INT64 nMccpOut;         // Bytes they compressed to.
+	CLinearTimeDelta ltdMccpCost; // Time spent compressing.
+	INT64 nConnAccepted;    // Connections admitted.
+	INT64 nConnDeferred;    // Passes which left connections for the next one.
+	INT64 nConnRejected;    // Connections refused by site.
 
 	char short_ver[64]; /* Short version number (for INFO) */
 	char doing_hdr[SIZEOF_DOING_STRING]; /* Doing column header in the WHO display */
@@ -377,8 +419,8 @@ struct statedata {
 	HELP_DESC *aHelpDesc;       // Table of help files hashes.
 	MARKBUF *markbits; /* temp storage for marking/unmarking */
 	OLSTK *olist; /* Stack of object lists for nested searches */
-	SITE *suspect_list; /* Sites that are suspect */
-	SITE *access_list; /* Access states for sites */
+	SITELIST suspect_list; /* Sites that are suspect */
+	SITELIST access_list; /* Access states for sites */
 
 	CLinearTimeAbsolute check_counter; /* Countdown to next db check */
 	CLinearTimeAbsolute cpu_count_from; /* When did we last reset CPU counters? */
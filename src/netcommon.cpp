@@ -27,6 +27,7 @@
 #include "levels.h"
 #endif // REALITY_LVLS
 
+static bool queue_shared_line(DESC *d, const char *s);
 
 /* ---------------------------------------------------------------------------
  * make_portlist: Make a list of ports for PORTS().
@@ -177,8 +178,11 @@ void raw_notify(dbref player, const char *msg)
 
     DESC_ITER_PLAYER(player, d)
     {
-        queue_string(d, msg);
-        queue_write_LEN(d, "\r\n", 2);
+        if (!queue_shared_line(d, msg))
+        {
+            queue_string(d, msg);
+            queue_write_LEN(d, "\r\n", 2);
+        }
     }
 }
 
@@ -220,16 +224,21 @@ void DCL_CDECL raw_broadcast(int inflags, const char *fmt, ...)
     mux_vsnprintf(buff, LBUF_SIZE, fmt, ap);
     va_end(ap);
 
+    BeginSharedOutput();
     DESC *d;
     DESC_ITER_CONN(d)
     {
         if ((Flags(d->player) & inflags) == inflags)
         {
-            queue_string(d, buff);
-            queue_write_LEN(d, "\r\n", 2);
+            if (!queue_shared_line(d, buff))
+            {
+                queue_string(d, buff);
+                queue_write_LEN(d, "\r\n", 2);
+            }
             process_output(d, false);
         }
     }
+    EndSharedOutput();
 }
 
 /* ---------------------------------------------------------------------------
@@ -250,45 +259,155 @@ void clearstrings(DESC *d)
     }
 }
 
-static void add_to_output_queue(DESC *d, const char *b, size_t n)
+/* ---------------------------------------------------------------------------
+ * Output blocks come from three pools: full blocks, small blocks queued after
+ * shared output, and bare headers which only point at shared output.
+ */
+
+static int tblock_pool(size_t nsize)
+{
+    if (OUTPUT_BLOCK_SIZE == nsize)
+    {
+        return POOL_TBLOCK;
+    }
+    else if (OUTPUT_SMALL_BLOCK_SIZE == nsize)
+    {
+        return POOL_TBLOCKS;
+    }
+    mux_assert(sizeof(TBLOCKHDR) == nsize);
+    return POOL_TBLKREF;
+}
+
+static TBLOCK *alloc_tblock(size_t nsize)
 {
-    TBLOCK *tp;
-    size_t left;
+    TBLOCK *tp = (TBLOCK *)pool_alloc(tblock_pool(nsize), "alloc_tblock",
+        __FILE__, __LINE__);
+    if (NULL != tp)
+    {
+        tp->hdr.nxt = NULL;
+        tp->hdr.start = tp->data;
+        tp->hdr.end = tp->data;
+        tp->hdr.nchars = 0;
+        tp->hdr.nsize = nsize;
+        tp->hdr.seg = NULL;
+    }
+    return tp;
+}
 
-    // Allocate an output buffer if needed.
-    //
+void free_tblock(TBLOCK *tp)
+{
+    if (NULL != tp->hdr.seg)
+    {
+        release_outseg(tp->hdr.seg);
+        tp->hdr.seg = NULL;
+    }
+    pool_free(tblock_pool(tp->hdr.nsize), (char *)tp, __FILE__, __LINE__);
+}
+
+/* ---------------------------------------------------------------------------
+ * retire_tblock: Dispose of an output block which has been written.
+ *
+ * Each descriptor keeps one full block in reserve so that the next burst of
+ * output does not need to visit the pool.
+ */
+
+void retire_tblock(DESC *d, TBLOCK *tp)
+{
+#ifdef HAVE_ZLIB_H
+    if (  NULL != d->mccp
+       && tp == d->mccp->done)
+    {
+        d->mccp->done = NULL;
+    }
+#endif // HAVE_ZLIB_H
+    if (  NULL == d->output_warm
+       && OUTPUT_BLOCK_SIZE == tp->hdr.nsize
+       && NULL == tp->hdr.seg)
+    {
+        tp->hdr.nxt = NULL;
+        d->output_warm = tp;
+    }
+    else
+    {
+        free_tblock(tp);
+    }
+}
+
+static TBLOCK *alloc_desc_tblock(DESC *d, size_t nsize)
+{
+    TBLOCK *tp = d->output_warm;
+    if (  NULL != tp
+       && OUTPUT_BLOCK_SIZE == nsize)
+    {
+        d->output_warm = NULL;
+        tp->hdr.start = tp->data;
+        tp->hdr.end = tp->data;
+        tp->hdr.nchars = 0;
+        return tp;
+    }
+    return alloc_tblock(nsize);
+}
+
+static void append_tblock(DESC *d, TBLOCK *tp)
+{
     if (d->output_head == NULL)
     {
-        tp = (TBLOCK *)MEMALLOC(OUTPUT_BLOCK_SIZE);
-        if (NULL != tp)
-        {
-            tp->hdr.nxt = NULL;
-            tp->hdr.start = tp->data;
-            tp->hdr.end = tp->data;
-            tp->hdr.nchars = 0;
+        d->output_head = tp;
+        d->output_tail = tp;
 
-            d->output_head = tp;
-            d->output_tail = tp;
-        }
-        else
+        // The queue was empty, so the socket was not being watched for
+        // writability.
+        //
+        UpdateDescEvents(d);
+    }
+    else
+    {
+        d->output_tail->hdr.nxt = tp;
+        d->output_tail = tp;
+    }
+}
+
+static void add_to_output_queue(DESC *d, const char *b, size_t n)
+{
+    TBLOCK *tp = d->output_tail;
+    size_t nBlock = OUTPUT_BLOCK_SIZE;
+    if (  NULL != tp
+       && NULL != tp->hdr.seg)
+    {
+        // Nothing can be appended to shared output, so what follows it gets
+        // a small block if it fits in one. Otherwise, a player receiving a
+        // run of broadcasts would strand most of a full block after each one.
+        //
+        if (sizeof(TBLOCKHDR) + n + 1 <= OUTPUT_SMALL_BLOCK_SIZE)
         {
-            ISOUTOFMEMORY(tp);
-            return;
+            nBlock = OUTPUT_SMALL_BLOCK_SIZE;
         }
+        tp = NULL;
     }
-    else
+#ifdef HAVE_ZLIB_H
+    else if (  NULL != d->mccp
+            && NULL != tp
+            && tp == d->mccp->done)
     {
-        tp = d->output_tail;
+        // The block has already been compressed.
+        //
+        tp = NULL;
     }
+#endif // HAVE_ZLIB_H
 
-    // Now tp points to the last buffer in the chain.
+    // Now tp points to the last buffer in the chain, if there is room in it.
     //
     do
     {
         // See if there is enough space in the buffer to hold the
         // string.  If so, copy it and update the pointers..
         //
-        left = OUTPUT_BLOCK_SIZE - (tp->hdr.end - (char *)tp + 1);
+        size_t left = 0;
+        if (NULL != tp)
+        {
+            left = tp->hdr.nsize - (tp->hdr.end - (char *)tp + 1);
+        }
+
         if (n <= left)
         {
             memcpy(tp->hdr.end, b, n);
@@ -310,37 +429,26 @@ static void add_to_output_queue(DESC *d, const char *b, size_t n)
                 n -= left;
             }
 
-            tp = (TBLOCK *)MEMALLOC(OUTPUT_BLOCK_SIZE);
-            if (NULL != tp)
+            tp = alloc_desc_tblock(d, nBlock);
+            if (NULL == tp)
             {
-                tp->hdr.nxt = NULL;
-                tp->hdr.start = tp->data;
-                tp->hdr.end = tp->data;
-                tp->hdr.nchars = 0;
-
-                d->output_tail->hdr.nxt = tp;
-                d->output_tail = tp;
-            }
-            else
-            {
-                ISOUTOFMEMORY(tp);
                 return;
             }
+            append_tblock(d, tp);
+            nBlock = OUTPUT_BLOCK_SIZE;
         }
     } while (n > 0);
 }
 
 /* ---------------------------------------------------------------------------
- * queue_write: Add text to the output queue for the indicated descriptor.
+ * make_output_room: Enforce output_limit before n more bytes are queued.
+ *
+ * The oldest queued output is discarded to make room. Returns false if the
+ * new output should be discarded instead.
  */
 
-void queue_write_LEN(DESC *d, const char *b, size_t n)
+static bool make_output_room(DESC *d, size_t n)
 {
-    if (n <= 0)
-    {
-        return;
-    }
-
     if (static_cast<size_t>(mudconf.output_limit) < d->output_size + n)
     {
         process_output(d, false);
@@ -349,7 +457,43 @@ void queue_write_LEN(DESC *d, const char *b, size_t n)
     if (static_cast<size_t>(mudconf.output_limit) < d->output_size + n)
     {
         TBLOCK *tp = d->output_head;
-        if (tp == NULL)
+        bool bKeepQueued = d->isFramed();
+#ifdef IO_THREADS
+        if (  NULL != d->io_conn
+           && NULL == tp)
+        {
+            // Everything queued is already with the I/O thread.
+            //
+            bKeepQueued = true;
+        }
+#endif // IO_THREADS
+#ifdef HAVE_ZLIB_H
+        if (  NULL != d->mccp
+           && d->mccp->bActive)
+        {
+            bKeepQueued = true;
+        }
+#endif // HAVE_ZLIB_H
+        if (bKeepQueued)
+        {
+            // Dropping queued bytes would cut a websocket frame or a
+            // compressed stream in two, so the new output is discarded
+            // instead.
+            //
+            STARTLOG(LOG_NET, "NET", "WRITE");
+            char *buf = alloc_lbuf("queue_write.LOG");
+            mux_sprintf(buf, LBUF_SIZE, "[%u/%s] Output buffer overflow, %d chars discarded by ", d->getSocket(), d->addr, n);
+            log_text(buf);
+            free_lbuf(buf);
+            if (d->flags & DS_CONNECTED)
+            {
+                log_name(d->player);
+            }
+            ENDLOG;
+            d->output_lost += n;
+            return false;
+        }
+        else if (tp == NULL)
         {
             STARTLOG(LOG_PROBLEMS, "QUE", "WRITE");
             log_text("Flushing when output_head is null!");
@@ -374,12 +518,15 @@ void queue_write_LEN(DESC *d, const char *b, size_t n)
             {
                 d->output_tail = NULL;
             }
-            MEMFREE(tp);
+            free_tblock(tp);
             tp = NULL;
         }
     }
+    return true;
+}
 
-    add_to_output_queue(d, b, n);
+static void output_queued(DESC *d, size_t n)
+{
     d->output_size += n;
     d->output_tot += n;
 
@@ -393,6 +540,307 @@ void queue_write_LEN(DESC *d, const char *b, size_t n)
 #endif
 }
 
+/* ---------------------------------------------------------------------------
+ * queue_write: Add text to the output queue for the indicated descriptor.
+ */
+
+void queue_write_LEN(DESC *d, const char *b, size_t n)
+{
+    if (n <= 0)
+    {
+        return;
+    }
+
+    if (d->isFramed())
+    {
+        d->encodeOutput(b, n);
+    }
+    queue_raw_LEN(d, b, n);
+}
+
+/* ---------------------------------------------------------------------------
+ * queue_raw_LEN: Queue bytes which are already in their wire form, such as
+ * replies to websocket control frames.
+ */
+
+void queue_raw_LEN(DESC *d, const char *b, size_t n)
+{
+    if (n <= 0)
+    {
+        return;
+    }
+
+    if (!make_output_room(d, n))
+    {
+        return;
+    }
+
+    add_to_output_queue(d, b, n);
+    output_queued(d, n);
+}
+
+#ifdef HAVE_ZLIB_H
+/* ---------------------------------------------------------------------------
+ * MCCP v2 (telnet option COMPRESS2).
+ *
+ * Once the client agrees to the option, everything after IAC SB COMPRESS2
+ * IAC SE is one deflate stream. Output is still queued as plain text, and
+ * process_output() compresses whatever was queued since its last visit just
+ * before writing, so one flush costs one deflate() with a sync flush rather
+ * than one for every string queued.
+ */
+
+void mccp_start(DESC *d)
+{
+    if (NULL == d->mccp)
+    {
+        d->mccp = (MCCP *)MEMALLOC(sizeof(MCCP));
+        ISOUTOFMEMORY(d->mccp);
+        d->mccp->nIn = 0;
+        d->mccp->nOut = 0;
+        d->mccp->ltdCost.Set100ns(0);
+    }
+    else if (d->mccp->bActive)
+    {
+        return;
+    }
+    MCCP *mc = d->mccp;
+    mc->bActive = false;
+    mc->done = NULL;
+
+    // A smaller window and memLevel than zlib's defaults keep the state near
+    // 64KB per connection, and lines of game output lose little by it.
+    //
+    memset(&mc->stream, 0, sizeof(mc->stream));
+    if (Z_OK != deflateInit2(&mc->stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                    13, 6, Z_DEFAULT_STRATEGY))
+    {
+        STARTLOG(LOG_PROBLEMS, "NET", "MCCP");
+        log_text("deflateInit2 failed.");
+        ENDLOG;
+        return;
+    }
+
+    static const char aStart[5] =
+    {
+        NVT_IAC, NVT_SB, TELNET_COMPRESS2, NVT_IAC, NVT_SE
+    };
+    queue_write_LEN(d, aStart, sizeof(aStart));
+    mc->done = d->output_tail;
+    mc->bActive = true;
+}
+
+void mccp_compress(DESC *d, int flush)
+{
+    MCCP *mc = d->mccp;
+    if (  NULL == mc
+       || !mc->bActive)
+    {
+        return;
+    }
+
+    TBLOCK *tp = (NULL == mc->done) ? d->output_head : mc->done->hdr.nxt;
+    if (  NULL == tp
+       && Z_FINISH != flush)
+    {
+        return;
+    }
+
+    CLinearTimeAbsolute ltaStart;
+    ltaStart.GetUTC();
+
+    bool bWasEmpty = (NULL == d->output_head);
+    TBLOCK *head = NULL;
+    TBLOCK *tail = NULL;
+    size_t nIn = 0;
+    size_t nOut = 0;
+    z_stream *zs = &mc->stream;
+    bool bLast = false;
+    while (!bLast)
+    {
+        int iFlush = Z_NO_FLUSH;
+        if (NULL == tp)
+        {
+            zs->next_in = NULL;
+            zs->avail_in = 0;
+        }
+        else
+        {
+            zs->next_in = (Bytef *)tp->hdr.start;
+            zs->avail_in = static_cast<uInt>(tp->hdr.nchars);
+            nIn += tp->hdr.nchars;
+        }
+        if (  NULL == tp
+           || NULL == tp->hdr.nxt)
+        {
+            iFlush = flush;
+            bLast = true;
+        }
+
+        // With no flush, deflate() stops when the input is used up or the
+        // output is full. With a flush, it also stops when the output is
+        // full, so keep going until it leaves room.
+        //
+        do
+        {
+            size_t left = 0;
+            if (NULL != tail)
+            {
+                left = tail->hdr.nsize - (tail->hdr.end - (char *)tail + 1);
+            }
+            if (0 == left)
+            {
+                TBLOCK *tpNew = alloc_desc_tblock(d, OUTPUT_BLOCK_SIZE);
+                if (NULL == head)
+                {
+                    head = tpNew;
+                }
+                else
+                {
+                    tail->hdr.nxt = tpNew;
+                }
+                tail = tpNew;
+                left = tail->hdr.nsize - (tail->hdr.end - (char *)tail + 1);
+            }
+            zs->next_out = (Bytef *)tail->hdr.end;
+            zs->avail_out = static_cast<uInt>(left);
+            int iResult = deflate(zs, iFlush);
+            size_t n = left - zs->avail_out;
+            tail->hdr.end += n;
+            tail->hdr.nchars += n;
+            nOut += n;
+            if (  Z_STREAM_END == iResult
+               || Z_STREAM_ERROR == iResult)
+            {
+                break;
+            }
+        } while (0 == zs->avail_out);
+
+        if (NULL != tp)
+        {
+            TBLOCK *tpNext = tp->hdr.nxt;
+            free_tblock(tp);
+            tp = tpNext;
+        }
+    }
+
+    // Replace the plain blocks with the compressed ones.
+    //
+    if (NULL == mc->done)
+    {
+        d->output_head = head;
+    }
+    else
+    {
+        mc->done->hdr.nxt = head;
+    }
+    d->output_tail = tail;
+    mc->done = tail;
+    d->output_size = d->output_size - nIn + nOut;
+    if (bWasEmpty)
+    {
+        UpdateDescEvents(d);
+    }
+
+    CLinearTimeAbsolute ltaEnd;
+    ltaEnd.GetUTC();
+    CLinearTimeDelta ltd = ltaEnd - ltaStart;
+    mc->nIn += nIn;
+    mc->nOut += nOut;
+    mc->ltdCost += ltd;
+    mudstate.nMccpIn += nIn;
+    mudstate.nMccpOut += nOut;
+    mudstate.ltdMccpCost += ltd;
+}
+
+/* ---------------------------------------------------------------------------
+ * mccp_stop: End the compressed stream. Output queued after this goes out as
+ * plain text. The totals are kept for SESSION.
+ */
+
+void mccp_stop(DESC *d)
+{
+    MCCP *mc = d->mccp;
+    if (  NULL == mc
+       || !mc->bActive)
+    {
+        return;
+    }
+    mccp_compress(d, Z_FINISH);
+    deflateEnd(&mc->stream);
+    mc->bActive = false;
+    mc->done = NULL;
+}
+
+void mccp_free(DESC *d)
+{
+    MCCP *mc = d->mccp;
+    if (NULL != mc)
+    {
+        if (mc->bActive)
+        {
+            deflateEnd(&mc->stream);
+        }
+        MEMFREE(mc);
+        d->mccp = NULL;
+    }
+}
+#endif // HAVE_ZLIB_H
+
+/* ---------------------------------------------------------------------------
+ * Shared output segments.
+ *
+ * A segment is queued by reference, so one copy of a broadcast line can sit
+ * in the output queues of every descriptor that receives it. Each queue holds
+ * a reference, and the segment is freed when the last one is written.
+ */
+
+OUTSEG *alloc_outseg(size_t n)
+{
+    OUTSEG *seg = (OUTSEG *)MEMALLOC(sizeof(OUTSEG) + n);
+    if (NULL != seg)
+    {
+        seg->refcount = 1;
+        seg->nchars = n;
+    }
+    else
+    {
+        ISOUTOFMEMORY(seg);
+    }
+    return seg;
+}
+
+void release_outseg(OUTSEG *seg)
+{
+    if (--seg->refcount <= 0)
+    {
+        MEMFREE(seg);
+    }
+}
+
+void queue_write_seg(DESC *d, OUTSEG *seg)
+{
+    size_t n = seg->nchars;
+    if (  n <= 0
+       || !make_output_room(d, n))
+    {
+        return;
+    }
+
+    TBLOCK *tp = alloc_tblock(sizeof(TBLOCKHDR));
+    if (NULL == tp)
+    {
+        return;
+    }
+    seg->refcount++;
+    tp->hdr.seg = seg;
+    tp->hdr.start = seg->data;
+    tp->hdr.end = seg->data + n;
+    tp->hdr.nchars = n;
+    append_tblock(d, tp);
+    output_queued(d, n);
+}
+
 void queue_write(DESC *d, const char *b)
 {
     queue_write_LEN(d, b, strlen(b));
@@ -444,37 +892,188 @@ static const char *encode_iac(const char *szString)
     return Buffer;
 }
 
-void queue_string(DESC *d, const char *s)
-{
-    const char *p = s;
+// The ways queue_string() can render a string for a particular descriptor.
+//
+#define SR_STRIP_ANSI       0x01
+#define SR_NORMAL_TO_WHITE  0x02
+#define SR_STRIP_ACCENTS    0x04
+#define SR_RENDERINGS       8
 
+static int string_rendering(DESC *d, bool bHasEscape)
+{
+    int iRendering = 0;
     if (d->flags & DS_CONNECTED)
     {
         if (  !Ansi(d->player)
-           && strchr(s, ESC_CHAR))
+           && bHasEscape)
         {
-            p = strip_ansi(p);
+            iRendering |= SR_STRIP_ANSI;
         }
         else if (NoBleed(d->player))
         {
-            p = normal_to_white(p);
+            iRendering |= SR_NORMAL_TO_WHITE;
         }
 
         if (NoAccents(d->player))
         {
-            p = strip_accents(p);
+            iRendering |= SR_STRIP_ACCENTS;
         }
     }
     else
     {
-        if (strchr(s, ESC_CHAR))
+        if (bHasEscape)
         {
-            p = strip_ansi(p);
+            iRendering |= SR_STRIP_ANSI;
         }
+        iRendering |= SR_STRIP_ACCENTS;
+    }
+    return iRendering;
+}
+
+static const char *render_string(const char *s, int iRendering)
+{
+    const char *p = s;
+    if (iRendering & SR_STRIP_ANSI)
+    {
+        p = strip_ansi(p);
+    }
+    else if (iRendering & SR_NORMAL_TO_WHITE)
+    {
+        p = normal_to_white(p);
+    }
+
+    if (iRendering & SR_STRIP_ACCENTS)
+    {
         p = strip_accents(p);
     }
-    p = encode_iac(p);
-    queue_write(d, p);
+    return encode_iac(p);
+}
+
+void queue_string(DESC *d, const char *s)
+{
+    queue_write(d, render_string(s, string_rendering(d, NULL != strchr(s, ESC_CHAR))));
+}
+
+/* ---------------------------------------------------------------------------
+ * BeginSharedOutput, EndSharedOutput: Bracket the delivery of one message to
+ * many players.
+ *
+ * In between, raw_notify() renders each distinct line once per rendering and
+ * queues the result by reference (see queue_write_seg) rather than copying
+ * it into every recipient's output queue. Websocket connections frame their
+ * own output and still take a copy.
+ */
+
+#define SHARED_LINES 2
+
+static struct
+{
+    char   *pLine;      // Copy of the line as given to raw_notify().
+    size_t  nLine;
+    bool    bHasEscape;
+    OUTSEG *aSeg[SR_RENDERINGS];
+} aSharedLines[SHARED_LINES];
+
+static int nSharedNest = 0;
+static int iSharedNext = 0;
+
+static void clear_shared_line(int i)
+{
+    if (NULL != aSharedLines[i].pLine)
+    {
+        MEMFREE(aSharedLines[i].pLine);
+        aSharedLines[i].pLine = NULL;
+    }
+    for (int j = 0; j < SR_RENDERINGS; j++)
+    {
+        if (NULL != aSharedLines[i].aSeg[j])
+        {
+            release_outseg(aSharedLines[i].aSeg[j]);
+            aSharedLines[i].aSeg[j] = NULL;
+        }
+    }
+}
+
+void BeginSharedOutput(void)
+{
+    nSharedNest++;
+}
+
+void EndSharedOutput(void)
+{
+    if (  0 < nSharedNest
+       && 0 == --nSharedNest)
+    {
+        for (int i = 0; i < SHARED_LINES; i++)
+        {
+            clear_shared_line(i);
+        }
+    }
+}
+
+// Queue s and a line break, sharing the rendered text with other recipients
+// of the same message. Returns false if the caller should queue it the
+// ordinary way.
+//
+static bool queue_shared_line(DESC *d, const char *s)
+{
+    if (  0 == nSharedNest
+       || d->isFramed())
+    {
+        return false;
+    }
+
+    size_t n = strlen(s);
+    if (n < OUTPUT_SHARE_MIN)
+    {
+        return false;
+    }
+
+    int i;
+    for (i = 0; i < SHARED_LINES; i++)
+    {
+        if (  NULL != aSharedLines[i].pLine
+           && n == aSharedLines[i].nLine
+           && memcmp(aSharedLines[i].pLine, s, n) == 0)
+        {
+            break;
+        }
+    }
+
+    if (SHARED_LINES == i)
+    {
+        i = iSharedNext;
+        iSharedNext = (iSharedNext + 1) % SHARED_LINES;
+        clear_shared_line(i);
+
+        aSharedLines[i].pLine = (char *)MEMALLOC(n + 1);
+        if (NULL == aSharedLines[i].pLine)
+        {
+            ISOUTOFMEMORY(aSharedLines[i].pLine);
+            return false;
+        }
+        memcpy(aSharedLines[i].pLine, s, n + 1);
+        aSharedLines[i].nLine = n;
+        aSharedLines[i].bHasEscape = (NULL != strchr(s, ESC_CHAR));
+    }
+
+    int iRendering = string_rendering(d, aSharedLines[i].bHasEscape);
+    OUTSEG *seg = aSharedLines[i].aSeg[iRendering];
+    if (NULL == seg)
+    {
+        const char *p = render_string(aSharedLines[i].pLine, iRendering);
+        size_t np = strlen(p);
+        seg = alloc_outseg(np + 2);
+        if (NULL == seg)
+        {
+            return false;
+        }
+        memcpy(seg->data, p, np);
+        memcpy(seg->data + np, "\r\n", 2);
+        aSharedLines[i].aSeg[iRendering] = seg;
+    }
+    queue_write_seg(d, seg);
+    return true;
 }
 
 void freeqs(DESC *d)
@@ -486,17 +1085,26 @@ void freeqs(DESC *d)
     while (tb)
     {
         tnext = tb->hdr.nxt;
-        MEMFREE(tb);
+        free_tblock(tb);
         tb = tnext;
     }
     d->output_head = NULL;
     d->output_tail = NULL;
+#ifdef HAVE_ZLIB_H
+    mccp_free(d);
+#endif // HAVE_ZLIB_H
+
+    if (d->output_warm)
+    {
+        free_tblock(d->output_warm);
+        d->output_warm = NULL;
+    }
 
     cb = d->input_head;
     while (cb)
     {
         cnext = (CBLK *) cb->hdr.nxt;
-        free_lbuf(cb);
+        free_cblk(cb);
         cb = cnext;
     }
 
@@ -505,7 +1113,7 @@ void freeqs(DESC *d)
 
     if (d->raw_input)
     {
-        free_lbuf(d->raw_input);
+        free_cblk(d->raw_input);
     }
     d->raw_input = NULL;
 
@@ -518,6 +1126,7 @@ void freeqs(DESC *d)
     d->nvt_eor_us_state   = OPTION_NO;
     d->nvt_naws_him_state = OPTION_NO;
     d->nvt_naws_us_state  = OPTION_NO;
+    d->nvt_compress2_us_state = OPTION_NO;
     d->height = 24;
     d->width = 78;
 }
@@ -600,6 +1209,10 @@ void save_command(DESC *d, CBLK *command)
         // We have added our first command to an empty list. Go process it later.
         //
         scheduler.DeferImmediateTask(PRIORITY_SYSTEM, Task_ProcessCommand, d, 0);
+
+        // Stop reading from this socket until the list drains.
+        //
+        UpdateDescEvents(d);
     }
     else
     {
@@ -1756,6 +2369,23 @@ static void dump_users(DESC *e, char *match, int key)
                     d->input_tot,
                     d->output_size, d->output_lost,
                     d->output_tot);
+#ifdef HAVE_ZLIB_H
+                if (  NULL != d->mccp
+                   && 0 < d->mccp->nIn)
+                {
+                    // Follow the session line with the compression totals.
+                    //
+                    queue_string(e, buf);
+                    char szIn[30], szOut[30];
+                    mux_i64toa(d->mccp->nIn, szIn);
+                    mux_i64toa(d->mccp->nOut, szOut);
+                    mux_sprintf(buf, MBUF_SIZE,
+                        "    MCCP2 %s: %s chars to %s bytes (%.1f%%), %ld ms compressing\r\n",
+                        d->mccp->bActive ? "on" : "off", szIn, szOut,
+                        100.0 * d->mccp->nOut / d->mccp->nIn,
+                        d->mccp->ltdCost.ReturnMilliseconds());
+                }
+#endif // HAVE_ZLIB_H
             }
             else if (  Wizard_Who(e->player)
                     || See_Hidden(e->player))
@@ -2718,6 +3348,7 @@ void Task_ProcessCommand(void *arg_voidptr, int arg_iInteger)
                 else
                 {
                     d->input_tail = NULL;
+                    UpdateDescEvents(d);
                 }
                 d->input_size -= strlen(t->cmd);
                 d->last_time.GetUTC();
@@ -2729,7 +3360,7 @@ void Task_ProcessCommand(void *arg_voidptr, int arg_iInteger)
                 {
                     do_command(d, t->cmd);
                 }
-                free_lbuf(t);
+                free_cblk(t);
             }
             else
             {
@@ -2745,21 +3376,135 @@ void Task_ProcessCommand(void *arg_voidptr, int arg_iInteger)
 }
 
 /* ---------------------------------------------------------------------------
- * site_check: Check for site flags in a site list.
+ * Site lists.
+ *
+ * The first entry in a site list which matches an address decides it. Each
+ * node of the trie stands for a prefix, and holds the first-checked entry
+ * for exactly that prefix. The entries which match an address are on the
+ * path from the root to the address, so the one which decides it is the
+ * lowest-ranked entry along that path.
+ *
+ * Keys are walked a bit at a time from an array of bytes in network order,
+ * so longer (IPv6) keys can share the same trie code.
  */
 
-int site_check(struct in_addr host, SITE *site_list)
+struct site_node
 {
-    SITE *this0;
+    SITENODE *child[2];
+    SITE     *site;     // First-checked entry for this prefix, if any.
+};
 
-    for (this0 = site_list; this0; this0 = this0->next)
+#define SITE_KEY_BIT(key, i) (((key)[(i) >> 3] >> (7 - ((i) & 7))) & 1)
+
+static int site_prefix_bits(struct in_addr mask)
+{
+    // cf_site only accepts contiguous masks.
+    //
+    in_addr_t ulMask = ntohl(mask.s_addr);
+    int nBits = 0;
+    while (  nBits < 32
+          && (ulMask & (0x80000000UL >> nBits)))
+    {
+        nBits++;
+    }
+    return nBits;
+}
+
+/* ---------------------------------------------------------------------------
+ * site_add: Add an entry to the end of a site list, or the start. Returns
+ * false if the trie could not be extended.
+ */
+
+bool site_add(SITELIST *pList, SITE *site, bool bAppend)
+{
+    const unsigned char *key = (const unsigned char *)&site->address.s_addr;
+    int nBits = site_prefix_bits(site->mask);
+
+    SITENODE **ppNode = &pList->root;
+    for (int i = 0; ; i++)
     {
-        if ((host.s_addr & this0->mask.s_addr) == this0->address.s_addr)
+        if (NULL == *ppNode)
+        {
+            SITENODE *pNode = NULL;
+            try
+            {
+                pNode = new SITENODE;
+            }
+            catch (...)
+            {
+                ; // Nothing.
+            }
+            if (NULL == pNode)
+            {
+                return false;
+            }
+            pNode->child[0] = NULL;
+            pNode->child[1] = NULL;
+            pNode->site = NULL;
+            *ppNode = pNode;
+        }
+        if (i == nBits)
         {
-            return this0->flag;
+            break;
+        }
+        ppNode = &(*ppNode)->child[SITE_KEY_BIT(key, i)];
+    }
+
+    site->next = NULL;
+    if (NULL == pList->head)
+    {
+        site->rank = 0;
+        pList->nFirst = 0;
+        pList->nLast = 0;
+        pList->head = site;
+        pList->tail = site;
+    }
+    else if (bAppend)
+    {
+        site->rank = ++pList->nLast;
+        pList->tail->next = site;
+        pList->tail = site;
+    }
+    else
+    {
+        site->rank = --pList->nFirst;
+        site->next = pList->head;
+        pList->head = site;
+    }
+
+    SITENODE *pNode = *ppNode;
+    if (  NULL == pNode->site
+       || site->rank < pNode->site->rank)
+    {
+        pNode->site = site;
+    }
+    return true;
+}
+
+/* ---------------------------------------------------------------------------
+ * site_check: Check for site flags in a site list.
+ */
+
+int site_check(struct in_addr host, SITELIST *pList)
+{
+    const unsigned char *key = (const unsigned char *)&host.s_addr;
+    SITE *pBest = NULL;
+    SITENODE *pNode = pList->root;
+    for (int i = 0; NULL != pNode; i++)
+    {
+        if (  NULL != pNode->site
+           && (  NULL == pBest
+              || pNode->site->rank < pBest->rank))
+        {
+            pBest = pNode->site;
+        }
+        if (32 == i)
+        {
+            break;
         }
+        pNode = pNode->child[SITE_KEY_BIT(key, i)];
     }
-    return 0;
+    return (NULL == pBest) ? 0 : pBest->flag;
 }
 
 /* --------------------------------------------------------------------------
@@ -2850,8 +3595,8 @@ static void list_sites(dbref player, SITE *site_list, const char *header_txt, in
 
 void list_siteinfo(dbref player)
 {
-    list_sites(player, mudstate.access_list, "Site Access", S_ACCESS);
-    list_sites(player, mudstate.suspect_list, "Suspected Sites", S_SUSPECT);
+    list_sites(player, mudstate.access_list.head, "Site Access", S_ACCESS);
+    list_sites(player, mudstate.suspect_list.head, "Suspected Sites", S_SUSPECT);
 }
 
 /* ---------------------------------------------------------------------------
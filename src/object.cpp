@@ -876,6 +876,7 @@ static void check_dead_refs(void)
                     owner = GOD;
                 }
                 s_Owner(i, owner);
+                que_rehome(i);
             }
         }
 
@@ -26,6 +26,7 @@ typedef struct player_cache
     int   money;
     int   queue;
     int   qmax;
+    int   qweight;
     int   cflags;
     struct player_cache *next;
 } PCACHE;
@@ -58,11 +59,12 @@ void pcache_init(void)
 
 /*! \brief Updates player cache items from the database.
  *
- * The Money and QueueMax attributes are used to initialize the corresponding
- * items in the player cache.  If a Money attribute does not exist for some
- * strange reason, it it initialized to zero and marked as dirty. If a
- * QueueMax attribute doesn't exist or is negative, then the game will
- * choose a reasonable limit later in QueueMax().
+ * The Money, QueueMax, and QueueWeight attributes are used to initialize the
+ * corresponding items in the player cache.  If a Money attribute does not
+ * exist for some strange reason, it it initialized to zero and marked as
+ * dirty. If a QueueMax attribute doesn't exist or is negative, then the game
+ * will choose a reasonable limit later in QueueMax(). QueueWeight works the
+ * same way with QueueWeight().
  *
  * \param player   player object to begin caching.
  * \param pp       pointer to PCACHE structure.
@@ -82,17 +84,37 @@ static void pcache_reload1(dbref player, PCACHE *pp)
         pp->money = 0;
     }
 
+    // QueueMax and QueueWeight are set by wizards, so they are usually
+    // stored with an owner, and must be decoded.
+    //
+    dbref aowner;
+    int   aflags;
+    char *buff = alloc_lbuf("pcache_reload1");
+
     int m = -1;
-    cp = atr_get_raw(player, A_QUEUEMAX);
-    if (cp && *cp)
+    atr_get_str(buff, player, A_QUEUEMAX, &aowner, &aflags);
+    if (*buff)
     {
-        m = mux_atol(cp);
+        m = mux_atol(buff);
         if (m < 0)
         {
             m = -1;
         }
     }
     pp->qmax = m;
+
+    m = -1;
+    atr_get_str(buff, player, A_QUEUEWEIGHT, &aowner, &aflags);
+    if (*buff)
+    {
+        m = mux_atol(buff);
+        if (m <= 0)
+        {
+            m = -1;
+        }
+    }
+    pp->qweight = m;
+    free_lbuf(buff);
 }
 
 /*! \brief Returns a player's cache record.
@@ -142,7 +164,7 @@ static void pcache_save(PCACHE *pp)
     }
 }
 
-/*! \brief Re-initializes Money and QueueMax items from the database.
+/*! \brief Re-initializes Money, QueueMax, and QueueWeight items from the database.
  *
  * \param player   player object dbref.
  * \return         None.
@@ -286,6 +308,35 @@ int QueueMax(dbref player)
     return m;
 }
 
+/*! \brief Returns the player's share of the time spent running queue entries.
+ *
+ * Players with work ready to run take turns, and each turn lasts in
+ * proportion to this weight. If a QueueWeight is set on the player, we use
+ * that. Otherwise, the game-wide queue_weight applies.
+ *
+ * \param player   dbref of player object.
+ * \return         Weight, at least 1.
+ */
+
+int QueueWeight(dbref player)
+{
+    int m = mudconf.queue_weight;
+    if (  Good_obj(player)
+       && OwnsOthers(player))
+    {
+        PCACHE *pp = pcache_find(player);
+        if (pp->qweight > 0)
+        {
+            m = pp->qweight;
+        }
+    }
+    if (m < 1)
+    {
+        m = 1;
+    }
+    return m;
+}
+
 /*! \brief Returns how many coins are in a player's or things's purse.
  *
  * \param obj      dbref of player object.
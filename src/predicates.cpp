@@ -15,6 +15,7 @@
 #include "command.h"
 #include "interface.h"
 #include "powers.h"
+#include "profile.h"
 #ifdef REALITY_LVLS
 #include "levels.h"
 #endif // REALITY_LVLS
@@ -1547,6 +1548,9 @@ void do_restart(dbref executor, dbref caller, dbref enactor, int key)
 #else // WIN32
 
     dump_restart_db();
+#ifdef IO_THREADS
+    IoShutdown();
+#endif // IO_THREADS
 
     CleanUpSlaveSocket();
     CleanUpSlaveProcess();
@@ -2314,9 +2318,10 @@ void did_it(dbref player, dbref thing, int what, const char *def, int owhat,
         return;
     }
 
-    char *d, *buff, *act, *charges, *bp, *str;
+    char *buff, *act, *charges, *bp;
     dbref loc, aowner;
     int num, aflags;
+    ATTR_VIEW av;
 
     // If we need to call exec() from within this function, we first save
     // the state of the global registers, in order to avoid munging them
@@ -2335,20 +2340,18 @@ void did_it(dbref player, dbref thing, int what, const char *def, int owhat,
     //
     if (what > 0)
     {
-        d = atr_pget(thing, what, &aowner, &aflags);
-        if (*d)
+        if (atr_pget_view(&av, thing, what))
         {
             need_pres = true;
             preserve = PushRegisters(MAX_GLOBAL_REGS);
             save_global_regs(preserve);
 
             buff = bp = alloc_lbuf("did_it.1");
-            str = d;
-            mux_exec(buff, &bp, thing, player, player,
-                AttrTrace(aflags, EV_EVAL|EV_FIGNORE|EV_FCHECK|EV_TOP),
-                &str, args, nargs);
+            mux_exec_attr(buff, &bp, thing, player, player,
+                AttrTrace(av.flags, EV_EVAL|EV_FIGNORE|EV_FCHECK|EV_TOP),
+                av.pText, av.nText, thing, what, args, nargs);
             *bp = '\0';
-            if (  (aflags & AF_HTML)
+            if (  (av.flags & AF_HTML)
                && Html(player))
             {
                 safe_str("\r\n", buff, &bp);
@@ -2375,7 +2378,7 @@ void did_it(dbref player, dbref thing, int what, const char *def, int owhat,
         {
             notify(player, def);
         }
-        free_lbuf(d);
+        atr_release(&av);
     }
     if (what < 0 && def)
     {
@@ -2388,8 +2391,7 @@ void did_it(dbref player, dbref thing, int what, const char *def, int owhat,
        && Has_location(player)
        && Good_obj(loc = Location(player)))
     {
-        d = atr_pget(thing, owhat, &aowner, &aflags);
-        if (*d)
+        if (atr_pget_view(&av, thing, owhat))
         {
             if (!need_pres)
             {
@@ -2398,17 +2400,16 @@ void did_it(dbref player, dbref thing, int what, const char *def, int owhat,
                 save_global_regs(preserve);
             }
             buff = bp = alloc_lbuf("did_it.2");
-            str = d;
-            mux_exec(buff, &bp, thing, player, player,
-                 AttrTrace(aflags, EV_EVAL|EV_FIGNORE|EV_FCHECK|EV_TOP),
-                 &str, args, nargs);
+            mux_exec_attr(buff, &bp, thing, player, player,
+                 AttrTrace(av.flags, EV_EVAL|EV_FIGNORE|EV_FCHECK|EV_TOP),
+                 av.pText, av.nText, thing, owhat, args, nargs);
             *bp = '\0';
 #if !defined(FIRANMUX)
             if (*buff)
 #endif // FIRANMUX
             {
 #ifdef REALITY_LVLS
-                if (aflags & AF_NONAME)
+                if (av.flags & AF_NONAME)
                 {
                     notify_except2_rlevel(loc, player, player, thing, buff);
                 }
@@ -2418,7 +2419,7 @@ void did_it(dbref player, dbref thing, int what, const char *def, int owhat,
                         tprintf("%s %s", Name(player), buff));
                 }
 #else
-                if (aflags & AF_NONAME)
+                if (av.flags & AF_NONAME)
                 {
                     notify_except2(loc, player, player, thing, buff);
                 }
@@ -2453,7 +2454,7 @@ void did_it(dbref player, dbref thing, int what, const char *def, int owhat,
             }
 #endif // REALITY_LVLS
         }
-        free_lbuf(d);
+        atr_release(&av);
     } else if (  owhat < 0
               && odef
               && Has_location(player)
@@ -2527,6 +2528,7 @@ void did_it(dbref player, dbref thing, int what, const char *def, int owhat,
             }
             free_lbuf(charges);
             CLinearTimeAbsolute lta;
+            prof_origin(PROF_QUEUE, thing, awhat);
             wait_que(thing, player, player, AttrTrace(aflags, 0), false, lta,
                 NOTHING, 0,
                 act,
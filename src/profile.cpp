@@ -0,0 +1,439 @@
+// profile.cpp -- Softcode profiler.
+//
+// See profile.h.  Totals are kept per (kind, object, attribute).  A call
+// tree with the same keys is kept beside them, so exclusive time can also be
+// written out per call stack in the folded format read by flame graph tools.
+//
+
+#include "copyright.h"
+#include "autoconf.h"
+#include "config.h"
+#include "externs.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "attrs.h"
+#include "command.h"
+#include "profile.h"
+
+typedef struct prof_stat
+{
+    INT64 nCalls;
+    INT64 tInclusive;
+    INT64 tExclusive;
+    int   nActive;                  // Frames open on this key right now.
+} PROF_STAT;
+
+typedef std::map<UINT64, PROF_STAT> PROF_STAT_MAP;
+typedef std::map<UINT64, struct prof_node *> PROF_NODE_MAP;
+
+struct prof_node
+{
+    UINT64         key;
+    PROF_STAT     *pStat;
+    INT64          tExclusive;      // Exclusive time along this call stack.
+    PROF_NODE_MAP  children;
+};
+typedef struct prof_node PROF_NODE;
+
+bool prof_bActive = false;
+
+static unsigned int prof_nGeneration = 0;
+static PROF_FRAME *prof_pTop = NULL;
+static PROF_NODE prof_root;
+static PROF_STAT_MAP prof_stats;
+static CLinearTimeAbsolute prof_ltaStarted;
+static CLinearTimeDelta prof_ltdProfiled;
+
+static int   prof_iOriginKind  = PROF_QUEUE;
+static dbref prof_OriginThing  = NOTHING;
+static int   prof_iOriginAttr  = 0;
+
+static UINT64 prof_key(int iKind, dbref thing, int attr)
+{
+    return (static_cast<UINT64>(static_cast<UINT32>(thing)) << 32)
+         | (static_cast<UINT64>(static_cast<UINT32>(attr)) << 2)
+         | static_cast<UINT64>(iKind);
+}
+
+static INT64 prof_now(void)
+{
+    CLinearTimeAbsolute lta;
+    lta.GetUTC();
+    return lta.Return100ns();
+}
+
+// The frame on top of the stack, if it belongs to the current profile.
+//
+static PROF_FRAME *prof_current(void)
+{
+    if (  NULL != prof_pTop
+       && prof_pTop->nGeneration == prof_nGeneration)
+    {
+        return prof_pTop;
+    }
+    return NULL;
+}
+
+void prof_enter(PROF_FRAME *pFrame, int iKind, dbref thing, int attr)
+{
+    PROF_FRAME *pCaller = prof_current();
+    PROF_NODE *pParent = pCaller ? pCaller->pNode : &prof_root;
+    UINT64 key = prof_key(iKind, thing, attr);
+
+    PROF_NODE *pNode;
+    PROF_NODE_MAP::iterator it = pParent->children.find(key);
+    if (it != pParent->children.end())
+    {
+        pNode = it->second;
+    }
+    else
+    {
+        pNode = NULL;
+        try
+        {
+            pNode = new PROF_NODE;
+        }
+        catch (...)
+        {
+            ; // Nothing.
+        }
+        if (NULL == pNode)
+        {
+            return;
+        }
+        pNode->key = key;
+        pNode->tExclusive = 0;
+
+        PROF_STAT_MAP::iterator itStat = prof_stats.find(key);
+        if (itStat == prof_stats.end())
+        {
+            PROF_STAT stat;
+            memset(&stat, 0, sizeof(stat));
+            itStat = prof_stats.insert(PROF_STAT_MAP::value_type(key, stat)).first;
+        }
+        pNode->pStat = &itStat->second;
+        pParent->children[key] = pNode;
+    }
+
+    pNode->pStat->nCalls++;
+    pNode->pStat->nActive++;
+
+    pFrame->pParent = prof_pTop;
+    pFrame->pNode = pNode;
+    pFrame->nGeneration = prof_nGeneration;
+    pFrame->tChildren = 0;
+    prof_pTop = pFrame;
+    pFrame->tStart = prof_now();
+}
+
+void prof_leave(PROF_FRAME *pFrame)
+{
+    prof_pTop = pFrame->pParent;
+    if (pFrame->nGeneration != prof_nGeneration)
+    {
+        // The profile was reset while this frame was open.
+        //
+        return;
+    }
+
+    // The clock is wall time, and it can be set back.
+    //
+    INT64 tElapsed = prof_now() - pFrame->tStart;
+    if (tElapsed < 0)
+    {
+        tElapsed = 0;
+    }
+    INT64 tSelf = tElapsed - pFrame->tChildren;
+    if (tSelf < 0)
+    {
+        tSelf = 0;
+    }
+    PROF_NODE *pNode = pFrame->pNode;
+    PROF_STAT *pStat = pNode->pStat;
+
+    pNode->tExclusive += tSelf;
+    pStat->tExclusive += tSelf;
+
+    // Recursive calls are already inside the outermost call's time.
+    //
+    pStat->nActive--;
+    if (0 == pStat->nActive)
+    {
+        pStat->tInclusive += tElapsed;
+    }
+
+    PROF_FRAME *pCaller = prof_current();
+    if (pCaller)
+    {
+        pCaller->tChildren += tElapsed;
+    }
+}
+
+void prof_origin(int iKind, dbref thing, int attr)
+{
+    prof_iOriginKind = iKind;
+    prof_OriginThing = thing;
+    prof_iOriginAttr = attr;
+}
+
+void prof_take_origin(int *piKind, dbref *pthing, int *pattr)
+{
+    *piKind = prof_iOriginKind;
+    *pthing = prof_OriginThing;
+    *pattr  = prof_iOriginAttr;
+    prof_iOriginKind = PROF_QUEUE;
+    prof_OriginThing = NOTHING;
+    prof_iOriginAttr = 0;
+}
+
+static void prof_free_children(PROF_NODE *pNode)
+{
+    PROF_NODE_MAP::iterator it;
+    for (it = pNode->children.begin(); it != pNode->children.end(); ++it)
+    {
+        prof_free_children(it->second);
+        delete it->second;
+    }
+    pNode->children.clear();
+}
+
+static void prof_reset(void)
+{
+    // Frames which are still open belong to the old generation and are
+    // ignored when they are left.
+    //
+    prof_nGeneration++;
+    prof_free_children(&prof_root);
+    prof_stats.clear();
+    prof_ltdProfiled.Set100ns(0);
+    prof_ltaStarted.GetUTC();
+}
+
+static CLinearTimeDelta prof_profiled(void)
+{
+    CLinearTimeDelta ltd = prof_ltdProfiled;
+    if (prof_bActive)
+    {
+        CLinearTimeAbsolute ltaNow;
+        ltaNow.GetUTC();
+        ltd += ltaNow - prof_ltaStarted;
+    }
+    return ltd;
+}
+
+// prof_label: Name a key as <kind>:#<object>[/<attribute>].
+//
+static const char *prof_kind_names[PROF_KINDS] = { "q", "u", "$", "^" };
+
+static void prof_label(UINT64 key, char *buff, char **bufc)
+{
+    int iKind = static_cast<int>(key & 3);
+    int attr = static_cast<int>((key >> 2) & 0x3FFFFFFF);
+    dbref thing = static_cast<dbref>(static_cast<UINT32>(key >> 32));
+
+    safe_str(prof_kind_names[iKind], buff, bufc);
+    safe_chr(':', buff, bufc);
+    safe_chr('#', buff, bufc);
+    safe_ltoa(thing, buff, bufc);
+    if (0 != attr)
+    {
+        safe_chr('/', buff, bufc);
+        ATTR *ap = atr_num(attr);
+        if (ap)
+        {
+            safe_str(ap->name, buff, bufc);
+        }
+        else
+        {
+            safe_ltoa(attr, buff, bufc);
+        }
+    }
+}
+
+// prof_ms: Format a time in 100ns units as milliseconds.
+//
+static void prof_ms(INT64 t, char *buff)
+{
+    INT64 tMicroseconds = t / 10;
+    size_t n = mux_i64toa(tMicroseconds / 1000, buff);
+    int iFraction = static_cast<int>(tMicroseconds % 1000);
+    buff[n++] = '.';
+    buff[n++] = static_cast<char>('0' + iFraction / 100);
+    buff[n++] = static_cast<char>('0' + (iFraction / 10) % 10);
+    buff[n++] = static_cast<char>('0' + iFraction % 10);
+    buff[n] = '\0';
+}
+
+typedef std::pair<UINT64, PROF_STAT *> PROF_ROW;
+
+static bool prof_by_exclusive(const PROF_ROW &a, const PROF_ROW &b)
+{
+    return a.second->tExclusive > b.second->tExclusive;
+}
+
+static bool prof_by_inclusive(const PROF_ROW &a, const PROF_ROW &b)
+{
+    return a.second->tInclusive > b.second->tInclusive;
+}
+
+static void prof_table(dbref executor, std::vector<PROF_ROW> &rows, size_t nTop, const char *pHeader)
+{
+    notify(executor, pHeader);
+    notify(executor, "     Calls    Incl(ms)    Excl(ms)  Code");
+
+    char *buff = alloc_lbuf("prof_table");
+    for (size_t i = 0; i < rows.size() && i < nTop; i++)
+    {
+        PROF_STAT *pStat = rows[i].second;
+        char aCalls[22];
+        char aIncl[26];
+        char aExcl[26];
+        mux_i64toa(pStat->nCalls, aCalls);
+        prof_ms(pStat->tInclusive, aIncl);
+        prof_ms(pStat->tExclusive, aExcl);
+
+        char *bufc = buff;
+        safe_tprintf_str(buff, &bufc, "%10s %11s %11s  ", aCalls, aIncl, aExcl);
+        prof_label(rows[i].first, buff, &bufc);
+        *bufc = '\0';
+        notify(executor, buff);
+    }
+    free_lbuf(buff);
+}
+
+static void prof_report(dbref executor, size_t nTop)
+{
+    std::vector<PROF_ROW> rows;
+    rows.reserve(prof_stats.size());
+    PROF_STAT_MAP::iterator it;
+    for (it = prof_stats.begin(); it != prof_stats.end(); ++it)
+    {
+        rows.push_back(PROF_ROW(it->first, &it->second));
+    }
+
+    notify(executor, tprintf("Profiling is %s. %ld seconds profiled, %d entries.",
+        prof_bActive ? "on" : "off", prof_profiled().ReturnSeconds(),
+        static_cast<int>(rows.size())));
+    if (rows.empty())
+    {
+        return;
+    }
+
+    std::sort(rows.begin(), rows.end(), prof_by_exclusive);
+    prof_table(executor, rows, nTop, "----- By exclusive time -----");
+    std::sort(rows.begin(), rows.end(), prof_by_inclusive);
+    prof_table(executor, rows, nTop, "----- By inclusive time -----");
+}
+
+// prof_fold: Write one line per call stack: the frames from the outermost
+// in, separated by semicolons, then the exclusive time in microseconds.
+//
+static int prof_fold(FILE *fp, PROF_NODE *pNode, std::string &path)
+{
+    int nStacks = 0;
+    PROF_NODE_MAP::iterator it;
+    for (it = pNode->children.begin(); it != pNode->children.end(); ++it)
+    {
+        PROF_NODE *pChild = it->second;
+        size_t nPath = path.size();
+
+        char *buff = alloc_lbuf("prof_fold");
+        char *bufc = buff;
+        prof_label(pChild->key, buff, &bufc);
+        *bufc = '\0';
+        if (0 != nPath)
+        {
+            path += ';';
+        }
+        path += buff;
+        free_lbuf(buff);
+
+        INT64 tMicroseconds = pChild->tExclusive / 10;
+        if (0 < tMicroseconds)
+        {
+            char aTime[22];
+            mux_i64toa(tMicroseconds, aTime);
+            fprintf(fp, "%s %s\n", path.c_str(), aTime);
+            nStacks++;
+        }
+        nStacks += prof_fold(fp, pChild, path);
+        path.resize(nPath);
+    }
+    return nStacks;
+}
+
+static void prof_export(dbref executor)
+{
+    FILE *fp;
+    if (!mux_fopen(&fp, mudconf.profile_file, "wb"))
+    {
+        notify(executor, tprintf("Cannot open %s.", mudconf.profile_file));
+        return;
+    }
+
+    std::string path;
+    int nStacks = prof_fold(fp, &prof_root, path);
+    fclose(fp);
+    notify(executor, tprintf("Wrote %d stacks to %s.", nStacks, mudconf.profile_file));
+}
+
+// ---------------------------------------------------------------------------
+// do_profile: Turn the profiler on or off, reset it, or report on it.
+//
+void do_profile(dbref executor, dbref caller, dbref enactor, int eval, int key, char *arg)
+{
+    UNUSED_PARAMETER(caller);
+    UNUSED_PARAMETER(enactor);
+    UNUSED_PARAMETER(eval);
+
+    switch (key)
+    {
+    case PROFILE_START:
+        if (!prof_bActive)
+        {
+            prof_bActive = true;
+            prof_ltaStarted.GetUTC();
+        }
+        notify(executor, "Profiling started.");
+        break;
+
+    case PROFILE_STOP:
+        if (prof_bActive)
+        {
+            prof_ltdProfiled = prof_profiled();
+            prof_bActive = false;
+        }
+        notify(executor, "Profiling stopped.");
+        break;
+
+    case PROFILE_RESET:
+        prof_reset();
+        notify(executor, "Profile reset.");
+        break;
+
+    case PROFILE_EXPORT:
+        prof_export(executor);
+        break;
+
+    default:
+        {
+            int nTop = 20;
+            if (  arg
+               && '\0' != arg[0])
+            {
+                nTop = mux_atol(arg);
+                if (nTop <= 0)
+                {
+                    notify(executor, "The number of entries must be positive.");
+                    return;
+                }
+            }
+            prof_report(executor, static_cast<size_t>(nTop));
+        }
+        break;
+    }
+}
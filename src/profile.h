@@ -0,0 +1,62 @@
+// profile.h -- Softcode profiler.
+//
+// While @profile is on, the time spent running queue entries, u() and
+// ulocal() calls, $-command bodies, and ^-listen bodies is charged to the
+// object and attribute which held the code.  Inclusive time covers
+// everything the code did.  Exclusive time leaves out the time charged to
+// the calls it made.
+//
+// Each piece of code being timed has a PROF_FRAME on the C stack.  Frames
+// are entered only while profiling is on, but a frame that was entered is
+// always left, even if profiling is turned off or reset in between.
+//
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#define PROF_QUEUE   0  // Queue entry
+#define PROF_UFUN    1  // u() or ulocal()
+#define PROF_COMMAND 2  // $-command
+#define PROF_LISTEN  3  // ^-listen
+#define PROF_KINDS   4
+
+struct prof_node;
+
+typedef struct prof_frame
+{
+    struct prof_frame *pParent;
+    struct prof_node  *pNode;       // NULL if the frame was not entered.
+    unsigned int nGeneration;       // Profile this frame was entered into.
+    INT64        tStart;
+    INT64        tChildren;         // Time charged to nested frames.
+} PROF_FRAME;
+
+extern bool prof_bActive;
+extern void prof_enter(PROF_FRAME *pFrame, int iKind, dbref thing, int attr);
+extern void prof_leave(PROF_FRAME *pFrame);
+
+// Queue entries remember where their code came from.  prof_origin() labels
+// the next entry given to wait_que(), which takes the label back with
+// prof_take_origin().
+//
+extern void prof_origin(int iKind, dbref thing, int attr);
+extern void prof_take_origin(int *piKind, dbref *pthing, int *pattr);
+
+DCL_INLINE void prof_begin(PROF_FRAME *pFrame, int iKind, dbref thing, int attr)
+{
+    pFrame->pNode = NULL;
+    if (prof_bActive)
+    {
+        prof_enter(pFrame, iKind, thing, attr);
+    }
+}
+
+DCL_INLINE void prof_end(PROF_FRAME *pFrame)
+{
+    if (NULL != pFrame->pNode)
+    {
+        prof_leave(pFrame);
+    }
+}
+
+#endif // !PROFILE_H
@@ -0,0 +1,964 @@
+// selftest.cpp -- Benchmarks and self-checks run inside the server.
+//
+// @selftest/<switch> runs one of them against the code the game itself is
+// running and reports to the executor, so the same measurement can be
+// repeated on any build.  The server does nothing else while one runs.
+//
+
+#include "copyright.h"
+#include "autoconf.h"
+#include "config.h"
+#include "externs.h"
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include "command.h"
+#include "functions.h"
+#include "OutputParser.h"
+#include "PerMessageDeflate.h"
+#include "Websockets.h"
+
+// Time in 100ns ticks.
+//
+static INT64 selftest_now(void)
+{
+    CLinearTimeAbsolute lta;
+    lta.GetUTC();
+    return lta.Return100ns();
+}
+
+// Report how long nIterations of something took, and the rate at which it
+// got through nBytes per iteration.
+//
+static void selftest_report(dbref executor, const char *pName,
+    int nIterations, size_t nBytes, INT64 tElapsed)
+{
+    if (tElapsed <= 0)
+    {
+        tElapsed = 1;
+    }
+    double mb = static_cast<double>(nBytes) * nIterations / 1.0e6;
+    double sec = static_cast<double>(tElapsed) / 1.0e7;
+    notify(executor, tprintf("%-24s %8d x %7u bytes  %8.3f sec  %8.1f MB/s",
+        pName, nIterations, static_cast<unsigned int>(nBytes), sec, mb / sec));
+}
+
+// The websocket output translation as it was before OutputParser made one
+// pass: text is gathered a byte at a time in a std::list<char>, escaped and
+// widened to UTF-8 by insert passes over the list, and copied into a heap
+// vector for each frame.  It is kept only as the baseline for
+// @selftest/websocket.
+//
+class SelftestOldOutputParser
+{
+private:
+    enum { NORMAL_DATA, IAC_START, IAC_CONT1, IAC_NEGOTIATE, ESC_SEQ } m_state;
+    std::list<char> m_data;
+    websocket::FrameWriter &m_writer;
+
+    void sendString(void)
+    {
+        std::list<char>::iterator it = m_data.begin();
+        while (it != m_data.end())
+        {
+            const char *p = NULL;
+            switch (*it)
+            {
+            case '&':  p = "&amp;";  break;
+            case '"':  p = "&quot;"; break;
+            case '\'': p = "&apos;"; break;
+            case '<':  p = "&lt;";   break;
+            case '>':  p = "&gt;";   break;
+            }
+            if (p)
+            {
+                m_data.insert(it, p, p + strlen(p));
+                it = m_data.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        for (it = m_data.begin(); it != m_data.end(); ++it)
+        {
+            unsigned char ch = static_cast<unsigned char>(*it);
+            if (ch & 0x80)
+            {
+                *it = static_cast<char>(0xC0 + (ch >> 6));
+                ++it;
+                it = m_data.insert(it, static_cast<char>(0x80 + (ch & 0x3F)));
+            }
+        }
+        std::vector<uint8_t> *pBytes = new std::vector<uint8_t>(m_data.begin(), m_data.end());
+        sendWSText(m_writer, reinterpret_cast<char *>(&(*pBytes)[0]),
+            static_cast<uint32_t>(pBytes->size()));
+        delete pBytes;
+        m_data.clear();
+    }
+
+    void sendModeChange(void)
+    {
+        const std::vector<uint8_t> copy(m_data.begin(), m_data.end());
+        const size_t n = copy.size();
+        if (3 <= n && '[' == copy[0] && 'm' == copy[n-1])
+        {
+            uint8_t code = static_cast<uint8_t>(copy[1] - '0');
+            if (4 <= n)
+            {
+                code = static_cast<uint8_t>(code * 10 + copy[2] - '0');
+            }
+            std::vector<uint8_t> *pBytes = new std::vector<uint8_t>(1, code);
+            sendWSData(m_writer, &(*pBytes)[0], 1);
+            delete pBytes;
+        }
+        m_data.clear();
+    }
+
+public:
+    SelftestOldOutputParser(websocket::FrameWriter &writer)
+        : m_state(NORMAL_DATA), m_data(), m_writer(writer)
+    {
+    }
+
+    void parseAndSend(const char *pText, size_t nText)
+    {
+        for (size_t i = 0; i < nText; i++)
+        {
+            uint8_t ch = static_cast<uint8_t>(pText[i]);
+            switch (m_state)
+            {
+            case NORMAL_DATA:
+                if (255 == ch || 27 == ch)
+                {
+                    if (!m_data.empty())
+                    {
+                        sendString();
+                    }
+                    m_state = (255 == ch) ? IAC_START : ESC_SEQ;
+                }
+                else
+                {
+                    m_data.push_back(static_cast<char>(ch));
+                }
+                break;
+
+            case IAC_START:
+                if (255 == ch)
+                {
+                    m_data.push_back(static_cast<char>(ch));
+                    m_state = NORMAL_DATA;
+                }
+                else if (250 == ch)
+                {
+                    m_state = IAC_NEGOTIATE;
+                }
+                else if (251 <= ch && ch <= 254)
+                {
+                    m_state = IAC_CONT1;
+                }
+                else
+                {
+                    m_state = NORMAL_DATA;
+                }
+                break;
+
+            case IAC_CONT1:
+                m_state = NORMAL_DATA;
+                break;
+
+            case IAC_NEGOTIATE:
+                if (255 == ch)
+                {
+                    m_state = IAC_START;
+                }
+                break;
+
+            case ESC_SEQ:
+                m_data.push_back(static_cast<char>(ch));
+                if ('m' == ch)
+                {
+                    sendModeChange();
+                    m_state = NORMAL_DATA;
+                }
+                break;
+            }
+        }
+        if (!m_data.empty() && NORMAL_DATA == m_state)
+        {
+            sendString();
+        }
+    }
+};
+
+// Websocket output: game output for twenty colored WHO lines with Latin-1
+// text, translated into frames the way a websocket descriptor does it, and
+// once more by the old parser.  The text has nothing the two translate
+// differently, so their frames must match.
+//
+static void selftest_websocket(dbref executor)
+{
+    std::string sLines;
+    for (int i = 0; i < 20; i++)
+    {
+        sLines += "\x1b[1m\x1b[32mPlayer";
+        sLines += static_cast<char>('A' + i);
+        sLines += "\x1b[0m   12m  3s  Doing something interesting here,"
+                  " with Latin-1 caf\xe9.\r\n";
+    }
+
+    const int nIterations = 100000;
+    websocket::FrameWriter writer;
+    websocket::OutputParser parser(writer);
+    size_t nOut = 0;
+    INT64 tStart = selftest_now();
+    for (int i = 0; i < nIterations; i++)
+    {
+        writer.clear();
+        parser.parseAndSend(sLines.data(), sLines.size());
+        nOut += writer.size();
+    }
+    INT64 tElapsed = selftest_now() - tStart;
+    std::vector<uint8_t> frames(writer.data(), writer.data() + writer.size());
+
+    const int nOldIterations = nIterations / 10;
+    websocket::FrameWriter oldWriter;
+    SelftestOldOutputParser oldParser(oldWriter);
+    tStart = selftest_now();
+    for (int i = 0; i < nOldIterations; i++)
+    {
+        oldWriter.clear();
+        oldParser.parseAndSend(sLines.data(), sLines.size());
+    }
+    INT64 tOldElapsed = selftest_now() - tStart;
+
+    selftest_report(executor, "Websocket output", nIterations, sLines.size(),
+        tElapsed);
+    selftest_report(executor, "Websocket output (old)", nOldIterations,
+        sLines.size(), tOldElapsed);
+    notify(executor, tprintf("%u bytes of frames per iteration.",
+        static_cast<unsigned int>(nOut / nIterations)));
+    if (  oldWriter.size() != frames.size()
+       || (  0 < frames.size()
+          && memcmp(oldWriter.data(), &frames[0], frames.size()) != 0))
+    {
+        notify(executor, "The two parsers sent different frames.");
+    }
+}
+
+#ifdef HAVE_ZLIB_H
+// The most a compressed message may inflate to, as the websocket reader
+// allows it.
+//
+static const size_t SELFTEST_INFLATE_LIMIT = 65536;
+
+// Inflate one compressed message, fed in pieces of nPiece bytes the way
+// frames of it might arrive.
+//
+static websocket::MessageInflater::Result selftest_inflate(
+    websocket::MessageInflater &inflater, const std::vector<uint8_t> &In,
+    size_t nPiece, std::vector<uint8_t> &Out, bool bKeep)
+{
+    Out.clear();
+    websocket::MessageInflater::Result r = websocket::MessageInflater::OK;
+    for (size_t i = 0; i < In.size() && websocket::MessageInflater::OK == r; i += nPiece)
+    {
+        size_t n = In.size() - i;
+        if (nPiece < n)
+        {
+            n = nPiece;
+        }
+        r = inflater.inflate(&In[i], n, Out, bKeep, SELFTEST_INFLATE_LIMIT);
+    }
+    if (websocket::MessageInflater::OK == r)
+    {
+        r = inflater.endMessage(Out, bKeep, SELFTEST_INFLATE_LIMIT);
+    }
+    return r;
+}
+
+static void selftest_deflate_check(dbref executor, const char *pName,
+    bool bPass, int *pnChecks, int *pnFailed)
+{
+    (*pnChecks)++;
+    if (!bPass)
+    {
+        (*pnFailed)++;
+        notify(executor, tprintf("Failed: %s.", pName));
+    }
+}
+
+// Compressed websocket input: good messages whole and in pieces, messages
+// at and just past the limit, a small message that inflates to 16MB, and
+// payloads that are not deflate data.  Then the time to inflate a message
+// just under the limit.
+//
+static void selftest_deflate(dbref executor)
+{
+    typedef websocket::MessageInflater MI;
+    int nChecks = 0;
+    int nFailed = 0;
+
+    std::string sText;
+    while (sText.size() < 60000)
+    {
+        sText += "Player";
+        sText += static_cast<char>('A' + sText.size() % 26);
+        sText += "   12m  3s  Doing something interesting here, with Latin-1"
+                 " caf\xe9.\r\n";
+    }
+    const uint8_t *pText = reinterpret_cast<const uint8_t *>(sText.data());
+
+    websocket::DeflateParams params;
+    params.enabled = true;
+    std::vector<uint8_t> z;
+    std::vector<uint8_t> out;
+    {
+        // The second message refers back to the first.
+        //
+        websocket::MessageDeflater deflater(params);
+        MI inflater;
+        deflater.compress(pText, sText.size(), z);
+        MI::Result r = selftest_inflate(inflater, z, z.size(), out, true);
+        selftest_deflate_check(executor, "60KB text message",
+            MI::OK == r && std::string(out.begin(), out.end()) == sText,
+            &nChecks, &nFailed);
+
+        deflater.compress(pText, sText.size(), z);
+        r = selftest_inflate(inflater, z, 7, out, true);
+        selftest_deflate_check(executor, "60KB text message again, in 7-byte pieces",
+            MI::OK == r && std::string(out.begin(), out.end()) == sText,
+            &nChecks, &nFailed);
+    }
+
+    std::vector<uint8_t> big(SELFTEST_INFLATE_LIMIT + 1, 'a');
+    for (int iPast = 0; iPast < 2; iPast++)
+    {
+        websocket::MessageDeflater deflater(params);
+        MI inflater;
+        deflater.compress(&big[0], SELFTEST_INFLATE_LIMIT + iPast, z);
+        MI::Result r = selftest_inflate(inflater, z, z.size(), out, true);
+        if (0 == iPast)
+        {
+            selftest_deflate_check(executor, "Message of exactly the limit",
+                MI::OK == r && SELFTEST_INFLATE_LIMIT == out.size(),
+                &nChecks, &nFailed);
+        }
+        else
+        {
+            selftest_deflate_check(executor, "Message one byte past the limit",
+                MI::TOO_BIG == r, &nChecks, &nFailed);
+        }
+    }
+
+    // Binary messages are inflated without being kept, and must stop at the
+    // limit all the same.
+    //
+    big.assign(16*1024*1024, 0);
+    for (int iKeep = 0; iKeep < 2; iKeep++)
+    {
+        websocket::MessageDeflater deflater(params);
+        MI inflater;
+        deflater.compress(&big[0], big.size(), z);
+        INT64 tStart = selftest_now();
+        MI::Result r = selftest_inflate(inflater, z, z.size(), out, 0 != iKeep);
+        INT64 tElapsed = selftest_now() - tStart;
+        selftest_deflate_check(executor,
+            iKeep ? "16MB text message" : "16MB binary message",
+            MI::TOO_BIG == r && out.size() <= SELFTEST_INFLATE_LIMIT,
+            &nChecks, &nFailed);
+        notify(executor, tprintf("%u bytes inflating to 16MB stopped after %.3f ms.",
+            static_cast<unsigned int>(z.size()),
+            static_cast<double>(tElapsed) / 1.0e4));
+    }
+    std::vector<uint8_t>().swap(big);
+
+    // A final block of the reserved type 3, and a stored block whose length
+    // does not match its complement.
+    //
+    static const uint8_t aBadType[] = { 0xFF, 0xFF, 0xFF, 0xFF };
+    static const uint8_t aBadStored[] = { 0x00, 0x05, 0x00, 0x00, 0x00, 'h', 'e', 'l', 'l', 'o' };
+    {
+        MI inflater;
+        z.assign(aBadType, aBadType + sizeof(aBadType));
+        selftest_deflate_check(executor, "Reserved block type",
+            MI::BAD_DATA == selftest_inflate(inflater, z, z.size(), out, true),
+            &nChecks, &nFailed);
+    }
+    {
+        MI inflater;
+        z.assign(aBadStored, aBadStored + sizeof(aBadStored));
+        selftest_deflate_check(executor, "Stored block with a bad length",
+            MI::BAD_DATA == selftest_inflate(inflater, z, 3, out, true),
+            &nChecks, &nFailed);
+    }
+
+    notify(executor, tprintf("%d checks, %d failed.", nChecks, nFailed));
+
+    // Every message compressed on its own, so one inflater takes them all.
+    //
+    params.serverNoContextTakeover = true;
+    websocket::MessageDeflater deflater(params);
+    deflater.compress(pText, sText.size(), z);
+    MI inflater;
+    const int nIterations = 2000;
+    INT64 tStart = selftest_now();
+    int nGood = 0;
+    for (int i = 0; i < nIterations; i++)
+    {
+        if (  MI::OK == selftest_inflate(inflater, z, z.size(), out, true)
+           && out.size() == sText.size())
+        {
+            nGood++;
+        }
+    }
+    INT64 tElapsed = selftest_now() - tStart;
+    selftest_report(executor, "Websocket inflate", nIterations, sText.size(),
+        tElapsed);
+    if (nGood != nIterations)
+    {
+        notify(executor, tprintf("Only %d of the %d messages inflated.", nGood,
+            nIterations));
+    }
+}
+#endif // HAVE_ZLIB_H
+
+// Telnet input: a client pasting 2000 lines of decompiled softcode, decoded
+// by nvt_decode_normal() as process_input_helper() does it, and once more a
+// byte at a time through the state tables as the decoder used to.  Line
+// ends are left to the caller, and here they only start a new line.
+//
+static void selftest_telnet(dbref executor)
+{
+    std::string sInput;
+    for (int i = 0; i < 2000; i++)
+    {
+        sInput += tprintf("&CMD_FOO_%d #1234=$+foo *:@pemit %%#="
+            "[u(me/fn_format,%%0,[get(%%#/name)],"
+            "lmath(add,iter(%%0,strlen(##))))]\r\n", i);
+    }
+    unsigned char *pLine =
+        reinterpret_cast<unsigned char *>(alloc_lbuf("selftest_telnet"));
+    const unsigned char *pIn =
+        reinterpret_cast<const unsigned char *>(sInput.data());
+    const size_t nIn = sInput.size();
+
+    const int nIterations = 200;
+    static const char *aNames[2] =
+    {
+        "Telnet input, per byte",
+        "Telnet input, runs"
+    };
+    size_t aAccepted[2];
+    for (int j = 0; j < 2; j++)
+    {
+        size_t nLines = 0;
+        aAccepted[j] = 0;
+        INT64 tStart = selftest_now();
+        for (int i = 0; i < nIterations; i++)
+        {
+            size_t k = 0;
+            while (k < nIn)
+            {
+                size_t nOut;
+                size_t nLost;
+                k += nvt_decode_normal(pIn + k, nIn - k, pLine,
+                    LBUF_SIZE - 1, &nOut, &nLost, 1 == j);
+                aAccepted[j] += nOut;
+                if (k < nIn)
+                {
+                    if ('\n' == pIn[k])
+                    {
+                        nLines++;
+                    }
+                    k++;
+                }
+            }
+        }
+        INT64 tElapsed = selftest_now() - tStart;
+        selftest_report(executor, aNames[j], nIterations, nIn, tElapsed);
+        if (nLines != 2000 * static_cast<size_t>(nIterations))
+        {
+            notify(executor, tprintf("%u lines decoded, expected %u.",
+                static_cast<unsigned int>(nLines), 2000 * nIterations));
+        }
+    }
+    if (aAccepted[0] != aAccepted[1])
+    {
+        notify(executor, "The two decoders accepted different text.");
+    }
+    free_lbuf(pLine);
+}
+
+// Scheduler: 100000 long waits spread over two hours on a scheduler of our
+// own, then 20000 of them cancelled one at a time as disconnects and
+// @halts do, then the rest run.
+//
+static int nSchedulerRan;
+
+static void selftest_task(void *arg_voidptr, int arg_Integer)
+{
+    UNUSED_PARAMETER(arg_voidptr);
+    UNUSED_PARAMETER(arg_Integer);
+    nSchedulerRan++;
+}
+
+static void selftest_scheduler(dbref executor)
+{
+    const int nTasks = 100000;
+    const int nCancels = 20000;
+    char *aObjects = new char[nTasks];
+    CScheduler *pScheduler = new CScheduler;
+
+    CLinearTimeAbsolute ltaNow;
+    ltaNow.GetUTC();
+
+    INT64 tStart = selftest_now();
+    for (int i = 0; i < nTasks; i++)
+    {
+        CLinearTimeDelta ltd;
+        ltd.SetSeconds(i % 7000 + 100);
+        pScheduler->DeferTask(ltaNow + ltd, PRIORITY_OBJECT, selftest_task,
+            aObjects + i, i & 3);
+    }
+    INT64 tDefer = selftest_now() - tStart;
+
+    tStart = selftest_now();
+    for (int i = 0; i < nCancels; i++)
+    {
+        int k = (i * 7919) % nTasks;
+        pScheduler->CancelTask(selftest_task, aObjects + k, k & 3);
+    }
+    INT64 tCancel = selftest_now() - tStart;
+
+    CLinearTimeDelta ltdLater;
+    ltdLater.SetSeconds(7200);
+    nSchedulerRan = 0;
+    tStart = selftest_now();
+    pScheduler->ReadyTasks(ltaNow + ltdLater + ltdLater);
+    pScheduler->RunAllTasks();
+    INT64 tRun = selftest_now() - tStart;
+
+    notify(executor, tprintf("Defer %d tasks: %.1f ms", nTasks,
+        tDefer / 1.0e4));
+    notify(executor, tprintf("Cancel %d tasks: %.1f ms, %.2f us each",
+        nCancels, tCancel / 1.0e4, tCancel / (10.0 * nCancels)));
+    notify(executor, tprintf("Run %d tasks: %.1f ms", nSchedulerRan,
+        tRun / 1.0e4));
+
+    delete pScheduler;
+    delete [] aObjects;
+}
+
+// Parse cache: each body below is stored in SELFTEST_T on the executor and
+// called through u(), ulocal(), map(), fold(), filter(), foreach() and an
+// @function.  Every call is evaluated with parse_cache off and then with it
+// on three times: with whatever the cache held for the previous body, warm,
+// and cold.  All four must agree, with and without space_compress.
+//
+// The bodies cover nesting, unbalanced brackets, escapes, %-codes, long
+// function names and results near LBUF_SIZE.  The helper attributes are
+// left on the executor, and @functions selftest_t and selftest_fnx stay
+// defined until restart.
+//
+static const char *aParseBodies[] =
+{
+    "plain text",
+    "  leading and   internal   spaces  ",
+    "%0 and %1 and %2",
+    "[add(%0,%1)]",
+    "add(%0,%1)",
+    "ADD(%0,%1)",
+    "add(%0,%1) trailing(paren) words",
+    "[add(1,2)][mul(3,4)] mid [sub(9,1)]",
+    "[add(mul(%0,%0),sub(%1,1))]",
+    "[foo(1,2)]",
+    "foo(1,2) and more",
+    "[%0(5,6)]",
+    "%0(5,6)",
+    "[ add(1,2)]",
+    "[add (1,2)]",
+    "add (1,2)",
+    " add(1,2)",
+    "[add(1,2)",
+    "add(1,2",
+    "[[[[[add(1,2)",
+    "{abc}",
+    "{ abc def}",
+    "{[add(1,2)]} x",
+    "{abc",
+    "[switch(%0,1,{one [add(1,1)]},3,{three},{other %0})]",
+    "[if(gt(%0,2),big [mul(%0,10)],small)]",
+    "[iter(lnum(%0),[add(##,1)],,-)]",
+    "[setq(0,hello)][setq(a,aa)]%q0-%qa-%q-%qz-%q",
+    "%q",
+    "%v",
+    "%va-%vb",
+    "%=<DESC>|%=<SELFTEST_T>|%=<nosuch>|%=|%=x",
+    "%=<unterminated",
+    "%xrred%xn %xz %cgx%cn %x",
+    "%n %N %s %S %p %P %o %O %a %A",
+    "%#%!%@%l%L",
+    "a%rb%tc%bd%%e",
+    "%|%m",
+    "trailing%",
+    "esc\\[add(1,2)\\]\\%0\\",
+    "[ulocal(me/SELFTEST_AUX,%0)] %q0",
+    "[u(me/SELFTEST_AUX,%0)] %q0",
+    "[u(me/SELFTEST_T2,%0)]",
+    "[lit(%0 [add(1,2)])]",
+    "[s(\\%0 [add(1,2)])]",
+    "[repeat(ab,3990)][add(1,2)] tail",
+    "[repeat(ab,4010)][add(1,2)] tail",
+    "[add()][add(1)][mid(abc)][mid(a,b,c,d)]",
+    "[strlen(a,b)][words(a b c,)]",
+    "[add(1,2))]",
+    "[add(1,2)]]",
+    "[add(1,[mul(2,3)])]",
+    "[add(1,{2})]",
+    "[first({a b},c)]",
+    "[rest(a b c)]x[first(a b c)]",
+    "[selftest_fnx(%0,%1)]",
+    "selftest_fnx(%0,%1)",
+    "[SELFTEST_FNX(1)]",
+    "[u(me/SELFTEST_REC,%0)]",
+    "[ucstr(left(abcdef,%0))] [lcstr(XYZ)]",
+    "[setr(0,%0)]%q0[inc(%q0)]",
+    "[ansi(r,red)] plain [ansi(hb,x)]",
+    "[space(5)]|[space(0)]|",
+    "[edit(abc,b,{[add(1,1)]})]",
+    "[default(me/NOSUCH,def %0)]",
+    "[get(me/SELFTEST_AUX)]",
+    "[v(SELFTEST_AUX)]",
+    "[%=<SELFTEST_AUX>]",
+    "[add(1,2)] [add(3,4)]",
+    "   [add(1,2)]   [add(3,4)]   ",
+    "[(1,2)]",
+    "(1,2)",
+    "[]",
+    "[",
+    "]",
+    "{}",
+    "{",
+    "}",
+    "%",
+    "\\",
+    "[if(lte(%0,1),1,mul(%0,u(me/SELFTEST_T,dec(%0))))]",
+    "[u(me/SELFTEST_T2,[u(me/SELFTEST_T2,%0)])] "
+        "[ulocal(me/SELFTEST_AUX,1)][ulocal(me/SELFTEST_AUX,2)]",
+    "[set(me,SELFTEST_T:changed %0)]after %0",
+    "[aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa(1)]",
+    "[aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa(1)]",
+    "[aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa(1)]",
+    "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa(1) x",
+    "[add(1,2,3,4,5,6,7,8,9,10,11,12)][cat(a,b,c,d)]",
+    "%0%1[add(%0,%1)]%0 %1 {%0} \\{ [lit(%0)]",
+    "[iter(a b c,[u(me/SELFTEST_T2,#@)])]",
+    "[map(me/SELFTEST_T2,1 2 3)] [filter(me/SELFTEST_FNX,1 2)]",
+    "%x%xh%xR%cR%c%x<red>x%xn",
+    "%=<SELFTEST_T2>%=<SELFTEST_AUX>",
+    "[setq(0,add)][%q0(1,2)] %q0(1,2)",
+    "add(1,2)(3,4)",
+    "[add(1,2)(3,4)]",
+    "{a}{b}[add(1,2)]{c}",
+};
+
+static const char *aParseHelpers[][2] =
+{
+    { "SELFTEST_AUX", "[setq(0,aux%0)]aux" },
+    { "SELFTEST_T2",  "[add(%0,1)] %0" },
+    { "SELFTEST_REC", "[u(me/SELFTEST_REC,%0)]" },
+    { "SELFTEST_FNX", "[add(%0,1)]<%1>" },
+};
+
+static const char *aParseCalls[] =
+{
+    "<[u(me/SELFTEST_T,3,4)]>",
+    "<[u(me/SELFTEST_T,add,ab)]>",
+    "<[map(me/SELFTEST_T,1 2)]>",
+    "<[ulocal(me/SELFTEST_T,2,x)]>",
+    "<[selftest_t(3,4)]>",
+    "<[fold(me/SELFTEST_T,1 2 3)]>",
+    "<[filter(me/SELFTEST_T,1 2 3)]>",
+    "<[foreach(me/SELFTEST_T,ab)]>",
+};
+
+// Evaluate one call the way think does, starting from a freshly stored body
+// and empty registers each time, since some bodies change both.
+//
+static void selftest_parse_eval(dbref executor, int atr, const char *pBody,
+    const char *pCall, char *buff)
+{
+    atr_add_raw(executor, atr, pBody);
+
+    reg_ref **preserve = PushRegisters(MAX_GLOBAL_REGS);
+    save_and_clear_global_regs(preserve);
+    mudstate.func_nest_lev = 0;
+    mudstate.func_invk_ctr = 0;
+
+    char *call = alloc_lbuf("selftest_parse_eval");
+    strcpy(call, pCall);
+    char *str = call;
+    char *bufc = buff;
+    mux_exec(buff, &bufc, executor, executor, executor,
+        EV_FCHECK|EV_EVAL|EV_TOP, &str, NULL, 0);
+    *bufc = '\0';
+    free_lbuf(call);
+
+    restore_global_regs(preserve);
+    PopRegisters(preserve, MAX_GLOBAL_REGS);
+}
+
+// Remove the helper attributes and any @functions the test defined, so that
+// nothing it made outlives the run.
+//
+static void selftest_parse_cleanup(dbref executor)
+{
+    remove_user_func("selftest_t");
+    remove_user_func("selftest_fnx");
+
+    for (size_t i = 0; i < sizeof(aParseHelpers)/sizeof(aParseHelpers[0]); i++)
+    {
+        ATTR *pattr = atr_str(aParseHelpers[i][0]);
+        if (pattr)
+        {
+            atr_clr(executor, pattr->number);
+        }
+    }
+    ATTR *pattr = atr_str("SELFTEST_T");
+    if (pattr)
+    {
+        atr_clr(executor, pattr->number);
+    }
+}
+
+static void selftest_parse(dbref executor)
+{
+    // The test defines these @functions itself and removes them afterwards,
+    // so it must not take over ones someone else defined.
+    //
+    if (  NULL != hashfindLEN("selftest_t", 10, &mudstate.ufunc_htab)
+       || NULL != hashfindLEN("selftest_fnx", 12, &mudstate.ufunc_htab))
+    {
+        notify(executor, "The @functions selftest_t and selftest_fnx must not be defined.");
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(aParseHelpers)/sizeof(aParseHelpers[0]); i++)
+    {
+        int atr = mkattr(executor, aParseHelpers[i][0]);
+        if (atr <= 0)
+        {
+            notify(executor, "Cannot make the helper attributes.");
+            selftest_parse_cleanup(executor);
+            return;
+        }
+        atr_add_raw(executor, atr, aParseHelpers[i][1]);
+    }
+    int atrBody = mkattr(executor, "SELFTEST_T");
+    if (atrBody <= 0)
+    {
+        notify(executor, "Cannot make the helper attributes.");
+        selftest_parse_cleanup(executor);
+        return;
+    }
+    atr_add_raw(executor, atrBody, "");
+
+    char *fname = alloc_sbuf("selftest_parse");
+    char *target = alloc_lbuf("selftest_parse");
+    strcpy(fname, "selftest_t");
+    strcpy(target, "me/SELFTEST_T");
+    do_function(executor, executor, executor, 0, 2, fname, target);
+    strcpy(fname, "selftest_fnx");
+    strcpy(target, "me/SELFTEST_FNX");
+    do_function(executor, executor, executor, 0, 2, fname, target);
+    free_lbuf(target);
+    free_sbuf(fname);
+
+    static const char *aModes[3] = { "after rewrite", "warm", "cold" };
+    const int nBodies = sizeof(aParseBodies)/sizeof(aParseBodies[0]);
+    const int nCalls = sizeof(aParseCalls)/sizeof(aParseCalls[0]);
+    char *aExpected[sizeof(aParseCalls)/sizeof(aParseCalls[0])];
+    for (int j = 0; j < nCalls; j++)
+    {
+        aExpected[j] = alloc_lbuf("selftest_parse");
+    }
+    char *result = alloc_lbuf("selftest_parse");
+
+    bool bSaveCache = mudconf.parse_cache;
+    bool bSaveCompress = mudconf.space_compress;
+    int nEvals = 0;
+    int nMismatches = 0;
+    for (int iCompress = 0; iCompress < 2; iCompress++)
+    {
+        mudconf.space_compress = (0 == iCompress);
+        for (int i = 0; i < nBodies; i++)
+        {
+            mudconf.parse_cache = false;
+            for (int j = 0; j < nCalls; j++)
+            {
+                selftest_parse_eval(executor, atrBody, aParseBodies[i],
+                    aParseCalls[j], aExpected[j]);
+            }
+
+            // The first pass finds entries left by the previous body, which
+            // must be noticed as stale from their text alone.
+            //
+            mudconf.parse_cache = true;
+            for (int k = 0; k < 3; k++)
+            {
+                if (2 == k)
+                {
+                    parse_cache_invalidate();
+                }
+                for (int j = 0; j < nCalls; j++)
+                {
+                    selftest_parse_eval(executor, atrBody, aParseBodies[i],
+                        aParseCalls[j], result);
+                    nEvals++;
+                    if (strcmp(aExpected[j], result) != 0)
+                    {
+                        nMismatches++;
+                        if (nMismatches <= 10)
+                        {
+                            notify(executor,
+                                tprintf("Body %d, %s, %s, space_compress %s:",
+                                i, aParseCalls[j], aModes[k],
+                                mudconf.space_compress ? "on" : "off"));
+                            notify(executor,
+                                tprintf("  uncached: %.1000s", aExpected[j]));
+                            notify(executor,
+                                tprintf("  cached:   %.1000s", result));
+                        }
+                    }
+                }
+            }
+        }
+    }
+    mudconf.parse_cache = bSaveCache;
+    mudconf.space_compress = bSaveCompress;
+    selftest_parse_cleanup(executor);
+    parse_cache_invalidate();
+
+    for (int j = 0; j < nCalls; j++)
+    {
+        free_lbuf(aExpected[j]);
+    }
+    free_lbuf(result);
+
+    notify(executor, tprintf("%d bodies, %d cached evaluations, %d mismatches.",
+        nBodies, nEvals, nMismatches));
+}
+
+// Function lookup: what mux_exec does with a name at each '(', once with a
+// lowercase copy probed in func_htab as it used to, and once through
+// function_find().  Names which are not builtins go on to ufunc_htab both
+// ways.
+//
+static void selftest_functions(dbref executor)
+{
+    static const char *aNames[] =
+    {
+        "add", "strlen", "iter", "u", "StrLen", "nosuchfunction"
+    };
+    const int nIterations = 2000000;
+    char *pLower = alloc_lbuf("selftest_functions");
+
+    for (size_t j = 0; j < sizeof(aNames)/sizeof(aNames[0]); j++)
+    {
+        const char *pName = aNames[j];
+        size_t nName = strlen(pName);
+        int nFound = 0;
+
+        INT64 tStart = selftest_now();
+        for (int i = 0; i < nIterations; i++)
+        {
+            for (size_t k = 0; k < nName; k++)
+            {
+                pLower[k] = mux_tolower(pName[k]);
+            }
+            pLower[nName] = '\0';
+            if (  hashfindLEN(pLower, nName, &mudstate.func_htab)
+               || hashfindLEN(pLower, nName, &mudstate.ufunc_htab))
+            {
+                nFound++;
+            }
+        }
+        INT64 tOld = selftest_now() - tStart;
+
+        tStart = selftest_now();
+        for (int i = 0; i < nIterations; i++)
+        {
+            if (function_find(pName, nName))
+            {
+                nFound++;
+                continue;
+            }
+            for (size_t k = 0; k < nName; k++)
+            {
+                pLower[k] = mux_tolower(pName[k]);
+            }
+            pLower[nName] = '\0';
+            if (hashfindLEN(pLower, nName, &mudstate.ufunc_htab))
+            {
+                nFound++;
+            }
+        }
+        INT64 tNew = selftest_now() - tStart;
+
+        notify(executor, tprintf("%-16s hashed %6.1f ns  indexed %6.1f ns%s",
+            pName, tOld * 100.0 / nIterations, tNew * 100.0 / nIterations,
+            nFound ? "" : "  (not found)"));
+    }
+    free_lbuf(pLower);
+    notify(executor, tprintf("%d lookups of each name, %u names in func_htab.",
+        nIterations, mudstate.func_htab.GetEntryCount()));
+}
+
+void do_selftest(dbref executor, dbref caller, dbref enactor, int eval,
+    int key, char *arg)
+{
+    UNUSED_PARAMETER(caller);
+    UNUSED_PARAMETER(enactor);
+    UNUSED_PARAMETER(eval);
+    UNUSED_PARAMETER(arg);
+
+    switch (key)
+    {
+    case SELFTEST_DEFLATE:
+#ifdef HAVE_ZLIB_H
+        selftest_deflate(executor);
+#else
+        notify(executor, "This server was built without zlib.");
+#endif // HAVE_ZLIB_H
+        break;
+
+    case SELFTEST_FUNCTIONS:
+        selftest_functions(executor);
+        break;
+
+    case SELFTEST_PARSE:
+        selftest_parse(executor);
+        break;
+
+    case SELFTEST_SCHEDULER:
+        selftest_scheduler(executor);
+        break;
+
+    case SELFTEST_TELNET:
+        selftest_telnet(executor);
+        break;
+
+    case SELFTEST_WEBSOCKET:
+        selftest_websocket(executor);
+        break;
+
+    default:
+        notify(executor,
+            "Usage: @selftest/deflate, /functions, /parse, /scheduler, /telnet,"
+            " or /websocket");
+        break;
+    }
+}
@@ -2,11 +2,10 @@
 //
 // $Id: slave.cpp 8 2006-09-05 01:55:58Z brazilofmux $
 //
-// The philosophy is to keep this program as simple/small as possible.  It
-// routinely performs non-vfork forks()s, so the conventional wisdom is that
-// the smaller it is, the faster it goes.  However, with modern memory
-// management support (including copy on reference paging), size is probably
-// not the issue it once was.
+// The philosophy is to keep this program as simple/small as possible.
+// Lookups are handed to a fixed pool of threads rather than a child process
+// each, so a burst of connections costs neither a burst of fork()s nor an
+// unbounded number of lookups at once. The game caches the answers.
 //
 #include "autoconf.h"
 #include "config.h"
@@ -17,6 +16,9 @@
 #include <sys/file.h>
 #include <sys/ioctl.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include "slave.h"
 #include <arpa/inet.h>
 
@@ -29,22 +31,14 @@
 pid_t parent_pid;
 
 #define MAX_STRING 1000
-char *arg_for_errors;
+#define SLAVE_THREADS 8
+#define MAX_QUEUED 64
+#define IDENT_TIMEOUT 30000 // milliseconds, to connect and to answer.
 
 #ifndef INADDR_NONE
 #define INADDR_NONE ((in_addr_t)-1)
 #endif
 
-char *format_inet_addr(char *dest, long addr)
-{
-    sprintf(dest, "%ld.%ld.%ld.%ld",
-        (addr & 0xFF000000) >> 24,
-        (addr & 0x00FF0000) >> 16,
-        (addr & 0x0000FF00) >> 8,
-        (addr & 0x000000FF));
-    return (dest + strlen(dest));
-}
-
 //
 // copy a string, returning pointer to the null terminator of dest
 //
@@ -58,148 +52,275 @@ char *stpcpyLcl(char *dest, const char *src)
     return (dest);
 }
 
-RETSIGTYPE child_timeout_signal(int iSig)
-{
-    exit(1);
-}
-
-int query(char *ip, char *orig_arg)
+// An /etc/hosts-style file given on the command line answers for the
+// addresses it lists before the resolver is asked. It lets a test stand in
+// for DNS.
+//
+typedef struct
 {
-    char *comma;
-    char *port_pair;
-    struct hostent *hp;
-    struct sockaddr_in sin;
-    int s;
-    FILE *f;
-    char result[MAX_STRING];
-    char buf[MAX_STRING * 2];
-    char buf2[MAX_STRING * 2];
-    char buf3[MAX_STRING * 4];
-    char arg[MAX_STRING];
-    size_t len;
-    char *p;
     in_addr_t addr;
+    char name[MAX_STRING];
+} HOSTS_ENTRY;
 
-    addr = inet_addr(ip);
-    if (addr == INADDR_NONE)
+HOSTS_ENTRY *hosts_fixture = NULL;
+int nHostsFixture = 0;
+
+void load_hosts(const char *pFile)
+{
+    FILE *f = fopen(pFile, "r");
+    if (f == NULL)
     {
-        return -1;
+        return;
     }
-    const char *pHName = ip;
-    hp = gethostbyaddr((char *)&addr, sizeof(addr), AF_INET);
-    if (  hp
-       && strlen(hp->h_name) < MAX_STRING)
+
+    int nAlloc = 0;
+    char line[MAX_STRING];
+    while (fgets(line, sizeof(line), f))
     {
-        pHName = hp->h_name;
+        char *p = strchr(line, '#');
+        if (p)
+        {
+            *p = '\0';
+        }
+        char ip[MAX_STRING], name[MAX_STRING];
+        if (sscanf(line, "%s %s", ip, name) != 2)
+        {
+            continue;
+        }
+        in_addr_t addr = inet_addr(ip);
+        if (addr == INADDR_NONE)
+        {
+            continue;
+        }
+
+        if (nHostsFixture == nAlloc)
+        {
+            nAlloc = nAlloc ? 2 * nAlloc : 16;
+            HOSTS_ENTRY *pNew = (HOSTS_ENTRY *)realloc(hosts_fixture,
+                nAlloc * sizeof(HOSTS_ENTRY));
+            if (pNew == NULL)
+            {
+                break;
+            }
+            hosts_fixture = pNew;
+        }
+        hosts_fixture[nHostsFixture].addr = addr;
+        strcpy(hosts_fixture[nHostsFixture].name, name);
+        nHostsFixture++;
     }
-    p = stpcpyLcl(buf, ip);
-    *p++ = ' ';
-    p = stpcpyLcl(p, pHName);
-    *p++ = '\n';
-    *p++ = '\0';
+    fclose(f);
+}
 
-    arg_for_errors = orig_arg;
-    strcpy(arg, orig_arg);
-    comma = (char *)strrchr(arg, ',');
-    if (comma == NULL)
+// Find the name of an address, or leave the address itself.
+//
+void lookup_name(in_addr_t addr, const char *ip, char *name)
+{
+    for (int i = 0; i < nHostsFixture; i++)
     {
-        return -1;
+        if (hosts_fixture[i].addr == addr)
+        {
+            strcpy(name, hosts_fixture[i].name);
+            return;
+        }
     }
-    *comma = 0;
-    port_pair = (char *)strrchr(arg, ',');
-    if (port_pair == NULL)
+
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = addr;
+    if (getnameinfo((struct sockaddr *)&sin, sizeof(sin), name, MAX_STRING,
+        NULL, 0, NI_NAMEREQD) != 0)
     {
-        return -1;
+        strcpy(name, ip);
     }
-    *port_pair++ = 0;
-    *comma = ',';
+}
 
-    hp = gethostbyname(arg);
-    if (hp == NULL)
+// Wait for a socket, giving up after IDENT_TIMEOUT.
+//
+bool wait_for(int s, short events)
+{
+    struct pollfd pfd;
+    pfd.fd = s;
+    pfd.events = events;
+    for (;;)
     {
-        static struct hostent def;
-        static struct in_addr defaddr;
-        static char *alist[1];
-        static char namebuf[MAX_STRING];
-
-        defaddr.s_addr = inet_addr(arg);
-        if (defaddr.s_addr == INADDR_NONE)
+        int n = poll(&pfd, 1, IDENT_TIMEOUT);
+        if (0 < n)
         {
-            return -1;
+            return true;
+        }
+        if (  n < 0
+           && errno == EINTR)
+        {
+            continue;
         }
-        strcpy(namebuf, arg);
-        def.h_name = namebuf;
-        def.h_addr_list = alist;
-        def.h_addr = (char *)&defaddr;
-        def.h_length = sizeof(struct in_addr);
-
-        def.h_addrtype = AF_INET;
-        def.h_aliases = 0;
-        hp = &def;
+        return false;
     }
-    sin.sin_family = hp->h_addrtype;
-    bcopy(hp->h_addr, (char *)&sin.sin_addr, hp->h_length);
+}
+
+// Ask the host's ident server who is on the other end of a connection. The
+// reply is the server's own line. A host with no ident server gets an
+// X-UNREACHABLE error, which the game remembers for a while.
+//
+int query_ident(in_addr_t addr, const char *ip, const char *port_pair,
+    char *reply)
+{
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = addr;
     sin.sin_port = htons(113); // ident port
-    s = socket(hp->h_addrtype, SOCK_STREAM, 0);
+
+    int s = socket(AF_INET, SOCK_STREAM, 0);
     if (s < 0)
     {
         return -1;
     }
-    if (connect(s, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
-        if (   errno != ECONNREFUSED
-            && errno != ETIMEDOUT
-            && errno != ENETUNREACH
-            && errno != EHOSTUNREACH)
+    fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+
+    int err = 0;
+    if (connect(s, (struct sockaddr *)&sin, sizeof(sin)) < 0)
+    {
+        err = errno;
+        if (err == EINPROGRESS)
         {
-            close(s);
-            return -1;
+            err = ETIMEDOUT;
+            if (wait_for(s, POLLOUT))
+            {
+                socklen_t len = sizeof(err);
+                if (getsockopt(s, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+                {
+                    err = errno;
+                }
+            }
         }
-        buf2[0] = '\0';
     }
-    else
+    if (err != 0)
     {
-        len = strlen(port_pair);
-        if ((size_t)write(s, port_pair, len) != len)
+        close(s);
+        if (   err != ECONNREFUSED
+            && err != ETIMEDOUT
+            && err != ENETUNREACH
+            && err != EHOSTUNREACH)
         {
-            close(s);
-            return (-1);
+            return -1;
         }
-        if (write(s, "\r\n", 2) != 2)
+        sprintf(reply, "%s %s : ERROR : X-UNREACHABLE\n", ip, port_pair);
+        return 0;
+    }
+
+    char request[MAX_STRING];
+    sprintf(request, "%s\r\n", port_pair);
+    size_t len = strlen(request);
+    if ((size_t)write(s, request, len) != len)
+    {
+        close(s);
+        return -1;
+    }
+
+    char *p = stpcpyLcl(reply, ip);
+    *p++ = ' ';
+    char *start = p;
+    bool bDone = false;
+    while (  !bDone
+          && wait_for(s, POLLIN))
+    {
+        char buf[MAX_STRING];
+        int got = read(s, buf, sizeof(buf));
+        if (got <= 0)
         {
-            close(s);
-            return (-1);
+            break;
         }
-        f = fdopen(s, "r");
+        for (int i = 0; i < got; i++)
         {
-            int c;
-
-            p = result;
-            while ((c = fgetc(f)) != EOF)
+            int c = (unsigned char)buf[i];
+            if (  c == '\n'
+               || p - start == MAX_STRING - 1)
             {
-                if (c == '\n')
-                {
-                    break;
-                }
-                if (0x20 <= c && c <= 0x7E)
-                {
-                    *p++ = c;
-                    if (p - result == MAX_STRING - 1)
-                    {
-                        break;
-                    }
-                }
+                bDone = true;
+                break;
             }
-            *p = '\0';
+            if (0x20 <= c && c <= 0x7E)
+            {
+                *p++ = c;
+            }
+        }
+    }
+    close(s);
+    *p++ = '\n';
+    *p = '\0';
+    return 0;
+}
+
+// A request is the address on one line, then the address, the remote and
+// local ports, and optionally which lookups are wanted (SLAVE_IPTONAME,
+// SLAVE_IDENTQ), separated by commas. The answer is a line for each lookup,
+// sent as one datagram.
+//
+int query(char *request)
+{
+    char *ip = request;
+    char *arg = strchr(request, '\n');
+    if (arg == NULL)
+    {
+        return -1;
+    }
+    *arg++ = '\0';
+
+    in_addr_t addr = inet_addr(ip);
+    if (addr == INADDR_NONE)
+    {
+        return -1;
+    }
+
+    char *field[4];
+    int nFields = 0;
+    char *p = arg;
+    while (nFields < 4)
+    {
+        field[nFields++] = p;
+        p = strchr(p, ',');
+        if (p == NULL)
+        {
+            break;
         }
-        fclose(f);
-        p = (char *)format_inet_addr(buf2, ntohl(sin.sin_addr.s_addr));
+        *p++ = '\0';
+    }
+    if (nFields < 3)
+    {
+        return -1;
+    }
+    const char *ops = (4 == nFields) ? field[3] : "";
+    bool bName = (*ops == '\0' || strchr(ops, SLAVE_IPTONAME) != NULL);
+    bool bIdent = (*ops == '\0' || strchr(ops, SLAVE_IDENTQ) != NULL);
+
+    char result[MAX_STRING * 4];
+    result[0] = '\0';
+    p = result;
+    if (bName)
+    {
+        char name[MAX_STRING];
+        lookup_name(addr, ip, name);
+        p = stpcpyLcl(p, ip);
         *p++ = ' ';
-        p = stpcpyLcl(p, result);
+        p = stpcpyLcl(p, name);
         *p++ = '\n';
-        *p++ = '\0';
+        *p = '\0';
+    }
+    if (bIdent)
+    {
+        char port_pair[MAX_STRING];
+        sprintf(port_pair, "%s , %s", field[1], field[2]);
+        if (query_ident(addr, ip, port_pair, p) == 0)
+        {
+            p += strlen(p);
+        }
+    }
+
+    if (p != result)
+    {
+        write(1, result, p - result);
     }
-    sprintf(buf3, "%s%s", buf, buf2);
-    write(1, buf3, strlen(buf3));
     return 0;
 }
 
@@ -220,34 +341,40 @@ RETSIGTYPE alarm_signal(int iSig)
     setitimer(ITIMER_REAL, &itime, 0);
 }
 
-#define MAX_CHILDREN 20
-volatile int nChildrenStarted = 0;
-volatile int nChildrenEndedSIGCHLD = 0;
-volatile int nChildrenEndedMain = 0;
+// Requests wait here for the next free thread.
+//
+char aQueue[MAX_QUEUED][MAX_STRING];
+int iQueueHead = 0;
+int nQueued = 0;
+pthread_mutex_t mtxQueue = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t cvQueued = PTHREAD_COND_INITIALIZER;
+pthread_cond_t cvRoom = PTHREAD_COND_INITIALIZER;
 
-RETSIGTYPE child_signal(int iSig)
+void *worker(void *)
 {
-    // Collect the children.
-    //
-    while (waitpid(0, NULL, WNOHANG) > 0)
+    char request[MAX_STRING];
+    for (;;)
     {
-        int nChildren = nChildrenStarted - nChildrenEndedSIGCHLD
-            - nChildrenEndedMain;
-        if (0 < nChildren)
+        pthread_mutex_lock(&mtxQueue);
+        while (nQueued == 0)
         {
-            nChildrenEndedSIGCHLD++;
+            pthread_cond_wait(&cvQueued, &mtxQueue);
         }
-    }
+        strcpy(request, aQueue[iQueueHead]);
+        iQueueHead = (iQueueHead + 1) % MAX_QUEUED;
+        nQueued--;
+        pthread_cond_signal(&cvRoom);
+        pthread_mutex_unlock(&mtxQueue);
 
-    signal(SIGCHLD, CAST_SIGNAL_FUNC child_signal);
+        query(request);
+    }
+    return NULL;
 }
 
 int main(int argc, char *argv[])
 {
     char arg[MAX_STRING];
-    char *p;
     int len;
-    pid_t child;
 
     parent_pid = getppid();
     if (parent_pid == 1)
@@ -258,9 +385,31 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    if (1 < argc)
+    {
+        load_hosts(argv[1]);
+    }
+
     alarm_signal(SIGALRM);
-    signal(SIGCHLD, CAST_SIGNAL_FUNC child_signal);
-    signal(SIGPIPE, SIG_DFL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // The lookups are done by a fixed pool of threads, which leave SIGALRM
+    // to this one.
+    //
+    sigset_t alarm, old;
+    sigemptyset(&alarm);
+    sigaddset(&alarm, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &alarm, &old);
+    for (int i = 0; i < SLAVE_THREADS; i++)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker, NULL) != 0)
+        {
+            exit(1);
+        }
+        pthread_detach(thread);
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
 
     for (;;)
     {
@@ -279,52 +428,21 @@ int main(int argc, char *argv[])
             break;
         }
         arg[len] = '\0';
-        p = strchr(arg, '\n');
-        if (p)
+        char *p = strrchr(arg, '\n');
+        if (p && p[1] == '\0')
         {
             *p = '\0';
         }
-        child = fork();
-        switch (child)
-        {
-        case -1:
-            exit(1);
-            break;
 
-        case 0: // child.
-            {
-                // We don't want to try this for more than 5 minutes.
-                //
-                struct itimerval itime;
-                struct timeval interval;
-
-                interval.tv_sec = 300;  // 5 minutes.
-                interval.tv_usec = 0;
-                itime.it_interval = interval;
-                itime.it_value = interval;
-                signal(SIGALRM, CAST_SIGNAL_FUNC child_timeout_signal);
-                setitimer(ITIMER_REAL, &itime, 0);
-            }
-            exit(query(arg, p + 1) != 0);
-            break;
-        }
-        if (child > 0)
-        {
-            nChildrenStarted++;
-        }
-
-        int nChildren = nChildrenStarted - nChildrenEndedSIGCHLD
-            - nChildrenEndedMain;
-
-        // Collect the children.
-        //
-        while (waitpid(0, NULL, (nChildren < MAX_CHILDREN) ? WNOHANG : 0) > 0)
+        pthread_mutex_lock(&mtxQueue);
+        while (nQueued == MAX_QUEUED)
         {
-            if (0 < nChildren)
-            {
-                nChildrenEndedMain++;
-            }
+            pthread_cond_wait(&cvRoom, &mtxQueue);
         }
+        strcpy(aQueue[(iQueueHead + nQueued) % MAX_QUEUED], arg);
+        nQueued++;
+        pthread_cond_signal(&cvQueued);
+        pthread_mutex_unlock(&mtxQueue);
     }
     exit(0);
 }
@@ -99,6 +99,13 @@ void dispatch_IdleCheck(void *pUnused, int iUnused)
         mudstate.debug_cmd = cmdsave;
     }
 
+    // Return network buffers beyond the high-water mark to the system.
+    //
+    pool_trim(POOL_TBLOCK, mudconf.netbuf_high_water);
+    pool_trim(POOL_TBLOCKS, mudconf.netbuf_high_water);
+    pool_trim(POOL_TBLKREF, mudconf.netbuf_high_water);
+    pool_trim(POOL_CBLK, mudconf.netbuf_high_water);
+
     // Schedule ourselves again.
     //
     CLinearTimeAbsolute ltaNow;
@@ -292,6 +299,128 @@ void do_timewarp(dbref executor, dbref caller, dbref enactor, int eval, int key,
 }
 
 #define INITIAL_TASKS 100
+#define INITIAL_BUCKETS 128
+
+#ifdef WIN32
+#define TASK_HASH_MULTIPLIER 0x9E3779B97F4A7C15ui64
+#else
+#define TASK_HASH_MULTIPLIER 0x9E3779B97F4A7C15ull
+#endif
+
+CTaskIndex::CTaskIndex(void)
+{
+    m_nBuckets = 0;
+    m_nTasks = 0;
+    m_pBuckets = NULL;
+    Grow();
+}
+
+CTaskIndex::~CTaskIndex(void)
+{
+    if (m_pBuckets)
+    {
+        delete [] m_pBuckets;
+    }
+}
+
+PTASK_RECORD *CTaskIndex::Bucket(FTASK *fpTask, void *arg_voidptr, int arg_Integer)
+{
+    // Fibonacci hashing: the top bits of the product are well mixed.
+    //
+    UINT64 nHash = (  (UINT64)(size_t)fpTask
+                   ^ ((UINT64)(size_t)arg_voidptr << 1)
+                   ^ ((UINT64)(UINT32)arg_Integer << 32)) * TASK_HASH_MULTIPLIER;
+    return m_pBuckets + (int)((nHash >> 32) & (m_nBuckets - 1));
+}
+
+PTASK_RECORD CTaskIndex::First(FTASK *fpTask, void *arg_voidptr, int arg_Integer)
+{
+    if (0 == m_nTasks)
+    {
+        return NULL;
+    }
+    return *Bucket(fpTask, arg_voidptr, arg_Integer);
+}
+
+// Keep about one task per bucket.
+//
+bool CTaskIndex::Grow(void)
+{
+    int n = (0 == m_nBuckets) ? INITIAL_BUCKETS : 2*m_nBuckets;
+    PTASK_RECORD *p = NULL;
+    try
+    {
+        p = new PTASK_RECORD[n];
+    }
+    catch (...)
+    {
+        ; // Nothing.
+    }
+
+    if (!p)
+    {
+        return false;
+    }
+
+    memset(p, 0, sizeof(PTASK_RECORD)*n);
+    PTASK_RECORD *pOld = m_pBuckets;
+    int nOld = m_nBuckets;
+    m_pBuckets = p;
+    m_nBuckets = n;
+
+    for (int i = 0; i < nOld; i++)
+    {
+        PTASK_RECORD pTask = pOld[i];
+        while (pTask)
+        {
+            PTASK_RECORD pNext = pTask->m_pNextIndexed;
+            PTASK_RECORD *ppBucket = Bucket(pTask->fpTask, pTask->arg_voidptr,
+                pTask->arg_Integer);
+            pTask->m_pNextIndexed = *ppBucket;
+            *ppBucket = pTask;
+            pTask = pNext;
+        }
+    }
+    if (pOld)
+    {
+        delete [] pOld;
+    }
+    return true;
+}
+
+bool CTaskIndex::Insert(PTASK_RECORD pTask)
+{
+    if (  m_nTasks == m_nBuckets
+       && !Grow()
+       && 0 == m_nBuckets)
+    {
+        return false;
+    }
+
+    PTASK_RECORD *ppBucket = Bucket(pTask->fpTask, pTask->arg_voidptr,
+        pTask->arg_Integer);
+    pTask->m_pNextIndexed = *ppBucket;
+    *ppBucket = pTask;
+    m_nTasks++;
+    return true;
+}
+
+void CTaskIndex::Remove(PTASK_RECORD pTask, FTASK *fpTask, void *arg_voidptr,
+    int arg_Integer)
+{
+    PTASK_RECORD *pp = Bucket(fpTask, arg_voidptr, arg_Integer);
+    while (  NULL != *pp
+          && pTask != *pp)
+    {
+        pp = &(*pp)->m_pNextIndexed;
+    }
+    if (NULL != *pp)
+    {
+        *pp = pTask->m_pNextIndexed;
+        m_nTasks--;
+    }
+    pTask->m_pNextIndexed = NULL;
+}
 
 CTaskHeap::CTaskHeap(void)
 {
@@ -331,9 +460,13 @@ bool CTaskHeap::Insert(PTASK_RECORD pTask, SCHCMP *pfCompare)
             return false;
         }
     }
+    if (!m_Index.Insert(pTask))
+    {
+        return false;
+    }
     pTask->m_iVisitedMark = m_iVisitedMark-1;
 
-    m_pHeap[m_nCurrent] = pTask;
+    Place(m_nCurrent, pTask);
     m_nCurrent++;
     SiftUp(m_nCurrent-1, pfCompare);
     return true;
@@ -414,18 +547,325 @@ PTASK_RECORD CTaskHeap::RemoveTopmost(SCHCMP *pfCompare)
     return Remove(0, pfCompare);
 }
 
-void CTaskHeap::CancelTask(FTASK *fpTask, void *arg_voidptr, int arg_Integer)
+void CTaskHeap::CancelTask(FTASK *fpTask, void *arg_voidptr, int arg_Integer,
+    SCHCMP *pfCompare)
 {
-    for (int i = 0; i < m_nCurrent; i++)
+    PTASK_RECORD p = m_Index.First(fpTask, arg_voidptr, arg_Integer);
+    while (p)
     {
-        PTASK_RECORD p = m_pHeap[i];
+        PTASK_RECORD pNext = p->m_pNextIndexed;
+        if (  p->fpTask == fpTask
+           && p->arg_voidptr == arg_voidptr
+           && p->arg_Integer == arg_Integer)
+        {
+            Remove(p->m_iSlot, pfCompare);
+            delete p;
+        }
+        p = pNext;
+    }
+}
+
+// The second in which a task is due.
+//
+static INT64 TaskSecond(PTASK_RECORD pTask)
+{
+    return pTask->ltaWhen.Return100ns()/FACTOR_100NS_PER_SECOND;
+}
+
+CTaskWheel::CTaskWheel(void)
+{
+    m_nCursor = 0;
+    m_nTasks = 0;
+    m_pRefile = NULL;
+    memset(m_anTasks, 0, sizeof(m_anTasks));
+    memset(m_apSlots, 0, sizeof(m_apSlots));
+}
+
+CTaskWheel::~CTaskWheel(void)
+{
+    for (int i = 0; i < WHEEL_LEVELS; i++)
+    {
+        for (int j = 0; j < WHEEL_SLOTS; j++)
+        {
+            PTASK_RECORD pTask = m_apSlots[i][j];
+            while (pTask)
+            {
+                PTASK_RECORD pNext = pTask->m_pNextInSlot;
+                delete pTask;
+                pTask = pNext;
+            }
+        }
+    }
+}
+
+// Put a task on the slot it belongs to, given the cursor. The task must
+// not be due before the cursor.
+//
+void CTaskWheel::LinkTask(PTASK_RECORD pTask)
+{
+    INT64 nWhen = TaskSecond(pTask);
+    INT64 nDelta = nWhen - m_nCursor;
+    int iLevel = 0;
+    while (  iLevel < WHEEL_LEVELS - 1
+          && (((INT64)1) << (WHEEL_BITS*(iLevel+1))) <= nDelta)
+    {
+        iLevel++;
+    }
+
+    INT64 nReach = ((INT64)1) << (WHEEL_BITS*WHEEL_LEVELS);
+    if (nReach <= nDelta)
+    {
+        // Further out than the wheel reaches. Park the task on the last
+        // slot, and it will be filed again when that slot cascades.
+        //
+        nWhen = m_nCursor + nReach - 1;
+    }
+
+    int iSlot = (int)((nWhen >> (WHEEL_BITS*iLevel)) & (WHEEL_SLOTS-1));
+    PTASK_RECORD *ppSlot = &m_apSlots[iLevel][iSlot];
+    pTask->m_iSlot = iLevel*WHEEL_SLOTS + iSlot;
+    pTask->m_pPrevInSlot = NULL;
+    pTask->m_pNextInSlot = *ppSlot;
+    if (*ppSlot)
+    {
+        (*ppSlot)->m_pPrevInSlot = pTask;
+    }
+    *ppSlot = pTask;
+    m_anTasks[iLevel]++;
+}
+
+void CTaskWheel::UnlinkTask(PTASK_RECORD pTask)
+{
+    int iLevel = pTask->m_iSlot / WHEEL_SLOTS;
+    if (pTask->m_pPrevInSlot)
+    {
+        pTask->m_pPrevInSlot->m_pNextInSlot = pTask->m_pNextInSlot;
+    }
+    else
+    {
+        m_apSlots[iLevel][pTask->m_iSlot % WHEEL_SLOTS] = pTask->m_pNextInSlot;
+    }
+    if (pTask->m_pNextInSlot)
+    {
+        pTask->m_pNextInSlot->m_pPrevInSlot = pTask->m_pPrevInSlot;
+    }
+    pTask->m_pNextInSlot = NULL;
+    pTask->m_pPrevInSlot = NULL;
+    m_anTasks[iLevel]--;
+}
+
+// Returns false if the task is due too soon for the wheel, and belongs in
+// the WhenHeap.
+//
+bool CTaskWheel::Insert(PTASK_RECORD pTask)
+{
+    if (0 == m_nCursor)
+    {
+        CLinearTimeAbsolute ltaNow;
+        ltaNow.GetUTC();
+        m_nCursor = ltaNow.Return100ns()/FACTOR_100NS_PER_SECOND + WHEEL_HORIZON;
+    }
+
+    if (  TaskSecond(pTask) < m_nCursor
+       || !m_Index.Insert(pTask))
+    {
+        return false;
+    }
+    LinkTask(pTask);
+    m_nTasks++;
+    return true;
+}
+
+// Move the cursor up to WHEEL_HORIZON seconds past ltaNow, and return the
+// tasks it passes, chained through m_pNextInSlot.
+//
+PTASK_RECORD CTaskWheel::Advance(const CLinearTimeAbsolute &ltaNow)
+{
+    CLinearTimeAbsolute lta = ltaNow;
+    INT64 nTarget = lta.Return100ns()/FACTOR_100NS_PER_SECOND + WHEEL_HORIZON;
+
+    PTASK_RECORD pDue = NULL;
+    while (  0 < m_nTasks
+          && m_nCursor < nTarget)
+    {
+        // Nothing happens on a level until its slot turns over, so skip
+        // ahead to that if the levels below it are empty.
+        //
+        int iLevel = 0;
+        while (0 == m_anTasks[iLevel])
+        {
+            iLevel++;
+        }
+        INT64 nSpan = ((INT64)1) << (WHEEL_BITS*iLevel);
+        if (0 != (m_nCursor & (nSpan - 1)))
+        {
+            INT64 nNext = (m_nCursor | (nSpan - 1)) + 1;
+            m_nCursor = (nNext < nTarget) ? nNext : nTarget;
+            continue;
+        }
+
+        // Each time a level comes round to its first slot, the next slot up
+        // cascades down onto it.
+        //
+        for (int i = 1; i < WHEEL_LEVELS; i++)
+        {
+            if (0 != (m_nCursor & ((((INT64)1) << (WHEEL_BITS*i)) - 1)))
+            {
+                break;
+            }
+            int iSlot = (int)((m_nCursor >> (WHEEL_BITS*i)) & (WHEEL_SLOTS-1));
+            PTASK_RECORD pTask = m_apSlots[i][iSlot];
+            m_apSlots[i][iSlot] = NULL;
+            while (pTask)
+            {
+                PTASK_RECORD pNext = pTask->m_pNextInSlot;
+                m_anTasks[i]--;
+                LinkTask(pTask);
+                pTask = pNext;
+            }
+        }
+
+        int iSlot = (int)(m_nCursor & (WHEEL_SLOTS-1));
+        PTASK_RECORD pTask = m_apSlots[0][iSlot];
+        m_apSlots[0][iSlot] = NULL;
+        while (pTask)
+        {
+            PTASK_RECORD pNext = pTask->m_pNextInSlot;
+            m_anTasks[0]--;
+            m_nTasks--;
+            m_Index.Remove(pTask, pTask->fpTask, pTask->arg_voidptr,
+                pTask->arg_Integer);
+            pTask->m_pNextInSlot = pDue;
+            pDue = pTask;
+            pTask = pNext;
+        }
+        m_nCursor++;
+    }
+
+    if (m_nCursor < nTarget)
+    {
+        m_nCursor = nTarget;
+    }
+    return pDue;
+}
+
+// When Advance() will next have something to do. This is never later than
+// when the first task on the wheel is due.
+//
+bool CTaskWheel::WhenNext(CLinearTimeAbsolute *pltaWhen)
+{
+    if (0 == m_nTasks)
+    {
+        return false;
+    }
+
+    INT64 nNext = 0;
+    bool bNext = false;
+    if (0 < m_anTasks[0])
+    {
+        nNext = m_nCursor;
+        while (NULL == m_apSlots[0][nNext & (WHEEL_SLOTS-1)])
+        {
+            nNext++;
+        }
+        bNext = true;
+    }
+    for (int i = 1; i < WHEEL_LEVELS; i++)
+    {
+        if (0 < m_anTasks[i])
+        {
+            INT64 nSpan = ((INT64)1) << (WHEEL_BITS*i);
+            INT64 nCascade = (m_nCursor + nSpan - 1) & ~(nSpan - 1);
+            if (  !bNext
+               || nCascade < nNext)
+            {
+                nNext = nCascade;
+            }
+            break;
+        }
+    }
+
+    // Advance() passes second nNext once ltaNow reaches this.
+    //
+    pltaWhen->Set100ns((nNext + 1 - WHEEL_HORIZON)*FACTOR_100NS_PER_SECOND);
+    return true;
+}
+
+void CTaskWheel::CancelTask(FTASK *fpTask, void *arg_voidptr, int arg_Integer)
+{
+    PTASK_RECORD p = m_Index.First(fpTask, arg_voidptr, arg_Integer);
+    while (p)
+    {
+        PTASK_RECORD pNext = p->m_pNextIndexed;
         if (  p->fpTask == fpTask
            && p->arg_voidptr == arg_voidptr
            && p->arg_Integer == arg_Integer)
         {
-            p->fpTask = NULL;
+            m_Index.Remove(p, fpTask, arg_voidptr, arg_Integer);
+            UnlinkTask(p);
+            m_nTasks--;
+            delete p;
+        }
+        p = pNext;
+    }
+}
+
+// Fills apTasks, which has room for Count() tasks, with the tasks on the
+// wheel.
+//
+int CTaskWheel::GetTasks(PTASK_RECORD *apTasks)
+{
+    int n = 0;
+    for (int i = 0; i < WHEEL_LEVELS; i++)
+    {
+        for (int j = 0; j < WHEEL_SLOTS; j++)
+        {
+            for (PTASK_RECORD p = m_apSlots[i][j]; p; p = p->m_pNextInSlot)
+            {
+                apTasks[n++] = p;
+            }
         }
     }
+    return n;
+}
+
+// Show a task on the wheel to a traversal. A task the callback changes is
+// taken off the wheel, and filed again once the traversal is over.
+//
+int CTaskWheel::Visit(PTASK_RECORD pTask, SCHLOOK *pfLook)
+{
+    FTASK *fpTask = pTask->fpTask;
+    void  *arg_voidptr = pTask->arg_voidptr;
+    int    arg_Integer = pTask->arg_Integer;
+    CLinearTimeAbsolute ltaWhen = pTask->ltaWhen;
+
+    int cmd = pfLook(pTask);
+    if (IU_REMOVE_TASK == cmd)
+    {
+        m_Index.Remove(pTask, fpTask, arg_voidptr, arg_Integer);
+        UnlinkTask(pTask);
+        m_nTasks--;
+        delete pTask;
+    }
+    else if (  fpTask != pTask->fpTask
+            || arg_voidptr != pTask->arg_voidptr
+            || arg_Integer != pTask->arg_Integer
+            || !(ltaWhen == pTask->ltaWhen))
+    {
+        m_Index.Remove(pTask, fpTask, arg_voidptr, arg_Integer);
+        UnlinkTask(pTask);
+        m_nTasks--;
+        pTask->m_pNextInSlot = m_pRefile;
+        m_pRefile = pTask;
+    }
+    return cmd;
+}
+
+PTASK_RECORD CTaskWheel::TakeRefile(void)
+{
+    PTASK_RECORD pTask = m_pRefile;
+    m_pRefile = NULL;
+    return pTask;
 }
 
 static int ComparePriority(PTASK_RECORD pTaskA, PTASK_RECORD pTaskB)
@@ -473,14 +913,34 @@ void CScheduler::DeferTask(const CLinearTimeAbsolute& ltaWhen, int iPriority,
     pTask->arg_Integer = arg_Integer;
     pTask->m_Ticket = m_Ticket++;
 
-    // Must add to the WhenHeap so that network is still serviced.
-    //
-    if (!m_WhenHeap.Insert(pTask, CompareWhen))
+    FileTask(pTask);
+}
+
+// Tasks due soon go straight into the WhenHeap. Later ones wait on the
+// wheel.
+//
+void CScheduler::FileTask(PTASK_RECORD pTask)
+{
+    if (  !m_Wheel.Insert(pTask)
+       && !m_WhenHeap.Insert(pTask, CompareWhen))
     {
         delete pTask;
     }
 }
 
+// File again the tasks a traversal changed on the wheel.
+//
+void CScheduler::RefileWheel(void)
+{
+    PTASK_RECORD pTask = m_Wheel.TakeRefile();
+    while (pTask)
+    {
+        PTASK_RECORD pNext = pTask->m_pNextInSlot;
+        FileTask(pTask);
+        pTask = pNext;
+    }
+}
+
 void CScheduler::DeferImmediateTask(int iPriority, FTASK *fpTask, void *arg_voidptr, int arg_Integer)
 {
     PTASK_RECORD pTask = new TASK_RECORD;
@@ -503,15 +963,29 @@ void CScheduler::DeferImmediateTask(int iPriority, FTASK *fpTask, void *arg_void
 
 void CScheduler::CancelTask(FTASK *fpTask, void *arg_voidptr, int arg_Integer)
 {
-    m_WhenHeap.CancelTask(fpTask, arg_voidptr, arg_Integer);
-    m_PriorityHeap.CancelTask(fpTask, arg_voidptr, arg_Integer);
+    m_WhenHeap.CancelTask(fpTask, arg_voidptr, arg_Integer, CompareWhen);
+    m_PriorityHeap.CancelTask(fpTask, arg_voidptr, arg_Integer, ComparePriority);
+    m_Wheel.CancelTask(fpTask, arg_voidptr, arg_Integer);
 }
 
 void CScheduler::ReadyTasks(const CLinearTimeAbsolute& ltaNow)
 {
+    // Move tasks coming due off the wheel and onto the WhenHeap.
+    //
+    PTASK_RECORD pTask = m_Wheel.Advance(ltaNow);
+    while (pTask)
+    {
+        PTASK_RECORD pNext = pTask->m_pNextInSlot;
+        if (!m_WhenHeap.Insert(pTask, CompareWhen))
+        {
+            delete pTask;
+        }
+        pTask = pNext;
+    }
+
     // Move ready-to-run tasks off the WhenHeap and onto the PriorityHeap.
     //
-    PTASK_RECORD pTask = m_WhenHeap.PeekAtTopmost();
+    pTask = m_WhenHeap.PeekAtTopmost();
     while (  pTask
           && pTask->ltaWhen < ltaNow)
     {
@@ -599,15 +1073,26 @@ bool CScheduler::WhenNext(CLinearTimeAbsolute  *ltaWhen)
         }
     }
 
-    // Check the When Queue next.
+    // Check the When Queue next, and then the wheel, which may need to hand
+    // tasks to the When Queue sooner.
     //
+    bool bWhen = false;
     pTask = m_WhenHeap.PeekAtTopmost();
     if (pTask)
     {
         *ltaWhen = pTask->ltaWhen;
-        return true;
+        bWhen = true;
+    }
+
+    CLinearTimeAbsolute ltaWheel;
+    if (  m_Wheel.WhenNext(&ltaWheel)
+       && (  !bWhen
+          || ltaWheel < *ltaWhen))
+    {
+        *ltaWhen = ltaWheel;
+        bWhen = true;
     }
-    return false;
+    return bWhen;
 }
 
 #define HEAP_LEFT_CHILD(x) (2*(x)+1)
@@ -634,28 +1119,27 @@ void CTaskHeap::SiftDown(int iSubRoot, SCHCMP *pfCompare)
         if (pfCompare(Ref, m_pHeap[child]) <= 0)
             break;
 
-        m_pHeap[parent] = m_pHeap[child];
+        Place(parent, m_pHeap[child]);
         parent = child;
         child = HEAP_LEFT_CHILD(parent);
     }
-    m_pHeap[parent] = Ref;
+    Place(parent, Ref);
 }
 
 void CTaskHeap::SiftUp(int child, SCHCMP *pfCompare)
 {
+    PTASK_RECORD Ref = m_pHeap[child];
+
     while (child)
     {
         int parent = HEAP_PARENT(child);
-        if (pfCompare(m_pHeap[parent], m_pHeap[child]) <= 0)
+        if (pfCompare(m_pHeap[parent], Ref) <= 0)
             break;
 
-        PTASK_RECORD Tmp;
-        Tmp = m_pHeap[child];
-        m_pHeap[child] = m_pHeap[parent];
-        m_pHeap[parent] = Tmp;
-
+        Place(child, m_pHeap[parent]);
         child = parent;
     }
+    Place(child, Ref);
 }
 
 PTASK_RECORD CTaskHeap::Remove(int iNode, SCHCMP *pfCompare)
@@ -663,11 +1147,15 @@ PTASK_RECORD CTaskHeap::Remove(int iNode, SCHCMP *pfCompare)
     if (iNode < 0 || m_nCurrent <= iNode) return NULL;
 
     PTASK_RECORD pTask = m_pHeap[iNode];
+    m_Index.Remove(pTask, pTask->fpTask, pTask->arg_voidptr, pTask->arg_Integer);
 
     m_nCurrent--;
-    m_pHeap[iNode] = m_pHeap[m_nCurrent];
-    SiftDown(iNode, pfCompare);
-    SiftUp(iNode, pfCompare);
+    if (iNode < m_nCurrent)
+    {
+        Place(iNode, m_pHeap[m_nCurrent]);
+        SiftDown(iNode, pfCompare);
+        SiftUp(iNode, pfCompare);
+    }
 
     return pTask;
 }
@@ -683,18 +1171,141 @@ void CTaskHeap::Update(int iNode, SCHCMP *pfCompare)
     SiftUp(iNode, pfCompare);
 }
 
+// Returns the tasks on the wheel in an array the caller deletes, or NULL if
+// there are none.
+//
+static PTASK_RECORD *GetWheelTasks(CTaskWheel *pWheel, int *pnTasks)
+{
+    *pnTasks = 0;
+    if (0 == pWheel->Count())
+    {
+        return NULL;
+    }
+
+    PTASK_RECORD *apTasks = NULL;
+    try
+    {
+        apTasks = new PTASK_RECORD[pWheel->Count()];
+    }
+    catch (...)
+    {
+        ; // Nothing.
+    }
+
+    if (apTasks)
+    {
+        *pnTasks = pWheel->GetTasks(apTasks);
+    }
+    return apTasks;
+}
+
 void CScheduler::TraverseUnordered(SCHLOOK *pfLook)
 {
     if (m_WhenHeap.TraverseUnordered(pfLook, CompareWhen))
     {
-        m_PriorityHeap.TraverseUnordered(pfLook, ComparePriority);
+        int nTasks;
+        PTASK_RECORD *apTasks = GetWheelTasks(&m_Wheel, &nTasks);
+
+        bool bDone = false;
+        for (int i = 0; i < nTasks && !bDone; i++)
+        {
+            bDone = (IU_DONE == m_Wheel.Visit(apTasks[i], pfLook));
+        }
+        if (apTasks)
+        {
+            delete [] apTasks;
+        }
+
+        if (!bDone)
+        {
+            m_PriorityHeap.TraverseUnordered(pfLook, ComparePriority);
+        }
     }
+    RefileWheel();
+}
+
+// While the WhenHeap is traversed in order, tasks on the wheel which sort
+// ahead of each WhenHeap task are shown first.
+//
+static CTaskWheel   *Merge_pWheel;
+static SCHLOOK      *Merge_pfLook;
+static PTASK_RECORD *Merge_apTasks;
+static int           Merge_nTasks;
+static int           Merge_iTask;
+static bool          Merge_bDone;
+
+static int CompareWhenSort(const void *pA, const void *pB)
+{
+    return CompareWhen(*(PTASK_RECORD *)pA, *(PTASK_RECORD *)pB);
+}
+
+static int CallBack_MergeWheel(PTASK_RECORD p)
+{
+    while (  Merge_iTask < Merge_nTasks
+          && CompareWhen(Merge_apTasks[Merge_iTask], p) < 0)
+    {
+        if (IU_DONE == Merge_pWheel->Visit(Merge_apTasks[Merge_iTask++], Merge_pfLook))
+        {
+            Merge_bDone = true;
+            return IU_DONE;
+        }
+    }
+
+    int cmd = Merge_pfLook(p);
+    if (IU_DONE == cmd)
+    {
+        Merge_bDone = true;
+    }
+    return cmd;
 }
 
 void CScheduler::TraverseOrdered(SCHLOOK *pfLook)
 {
     m_PriorityHeap.TraverseOrdered(pfLook, ComparePriority);
-    m_WhenHeap.TraverseOrdered(pfLook, CompareWhen);
+
+    Merge_pWheel  = &m_Wheel;
+    Merge_pfLook  = pfLook;
+    Merge_apTasks = GetWheelTasks(&m_Wheel, &Merge_nTasks);
+    Merge_iTask   = 0;
+    Merge_bDone   = false;
+    if (Merge_apTasks)
+    {
+        qsort(Merge_apTasks, Merge_nTasks, sizeof(PTASK_RECORD), CompareWhenSort);
+    }
+
+    m_WhenHeap.TraverseOrdered(CallBack_MergeWheel, CompareWhen);
+    while (  !Merge_bDone
+          && Merge_iTask < Merge_nTasks)
+    {
+        Merge_bDone = (IU_DONE == m_Wheel.Visit(Merge_apTasks[Merge_iTask++], pfLook));
+    }
+
+    if (Merge_apTasks)
+    {
+        delete [] Merge_apTasks;
+        Merge_apTasks = NULL;
+    }
+    RefileWheel();
+}
+
+// Callbacks may change what a task runs (a notified semaphore becomes a
+// queue entry), so the task is re-indexed if its key changed.
+//
+int CTaskHeap::Look(PTASK_RECORD p, SCHLOOK *pfLook)
+{
+    FTASK *fpTask = p->fpTask;
+    void  *arg_voidptr = p->arg_voidptr;
+    int    arg_Integer = p->arg_Integer;
+
+    int cmd = pfLook(p);
+    if (  fpTask != p->fpTask
+       || arg_voidptr != p->arg_voidptr
+       || arg_Integer != p->arg_Integer)
+    {
+        m_Index.Remove(p, fpTask, arg_voidptr, arg_Integer);
+        m_Index.Insert(p);
+    }
+    return cmd;
 }
 
 // The following guarantees that in spite of any changes to the heap
@@ -736,11 +1347,11 @@ int CTaskHeap::TraverseUnordered(SCHLOOK *pfLook, SCHCMP *pfCompare)
             bUnvisitedRecords = true;
             p->m_iVisitedMark = m_iVisitedMark;
 
-            int cmd = pfLook(p);
+            int cmd = Look(p, pfLook);
             switch (cmd)
             {
             case IU_REMOVE_TASK:
-                Remove(i, pfCompare);
+                delete Remove(i, pfCompare);
                 break;
 
             case IU_DONE:
@@ -766,7 +1377,7 @@ int CTaskHeap::TraverseOrdered(SCHLOOK *pfLook, SCHCMP *pfCompare)
     for (int i = m_nCurrent-1; i >= 0; i--)
     {
         PTASK_RECORD p = m_pHeap[i];
-        int cmd = pfLook(p);
+        int cmd = Look(p, pfLook);
         if (IU_DONE == cmd)
         {
             break;
@@ -783,8 +1394,8 @@ void CTaskHeap::Sort(SCHCMP *pfCompare)
     while (m_nCurrent--)
     {
         PTASK_RECORD p = m_pHeap[m_nCurrent];
-        m_pHeap[m_nCurrent] = m_pHeap[0];
-        m_pHeap[0] = p;
+        Place(m_nCurrent, m_pHeap[0]);
+        Place(0, p);
         SiftDown(0, pfCompare);
     }
     m_nCurrent = s_nCurrent;
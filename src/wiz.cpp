@@ -394,6 +394,7 @@ void do_toad
         //
         count = chown_all(victim, recipient, executor, CHOWN_NOZONE);
         s_Owner(victim, recipient);
+        que_rehome(victim);
         s_Zone(victim, NOTHING);
     }
     s_Flags(victim, FLAG_WORD1, TYPE_THING | HALT);